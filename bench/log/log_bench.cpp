@@ -0,0 +1,577 @@
+/**
+ * @file
+ * @brief      Benchmarks of the log management system
+ * @authors    Jesus Gonzalez <jgonzalez@gdr-sistemas.com>
+ * @copyright  Copyright (c) 2003-2016 Jesus Gonzalez
+ * @license    See LICENSE.txt
+ */
+
+#define LOG_CATEGORY "bench"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <string>
+#include <algorithm>
+
+#ifdef WIN32
+    #include <io.h>
+    #define dup _dup
+    #define dup2 _dup2
+    #define close _close
+    #define NULL_DEVICE "NUL"
+#else
+    #include <unistd.h>
+    #define NULL_DEVICE "/dev/null"
+#endif
+
+#include "Extended/log.hpp"
+#include "Extended/log_file_sink.hpp"
+
+#define BENCH_LOG_FILE  "log_bench.log"
+
+/*===========================================================================
+ *                          ALLOCATION COUNTING
+ *===========================================================================*/
+
+// Trivially constructible, so that it can be used from the allocation functions at any moment
+static thread_local unsigned long long t_allocations;
+
+void* operator new( size_t size )
+{
+    t_allocations++;
+    void* ptr = malloc( ( size > 0 ) ? size : 1 );
+    if( ptr == NULL )
+    {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void* operator new[]( size_t size )
+{
+    return operator new( size );
+}
+
+void operator delete( void* ptr ) noexcept
+{
+    free( ptr );
+}
+
+void operator delete[]( void* ptr ) noexcept
+{
+    free( ptr );
+}
+
+/*===========================================================================
+ *                          BENCHMARKED OPERATIONS
+ *===========================================================================*/
+
+namespace
+{
+
+typedef void (*bench_operation)( unsigned int i );
+
+/**
+ * Log handler that discards all the messages, to measure the cost of the log management system itself.
+ */
+class null_log_handler : public ext::log_handler
+{
+public:
+    virtual bool process_record( const ext::log_record& record ) override
+    {
+        (void) record;
+        return false;
+    }
+};
+
+} // namespace
+
+static std::string g_longText( 480, 'x' );
+
+static void log_disabled( unsigned int i )
+{
+    LOG_DEBUG( "Disabled message %u", i );
+}
+
+static void log_0_args( unsigned int i )
+{
+    (void) i;
+    LOG_INFO( "Message without arguments" );
+}
+
+static void log_1_arg( unsigned int i )
+{
+    LOG_INFO( "Message with one argument: %u", i );
+}
+
+static void log_4_args( unsigned int i )
+{
+    LOG_INFO( "Message with four arguments: %u %s %.3f %p", i, "text", i * 0.5, &i );
+}
+
+static void log_8_args( unsigned int i )
+{
+    LOG_INFO( "Message with eight arguments: %u %s %.3f %p %d %x %c %lld", i, "text", i * 0.5, &i, -(int) i, i, 'c',
+              (long long) i * 1000 );
+}
+
+static void log_long( unsigned int i )
+{
+    LOG_INFO( "Message with a long argument: %u %s", i, g_longText.c_str() );
+}
+
+static void trace_span( unsigned int i )
+{
+    (void) i;
+    TRACE_SPAN( "span" );
+}
+
+/*===========================================================================
+ *                          SCENARIOS
+ *===========================================================================*/
+
+namespace
+{
+
+/**
+ * Destination of the messages during a benchmark.
+ */
+enum bench_target
+{
+    TARGET_DISABLED,
+    TARGET_NULL,
+    TARGET_CONSOLE,
+    TARGET_FILE,
+    TARGET_ASYNC_SHARED,        ///< Null log handler called by the writer thread, from a shared ring buffer
+    TARGET_ASYNC_PER_THREAD,    ///< Null log handler called by the writer thread, from per-thread ring buffers
+    TARGET_TRACE_DISABLED,      ///< Trace spans while tracing is disabled
+    TARGET_TRACE                ///< Trace spans recorded into the per-thread trace buffers
+};
+
+struct bench_scenario
+{
+    std::string name;
+    bench_target target;
+    bench_operation operation;
+    unsigned int threads;
+};
+
+struct bench_result
+{
+    bench_scenario scenario;
+    unsigned long long operations;
+    double ns_per_op;               ///< Average time of a call (in each thread)
+    double ops_per_s;               ///< Aggregated throughput of all the threads
+    unsigned long long p50_ns;
+    unsigned long long p99_ns;
+    unsigned long long p999_ns;
+    double allocs_per_op;
+};
+
+/**
+ * Measurements of a thread.
+ */
+struct thread_result
+{
+    std::vector<uint32_t> latencies;
+    unsigned long long allocations;
+};
+
+/**
+ * Redirects the standard output to the null device while it exists, so that console benchmarks don't
+ * flood the report.
+ */
+class stdout_silencer
+{
+public:
+    stdout_silencer()
+    {
+        fflush( stdout );
+        m_saved = dup( 1 );
+        FILE* nullFile = fopen( NULL_DEVICE, "w" );
+        if( nullFile != NULL )
+        {
+            dup2( fileno( nullFile ), 1 );
+            fclose( nullFile );
+        }
+    }
+
+    ~stdout_silencer()
+    {
+        fflush( stdout );
+        if( m_saved >= 0 )
+        {
+            dup2( m_saved, 1 );
+            close( m_saved );
+        }
+    }
+
+private:
+    int m_saved;
+};
+
+} // namespace
+
+typedef std::chrono::steady_clock bench_clock;
+
+static unsigned long long elapsed_ns( bench_clock::time_point start, bench_clock::time_point end )
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>( end - start ).count();
+}
+
+/**
+ * Runs an operation in several threads at once.
+ *
+ * @param[in] scenario Scenario to run
+ * @param[in] iterations Number of calls performed by each thread
+ * @param[in] timed Whether each call must be timed individually
+ * @param[out] results Measurements of each thread
+ * @return Time elapsed since all the threads started until all of them finished (in nanoseconds)
+ */
+static unsigned long long run_threads( const bench_scenario& scenario, unsigned int iterations, bool timed,
+                                       std::vector<thread_result>& results )
+{
+    results.assign( scenario.threads, thread_result() );
+
+    std::atomic<unsigned int> ready( 0 );
+    std::atomic<unsigned int> finished( 0 );
+    std::atomic<bool> go( false );
+
+    std::vector<std::thread> threads;
+    for( unsigned int t = 0; t < scenario.threads; t++ )
+    {
+        threads.push_back( std::thread( [&, t]()
+        {
+            thread_result& result = results[t];
+            if( timed )
+            {
+                result.latencies.resize( iterations );
+            }
+
+            // Warm-up, which also registers the thread and the call site
+            for( unsigned int i = 0; i < 16; i++ )
+            {
+                scenario.operation( i );
+            }
+
+            ready.fetch_add( 1 );
+            while( !go.load() )
+            {
+                std::this_thread::yield();
+            }
+
+            unsigned long long allocations = t_allocations;
+
+            if( timed )
+            {
+                for( unsigned int i = 0; i < iterations; i++ )
+                {
+                    bench_clock::time_point start = bench_clock::now();
+                    scenario.operation( i );
+                    result.latencies[i] = (uint32_t) std::min( elapsed_ns( start, bench_clock::now() ), 0xFFFFFFFFull );
+                }
+            }
+            else
+            {
+                for( unsigned int i = 0; i < iterations; i++ )
+                {
+                    scenario.operation( i );
+                }
+            }
+
+            result.allocations = t_allocations - allocations;
+
+            finished.fetch_add( 1 );
+        } ) );
+    }
+
+    while( ready.load() < scenario.threads )
+    {
+        std::this_thread::yield();
+    }
+
+    bench_clock::time_point start = bench_clock::now();
+    go.store( true );
+
+    while( finished.load() < scenario.threads )
+    {
+        std::this_thread::yield();
+    }
+    bench_clock::time_point end = bench_clock::now();
+
+    for( std::thread& thread : threads )
+    {
+        thread.join();
+    }
+
+    return elapsed_ns( start, end );
+}
+
+static unsigned long long percentile( std::vector<uint32_t>& samples, double fraction )
+{
+    size_t index = std::min( (size_t) ( fraction * samples.size() ), samples.size() - 1 );
+    std::nth_element( samples.begin(), samples.begin() + index, samples.end() );
+    return samples[index];
+}
+
+static void remove_log_files()
+{
+    remove( BENCH_LOG_FILE );
+    for( unsigned int i = 1; i <= 5; i++ )
+    {
+        remove( ( std::string( BENCH_LOG_FILE ) + "." + std::to_string( i ) ).c_str() );
+    }
+}
+
+static bench_result run_scenario( const bench_scenario& scenario, unsigned int iterations )
+{
+    std::shared_ptr<ext::file_log_sink> fileSink;
+
+    ext::log::set_priority_limit( ( scenario.target == TARGET_DISABLED ) ? LOG_PRIORITY_INFO : LOG_PRIORITY_DEBUG );
+
+    switch( scenario.target )
+    {
+        case TARGET_DISABLED:
+        case TARGET_NULL:
+            ext::log::set_log_handler( std::make_shared<null_log_handler>() );
+            break;
+
+        case TARGET_CONSOLE:
+            ext::log::set_log_handler( NULL );
+            break;
+
+        case TARGET_FILE:
+            remove_log_files();
+            fileSink = std::make_shared<ext::file_log_sink>( BENCH_LOG_FILE );
+            ext::log::set_log_handler( fileSink );
+            break;
+
+        case TARGET_ASYNC_SHARED:
+        case TARGET_ASYNC_PER_THREAD:
+            ext::log::set_log_handler( std::make_shared<null_log_handler>() );
+            ext::log::enable_async_mode( 8192, ext::log::OVERFLOW_BLOCK,
+                                         ( scenario.target == TARGET_ASYNC_SHARED ) ? ext::log::QUEUE_SHARED :
+                                                                                      ext::log::QUEUE_PER_THREAD );
+            break;
+
+        case TARGET_TRACE_DISABLED:
+            ext::log::set_log_handler( std::make_shared<null_log_handler>() );
+            break;
+
+        case TARGET_TRACE:
+            // Room for the warm-up and all the iterations, so that no span is discarded
+            ext::log::set_log_handler( std::make_shared<null_log_handler>() );
+            ext::log::enable_tracing( iterations + 16 );
+            break;
+    }
+
+    std::vector<thread_result> results;
+    unsigned long long throughputNs;
+    {
+        std::unique_ptr<stdout_silencer> silencer( ( scenario.target == TARGET_CONSOLE ) ? new stdout_silencer() : NULL );
+
+        // Throughput is measured without timing each call, and latencies in a separate pass
+        throughputNs = run_threads( scenario, iterations, false, results );
+        run_threads( scenario, iterations, true, results );
+
+        if( fileSink )
+        {
+            fileSink->flush();
+        }
+    }
+
+    ext::log::disable_async_mode();
+    ext::log::disable_tracing();
+    ext::log::set_log_handler( NULL );
+
+    if( fileSink )
+    {
+        fileSink.reset();
+        remove_log_files();
+    }
+
+    std::vector<uint32_t> latencies;
+    unsigned long long allocations = 0;
+    for( thread_result& result : results )
+    {
+        latencies.insert( latencies.end(), result.latencies.begin(), result.latencies.end() );
+        allocations += result.allocations;
+    }
+
+    unsigned long long operations = (unsigned long long) iterations * scenario.threads;
+
+    bench_result result;
+    result.scenario = scenario;
+    result.operations = operations;
+    result.ns_per_op = (double) throughputNs * scenario.threads / operations;
+    result.ops_per_s = ( throughputNs > 0 ) ? ( operations * 1e9 / throughputNs ) : 0;
+    result.p50_ns = percentile( latencies, 0.5 );
+    result.p99_ns = percentile( latencies, 0.99 );
+    result.p999_ns = percentile( latencies, 0.999 );
+    result.allocs_per_op = (double) allocations / operations;
+    return result;
+}
+
+/**
+ * Estimates the overhead of timing a single call, which is included in the latency percentiles.
+ */
+static unsigned long long measure_clock_overhead()
+{
+    std::vector<uint32_t> samples( 10000 );
+    for( uint32_t& sample : samples )
+    {
+        bench_clock::time_point start = bench_clock::now();
+        sample = (uint32_t) elapsed_ns( start, bench_clock::now() );
+    }
+    return percentile( samples, 0.5 );
+}
+
+static std::vector<bench_scenario> build_scenarios( unsigned int maxThreads )
+{
+    std::vector<bench_scenario> scenarios;
+
+    scenarios.push_back( { "disabled_debug", TARGET_DISABLED, &log_disabled, 1 } );
+
+    scenarios.push_back( { "null_0_args", TARGET_NULL, &log_0_args, 1 } );
+    scenarios.push_back( { "null_1_arg", TARGET_NULL, &log_1_arg, 1 } );
+    scenarios.push_back( { "null_4_args", TARGET_NULL, &log_4_args, 1 } );
+    scenarios.push_back( { "null_8_args", TARGET_NULL, &log_8_args, 1 } );
+    scenarios.push_back( { "null_long", TARGET_NULL, &log_long, 1 } );
+
+    scenarios.push_back( { "console_1_arg", TARGET_CONSOLE, &log_1_arg, 1 } );
+    scenarios.push_back( { "console_long", TARGET_CONSOLE, &log_long, 1 } );
+
+    scenarios.push_back( { "file_1_arg", TARGET_FILE, &log_1_arg, 1 } );
+    scenarios.push_back( { "file_long", TARGET_FILE, &log_long, 1 } );
+
+    scenarios.push_back( { "span_disabled", TARGET_TRACE_DISABLED, &trace_span, 1 } );
+    scenarios.push_back( { "span_enabled", TARGET_TRACE, &trace_span, 1 } );
+
+    for( unsigned int threads = 2; threads <= maxThreads; threads *= 2 )
+    {
+        scenarios.push_back( { "disabled_debug", TARGET_DISABLED, &log_disabled, threads } );
+        scenarios.push_back( { "null_1_arg", TARGET_NULL, &log_1_arg, threads } );
+        scenarios.push_back( { "file_1_arg", TARGET_FILE, &log_1_arg, threads } );
+        scenarios.push_back( { "async_shared_1_arg", TARGET_ASYNC_SHARED, &log_1_arg, threads } );
+        scenarios.push_back( { "async_per_thread_1_arg", TARGET_ASYNC_PER_THREAD, &log_1_arg, threads } );
+        scenarios.push_back( { "span_enabled", TARGET_TRACE, &trace_span, threads } );
+    }
+
+    return scenarios;
+}
+
+/*===========================================================================
+ *                          REPORT
+ *===========================================================================*/
+
+static void print_result( const bench_result& result )
+{
+    printf( "%-24s %7u %11.1f %13.0f %8llu %8llu %8llu %10.2f\n", result.scenario.name.c_str(),
+            result.scenario.threads, result.ns_per_op, result.ops_per_s, result.p50_ns, result.p99_ns,
+            result.p999_ns, result.allocs_per_op );
+    fflush( stdout );
+}
+
+static bool write_json( const char* path, const std::vector<bench_result>& results, unsigned int iterations,
+                        unsigned long long clockOverhead )
+{
+    FILE* file = fopen( path, "w" );
+    if( file == NULL )
+    {
+        return false;
+    }
+
+    fprintf( file, "{\n  \"iterations\": %u,\n  \"clock_overhead_ns\": %llu,\n  \"benchmarks\": [\n",
+             iterations, clockOverhead );
+
+    for( size_t i = 0; i < results.size(); i++ )
+    {
+        const bench_result& result = results[i];
+        fprintf( file, "    { \"name\": \"%s\", \"threads\": %u, \"operations\": %llu, \"ns_per_op\": %.1f, "
+                       "\"ops_per_s\": %.0f, \"p50_ns\": %llu, \"p99_ns\": %llu, \"p999_ns\": %llu, "
+                       "\"allocs_per_op\": %.3f }%s\n",
+                 result.scenario.name.c_str(), result.scenario.threads, result.operations, result.ns_per_op,
+                 result.ops_per_s, result.p50_ns, result.p99_ns, result.p999_ns, result.allocs_per_op,
+                 ( i + 1 < results.size() ) ? "," : "" );
+    }
+
+    fprintf( file, "  ]\n}\n" );
+
+    return ( fclose( file ) == 0 );
+}
+
+static void print_usage()
+{
+    fprintf( stderr, "Usage: ExtendedLib.Bench.log [--json <output file>] [--iterations <n>] [--threads <n>]\n"
+                     "                              [--filter <name>]\n" );
+}
+
+int main( int argc, char* argv[] )
+{
+    const char* jsonPath = NULL;
+    const char* filter = NULL;
+    unsigned int iterations = 100000;
+    unsigned int maxThreads = std::max( std::thread::hardware_concurrency(), 2u );
+
+    for( int i = 1; i < argc; i++ )
+    {
+        if( ( strcmp( argv[i], "--json" ) == 0 ) && ( i + 1 < argc ) )
+        {
+            jsonPath = argv[++i];
+        }
+        else if( ( strcmp( argv[i], "--iterations" ) == 0 ) && ( i + 1 < argc ) )
+        {
+            iterations = (unsigned int) strtoul( argv[++i], NULL, 10 );
+        }
+        else if( ( strcmp( argv[i], "--threads" ) == 0 ) && ( i + 1 < argc ) )
+        {
+            maxThreads = (unsigned int) strtoul( argv[++i], NULL, 10 );
+        }
+        else if( ( strcmp( argv[i], "--filter" ) == 0 ) && ( i + 1 < argc ) )
+        {
+            filter = argv[++i];
+        }
+        else
+        {
+            print_usage();
+            return 2;
+        }
+    }
+
+    if( iterations == 0 )
+    {
+        print_usage();
+        return 2;
+    }
+
+    unsigned long long clockOverhead = measure_clock_overhead();
+
+    printf( "Iterations per thread: %u, clock overhead (included in latencies): %llu ns\n\n", iterations,
+            clockOverhead );
+    printf( "%-24s %7s %11s %13s %8s %8s %8s %10s\n", "Benchmark", "Threads", "ns/op", "ops/s", "p50 ns",
+            "p99 ns", "p999 ns", "allocs/op" );
+
+    std::vector<bench_result> results;
+    for( const bench_scenario& scenario : build_scenarios( maxThreads ) )
+    {
+        if( ( filter == NULL ) || ( scenario.name.find( filter ) != std::string::npos ) )
+        {
+            results.push_back( run_scenario( scenario, iterations ) );
+            print_result( results.back() );
+        }
+    }
+
+    if( ( jsonPath != NULL ) && !write_json( jsonPath, results, iterations, clockOverhead ) )
+    {
+        fprintf( stderr, "Error: cannot write '%s'\n", jsonPath );
+        return 1;
+    }
+
+    return 0;
+}
@@ -12,17 +12,395 @@
 ///@defgroup log Logging
 ///@{
 
+#include <stddef.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
 #include <memory>
+#include <atomic>
+#include <string>
+#include <vector>
 
 #include "extended_config.hpp"
 #include "log_common.hpp"
+#include "log_format_check.hpp"
 
 namespace ext
 {
 
+/**
+ * Typed key-value field of a structured log message.
+ *
+ * Fields don't copy the key nor string values, they are only valid during the call where they are created.
+ */
+class Extended_API log_field
+{
+public:
+    enum field_type
+    {
+        TYPE_INT,       ///< Signed integer
+        TYPE_UINT,      ///< Unsigned integer
+        TYPE_DOUBLE,    ///< Floating point number
+        TYPE_BOOL,      ///< Boolean
+        TYPE_STRING     ///< String of characters
+    };
+
+    log_field() noexcept
+    : m_key( "" ), m_type( TYPE_INT )
+    {
+        m_value.i = 0;
+    }
+
+    log_field( const char* key, int value ) noexcept
+    : m_key( key ), m_type( TYPE_INT )
+    {
+        m_value.i = value;
+    }
+
+    log_field( const char* key, long value ) noexcept
+    : m_key( key ), m_type( TYPE_INT )
+    {
+        m_value.i = value;
+    }
+
+    log_field( const char* key, long long value ) noexcept
+    : m_key( key ), m_type( TYPE_INT )
+    {
+        m_value.i = value;
+    }
+
+    log_field( const char* key, unsigned int value ) noexcept
+    : m_key( key ), m_type( TYPE_UINT )
+    {
+        m_value.u = value;
+    }
+
+    log_field( const char* key, unsigned long value ) noexcept
+    : m_key( key ), m_type( TYPE_UINT )
+    {
+        m_value.u = value;
+    }
+
+    log_field( const char* key, unsigned long long value ) noexcept
+    : m_key( key ), m_type( TYPE_UINT )
+    {
+        m_value.u = value;
+    }
+
+    log_field( const char* key, double value ) noexcept
+    : m_key( key ), m_type( TYPE_DOUBLE )
+    {
+        m_value.d = value;
+    }
+
+    log_field( const char* key, bool value ) noexcept
+    : m_key( key ), m_type( TYPE_BOOL )
+    {
+        m_value.b = value;
+    }
+
+    log_field( const char* key, const char* value, size_t length ) noexcept
+    : m_key( key ), m_type( TYPE_STRING )
+    {
+        m_value.s.ptr = value;
+        m_value.s.len = length;
+    }
+
+    log_field( const char* key, const char* value ) noexcept
+    : log_field( key, ( value != NULL ) ? value : "(null)", ( value != NULL ) ? strlen( value ) : 6 )
+    {}
+
+    log_field( const char* key, const std::string& value ) noexcept
+    : log_field( key, value.data(), value.size() )
+    {}
+
+    const char* key() const noexcept
+    {
+        return m_key;
+    }
+
+    field_type type() const noexcept
+    {
+        return m_type;
+    }
+
+    int64_t int_value() const noexcept
+    {
+        return m_value.i;
+    }
+
+    uint64_t uint_value() const noexcept
+    {
+        return m_value.u;
+    }
+
+    double double_value() const noexcept
+    {
+        return m_value.d;
+    }
+
+    bool bool_value() const noexcept
+    {
+        return m_value.b;
+    }
+
+    /**
+     * Returns the characters of a string value (not null-terminated).
+     */
+    const char* string_value() const noexcept
+    {
+        return m_value.s.ptr;
+    }
+
+    size_t string_length() const noexcept
+    {
+        return m_value.s.len;
+    }
+
+private:
+    const char* m_key;
+    field_type m_type;
+    union
+    {
+        int64_t i;
+        uint64_t u;
+        double d;
+        bool b;
+        struct
+        {
+            const char* ptr;
+            size_t len;
+        } s;
+    } m_value;
+};
+
+class log_site;
+
+namespace log_internal
+{
+class format_plan;
+}
+
+/**
+ * Log message passed to the log handlers.
+ *
+ * Messages generated through a call site (i.e. using the logging macros) are not formatted when the record
+ * is created: the record holds the format string and its arguments, and the message text is rendered the
+ * first time it's requested and then shared by all the log handlers. Therefore, handlers that discard
+ * messages based on their priority, category or call site don't pay for their formatting.
+ *
+ * The strings referenced by a record are only valid during the call to the log handler.
+ */
+class Extended_API log_record
+{
+public:
+    /**
+     * Constructor.
+     *
+     * @param[in] prio Priority of the message
+     * @param[in] category Category of the message (may be NULL)
+     * @param[in] function Name of the function or method where the message was generated
+     * @param[in] msg Message text
+     * @param[in] timestamp Time when the message was generated, from log::get_timestamp() (0 = unknown)
+     * @param[in] threadId Identifier of the thread that generated the message (0 = unknown)
+     * @param[in] threadName Name of the thread that generated the message (may be NULL)
+     */
+    log_record( int prio, const char* category, const char* function, const char* msg, uint64_t timestamp = 0,
+                unsigned long threadId = 0, const char* threadName = NULL ) noexcept
+    : m_prio( prio ), m_category( category ), m_function( function ), m_msg( msg ),
+      m_timestamp( timestamp ), m_threadId( threadId ), m_threadName( ( threadName != NULL ) ? threadName : "" ),
+      m_fields( NULL ), m_fieldCount( 0 ), m_site( NULL ), m_format( NULL ), m_args( NULL ), m_capturedArgs( NULL ),
+      m_capturedArgsLen( 0 ), m_hasMsg( true ), m_hasText( false )
+    {}
+
+    /**
+     * Constructor for structured messages, whose fields are appended to the message text on demand.
+     *
+     * @param[in] prio Priority of the message
+     * @param[in] category Category of the message (may be NULL)
+     * @param[in] function Name of the function or method where the message was generated
+     * @param[in] msg Message text without the fields
+     * @param[in] fields Fields of the message (must remain valid while the record exists)
+     * @param[in] fieldCount Number of fields
+     * @param[in] timestamp Time when the message was generated, from log::get_timestamp() (0 = unknown)
+     * @param[in] threadId Identifier of the thread that generated the message (0 = unknown)
+     * @param[in] threadName Name of the thread that generated the message (may be NULL)
+     */
+    log_record( int prio, const char* category, const char* function, const char* msg, const log_field* fields,
+                size_t fieldCount, uint64_t timestamp = 0, unsigned long threadId = 0, const char* threadName = NULL ) noexcept
+    : m_prio( prio ), m_category( category ), m_function( function ), m_msg( msg ),
+      m_timestamp( timestamp ), m_threadId( threadId ), m_threadName( ( threadName != NULL ) ? threadName : "" ),
+      m_fields( fields ), m_fieldCount( fieldCount ), m_site( NULL ), m_format( NULL ), m_args( NULL ), m_capturedArgs( NULL ),
+      m_capturedArgsLen( 0 ), m_hasMsg( false ), m_hasText( false )
+    {}
+
+    /**
+     * Constructor for messages to be formatted on demand.
+     *
+     * @param[in] site Call site that generated the message
+     * @param[in] format Format string (using printf format)
+     * @param[in] args Arguments of the format string (must remain valid while the record exists)
+     * @param[in] timestamp Time when the message was generated, from log::get_timestamp() (0 = unknown)
+     * @param[in] threadId Identifier of the thread that generated the message (0 = unknown)
+     * @param[in] threadName Name of the thread that generated the message (may be NULL)
+     */
+    log_record( const log_site& site, const char* format, va_list* args, uint64_t timestamp = 0,
+                unsigned long threadId = 0, const char* threadName = NULL ) noexcept;
+
+    /**
+     * Constructor for messages to be formatted on demand, whose arguments were captured with
+     * log_internal::capture_format_args().
+     *
+     * @param[in] site Call site that generated the message
+     * @param[in] format Format string (using printf format)
+     * @param[in] args Captured arguments of the format string
+     * @param[in] argsLen Length of the captured arguments
+     * @param[in] timestamp Time when the message was generated, from log::get_timestamp() (0 = unknown)
+     * @param[in] threadId Identifier of the thread that generated the message (0 = unknown)
+     * @param[in] threadName Name of the thread that generated the message (may be NULL)
+     */
+    log_record( const log_site& site, const char* format, const char* args, size_t argsLen, uint64_t timestamp = 0,
+                unsigned long threadId = 0, const char* threadName = NULL ) noexcept;
+
+    int priority() const noexcept
+    {
+        return m_prio;
+    }
+
+    /**
+     * Returns the category of the message (may be NULL).
+     */
+    const char* category() const noexcept
+    {
+        return m_category;
+    }
+
+    const char* function() const noexcept
+    {
+        return m_function;
+    }
+
+    /**
+     * Returns the text of the message.
+     *
+     * For structured messages, the fields are appended to the message in logfmt format
+     * (e.g. "Connection closed fd=3 peer=\"host:80\"").
+     *
+     * If the message is formatted on demand, or it's a structured message, it's rendered the first time
+     * it's requested.
+     */
+    const char* message() const
+    {
+        return ( ( m_format != NULL ) || ( m_fields != NULL ) ) ? render_message() : m_msg;
+    }
+
+    /**
+     * Returns the text of the message without the fields (same as message() for non-structured messages).
+     */
+    const char* base_message() const
+    {
+        return ( m_format != NULL ) ? render_message() : m_msg;
+    }
+
+    /**
+     * Returns the format string of a message formatted on demand (NULL if the message was already formatted
+     * when the record was created).
+     */
+    const char* format() const noexcept
+    {
+        return m_format;
+    }
+
+    /**
+     * Returns the call site that generated the message (NULL if unknown).
+     */
+    const log_site* site() const noexcept
+    {
+        return m_site;
+    }
+
+    /**
+     * Returns the fields of a structured message (NULL if it's not a structured message).
+     */
+    const log_field* fields() const noexcept
+    {
+        return m_fields;
+    }
+
+    size_t field_count() const noexcept
+    {
+        return m_fieldCount;
+    }
+
+    /**
+     * Returns the time when the message was generated, in ticks of the log clock (0 if unknown).
+     *
+     * @see log::timestamp_to_wall_ns()
+     */
+    uint64_t timestamp() const noexcept
+    {
+        return m_timestamp;
+    }
+
+    /**
+     * Returns the identifier of the thread that generated the message for the operating system (0 if unknown).
+     */
+    unsigned long thread_id() const noexcept
+    {
+        return m_threadId;
+    }
+
+    /**
+     * Returns the name of the thread that generated the message (empty if it has no name).
+     *
+     * @see ext::thread::set_current_name()
+     */
+    const char* thread_name() const noexcept
+    {
+        return m_threadName;
+    }
+
+    /**
+     * Returns the message formatted as a line of text, in the same format written to console.
+     *
+     * The text is formatted the first time it's requested, and shared by all the log handlers (and the
+     * console output) that request it afterwards.
+     */
+    const std::string& text() const;
+
+private:
+    /**
+     * Renders the message formatted on demand, or appends the fields of a structured message (only the first
+     * time it's called).
+     */
+    const char* render_message() const;
+
+    int m_prio;
+    const char* m_category;
+    const char* m_function;
+    const char* m_msg;      // Without the fields (NULL if formatted on demand)
+    uint64_t m_timestamp;
+    unsigned long m_threadId;
+    const char* m_threadName;
+    const log_field* m_fields;
+    size_t m_fieldCount;
+    const log_site* m_site;
+    const char* m_format;
+    va_list* m_args;
+    const char* m_capturedArgs;
+    size_t m_capturedArgsLen;
+    mutable bool m_hasMsg;
+    mutable std::string m_renderedMsg;
+    mutable bool m_hasText;
+    mutable std::string m_text;
+};
+
 /**
  * The log_handler abstract class is the base class for implementations of log handlers
  * (to process the log messages generated by the application).
+ *
+ * Log handlers must implement either process() or process_record(), and can also implement process_batch()
+ * if they can process several messages more efficiently than one by one.
  */
 class Extended_API log_handler
 {
@@ -31,76 +409,925 @@ public:
     {}
 
     /**
-     * This method is called by the log management system when a log message is generated by the application.
+     * This method is called by the log management system when a log message is generated by the application
+     * (unless process_record() is overridden).
+     *
+     * @param[in] prio Priority of the message
+     * @param[in] category Category of the message
+     * @param[in] function Name of the function or method where the message was generated
+     * @param[in] msg Message text
+     * @retval true if the message must be also logged to console (if verbose mode is activated)
+     * @retval false otherwise
+     */
+    virtual bool process( int prio, const char* category, const char* function, const char* msg )
+    {
+        (void) prio; (void) category; (void) function; (void) msg;
+        return true;
+    }
+
+    /**
+     * This method is called by the log management system when a log message is generated by the application.
+     *
+     * The default implementation calls process().
+     *
+     * @param[in] record Log message
+     * @retval true if the message must be also logged to console (if verbose mode is activated)
+     * @retval false otherwise
+     */
+    virtual bool process_record( const log_record& record )
+    {
+        return process( record.priority(), record.category(), record.function(), record.message() );
+    }
+
+    /**
+     * This method is called by the log management system when a structured log message is generated by
+     * the application.
+     *
+     * The default implementation calls process_record() (the fields are also available in the record).
+     *
+     * @param[in] record Log message
+     * @param[in] fields Fields of the message
+     * @param[in] count Number of fields
+     * @retval true if the message must be also logged to console (if verbose mode is activated)
+     * @retval false otherwise
+     */
+    virtual bool process_fields( const log_record& record, const log_field* fields, size_t count )
+    {
+        (void) fields; (void) count;
+        return process_record( record );
+    }
+
+    /**
+     * Passes a message to process_fields() if it's a structured message, or to process_record() otherwise.
+     */
+    bool dispatch( const log_record& record )
+    {
+        return ( record.field_count() > 0 ) ? process_fields( record, record.fields(), record.field_count() )
+                                            : process_record( record );
+    }
+
+    /**
+     * This method is called by the log management system to process several log messages at once
+     * (e.g. by the writer thread in asynchronous mode).
+     *
+     * The default implementation calls dispatch() for each message.
+     *
+     * @param[in] records Log messages
+     * @param[in] count Number of log messages
+     * @param[out] toConsole For each message, set to @c true if it must be also logged to console, or to
+     *                       @c false otherwise
+     */
+    virtual void process_batch( const log_record* const* records, size_t count, bool* toConsole )
+    {
+        for( size_t i = 0; i < count; i++ )
+        {
+            toConsole[i] = dispatch( *records[i] );
+        }
+    }
+};
+
+/**
+ * Static descriptor of the place in the code where a message is logged (i.e. an expansion of the
+ * logging macros).
+ *
+ * Each call site caches whether its messages must be logged according to the current priority limit
+ * of its category, so that checking it doesn't require a call into the library. The name of its function
+ * is simplified at compile time by the logging macros (see LOG_DECLARE_FUNCTION_NAME). The descriptor is
+ * registered the first time its messages are checked.
+ *
+ * @remark
+ * Instances are intended to be defined only by the logging macros, as function-local static variables.
+ */
+class Extended_API log_site
+{
+public:
+    /**
+     * Constructor.
+     *
+     * @param[in] prio Priority of the messages (one of LOG_PRIORITY_xxx)
+     * @param[in] category Category of the messages (may be NULL)
+     * @param[in] function Simplified name of the function or method where the messages are generated
+     * @param[in] file Name of the source file
+     * @param[in] line Line in the source file
+     * @param[in] literalFormat Indicates if the format strings of the messages are string literals, otherwise
+     *                          they are not assumed to outlive the logging calls
+     */
+    constexpr log_site( int prio, const char* category, const char* function, const char* file, int line,
+                        bool literalFormat = true ) noexcept
+    : m_state( STATE_UNREGISTERED ), m_prio( prio ), m_category( category ), m_function( function ),
+      m_file( file ), m_line( line ), m_literalFormat( literalFormat ), m_categoryIndex( 0 ), m_next( nullptr ),
+      m_rate(), m_formatPlan( nullptr )
+    {}
+
+    /**
+     * Indicates if the messages of the call site must be passed to the log management system (either to
+     * be logged or to be captured by the flight recorder).
+     */
+    bool is_enabled() noexcept
+    {
+        // Acquire pairs with the registration of the call site (free on most architectures)
+        int state = m_state.load( std::memory_order_acquire );
+        return ( state > STATE_DISABLED ) || ( ( state == STATE_UNREGISTERED ) && register_site() );
+    }
+
+    int get_priority() const noexcept
+    {
+        return m_prio;
+    }
+
+    const char* get_category() const noexcept
+    {
+        return m_category;
+    }
+
+    const char* get_function() const noexcept
+    {
+        return m_function;
+    }
+
+    const char* get_file() const noexcept
+    {
+        return m_file;
+    }
+
+    int get_line() const noexcept
+    {
+        return m_line;
+    }
+
+private:
+    friend class log;
+    friend class log_record;
+
+    enum
+    {
+        STATE_UNREGISTERED = -1,
+        STATE_DISABLED = 0,
+        STATE_ENABLED = 1,
+        STATE_RECORDED = 2      // Not logged, but captured by the flight recorder
+    };
+
+    /**
+     * Registers the call site, so that its state is updated when the priority limits change.
+     *
+     * @retval true if the messages of the call site must be logged or recorded
+     * @retval false otherwise
+     */
+    bool register_site() noexcept;
+
+    /**
+     * Computes the state of the call site according to the priority limit of its category and the
+     * flight recorder priority limit.
+     */
+    int compute_state() const noexcept;
+
+    /**
+     * Updates the priority limits of the categories and the state of all the registered call sites
+     * (the registry must be locked).
+     */
+    static void refresh_all() noexcept;
+
+    /**
+     * Updates the rate limiting parameters of the call site according to the rate limit rules (the registry
+     * must be locked).
+     */
+    void refresh_rate_limit() noexcept;
+
+    /**
+     * Returns the parsed format string of the messages of the call site, which is created the first time
+     * it's requested.
+     *
+     * @param[in] format Format string of the message being rendered
+     * @return The format plan, or NULL if @p format is not the format string of the call site
+     */
+    const log_internal::format_plan* get_format_plan( const char* format ) const;
+
+    /**
+     * Checks a message against the rate limit of the call site, without formatting it.
+     *
+     * @param[in] hash Hash of the message, from hash_message() or hash_fields() (0 = can't be compared)
+     * @param[out] repeated Number of identical consecutive messages collapsed before this one (which must
+     *                      be reported before it)
+     * @param[out] suppressed Number of messages suppressed by the rate limit before this one (which must be
+     *                        reported before it)
+     * @retval true if the message must be logged
+     * @retval false if the message has been suppressed
+     */
+    bool check_rate_limit( uint64_t hash, unsigned int& repeated, unsigned int& suppressed ) const noexcept;
+
+    /**
+     * Rate limiting parameters and state of a call site.
+     *
+     * The rate limit is a token bucket implemented as a virtual scheduling algorithm (GCRA): a single
+     * timestamp, the theoretical arrival time of the next message, is updated atomically.
+     */
+    struct rate_state
+    {
+        constexpr rate_state() noexcept
+        : enabled( false ), collapse( false ), interval( 0 ), tolerance( 0 ), tat( 0 ), lastHash( 0 ),
+          repeated( 0 ), suppressed( 0 )
+        {}
+
+        std::atomic<bool> enabled;
+        std::atomic<bool> collapse;             // Identical consecutive messages are collapsed
+        std::atomic<uint64_t> interval;         // Nanoseconds per message (0 = no rate limit)
+        std::atomic<uint64_t> tolerance;        // Burst tolerance in nanoseconds
+        std::atomic<uint64_t> tat;              // Theoretical arrival time of the next message
+        std::atomic<uint64_t> lastHash;         // Hash of the last message (0 = unknown)
+        std::atomic<unsigned int> repeated;
+        std::atomic<unsigned int> suppressed;
+    };
+
+    std::atomic<int> m_state;
+    const int m_prio;
+    const char* const m_category;
+    const char* const m_function;
+    const char* const m_file;
+    const int m_line;
+    const bool m_literalFormat;
+    unsigned int m_categoryIndex;
+    log_site* m_next;
+    mutable rate_state m_rate;
+    mutable std::atomic<const log_internal::format_plan*> m_formatPlan;
+};
+
+/**
+ * Static descriptor of the place in the code where a trace span is opened (i.e. an expansion of the
+ * TRACE_SPAN or TRACE_FUNCTION_ENTRY macros).
+ *
+ * Just like log call sites, each trace site caches whether tracing is enabled, so that opening a span while
+ * tracing is disabled only costs a load and a branch. The descriptor is registered the first time it's
+ * checked.
+ *
+ * @remark
+ * Instances are intended to be defined only by the tracing macros, as function-local static variables.
+ */
+class Extended_API trace_site
+{
+public:
+    /**
+     * Constructor.
+     *
+     * @param[in] name Name of the spans (NULL = name of the function)
+     * @param[in] category Category of the spans (may be NULL)
+     * @param[in] function Simplified name of the function or method where the spans are opened
+     * @param[in] file Name of the source file
+     * @param[in] line Line in the source file
+     */
+    constexpr trace_site( const char* name, const char* category, const char* function, const char* file, int line ) noexcept
+    : m_state( STATE_UNREGISTERED ), m_name( ( name != nullptr ) ? name : function ), m_category( category ),
+      m_function( function ), m_file( file ), m_line( line ), m_next( nullptr )
+    {}
+
+    /**
+     * Indicates if the spans of the trace site must be recorded.
+     */
+    bool is_enabled() noexcept
+    {
+        int state = m_state.load( std::memory_order_acquire );
+        return ( state > STATE_DISABLED ) || ( ( state == STATE_UNREGISTERED ) && register_site() );
+    }
+
+    const char* get_name() const noexcept
+    {
+        return m_name;
+    }
+
+    const char* get_category() const noexcept
+    {
+        return m_category;
+    }
+
+    const char* get_function() const noexcept
+    {
+        return m_function;
+    }
+
+    const char* get_file() const noexcept
+    {
+        return m_file;
+    }
+
+    int get_line() const noexcept
+    {
+        return m_line;
+    }
+
+private:
+    friend class log;
+
+    enum
+    {
+        STATE_UNREGISTERED = -1,
+        STATE_DISABLED = 0,
+        STATE_ENABLED = 1
+    };
+
+    /**
+     * Registers the trace site, so that its state is updated when tracing is enabled or disabled.
+     *
+     * @retval true if tracing is enabled
+     * @retval false otherwise
+     */
+    bool register_site() noexcept;
+
+    /**
+     * Updates the state of all the registered trace sites (the trace registry must be locked).
+     */
+    static void refresh_all( bool enabled ) noexcept;
+
+    std::atomic<int> m_state;
+    const char* const m_name;
+    const char* const m_category;
+    const char* const m_function;
+    const char* const m_file;
+    const int m_line;
+    trace_site* m_next;
+};
+
+/**
+ * Number of buckets of the latency histogram of the log statistics.
+ */
+#define LOG_LATENCY_BUCKETS 40
+
+/**
+ * Snapshot of the statistics of the log management system.
+ *
+ * @see log::get_statistics()
+ */
+struct Extended_API log_statistics
+{
+    /**
+     * Counters of a category.
+     */
+    struct category_counters
+    {
+        std::string name;               ///< Name of the category (empty for messages without category)
+        unsigned long long emitted;     ///< Messages logged
+        unsigned long long filtered;    ///< Messages discarded by the priority limits
+    };
+
+    unsigned long long emitted[LOG_PRIORITY_ALLOC + 1];     ///< Messages logged, per priority
+    unsigned long long filtered[LOG_PRIORITY_ALLOC + 1];    ///< Messages discarded by the priority limits, per priority
+    std::vector<category_counters> categories;              ///< Counters of the categories with any message
+    unsigned long long bytes_written;                       ///< Bytes of text written to console and by the file sinks
+    unsigned long long handler_calls;                       ///< Calls to the log handler (each batch is a single call)
+    unsigned long long handler_time_ns;                     ///< Time spent inside the log handler
+    unsigned long long dropped;                             ///< Messages discarded because the ring buffer was full
+    unsigned long long suppressed;                          ///< Messages suppressed by the rate limits
+
+    /**
+     * Histogram of the sampled latencies of logging a message (from entering the library until the message
+     * has been processed, or queued in asynchronous mode). Bucket @c i counts the latencies in the range
+     * [2^i, 2^(i+1)) nanoseconds.
+     */
+    unsigned long long latency_histogram[LOG_LATENCY_BUCKETS];
+    unsigned long long latency_samples;                     ///< Number of sampled latencies
+
+    /**
+     * Returns an estimate of a percentile of the sampled latencies.
+     *
+     * @param[in] fraction Fraction of the samples below the percentile (e.g. 0.99 for p99)
+     * @return The upper bound of the histogram bucket which contains the percentile, in nanoseconds (0 if
+     *         there are no samples)
+     */
+    unsigned long long latency_percentile( double fraction ) const noexcept;
+};
+
+/**
+ * The log singleton class provides access to the log management functionalities.
+ */
+class Extended_API log
+{
+public:
+    ///@cond INTERNAL
+    /**
+     * Logs a message.
+     *
+     * @param[in] prio Priority of the message (one of LOG_PRIORITY_xxx)
+     * @param[in] category Category of the message (may be NULL)
+     * @param[in] function Name of the function or method where the message was generated
+     * @param[in] msg Message format string (using printf format)
+     * @param[in] ... Variable parameters for the format string
+     */
+    static void log_message( int prio, const char* category, const char* function, const char* format, ... );
+
+    /**
+     * Logs a message generated at a call site.
+     *
+     * The message is logged unconditionally, the call site must have been checked to be enabled before.
+     *
+     * @remark
+     * In asynchronous mode the message is formatted later by the writer thread, therefore the string
+     * pointed by @p format must have static storage duration (e.g. a string literal), unless the call site
+     * was defined as not having literal format strings (then the message is formatted immediately).
+     *
+     * @param[in] site Call site where the message was generated
+     * @param[in] format Message format string (using printf format)
+     * @param[in] ... Variable parameters for the format string
+     */
+    static void log_message( const log_site& site, const char* format, ... );
+
+    /**
+     * Logs a structured message generated at a call site.
+     *
+     * The message is logged unconditionally, the call site must have been checked to be enabled before.
+     *
+     * @param[in] site Call site where the message was generated
+     * @param[in] msg Message text
+     * @param[in] fields Fields of the message
+     * @param[in] count Number of fields
+     */
+    static void log_fields( const log_site& site, const char* msg, const log_field* fields, size_t count );
+
+    /**
+     * Logs a structured message generated at a call site, with its fields given as key-value pairs.
+     *
+     * The fields are encoded into an array on the stack, therefore no memory is allocated for them.
+     */
+    template<typename... Args>
+    static void log_structured( const log_site& site, const char* msg, const Args&... args )
+    {
+        static_assert( ( sizeof...( Args ) % 2 ) == 0, "Fields must be given as key-value pairs" );
+
+        log_field fields[sizeof...( Args ) / 2 + 1];
+        fill_fields( fields, args... );
+        log_fields( site, msg, fields, sizeof...( Args ) / 2 );
+    }
+    ///@endcond
+
+    /**
+     * Gets the current priority limit for logging messages.
+     */
+    static int get_priority_limit() noexcept;
+
+    /**
+     * Sets the runtime priority limit for logging messages.
+     *
+     * Messages with priority lower (higher "value") than the given priority will be ignored.
+     *
+     * @remark
+     * The macro LOG_PRIORITY_MAX sets the lowest priority limit at compile-time. Therefore,
+     * setting the log priority at runtime lower than LOG_PRIORITY_MAX will behave just as
+     * setting it to LOG_PRIORITY_MAX.
+     *
+     * @see LOG_PRIORITY_MAX
+     *
+     * @param[in] logPriorityLimit Priority limit to be set
+     */
+    static void set_priority_limit( int logPriorityLimit ) noexcept;
+
+    /**
+     * Gets the current priority limit for logging messages of a category.
+     *
+     * @param[in] category Name of the category (may be NULL)
+     * @return The priority limit set for the category, or the general priority limit if none was set
+     */
+    static int get_category_priority_limit( const char* category ) noexcept;
+
+    /**
+     * Sets the priority limit for logging messages of the categories matching a pattern.
+     *
+     * The pattern can be the exact name of a category, or a prefix followed by @c '*' to match all the
+     * categories starting with it (e.g. <tt>"Net*"</tt>, or just <tt>"*"</tt> to match all the categories).
+     * The limit also applies to the matching categories that are used for the first time later.
+     *
+     * When several patterns match a category, the most recently set one takes precedence. Categories that
+     * don't match any pattern, and messages without category, follow the general priority limit.
+     *
+     * @remark
+     * Just like the general priority limit, the macro LOG_PRIORITY_MAX sets the lowest priority limit at
+     * compile-time.
+     *
+     * @see set_priority_limit()
+     *
+     * @param[in] pattern Name or prefix pattern of the categories
+     * @param[in] logPriorityLimit Priority limit to be set
+     */
+    static void set_category_priority_limit( const char* pattern, int logPriorityLimit );
+
+    /**
+     * Removes all the priority limits set for categories, so that all of them follow again the general
+     * priority limit.
+     */
+    static void clear_category_priority_limits() noexcept;
+
+    /**
+     * Sets the general priority limit and replaces all the priority limits set for categories at once.
+     *
+     * Call sites go directly from the previous limits to the new ones, without the intermediate states that
+     * setting the limits one by one would produce (e.g. all the categories following the general priority
+     * limit after clearing their limits). Threads logging messages are not blocked meanwhile.
+     *
+     * @param[in] logPriorityLimit General priority limit
+     * @param[in] categoryLimits Patterns of the categories (as in set_category_priority_limit()) and their
+     *                           priority limits, in increasing order of precedence
+     */
+    static void set_priority_limits( int logPriorityLimit, const std::vector<std::pair<std::string, int>>& categoryLimits );
+
+    /**
+     * Gets the currently installed log handler.
+     */
+    static std::shared_ptr<log_handler> get_log_handler() noexcept;
+
+    /**
+     * Sets a new log handler.
+     *
+     * If a log handler was set previously, the new log handler replaces the old one.
+     *
+     * @remark
+     * The log handler can be replaced at any moment, even while other threads are logging messages,
+     * without blocking them. The reference to the old log handler is released once all the messages
+     * that were being passed to it have been processed (therefore, this method waits for them to finish).
+     * If this method is called from the log handler itself, the release of the old one is deferred.
+     *
+     * @param[in] userLogHandler New log handler
+     */
+    static void set_log_handler( const std::shared_ptr<log_handler>& userLogHandler ) noexcept;
+
+    /**
+     * Policy applied in asynchronous mode when a message is logged and the ring buffer is full.
+     */
+    enum overflow_policy
+    {
+        OVERFLOW_BLOCK,       //!< The logging thread waits until there is room in the ring buffer
+        OVERFLOW_DROP_NEWEST, //!< The new message is discarded
+        OVERFLOW_DROP_OLDEST  //!< The oldest queued message is discarded to make room for the new one
+    };
+
+    /**
+     * Queues where the messages are pushed in asynchronous mode.
+     */
+    enum queue_mode
+    {
+        QUEUE_SHARED,       //!< All the threads push their messages into a single ring buffer
+        QUEUE_PER_THREAD    //!< Each thread pushes its messages into its own ring buffer
+    };
+
+    /**
+     * Enables the asynchronous logging mode.
      *
-     * @param[in] prio Priority of the message
-     * @param[in] category Category of the message
-     * @param[in] function Name of the function or method where the message was generated
-     * @param[in] msg Message text
-     * @retval true if the message must be also logged to console (if verbose mode is activated)
-     * @retval false otherwise
+     * In asynchronous mode the threads that log messages just push them into a bounded ring buffer,
+     * and a dedicated writer thread takes care of calling the log handler and writing to console.
+     *
+     * @remark
+     * The capacity of the ring buffer is rounded up to the next power of two. Calling this method while
+     * the asynchronous mode is already enabled only changes the overflow policy.
+     *
+     * @remark
+     * With QUEUE_PER_THREAD each logging thread gets its own ring buffer (with the given capacity) the first
+     * time it logs a message, so that threads don't contend for a shared write position, and the writer
+     * thread merges the buffers by timestamp. The buffer of a thread that exits is recycled once its
+     * messages have been processed. Messages are ordered among those already queued when they are merged,
+     * therefore a message whose thread is preempted while queuing it may be processed after newer ones.
+     *
+     * @param[in] capacity Maximum number of messages that can be queued (per thread with QUEUE_PER_THREAD)
+     * @param[in] policy Policy to apply when the ring buffer is full
+     * @param[in] queue Queues where the messages are pushed
      */
-    virtual bool process( int prio, const char* category, const char* function, const char* msg ) = 0;
-};
+    static void enable_async_mode( size_t capacity = 8192, overflow_policy policy = OVERFLOW_BLOCK,
+                                   queue_mode queue = QUEUE_SHARED );
 
-/**
- * The log singleton class provides access to the log management functionalities.
- */
-class Extended_API log
-{
-public:
-    ///@cond INTERNAL
     /**
-     * Logs a message.
+     * Enables the asynchronous logging mode writing the messages to a binary log file.
      *
-     * @param[in] prio Priority of the message (one of LOG_PRIORITY_xxx)
-     * @param[in] category Category of the message (may be NULL)
-     * @param[in] function Name of the function or method where the message was generated
-     * @param[in] msg Message format string (using printf format)
-     * @param[in] ... Variable parameters for the format string
+     * In binary mode the logging threads only capture the arguments of the messages, and the writer thread
+     * stores them in the file without formatting them and without calling the log handler. Each
+     * combination of category, function and format is written only once. The file can be converted
+     * to text afterwards using the log decoder tool.
+     *
+     * @remark
+     * If the asynchronous mode is already enabled, it's disabled first (processing all the queued messages).
+     * The binary log file is closed when the asynchronous mode is disabled.
+     *
+     * @param[in] path Path of the binary log file (an existing file is overwritten)
+     * @param[in] capacity Maximum number of messages that can be queued
+     * @param[in] policy Policy to apply when the ring buffer is full
+     * @throws ext::runtime_error if the file could not be created
      */
-    static void log_message( int prio, const char* category, const char* function, const char* format, ... );
-    ///@endcond
+    static void enable_binary_mode( const char* path, size_t capacity = 8192, overflow_policy policy = OVERFLOW_BLOCK );
 
     /**
-     * Gets the current priority limit for logging messages.
+     * Disables the asynchronous logging mode.
+     *
+     * All the messages queued are processed before returning, and the writer thread is stopped.
      */
-    static int get_priority_limit() noexcept;
+    static void disable_async_mode();
 
     /**
-     * Sets the runtime priority limit for logging messages.
+     * Indicates if the asynchronous logging mode is enabled.
+     */
+    static bool is_async_mode() noexcept;
+
+    /**
+     * Waits until all the messages logged before the call have been processed by the log handler and
+     * written to console.
+     */
+    static void flush();
+
+    /**
+     * Returns the number of messages discarded since the start of the program because the asynchronous
+     * mode ring buffer was full.
+     */
+    static unsigned long long get_dropped_count() noexcept;
+
+    /**
+     * Gets the current time from the log clock.
      *
-     * Messages with priority lower (higher "value") than the given priority will be ignored.
+     * The log clock is the calibrated time stamp counter of the processor when it's invariant, otherwise
+     * the monotonic clock of the system, therefore reading it is very cheap. Timestamps are only converted
+     * to wall-clock time when the messages are formatted.
+     *
+     * @return Time in ticks of the log clock (never 0)
+     */
+    static uint64_t get_timestamp() noexcept;
+
+    /**
+     * Converts a timestamp of the log clock to wall-clock time.
+     *
+     * @param[in] timestamp Time in ticks of the log clock
+     * @return Nanoseconds since the Unix epoch
+     */
+    static uint64_t timestamp_to_wall_ns( uint64_t timestamp ) noexcept;
+
+    /**
+     * Enables or disables the timestamps in the lines of text of the messages (enabled by default, unless
+     * the library is built with LOG_TIMESTAMPS_DEFAULT defined as 0).
+     *
+     * Timestamps are written as local date and time with microseconds (e.g. "2016-03-01 12:34:56.123456").
+     */
+    static void set_timestamps_enabled( bool enabled ) noexcept;
+
+    static bool are_timestamps_enabled() noexcept;
+
+    /**
+     * Enables or disables the tags that identify the thread that generated the messages in their lines of
+     * text (enabled by default, unless the library is built with LOG_THREAD_TAGS_DEFAULT defined as 0).
+     *
+     * Threads are identified by their operating system identifier and their name, if any
+     * (e.g. "(1234:worker)").
+     */
+    static void set_thread_tags_enabled( bool enabled ) noexcept;
+
+    static bool are_thread_tags_enabled() noexcept;
+
+    /**
+     * Sets a rate limit for the messages of the categories matching a pattern.
+     *
+     * Each call site matching the rule gets its own token bucket, which allows bursts of up to @p burst
+     * messages and refills at @p messagesPerSecond. Messages exceeding the rate are counted but not
+     * formatted, and the next message logged by the call site is preceded by a message reporting
+     * "N similar messages suppressed". Additionally, if @p collapseRepeats is true, identical consecutive
+     * messages from a call site (i.e. with the same arguments) are collapsed, and the next different message
+     * is preceded by a message reporting "Last message repeated N times".
+     *
+     * Rate limits are checked before formatting the messages, and they apply only to the messages logged
+     * with the LOG_xxx macros.
+     *
+     * @param[in] pattern Name of a category, a prefix followed by '*', or NULL for all the call sites
+     *                    (including those without category)
+     * @param[in] priority Rate limit applies to the messages with this priority or a less severe one
+     * @param[in] messagesPerSecond Sustained rate of messages allowed (0 = no rate limit)
+     * @param[in] burst Maximum number of messages allowed in a burst
+     * @param[in] collapseRepeats Collapse identical consecutive messages
+     */
+    static void set_rate_limit( const char* pattern, int priority, unsigned int messagesPerSecond, unsigned int burst = 1,
+                                bool collapseRepeats = true );
+
+    /**
+     * Removes all the rate limits.
+     */
+    static void clear_rate_limits() noexcept;
+
+    /**
+     * Returns the number of messages suppressed by the rate limits (including collapsed repeated messages).
+     */
+    static unsigned long long get_suppressed_count() noexcept;
+
+    /**
+     * Enables the flight recorder.
+     *
+     * The flight recorder captures the messages that are not logged because of the priority limits, so that
+     * the context of a failure is available even when running with a low level of detail. Captured messages
+     * are stored without formatting them and without any locking in a fixed-size ring buffer owned by each
+     * thread (16 KB, unless the library is built with a different LOG_FLIGHT_RECORDER_SIZE), which is allocated
+     * when the thread captures its first message. The last captured messages of a thread are logged (and
+     * removed from its ring buffer) when the thread logs an @c ERROR message (including when a
+     * runtime_error is logged), when dump_flight_recorder() is called, or when the program is terminated
+     * by an unhandled exception.
      *
      * @remark
-     * The macro LOG_PRIORITY_MAX sets the lowest priority limit at compile-time. Therefore,
-     * setting the log priority at runtime lower than LOG_PRIORITY_MAX will behave just as
-     * setting it to LOG_PRIORITY_MAX.
+     * Only messages logged with the LOG_xxx macros are captured, and messages with priorities beyond
+     * LOG_PRIORITY_MAX are removed at compile-time.
      *
-     * @see LOG_PRIORITY_MAX
+     * @param[in] priorityLimit Maximum priority of the messages captured
+     * @param[in] dumpCount Maximum number of messages logged when the ring buffer is dumped
+     */
+    static void enable_flight_recorder( int priorityLimit = LOG_PRIORITY_ALLOC, unsigned int dumpCount = 64 ) noexcept;
+
+    /**
+     * Disables the flight recorder.
      *
-     * @param[in] logPriorityLimit Priority limit to be set
+     * Messages already captured are kept until dumped.
      */
-    static void set_priority_limit( int logPriorityLimit ) noexcept;
+    static void disable_flight_recorder() noexcept;
 
     /**
-     * Gets the currently installed log handler.
+     * Indicates if the flight recorder is enabled.
      */
-    static const std::shared_ptr<log_handler>& get_log_handler() noexcept;
+    static bool is_flight_recorder_enabled() noexcept;
 
     /**
-     * Sets a new log handler.
+     * Logs the messages captured by the flight recorder in the calling thread, and clears them.
+     */
+    static void dump_flight_recorder();
+
+    /**
+     * Returns a snapshot of the statistics of the log management system.
      *
-     * If a log handler was set previously, the new log handler replaces the old one.
+     * Counters are kept in shards assigned to the threads, so that counting doesn't make the threads
+     * contend, and are added up when taking the snapshot.
      *
-     * @param[in] userLogHandler New log handler
+     * @remark
+     * Messages discarded at the call site by the LOG_xxx macros are not counted as filtered, because
+     * checking the priority limit of a call site is kept free of any overhead (they are counted only if
+     * captured by the flight recorder).
      */
-    static void set_log_handler( const std::shared_ptr<log_handler>& userLogHandler ) noexcept;
+    static log_statistics get_statistics();
+
+    /**
+     * Resets the counters and the latency histogram of the statistics.
+     */
+    static void reset_statistics() noexcept;
+
+    /**
+     * Sets the sampling of the latency of logging messages.
+     *
+     * @param[in] interval One of every @p interval messages logged by each thread is sampled (0 = disabled)
+     */
+    static void set_latency_sampling( unsigned int interval ) noexcept;
+
+    /**
+     * Logs a summary of the statistics, bypassing the priority limits.
+     */
+    static void dump_statistics();
+
+    /**
+     * Enables the recording of trace spans.
+     *
+     * Spans opened with TRACE_SPAN or TRACE_FUNCTION_ENTRY record their begin and end timestamps, their thread
+     * and their trace site into a buffer owned by each thread, without formatting them nor locking (the
+     * buffer is allocated the first time each thread records a span). Spans that don't fit into the buffer of
+     * their thread are discarded and counted.
+     *
+     * The spans recorded are kept until tracing is enabled again, and can be exported while recording.
+     *
+     * @param[in] spansPerThread Maximum number of spans recorded by each thread
+     */
+    static void enable_tracing( size_t spansPerThread = 16384 );
+
+    /**
+     * Disables the recording of trace spans.
+     *
+     * The spans already recorded are kept, so that they can be exported.
+     */
+    static void disable_tracing() noexcept;
+
+    /**
+     * Indicates if the recording of trace spans is enabled.
+     */
+    static bool is_tracing_enabled() noexcept;
+
+    /**
+     * Returns the number of spans discarded because the buffer of their thread was full.
+     */
+    static unsigned long long get_trace_dropped_count() noexcept;
+
+    /**
+     * Exports the spans recorded in the Chrome trace event format (JSON), which can be opened with
+     * chrome://tracing or the Perfetto UI.
+     *
+     * Spans are exported as complete events, with their timestamps in wall-clock microseconds, and
+     * threads are named after the threads that recorded them.
+     *
+     * @return The JSON document
+     */
+    static std::string export_trace();
+
+    /**
+     * Exports the spans recorded in the Chrome trace event format (JSON) to a file.
+     *
+     * @see export_trace()
+     *
+     * @param[in] path Path of the file (an existing file is overwritten)
+     * @throws ext::runtime_error if the file could not be written
+     */
+    static void export_trace( const char* path );
+
+    ///@cond INTERNAL
+    /**
+     * Records a span into the buffer of the calling thread.
+     *
+     * @param[in] site Trace site of the span
+     * @param[in] begin Timestamp of the beginning of the span (from get_timestamp())
+     * @param[in] end Timestamp of the end of the span (from get_timestamp())
+     */
+    static void record_span( const trace_site& site, uint64_t begin, uint64_t end ) noexcept;
+    ///@endcond
 
 private:
     log() {}; // Make it non-instantiable
+
+    /**
+     * Checks a message against the rate limit of its call site, logging the summary of the messages
+     * collapsed or suppressed before it.
+     *
+     * @retval true if the message must be logged
+     * @retval false if the message has been suppressed
+     */
+    static bool pass_rate_limit( const log_site& site, uint64_t hash, uint64_t timestamp );
+
+    /**
+     * Logs a message generated at a call site, whose format string must have static storage duration.
+     */
+    static void log_site_message( const log_site& site, const char* format, ... );
+
+    static void log_site_vmessage( const log_site& site, const char* format, va_list args );
+
+    static void fill_fields( log_field* )
+    {}
+
+    template<typename T, typename... Rest>
+    static void fill_fields( log_field* fields, const char* key, const T& value, const Rest&... rest )
+    {
+        *fields = log_field( key, value );
+        fill_fields( fields + 1, rest... );
+    }
+};
+
+/**
+ * Scoped trace span, which records the time elapsed from its construction until its end (or its destruction)
+ * when tracing is enabled.
+ *
+ * @remark
+ * Instances are intended to be defined only by the tracing macros.
+ */
+class trace_span
+{
+public:
+    explicit trace_span( trace_site& site ) noexcept
+    : m_site( site.is_enabled() ? &site : nullptr ), m_begin( ( m_site != nullptr ) ? log::get_timestamp() : 0 )
+    {}
+
+    ~trace_span()
+    {
+        end();
+    }
+
+    /**
+     * Ends the span before its destruction.
+     */
+    void end() noexcept
+    {
+        if( m_site != nullptr )
+        {
+            log::record_span( *m_site, m_begin, log::get_timestamp() );
+            m_site = nullptr;
+        }
+    }
+
+private:
+    trace_span( const trace_span& ) = delete;
+    trace_span& operator=( const trace_span& ) = delete;
+
+    const trace_site* m_site;
+    const uint64_t m_begin;
+};
+
+///@cond INTERNAL
+namespace log_internal
+{
+
+/**
+ * Found by TRACE_FUNCTION_EXIT through a using-directive when TRACE_FUNCTION_ENTRY has not opened a span in
+ * the same or in an enclosing scope (otherwise the variable of the span hides it).
+ */
+enum no_function_span
+{
+    ext_trace_function_span
 };
 
+inline void end_function_span( trace_span& span ) noexcept
+{
+    span.end();
+}
+
+inline void end_function_span( no_function_span ) noexcept
+{}
+
+} // namespace
+///@endcond
+
 } // namespace
 
 template class Extended_API std::shared_ptr<ext::log_handler>;
@@ -111,8 +1338,22 @@ template class Extended_API std::shared_ptr<ext::log_handler>;
 ///@cond INTERNAL
 /**
  * Logs a formatted message with the given priority.
+ *
+ * The arguments are only evaluated if the message is going to be logged. If the format string is a string
+ * literal, they are checked at compile time against it, otherwise the format string is parsed at run time.
  */
-#define LOG(prio,str,...) ext::log::log_message( prio, LOG_CATEGORY, __FUNCTION_INFO__, str, ##__VA_ARGS__ )
+#define LOG(prio,str,...) \
+    do \
+    { \
+        LOG_CHECK_FORMAT( str, ##__VA_ARGS__ ); \
+        LOG_DECLARE_FUNCTION_NAME( __ext_log_function ); \
+        static ext::log_site __ext_log_site( prio, LOG_CATEGORY, __ext_log_function.value, __FILE__, __LINE__, \
+                                             ::ext::log_internal::is_format_literal<decltype( str )>::value ); \
+        if( __ext_log_site.is_enabled() ) \
+        { \
+            ext::log::log_message( __ext_log_site, str, ##__VA_ARGS__ ); \
+        } \
+    } while( 0 )
 ///@endcond
 
 /**
@@ -199,13 +1440,145 @@ template class Extended_API std::shared_ptr<ext::log_handler>;
 #define LOG_ALLOC(str,...)
 #endif
 
+///@cond INTERNAL
+/**
+ * Logs a structured message with the given priority.
+ *
+ * The arguments are only evaluated if the message is going to be logged.
+ */
+#define LOG_KV(prio,str,...) \
+    do \
+    { \
+        LOG_DECLARE_FUNCTION_NAME( __ext_log_function ); \
+        static ext::log_site __ext_log_site( prio, LOG_CATEGORY, __ext_log_function.value, __FILE__, __LINE__ ); \
+        if( __ext_log_site.is_enabled() ) \
+        { \
+            ext::log::log_structured( __ext_log_site, str, ##__VA_ARGS__ ); \
+        } \
+    } while( 0 )
+///@endcond
+
+/**
+ * \def LOG_ERROR_KV
+ * Logs a structured message with @c ERROR priority.
+ * @param[in] str Message text
+ * @param[in] ... Fields of the message as key-value pairs (e.g. @c "fd", @c fd, @c "peer", @c name)
+ */
+#if LOG_PRIORITY_MAX >= LOG_PRIORITY_ERROR
+#define LOG_ERROR_KV(str,...) LOG_KV( LOG_PRIORITY_ERROR, str, ##__VA_ARGS__ )
+#else
+#define LOG_ERROR_KV(str,...)
+#endif
+
+/**
+ * \def LOG_WARN_KV
+ * Logs a structured message with @c WARN priority.
+ * @param[in] str Message text
+ * @param[in] ... Fields of the message as key-value pairs
+ */
+#if LOG_PRIORITY_MAX >= LOG_PRIORITY_WARN
+#define LOG_WARN_KV(str,...) LOG_KV( LOG_PRIORITY_WARN, str, ##__VA_ARGS__ )
+#else
+#define LOG_WARN_KV(str,...)
+#endif
+
+/**
+ * \def LOG_INFO_KV
+ * Logs a structured message with @c INFO priority.
+ * @param[in] str Message text
+ * @param[in] ... Fields of the message as key-value pairs
+ */
+#if LOG_PRIORITY_MAX >= LOG_PRIORITY_INFO
+#define LOG_INFO_KV(str,...) LOG_KV( LOG_PRIORITY_INFO, str, ##__VA_ARGS__ )
+#else
+#define LOG_INFO_KV(str,...)
+#endif
+
+/**
+ * \def LOG_DEBUG_KV
+ * Logs a structured message with @c DEBUG priority.
+ * @param[in] str Message text
+ * @param[in] ... Fields of the message as key-value pairs
+ */
+#if LOG_PRIORITY_MAX >= LOG_PRIORITY_DEBUG
+#define LOG_DEBUG_KV(str,...) LOG_KV( LOG_PRIORITY_DEBUG, str, ##__VA_ARGS__ )
+#else
+#define LOG_DEBUG_KV(str,...)
+#endif
+
+/**
+ * \def LOG_TRACE_KV
+ * Logs a structured message with @c TRACE priority.
+ * @param[in] str Message text
+ * @param[in] ... Fields of the message as key-value pairs
+ */
+#if LOG_PRIORITY_MAX >= LOG_PRIORITY_TRACE
+#define LOG_TRACE_KV(str,...) LOG_KV( LOG_PRIORITY_TRACE, str, ##__VA_ARGS__ )
+#else
+#define LOG_TRACE_KV(str,...)
+#endif
+
 ///@}
 
-///@name Utility Macros
+///@name Tracing Macros
 ///@{
 
 /**
- * Useful macro to trace function/method entries.
+ * @def LOG_TRACE_SPANS_DISABLED
+ *
+ * Define this macro (e.g. @c -DLOG_TRACE_SPANS_DISABLED) to remove the trace spans at compile-time.
+ *
+ * Trace spans don't depend on LOG_PRIORITY_MAX (i.e. they are kept even if LOG_TRACE messages are removed).
+ */
+
+///@cond INTERNAL
+#define LOG_TRACE_SPAN_VAR_( prefix, line ) prefix##line
+#define LOG_TRACE_SPAN_VAR( prefix, line ) LOG_TRACE_SPAN_VAR_( prefix, line )
+
+/**
+ * Opens a trace span named @p name, held in a variable named @p var, which ends at the end of the scope.
+ */
+#define LOG_TRACE_SPAN_DECLARE( name, var ) \
+    LOG_DECLARE_FUNCTION_NAME( LOG_TRACE_SPAN_VAR( __ext_trace_function, __LINE__ ) ); \
+    static ext::trace_site LOG_TRACE_SPAN_VAR( __ext_trace_site, __LINE__ )( name, LOG_CATEGORY, \
+        LOG_TRACE_SPAN_VAR( __ext_trace_function, __LINE__ ).value, __FILE__, __LINE__ ); \
+    ext::trace_span var( LOG_TRACE_SPAN_VAR( __ext_trace_site, __LINE__ ) )
+///@endcond
+
+/**
+ * \def TRACE_SPAN
+ * Opens a trace span that lasts until the end of the enclosing scope.
+ *
+ * When tracing is disabled (see log::enable_tracing()), opening the span only costs a branch.
+ *
+ * @par Example
+ * @code{.cpp}
+ * void handle_request( const request& req )
+ * {
+ *     {
+ *         TRACE_SPAN( "parse" );
+ *         // ... Parse the request ...
+ *     }
+ *
+ *     TRACE_SPAN( "execute" );
+ *     // ... Execute the request ...
+ * }
+ * @endcode
+ *
+ * @param[in] name Name of the span (a string literal)
+ */
+#ifndef LOG_TRACE_SPANS_DISABLED
+#define TRACE_SPAN( name ) LOG_TRACE_SPAN_DECLARE( name, LOG_TRACE_SPAN_VAR( __ext_trace_span, __LINE__ ) )
+#else
+#define TRACE_SPAN( name )
+#endif
+
+/**
+ * Opens a trace span named after the current function, which lasts until the end of the enclosing scope
+ * or until TRACE_FUNCTION_EXIT.
+ *
+ * It can be used only once in each scope (use TRACE_SPAN to open additional spans). Unlike LOG_TRACE
+ * messages, the span is not removed by LOG_PRIORITY_MAX, but by LOG_TRACE_SPANS_DISABLED.
  *
  * @par Example
  * @code{.cpp}
@@ -219,10 +1592,15 @@ template class Extended_API std::shared_ptr<ext::log_handler>;
  * }
  * @endcode
  */
-#define TRACE_FUNCTION_ENTRY  LOG_TRACE("Entry");
+#ifndef LOG_TRACE_SPANS_DISABLED
+#define TRACE_FUNCTION_ENTRY  LOG_TRACE_SPAN_DECLARE( nullptr, ext_trace_function_span );
+#else
+#define TRACE_FUNCTION_ENTRY
+#endif
 
- /**
- * Useful macro to trace function/method exits.
+/**
+ * Ends the span opened by TRACE_FUNCTION_ENTRY in the same or in an enclosing scope (it's not needed at the
+ * end of the function). Does nothing if there is no such span.
  *
  * @par Example
  * @code{.cpp}
@@ -236,7 +1614,15 @@ template class Extended_API std::shared_ptr<ext::log_handler>;
  * }
  * @endcode
  */
-#define TRACE_FUNCTION_EXIT   LOG_TRACE("Exit");
+#ifndef LOG_TRACE_SPANS_DISABLED
+#define TRACE_FUNCTION_EXIT \
+    { \
+        using namespace ext::log_internal; \
+        ext::log_internal::end_function_span( ext_trace_function_span ); \
+    }
+#else
+#define TRACE_FUNCTION_EXIT
+#endif
 
 ///@}
 
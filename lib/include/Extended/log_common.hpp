@@ -12,6 +12,8 @@
 ///@defgroup log Logging
 ///@{
 
+#include <stddef.h>
+
 #ifndef LOG_CATEGORY
 /**
  * Name of the category for the messages that will be logged.
@@ -79,6 +81,137 @@
 #else
 #define __FUNCTION_INFO__     __FUNCTION__
 #endif
+
+namespace ext
+{
+namespace log_internal
+{
+
+/*
+ * Compile-time simplification of the function signatures given by __FUNCTION_INFO__ to only their qualified
+ * names (e.g. "int ns::cls::method(char) const" is simplified to "ns::cls::method").
+ *
+ * The searches split the signature in halves, so that the recursion depth of the constant expressions
+ * grows logarithmically with the length of the signature.
+ */
+
+constexpr size_t FUNCTION_NAME_NPOS = (size_t) -1;
+
+constexpr size_t rfind_char( const char* str, char c, size_t begin, size_t end );
+
+constexpr size_t rfind_char_lower( size_t upperPos, const char* str, char c, size_t begin, size_t middle )
+{
+    return ( upperPos != FUNCTION_NAME_NPOS ) ? upperPos : rfind_char( str, c, begin, middle );
+}
+
+/**
+ * Returns the position of the last occurrence of a character in the range [begin, end) of a string, or
+ * FUNCTION_NAME_NPOS if not found.
+ */
+constexpr size_t rfind_char( const char* str, char c, size_t begin, size_t end )
+{
+    return ( end <= begin ) ? FUNCTION_NAME_NPOS :
+           ( end - begin == 1 ) ? ( ( str[begin] == c ) ? begin : FUNCTION_NAME_NPOS ) :
+           rfind_char_lower( rfind_char( str, c, begin + ( end - begin ) / 2, end ), str, c, begin,
+                             begin + ( end - begin ) / 2 );
+}
+
+/**
+ * Returns the position following the end of the name of the function in a signature of length @p len.
+ */
+constexpr size_t function_name_end( const char* signature, size_t len )
+{
+#ifdef __GNUC__
+    return ( rfind_char( signature, '(', 0, len ) != FUNCTION_NAME_NPOS ) ? rfind_char( signature, '(', 0, len ) : len;
+#else
+    return len;
+#endif
+}
+
+/**
+ * Returns the position of the beginning of the name of the function in a signature of length @p len.
+ */
+constexpr size_t function_name_begin( const char* signature, size_t len )
+{
+#ifdef __GNUC__
+    return ( rfind_char( signature, ' ', 0, function_name_end( signature, len ) ) != FUNCTION_NAME_NPOS ) ?
+           rfind_char( signature, ' ', 0, function_name_end( signature, len ) ) + 1 : 0;
+#else
+    return 0;
+#endif
+}
+
+/**
+ * Simplified name of a function, stored as a null-terminated string.
+ */
+template<size_t N>
+struct function_name
+{
+    char value[N + 1];
+};
+
+template<size_t... I>
+struct index_list
+{
+};
+
+template<typename List, bool Odd>
+struct double_index_list;
+
+template<size_t... I>
+struct double_index_list<index_list<I...>, false>
+{
+    typedef index_list<I..., ( sizeof...( I ) + I )...> type;
+};
+
+template<size_t... I>
+struct double_index_list<index_list<I...>, true>
+{
+    typedef index_list<I..., ( sizeof...( I ) + I )..., 2 * sizeof...( I )> type;
+};
+
+/**
+ * Generates the list of indexes [0, N) doubling lists of half size.
+ */
+template<size_t N>
+struct make_index_list
+{
+    typedef typename double_index_list<typename make_index_list<N / 2>::type, ( N % 2 ) == 1>::type type;
+};
+
+template<>
+struct make_index_list<0>
+{
+    typedef index_list<> type;
+};
+
+template<size_t... I>
+constexpr function_name<sizeof...( I )> copy_function_name( const char* name, index_list<I...> )
+{
+    return {{ name[I]..., '\0' }};
+}
+
+/**
+ * Copies the @p N characters of a function name that begins at @p name.
+ */
+template<size_t N>
+constexpr function_name<N> make_function_name( const char* name )
+{
+    return copy_function_name( name, typename make_index_list<N>::type() );
+}
+
+} // namespace
+} // namespace
+
+/**
+ * Declares a static variable with the simplified name of the current function (in its @c value member),
+ * which is computed at compile time.
+ */
+#define LOG_DECLARE_FUNCTION_NAME( var ) \
+    static constexpr auto var = ::ext::log_internal::make_function_name< \
+        ::ext::log_internal::function_name_end( __FUNCTION_INFO__, sizeof( __FUNCTION_INFO__ ) - 1 ) - \
+        ::ext::log_internal::function_name_begin( __FUNCTION_INFO__, sizeof( __FUNCTION_INFO__ ) - 1 )>( \
+        __FUNCTION_INFO__ + ::ext::log_internal::function_name_begin( __FUNCTION_INFO__, sizeof( __FUNCTION_INFO__ ) - 1 ) )
 ///@endcond
 
 ///@}
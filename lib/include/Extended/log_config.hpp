@@ -0,0 +1,125 @@
+/**
+ * @file
+ * @brief      Header for the log configuration read from text
+ * @authors    Jesus Gonzalez <jgonzalez@gdr-sistemas.com>
+ * @copyright  Copyright (c) 2003-2016 Jesus Gonzalez
+ * @license    See LICENSE.txt
+ */
+
+#ifndef Extended_log_config_hpp_
+#define Extended_log_config_hpp_
+
+///@addtogroup log
+///@{
+
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "log_pipeline.hpp"
+
+namespace ext
+{
+
+/**
+ * Settings of the log management system read from a configuration file, which can be applied to the
+ * running program at any moment.
+ *
+ * The configuration is a text with one setting per line, optionally grouped in sections:
+ *
+ * @code
+ * # General settings
+ * priority = INFO
+ * timestamps = on
+ * thread_tags = off
+ *
+ * # Priority limits of the categories (names or prefix patterns, later ones take precedence)
+ * [categories]
+ * Net* = DEBUG
+ * Net.Http = WARN
+ *
+ * # Priority limits of the sinks, by the name given when applying the configuration
+ * [sinks]
+ * file = TRACE
+ * syslog = WARN
+ * @endcode
+ *
+ * Priorities are given by name (@c ERROR, @c WARN, @c INFO, @c DEBUG, @c TRACE, @c DEBUG_EXTRA, @c ALLOC, or
+ * @c OFF to discard all the messages, case-insensitive) or by their numeric value. Lines starting with
+ * @c '#' or @c ';' are comments.
+ *
+ * General settings and sinks not present in the configuration are left unchanged when it's applied.
+ * Category limits are replaced as a whole instead, so that removing a category from the configuration
+ * makes it follow the general priority limit again.
+ */
+class Extended_API log_config
+{
+public:
+    /**
+     * Sinks that can be configured, by name.
+     */
+    typedef std::map<std::string, std::shared_ptr<log_sink>> sink_map;
+
+    /**
+     * Constructor of an empty configuration (which only clears the category limits when applied).
+     */
+    log_config() noexcept;
+
+    /**
+     * Parses a configuration.
+     *
+     * @param[in] text Text of the configuration
+     * @return The configuration
+     * @throw ext::runtime_error if the configuration is not valid
+     */
+    static log_config parse( const std::string& text );
+
+    /**
+     * Reads and parses a configuration file.
+     *
+     * @param[in] path Path of the configuration file
+     * @return The configuration
+     * @throw ext::runtime_error if the file can't be read or the configuration is not valid
+     */
+    static log_config load( const char* path );
+
+    /**
+     * Applies the configuration.
+     *
+     * The general and category priority limits are replaced at once (see log::set_priority_limits()), and
+     * threads logging messages are never blocked. Settings for sinks not present in @p sinks are ignored.
+     *
+     * @param[in] sinks Sinks that can be configured
+     */
+    void apply( const sink_map& sinks = sink_map() ) const;
+
+    /**
+     * Returns the general priority limit, or -1 if not set.
+     */
+    int get_priority_limit() const noexcept;
+
+    /**
+     * Returns the patterns of the categories and their priority limits.
+     */
+    const std::vector<std::pair<std::string, int>>& get_category_limits() const noexcept;
+
+    /**
+     * Returns the names of the sinks and their priority limits.
+     */
+    const std::vector<std::pair<std::string, int>>& get_sink_limits() const noexcept;
+
+private:
+    int m_priorityLimit;
+    int m_timestamps;   // -1 = not set
+    int m_threadTags;   // -1 = not set
+    std::vector<std::pair<std::string, int>> m_categoryLimits;
+    std::vector<std::pair<std::string, int>> m_sinkLimits;
+};
+
+} // namespace
+
+///@}
+
+#endif // header guard
@@ -0,0 +1,79 @@
+/**
+ * @file
+ * @brief      Header for the watcher that applies the log configuration file when it changes
+ * @authors    Jesus Gonzalez <jgonzalez@gdr-sistemas.com>
+ * @copyright  Copyright (c) 2003-2016 Jesus Gonzalez
+ * @license    See LICENSE.txt
+ */
+
+#ifndef Extended_log_config_watcher_hpp_
+#define Extended_log_config_watcher_hpp_
+
+///@addtogroup log
+///@{
+
+#include <memory>
+#include <string>
+
+#include "log_config.hpp"
+
+namespace ext
+{
+
+/**
+ * Watcher that applies a log configuration file (see log_config) to the running program each time it
+ * changes, so that the level of detail can be changed without restarting it (only available on Linux).
+ *
+ * The file is monitored with inotify by a dedicated thread, which reloads it when it's written or replaced
+ * (e.g. renamed over by an editor). A configuration that can't be read or parsed is not applied at all, and
+ * the error is logged and kept until the next valid one.
+ *
+ * The file doesn't need to exist when the watcher is created, but its directory does.
+ */
+class Extended_API log_config_watcher
+{
+public:
+    /**
+     * Constructor.
+     *
+     * The configuration file is applied immediately if it exists.
+     *
+     * @param[in] path Path of the configuration file
+     * @param[in] sinks Sinks that can be configured, by name
+     * @throw ext::runtime_error if the directory of the file can't be watched
+     */
+    log_config_watcher( const char* path, const log_config::sink_map& sinks = log_config::sink_map() );
+
+    /**
+     * Destructor.
+     *
+     * Stops watching the file. The configuration applied is kept.
+     */
+    ~log_config_watcher();
+
+    const std::string& get_path() const noexcept;
+
+    /**
+     * Returns the number of times that the configuration has been applied.
+     */
+    unsigned long long get_applied_count() const noexcept;
+
+    /**
+     * Returns the error of the last attempt to apply the configuration (empty if it was applied).
+     */
+    std::string get_last_error() const;
+
+private:
+    log_config_watcher( const log_config_watcher& ) = delete;
+    log_config_watcher& operator=( const log_config_watcher& ) = delete;
+
+    struct impl;
+
+    std::unique_ptr<impl> m_impl;
+};
+
+} // namespace
+
+///@}
+
+#endif // header guard
@@ -0,0 +1,88 @@
+/**
+ * @file
+ * @brief      Header for the fatal signal handler of the log management system
+ * @authors    Jesus Gonzalez <jgonzalez@gdr-sistemas.com>
+ * @copyright  Copyright (c) 2003-2016 Jesus Gonzalez
+ * @license    See LICENSE.txt
+ */
+
+#ifndef Extended_log_crash_handler_hpp_
+#define Extended_log_crash_handler_hpp_
+
+///@addtogroup log
+///@{
+
+#include <stddef.h>
+
+#include "log.hpp"
+
+namespace ext
+{
+
+/**
+ * Handler of the fatal signals (@c SIGSEGV, @c SIGBUS, @c SIGFPE, @c SIGILL and @c SIGABRT) that reports
+ * the crash and saves the buffered log data before the program is terminated (only available on POSIX
+ * systems).
+ *
+ * When a fatal signal is received, the handler writes to the crash file descriptor the signal information,
+ * a backtrace (with the mangled names of the functions, taken from the symbol tables of the modules that
+ * were loaded when the handler was installed) and the executable mappings of the process (to symbolize
+ * the addresses offline). Then it waits for the messages queued in asynchronous mode to be processed
+ * (unless the crash happened in the writer thread), and writes the messages buffered by the file sinks
+ * into their files.
+ * Finally, the default action of the signal is restored and the signal is raised again, so the process
+ * terminates (and dumps core) as it would without the handler.
+ *
+ * The handler is async-signal-safe: it only uses preallocated memory and system calls, therefore it can
+ * report crashes produced inside the memory allocator or while holding locks. Buffered data that can't be
+ * accessed safely (e.g. a file sink buffer that was being modified by the crashing thread) is skipped.
+ *
+ * The handler runs on an alternate signal stack, so that stack overflows can be reported. Alternate stacks
+ * are per thread: install() prepares one for the calling thread, and other threads must call
+ * prepare_thread() to get theirs.
+ */
+class Extended_API log_crash_handler
+{
+public:
+    /**
+     * Configuration of the crash handler.
+     */
+    struct options
+    {
+        int fd;                             ///< File descriptor where the crash report is written
+        unsigned int flush_timeout_ms;      ///< Maximum time waiting for the asynchronous writer thread
+        size_t stack_size;                  ///< Size of the alternate signal stacks
+
+        options()
+        : fd( 2 ), flush_timeout_ms( 250 ), stack_size( 64 * 1024 )
+        {}
+    };
+
+    /**
+     * Installs the handler for the fatal signals, replacing any previous handlers.
+     *
+     * @param[in] opts Configuration
+     * @throw ext::runtime_error if the handler can't be installed
+     */
+    static void install( const options& opts = options() );
+
+    /**
+     * Restores the default action of the fatal signals.
+     */
+    static void uninstall() noexcept;
+
+    static bool is_installed() noexcept;
+
+    /**
+     * Prepares the alternate signal stack of the calling thread (it's released when the thread exits).
+     *
+     * @throw ext::runtime_error if the stack can't be allocated
+     */
+    static void prepare_thread();
+};
+
+} // namespace
+
+///@}
+
+#endif // header guard
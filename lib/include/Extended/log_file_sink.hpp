@@ -0,0 +1,120 @@
+/**
+ * @file
+ * @brief      Header for the buffered log file sink
+ * @authors    Jesus Gonzalez <jgonzalez@gdr-sistemas.com>
+ * @copyright  Copyright (c) 2003-2016 Jesus Gonzalez
+ * @license    See LICENSE.txt
+ */
+
+#ifndef Extended_log_file_sink_hpp_
+#define Extended_log_file_sink_hpp_
+
+///@addtogroup log
+///@{
+
+#include <stddef.h>
+#include <memory>
+#include <string>
+
+#include "log_pipeline.hpp"
+
+namespace ext
+{
+
+/**
+ * Log sink that writes the log messages to a text file.
+ *
+ * Messages are accumulated in a user-space buffer, which is handed to a background thread that writes all
+ * the pending buffers to the file with a single system call. Buffers are written when they are full, when
+ * the flush interval expires, or immediately when a message with a priority at or below the flush priority
+ * is logged.
+ *
+ * The file can be rotated by size and/or by time: the current file is renamed to @c path.1 (and previous
+ * backups to @c path.2, @c path.3, etc.) and a new file is created. Rotation is performed by the background
+ * thread, therefore it doesn't block the logging threads. If the new file can't be created, messages are
+ * discarded until a later write succeeds in creating it.
+ *
+ * Messages processed by this sink are not logged to console (unless other sink of the pipeline requests it).
+ */
+class Extended_API file_log_sink : public log_sink
+{
+public:
+    /**
+     * Format of the lines written to the file.
+     */
+    enum line_format
+    {
+        FORMAT_TEXT,        ///< Same format written to console
+        FORMAT_JSON,        ///< One JSON object per line, with the fields of structured messages as members
+        FORMAT_LOGFMT       ///< One line of key=value pairs per message, including the fields of structured messages
+    };
+
+    /**
+     * Configuration of the file sink.
+     */
+    struct options
+    {
+        size_t buffer_size;                 ///< Size of the buffer that triggers a write
+        unsigned int flush_interval_ms;     ///< Maximum time messages are kept in the buffer (0 = unbounded)
+        int flush_priority;                 ///< Messages with this priority or lower are written immediately
+        size_t max_file_size;               ///< Size that triggers a rotation (0 = no rotation by size)
+        unsigned int rotation_interval_s;   ///< Age of the file that triggers a rotation (0 = no rotation by time)
+        unsigned int max_backup_files;      ///< Number of rotated files kept
+        line_format format;                 ///< Format of the lines
+
+        options()
+        : buffer_size( 256 * 1024 ), flush_interval_ms( 1000 ), flush_priority( LOG_PRIORITY_ERROR ),
+          max_file_size( 0 ), rotation_interval_s( 0 ), max_backup_files( 5 ), format( FORMAT_TEXT )
+        {}
+    };
+
+    /**
+     * Constructor.
+     *
+     * The file is opened for appending (it's created if it doesn't exist).
+     *
+     * @param[in] path Path of the log file
+     * @param[in] opts Configuration
+     * @param[in] logPriorityLimit Maximum priority of the messages written to the file
+     * @throw ext::runtime_error if the file can't be opened
+     */
+    file_log_sink( const char* path, const options& opts = options(), int logPriorityLimit = LOG_PRIORITY_ALLOC );
+
+    /**
+     * Destructor.
+     *
+     * Writes all the pending messages and closes the file.
+     */
+    virtual ~file_log_sink();
+
+    /**
+     * Writes to the file all the messages processed by the sink, and waits until they have been written.
+     */
+    void flush();
+
+    const std::string& get_path() const noexcept;
+
+    /**
+     * Returns the number of bytes discarded because they couldn't be written to the file (e.g. because the file
+     * couldn't be reopened after a rotation, which is retried on each write).
+     */
+    unsigned long long get_dropped_bytes() const noexcept;
+
+    virtual bool process_record( const log_record& record ) override;
+
+    virtual void process_batch( const log_record* const* records, size_t count, bool* toConsole ) override;
+
+private:
+    file_log_sink( const file_log_sink& ) = delete;
+    file_log_sink& operator=( const file_log_sink& ) = delete;
+
+    struct impl;
+
+    std::unique_ptr<impl> m_impl;
+};
+
+} // namespace
+
+///@}
+
+#endif // header guard
@@ -0,0 +1,305 @@
+/**
+ * @file
+ * @brief      Header for the compile-time validation of the format strings of log messages
+ * @authors    Jesus Gonzalez <jgonzalez@gdr-sistemas.com>
+ * @copyright  Copyright (c) 2003-2016 Jesus Gonzalez
+ * @license    See LICENSE.txt
+ */
+
+#ifndef Extended_log_format_check_hpp_
+#define Extended_log_format_check_hpp_
+
+///@cond INTERNAL
+
+#include <stddef.h>
+#include <stdint.h>
+#include <wchar.h>
+#include <cstddef>
+#include <type_traits>
+
+namespace ext
+{
+namespace log_internal
+{
+
+/*
+ * The format string is checked with constant expressions that visit only its conversion specifications:
+ * literal text is skipped splitting it in halves, so that the recursion depth of the evaluation grows with
+ * the number of arguments and not with the length of the format string.
+ */
+
+/**
+ * Returns the position of the first occurrence of a character in the range [begin, end) of a string, or
+ * @p end if not found.
+ */
+constexpr size_t find_format_char( const char* str, char c, size_t begin, size_t end );
+
+constexpr size_t find_format_char_upper( size_t lowerPos, const char* str, char c, size_t middle, size_t end )
+{
+    return ( lowerPos != middle ) ? lowerPos : find_format_char( str, c, middle, end );
+}
+
+constexpr size_t find_format_char( const char* str, char c, size_t begin, size_t end )
+{
+    return ( end <= begin ) ? end :
+           ( end - begin == 1 ) ? ( ( str[begin] == c ) ? begin : end ) :
+           find_format_char_upper( find_format_char( str, c, begin, begin + ( end - begin ) / 2 ), str, c,
+                                   begin + ( end - begin ) / 2, end );
+}
+
+constexpr bool is_format_digit( char c )
+{
+    return ( c >= '0' ) && ( c <= '9' );
+}
+
+constexpr bool is_format_flag( char c )
+{
+    return ( c == '-' ) || ( c == '+' ) || ( c == ' ' ) || ( c == '#' ) || ( c == '0' ) || ( c == '\'' );
+}
+
+constexpr size_t skip_format_digits( const char* str, size_t pos )
+{
+    return is_format_digit( str[pos] ) ? skip_format_digits( str, pos + 1 ) : pos;
+}
+
+constexpr size_t skip_format_flags( const char* str, size_t pos )
+{
+    return is_format_flag( str[pos] ) ? skip_format_flags( str, pos + 1 ) : pos;
+}
+
+/**
+ * Parsed conversion specification (see the length modifier codes of parse_conversion() in log_format.cpp).
+ */
+struct format_spec
+{
+    constexpr format_spec( size_t end_, unsigned int stars_, char length_, char conv_, bool positional_ )
+    : end( end_ ), stars( stars_ ), length( length_ ), conv( conv_ ), positional( positional_ )
+    {}
+
+    size_t end;             ///< Position following the conversion character
+    unsigned int stars;     ///< Number of arguments taken by '*' for width and precision
+    char length;            ///< Length modifier ('H' = hh, 'q' = ll / I64, 'w' = I32, 'Z' = z / I)
+    char conv;              ///< Conversion character
+    bool positional;        ///< Positional arguments (not checked)
+};
+
+constexpr format_spec make_format_spec( const char* str, size_t pos, unsigned int stars, char length )
+{
+    // 'L' applied to integers is a synonym of 'll'
+    return format_spec( ( str[pos] != 0 ) ? pos + 1 : pos, stars,
+                        ( ( length == 'L' ) && ( str[pos] != 0 ) && ( str[pos] != 'f' ) && ( str[pos] != 'F' ) &&
+                          ( str[pos] != 'e' ) && ( str[pos] != 'E' ) && ( str[pos] != 'g' ) && ( str[pos] != 'G' ) &&
+                          ( str[pos] != 'a' ) && ( str[pos] != 'A' ) ) ? 'q' : length,
+                        str[pos], false );
+}
+
+constexpr format_spec parse_format_length( const char* str, size_t pos, unsigned int stars )
+{
+    return ( str[pos] == 'h' ) ? ( ( str[pos + 1] == 'h' ) ? make_format_spec( str, pos + 2, stars, 'H' ) :
+                                                             make_format_spec( str, pos + 1, stars, 'h' ) ) :
+           ( str[pos] == 'l' ) ? ( ( str[pos + 1] == 'l' ) ? make_format_spec( str, pos + 2, stars, 'q' ) :
+                                                             make_format_spec( str, pos + 1, stars, 'l' ) ) :
+           ( str[pos] == 'q' ) ? make_format_spec( str, pos + 1, stars, 'q' ) :
+           ( ( str[pos] == 'j' ) || ( str[pos] == 't' ) || ( str[pos] == 'L' ) ) ?
+               make_format_spec( str, pos + 1, stars, str[pos] ) :
+           ( ( str[pos] == 'z' ) || ( str[pos] == 'Z' ) ) ? make_format_spec( str, pos + 1, stars, 'Z' ) :
+           ( str[pos] == 'I' ) ? ( ( ( str[pos + 1] == '6' ) && ( str[pos + 2] == '4' ) ) ? make_format_spec( str, pos + 3, stars, 'q' ) :
+                                   ( ( str[pos + 1] == '3' ) && ( str[pos + 2] == '2' ) ) ? make_format_spec( str, pos + 3, stars, 'w' ) :
+                                   make_format_spec( str, pos + 1, stars, 'Z' ) ) :
+           make_format_spec( str, pos, stars, 0 );
+}
+
+constexpr format_spec parse_format_precision( const char* str, size_t pos, unsigned int stars )
+{
+    return ( str[pos] != '.' ) ? parse_format_length( str, pos, stars ) :
+           ( str[pos + 1] == '*' ) ? parse_format_length( str, pos + 2, stars + 1 ) :
+           parse_format_length( str, skip_format_digits( str, pos + 1 ), stars );
+}
+
+constexpr format_spec parse_format_width( const char* str, size_t pos )
+{
+    return ( str[pos] == '*' ) ? parse_format_precision( str, pos + 1, 1 ) :
+           parse_format_precision( str, skip_format_digits( str, pos ), 0 );
+}
+
+/**
+ * Parses the conversion specification that follows the '%' at position @p pos - 1.
+ */
+constexpr format_spec parse_format_spec( const char* str, size_t pos )
+{
+    return ( str[pos] == '%' ) ? format_spec( pos + 1, 0, 0, '%', false ) :
+           ( str[skip_format_digits( str, pos )] == '$' ) ? format_spec( pos, 0, 0, 0, true ) :
+           parse_format_width( str, skip_format_flags( str, pos ) );
+}
+
+/**
+ * Indicates if the conversion doesn't take any argument.
+ */
+constexpr bool is_argless_conversion( char conv )
+{
+    return ( conv == '%' ) || ( conv == 'm' );
+}
+
+template<typename T>
+constexpr bool is_format_integer()
+{
+    return std::is_integral<T>::value || std::is_enum<T>::value;
+}
+
+template<typename T>
+constexpr bool is_format_char_pointer()
+{
+    return std::is_pointer<T>::value &&
+           ( std::is_same<typename std::remove_cv<typename std::remove_pointer<T>::type>::type, char>::value ||
+             std::is_same<typename std::remove_cv<typename std::remove_pointer<T>::type>::type, signed char>::value ||
+             std::is_same<typename std::remove_cv<typename std::remove_pointer<T>::type>::type, unsigned char>::value );
+}
+
+template<typename T>
+constexpr bool is_format_wchar_pointer()
+{
+    return std::is_pointer<T>::value &&
+           std::is_same<typename std::remove_cv<typename std::remove_pointer<T>::type>::type, wchar_t>::value;
+}
+
+/**
+ * Indicates if an integer argument has the size expected by a length modifier.
+ */
+template<typename T>
+constexpr bool has_format_integer_size( char length )
+{
+    return ( ( length == 0 ) || ( length == 'h' ) || ( length == 'H' ) ) ? ( sizeof( T ) <= sizeof( int ) ) :
+           ( length == 'l' ) ? ( sizeof( T ) == sizeof( long ) ) :
+           ( length == 'q' ) ? ( sizeof( T ) == sizeof( long long ) ) :
+           ( length == 'j' ) ? ( sizeof( T ) == sizeof( intmax_t ) ) :
+           ( length == 't' ) ? ( sizeof( T ) == sizeof( ptrdiff_t ) ) :
+           ( length == 'Z' ) ? ( sizeof( T ) == sizeof( size_t ) ) :
+           ( length == 'w' ) ? ( sizeof( T ) == 4 ) :
+           false;
+}
+
+/**
+ * Indicates if an argument (with its type already decayed) can be passed to a conversion.
+ */
+template<typename T>
+constexpr bool is_format_arg_valid( char conv, char length )
+{
+    return ( ( conv == 'd' ) || ( conv == 'i' ) || ( conv == 'u' ) || ( conv == 'o' ) || ( conv == 'x' ) || ( conv == 'X' ) ) ?
+               ( is_format_integer<T>() && has_format_integer_size<T>( length ) ) :
+           ( conv == 'c' ) ? ( is_format_integer<T>() && ( ( length == 'l' ) || ( sizeof( T ) <= sizeof( int ) ) ) ) :
+           ( ( conv == 'e' ) || ( conv == 'E' ) || ( conv == 'f' ) || ( conv == 'F' ) || ( conv == 'g' ) || ( conv == 'G' ) ||
+             ( conv == 'a' ) || ( conv == 'A' ) ) ?
+               ( std::is_floating_point<T>::value && ( ( length == 'L' ) == std::is_same<T, long double>::value ) ) :
+           ( conv == 's' ) ? ( std::is_same<T, std::nullptr_t>::value ||
+                               ( ( length == 'l' ) ? is_format_wchar_pointer<T>() : is_format_char_pointer<T>() ) ) :
+           ( conv == 'p' ) ? ( std::is_pointer<T>::value || std::is_same<T, std::nullptr_t>::value ) :
+           false;
+}
+
+/**
+ * List of the (decayed) types of the arguments of a format string.
+ */
+template<typename... T>
+struct format_arg_list
+{
+};
+
+/**
+ * Helper to obtain the types of the arguments in an unevaluated context (it's never defined).
+ */
+template<typename... T>
+format_arg_list<typename std::decay<T>::type...> format_arg_types( int, const T&... );
+
+/**
+ * Checks the arguments of a format string.
+ */
+template<typename List>
+struct format_checker;
+
+template<>
+struct format_checker<format_arg_list<>>
+{
+    static constexpr bool check( const char* str, size_t pos, size_t len )
+    {
+        return ( find_format_char( str, '%', pos, len ) == len ) ||
+               consume( str, len, parse_format_spec( str, find_format_char( str, '%', pos, len ) + 1 ) );
+    }
+
+    static constexpr bool consume( const char* str, size_t len, format_spec spec )
+    {
+        return spec.positional || ( ( spec.stars == 0 ) && is_argless_conversion( spec.conv ) && check( str, spec.end, len ) );
+    }
+
+    template<size_t N>
+    static constexpr bool check_literal( const char (&str)[N] )
+    {
+        return check( str, 0, N - 1 );
+    }
+
+    template<typename S>
+    static constexpr bool check_literal( const S& )
+    {
+        return true; // Not a string literal, checked at run time
+    }
+};
+
+template<typename T, typename... Rest>
+struct format_checker<format_arg_list<T, Rest...>>
+{
+    static constexpr bool check( const char* str, size_t pos, size_t len )
+    {
+        // There are arguments left, therefore there must be a conversion
+        return ( find_format_char( str, '%', pos, len ) != len ) &&
+               consume( str, len, parse_format_spec( str, find_format_char( str, '%', pos, len ) + 1 ) );
+    }
+
+    static constexpr bool consume( const char* str, size_t len, format_spec spec )
+    {
+        return spec.positional ||
+               ( ( spec.stars > 0 ) ?
+                     ( is_format_integer<T>() && ( sizeof( T ) <= sizeof( int ) ) &&
+                       format_checker<format_arg_list<Rest...>>::consume(
+                           str, len, format_spec( spec.end, spec.stars - 1, spec.length, spec.conv, false ) ) ) :
+                 is_argless_conversion( spec.conv ) ? check( str, spec.end, len ) :
+                 ( is_format_arg_valid<T>( spec.conv, spec.length ) &&
+                   format_checker<format_arg_list<Rest...>>::check( str, spec.end, len ) ) );
+    }
+
+    template<size_t N>
+    static constexpr bool check_literal( const char (&str)[N] )
+    {
+        return check( str, 0, N - 1 );
+    }
+
+    template<typename S>
+    static constexpr bool check_literal( const S& )
+    {
+        return true; // Not a string literal, checked at run time
+    }
+};
+
+/**
+ * Indicates if the expression given as format string is a string literal (whose type is an lvalue reference
+ * to an array of characters), as opposed to a pointer, a named array or a temporary string.
+ */
+template<typename S>
+struct is_format_literal
+: std::integral_constant<bool, std::is_lvalue_reference<S>::value && std::is_array<typename std::remove_reference<S>::type>::value>
+{};
+
+} // namespace
+} // namespace
+
+/**
+ * Checks at compile time that the arguments of a log message match its format string, if it's a string
+ * literal (other format strings are not evaluated, and are parsed at run time instead).
+ */
+#define LOG_CHECK_FORMAT( str, ... ) \
+    static_assert( !::ext::log_internal::is_format_literal<decltype( str )>::value || \
+                   ::ext::log_internal::format_checker< \
+                       decltype( ::ext::log_internal::format_arg_types( 0, ##__VA_ARGS__ ) )>::check_literal( str ), \
+                   "The arguments of the log message don't match its format string" )
+
+///@endcond
+
+#endif // header guard
@@ -0,0 +1,109 @@
+/**
+ * @file
+ * @brief      Header for the memory-mapped log file sink
+ * @authors    Jesus Gonzalez <jgonzalez@gdr-sistemas.com>
+ * @copyright  Copyright (c) 2003-2016 Jesus Gonzalez
+ * @license    See LICENSE.txt
+ */
+
+#ifndef Extended_log_mmap_sink_hpp_
+#define Extended_log_mmap_sink_hpp_
+
+///@addtogroup log
+///@{
+
+#include <stddef.h>
+#include <memory>
+#include <string>
+
+#include "log_pipeline.hpp"
+
+namespace ext
+{
+
+/**
+ * Log sink that writes the log messages to a memory-mapped text file (only available on POSIX systems).
+ *
+ * The file is preallocated with a fixed segment size and mapped into memory. Logging threads reserve space
+ * for their messages with a single atomic operation and copy them directly into the mapping, therefore
+ * logging doesn't involve any system call nor lock. When the segment is full, the file is renamed to
+ * @c path.1 (and previous backups to @c path.2, @c path.3, etc.) and a new segment is created; if it can't be
+ * created, messages are discarded until a later attempt succeeds.
+ *
+ * Closed segments are truncated to the size actually used. If the process crashes, the data already
+ * logged is preserved by the operating system, and the unused part of the segment is filled with NUL
+ * characters; recover_file() truncates such a file, and it's called automatically for an existing file
+ * when the sink is created.
+ *
+ * Messages processed by this sink are not logged to console (unless other sink of the pipeline requests it).
+ */
+class Extended_API mmap_log_sink : public log_sink
+{
+public:
+    /**
+     * Configuration of the memory-mapped sink.
+     */
+    struct options
+    {
+        size_t segment_size;            ///< Size of the file segments
+        unsigned int max_backup_files;  ///< Number of rolled segments kept
+
+        options()
+        : segment_size( 64 * 1024 * 1024 ), max_backup_files( 5 )
+        {}
+    };
+
+    /**
+     * Constructor.
+     *
+     * If the file already exists, it's recovered and kept as a backup (@c path.1).
+     *
+     * @param[in] path Path of the log file
+     * @param[in] opts Configuration
+     * @param[in] logPriorityLimit Maximum priority of the messages written to the file
+     * @throw ext::runtime_error if the file can't be created or mapped
+     */
+    mmap_log_sink( const char* path, const options& opts = options(), int logPriorityLimit = LOG_PRIORITY_ALLOC );
+
+    /**
+     * Destructor.
+     *
+     * Unmaps the file and truncates it to the size actually used.
+     */
+    virtual ~mmap_log_sink();
+
+    const std::string& get_path() const noexcept;
+
+    /**
+     * Returns the number of messages discarded because they didn't fit into a segment or a new segment
+     * couldn't be created.
+     */
+    unsigned long long get_dropped_count() const noexcept;
+
+    /**
+     * Truncates the unused part (NUL padding) of a segment left by a process that didn't terminate properly.
+     *
+     * @param[in] path Path of the log file
+     * @retval true if the file was recovered (or it didn't need recovery)
+     * @retval false if the file couldn't be opened or truncated
+     */
+    static bool recover_file( const char* path );
+
+    virtual bool process_record( const log_record& record ) override;
+
+    virtual void process_batch( const log_record* const* records, size_t count, bool* toConsole ) override;
+
+private:
+    mmap_log_sink( const mmap_log_sink& ) = delete;
+    mmap_log_sink& operator=( const mmap_log_sink& ) = delete;
+
+    struct impl;
+
+    std::unique_ptr<impl> m_impl;
+};
+
+} // namespace
+
+///@}
+
+#endif // header guard
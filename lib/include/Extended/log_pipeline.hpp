@@ -0,0 +1,138 @@
+/**
+ * @file
+ * @brief      Header for the log pipeline, which dispatches the log messages to several log sinks
+ * @authors    Jesus Gonzalez <jgonzalez@gdr-sistemas.com>
+ * @copyright  Copyright (c) 2003-2016 Jesus Gonzalez
+ * @license    See LICENSE.txt
+ */
+
+#ifndef Extended_log_pipeline_hpp_
+#define Extended_log_pipeline_hpp_
+
+///@addtogroup log
+///@{
+
+#include <stddef.h>
+#include <memory>
+#include <atomic>
+#include <mutex>
+
+#include "log.hpp"
+
+namespace ext
+{
+
+/**
+ * Base class for the log handlers that can be added to a log pipeline.
+ *
+ * Each sink has its own priority limit, so that each destination can receive a different level of detail
+ * (e.g. a file receiving debug messages while the console only receives warnings).
+ */
+class Extended_API log_sink : public log_handler
+{
+public:
+    /**
+     * Constructor.
+     *
+     * @param[in] logPriorityLimit Maximum priority of the messages passed to the sink
+     */
+    log_sink( int logPriorityLimit = LOG_PRIORITY_ALLOC ) noexcept
+    : m_priorityLimit( logPriorityLimit )
+    {}
+
+    int get_priority_limit() const noexcept
+    {
+        return m_priorityLimit.load( std::memory_order_relaxed );
+    }
+
+    /**
+     * Sets the maximum priority of the messages passed to the sink.
+     *
+     * Messages must also pass the global and category priority limits to reach the sink.
+     */
+    void set_priority_limit( int logPriorityLimit ) noexcept
+    {
+        m_priorityLimit.store( logPriorityLimit, std::memory_order_relaxed );
+    }
+
+    /**
+     * Indicates if messages with the given priority are passed to the sink.
+     */
+    bool accepts( int prio ) const noexcept
+    {
+        return prio <= m_priorityLimit.load( std::memory_order_relaxed );
+    }
+
+private:
+    std::atomic<int> m_priorityLimit;
+};
+
+/**
+ * Log handler that dispatches the log messages to several log sinks.
+ *
+ * Each message is passed to the sinks whose priority limit accepts it. The text of the message
+ * (see log_record::text()) is formatted at most once, and shared by all the sinks that need it.
+ * Batches of messages (e.g. from the writer thread in asynchronous mode) are passed to each sink as a
+ * single batch with only the messages accepted by the sink.
+ *
+ * Messages are logged to console if any of the sinks that received them requests it.
+ *
+ * Sinks can be added and removed at any time, even while messages are being logged; the sinks being
+ * used are not blocked by these operations.
+ */
+class Extended_API log_pipeline : public log_handler
+{
+public:
+    log_pipeline() noexcept;
+
+    virtual ~log_pipeline();
+
+    /**
+     * Adds a sink to the pipeline.
+     *
+     * @param[in] sink Log sink
+     */
+    void add_sink( const std::shared_ptr<log_sink>& sink );
+
+    /**
+     * Removes a sink from the pipeline.
+     *
+     * @remark After returning, the sink is no longer being used by the pipeline.
+     *
+     * @param[in] sink Log sink
+     * @retval true if the sink was removed
+     * @retval false if the sink was not in the pipeline
+     */
+    bool remove_sink( const std::shared_ptr<log_sink>& sink );
+
+    /**
+     * Removes all the sinks from the pipeline.
+     */
+    void clear_sinks();
+
+    /**
+     * Returns the number of sinks in the pipeline.
+     */
+    size_t get_sink_count() const noexcept;
+
+    virtual bool process_record( const log_record& record ) override;
+
+    virtual void process_batch( const log_record* const* records, size_t count, bool* toConsole ) override;
+
+private:
+    log_pipeline( const log_pipeline& ) = delete;
+    log_pipeline& operator=( const log_pipeline& ) = delete;
+
+    struct sink_list;
+
+    void publish( sink_list* sinks );
+
+    std::atomic<sink_list*> m_sinks;
+    std::mutex m_mutex;
+};
+
+} // namespace
+
+///@}
+
+#endif // header guard
@@ -0,0 +1,162 @@
+/**
+ * @file
+ * @brief      Header for the log sink that publishes the log messages into a shared memory ring
+ * @authors    Jesus Gonzalez <jgonzalez@gdr-sistemas.com>
+ * @copyright  Copyright (c) 2003-2016 Jesus Gonzalez
+ * @license    See LICENSE.txt
+ */
+
+#ifndef Extended_log_shm_sink_hpp_
+#define Extended_log_shm_sink_hpp_
+
+///@addtogroup log
+///@{
+
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <string>
+
+#include "log_pipeline.hpp"
+
+namespace ext
+{
+
+/**
+ * Log sink that publishes the lines of text of the log messages into a named shared memory ring, so that
+ * another process can follow them using shm_log_reader (only available on POSIX systems).
+ *
+ * The ring is divided into fixed-size slots. Logging threads claim a slot with an atomic increment, copy
+ * the line directly into it and publish it by storing its sequence number, therefore logging doesn't
+ * involve any system call nor lock. Lines longer than a slot are truncated.
+ *
+ * The ring never waits for the readers: when it wraps around, the oldest lines are overwritten, and
+ * readers that fall behind detect it and skip them.
+ *
+ * Messages processed by this sink are not logged to console (unless other sink of the pipeline requests it).
+ */
+class Extended_API shm_log_sink : public log_sink
+{
+public:
+    /**
+     * Configuration of the shared memory sink.
+     */
+    struct options
+    {
+        size_t slot_count;          ///< Number of slots of the ring (rounded up to the next power of two)
+        size_t slot_size;           ///< Size of the slots (including a 16 byte header)
+        bool remove_on_close;       ///< Removes the name of the shared memory object when the sink is destroyed
+
+        options()
+        : slot_count( 8192 ), slot_size( 512 ), remove_on_close( true )
+        {}
+    };
+
+    /**
+     * Constructor.
+     *
+     * An existing shared memory object with the same name is replaced.
+     *
+     * @param[in] name Name of the shared memory object (e.g. "/myapp.log")
+     * @param[in] opts Configuration
+     * @param[in] logPriorityLimit Maximum priority of the messages published
+     * @throw ext::runtime_error if the shared memory object can't be created or mapped
+     */
+    shm_log_sink( const char* name, const options& opts = options(), int logPriorityLimit = LOG_PRIORITY_ALLOC );
+
+    virtual ~shm_log_sink();
+
+    const std::string& get_name() const noexcept;
+
+    /**
+     * Returns the number of messages discarded because their slot was still being written by another
+     * thread (which can only happen when the ring wraps around while a line is being copied).
+     */
+    unsigned long long get_dropped_count() const noexcept;
+
+    virtual bool process_record( const log_record& record ) override;
+
+    virtual void process_batch( const log_record* const* records, size_t count, bool* toConsole ) override;
+
+private:
+    shm_log_sink( const shm_log_sink& ) = delete;
+    shm_log_sink& operator=( const shm_log_sink& ) = delete;
+
+    struct impl;
+
+    std::unique_ptr<impl> m_impl;
+};
+
+/**
+ * Reader that follows the lines published by a shm_log_sink (possibly in another process).
+ *
+ * Lines are accessed in place, without copying them: peek() returns a view of the next line inside the
+ * shared memory, and consume() confirms that the line was not overwritten while it was being used and
+ * advances to the next one. If the reader falls behind the sink by more than the size of the ring, the
+ * lines overwritten are skipped and counted as lost, and so are the lines dropped by the sink because their
+ * slot was busy.
+ *
+ * A reader must only be used by a single thread.
+ */
+class Extended_API shm_log_reader
+{
+public:
+    /**
+     * View of a line inside the shared memory.
+     */
+    struct line_view
+    {
+        const char* text;       ///< Characters of the line (not null-terminated)
+        size_t length;          ///< Number of characters
+        int priority;           ///< Priority of the message
+        bool truncated;         ///< The line didn't fit into a slot
+        uint64_t sequence;      ///< Sequence number of the line
+    };
+
+    /**
+     * Constructor.
+     *
+     * @param[in] name Name of the shared memory object
+     * @param[in] fromOldest Starts reading from the oldest line still in the ring (otherwise, only new lines are read)
+     * @throw ext::runtime_error if the shared memory object can't be opened or it isn't a log ring
+     */
+    shm_log_reader( const char* name, bool fromOldest = true );
+
+    ~shm_log_reader();
+
+    /**
+     * Gets the next line, if already published.
+     *
+     * @param[out] view View of the line, valid until consume() is called
+     * @retval true if a line is available
+     * @retval false if there are no new lines
+     */
+    bool peek( line_view& view ) noexcept;
+
+    /**
+     * Advances past the line returned by the last call to peek().
+     *
+     * @retval true if the line remained intact while it was being used
+     * @retval false if the line was overwritten meanwhile (the data obtained from it must be discarded)
+     */
+    bool consume() noexcept;
+
+    /**
+     * Returns the number of lines that were overwritten before being read.
+     */
+    unsigned long long get_lost_count() const noexcept;
+
+private:
+    shm_log_reader( const shm_log_reader& ) = delete;
+    shm_log_reader& operator=( const shm_log_reader& ) = delete;
+
+    struct impl;
+
+    std::unique_ptr<impl> m_impl;
+};
+
+} // namespace
+
+///@}
+
+#endif // header guard
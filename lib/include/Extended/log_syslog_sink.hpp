@@ -0,0 +1,117 @@
+/**
+ * @file
+ * @brief      Header for the log sink that sends the log messages to the local syslog / journald daemon
+ * @authors    Jesus Gonzalez <jgonzalez@gdr-sistemas.com>
+ * @copyright  Copyright (c) 2003-2016 Jesus Gonzalez
+ * @license    See LICENSE.txt
+ */
+
+#ifndef Extended_log_syslog_sink_hpp_
+#define Extended_log_syslog_sink_hpp_
+
+///@addtogroup log
+///@{
+
+#include <stddef.h>
+#include <memory>
+#include <string>
+
+#include "log_pipeline.hpp"
+
+namespace ext
+{
+
+/**
+ * Log sink that sends the log messages to the local syslog or journald daemon through a Unix datagram
+ * socket (only available on POSIX systems).
+ *
+ * Each message is sent as a datagram, either as an RFC 5424 syslog message or in the native protocol of
+ * journald. The fields of structured messages are sent as structured data (RFC 5424) or as journal fields.
+ * Batches of messages (e.g. from the writer thread in asynchronous mode) are sent with a single system call.
+ *
+ * Sending never blocks the logging threads: messages that the daemon can't accept (because its queue is
+ * full or it's not running) are discarded and counted. When the daemon is restarted, the socket is
+ * reconnected on the next message, and if the daemon is not available yet, reconnection is retried once
+ * the reconnection interval has elapsed.
+ *
+ * Messages processed by this sink are not logged to console (unless other sink of the pipeline requests it).
+ */
+class Extended_API syslog_log_sink : public log_sink
+{
+public:
+    /**
+     * Protocol of the datagrams.
+     */
+    enum protocol
+    {
+        PROTOCOL_RFC5424,   ///< Syslog messages as described in RFC 5424
+        PROTOCOL_JOURNALD   ///< Native protocol of the systemd journal (KEY=value lines)
+    };
+
+    /**
+     * Configuration of the syslog sink.
+     */
+    struct options
+    {
+        std::string socket_path;                ///< Path of the socket of the daemon (empty = default of the protocol)
+        protocol format;                        ///< Protocol of the datagrams
+        int facility;                           ///< Syslog facility code (e.g. 1 = user, 16 = local0)
+        std::string app_name;                   ///< Name that identifies the program (empty = program name)
+        unsigned int reconnect_interval_ms;     ///< Minimum time between reconnection attempts
+
+        options()
+        : format( PROTOCOL_RFC5424 ), facility( 1 ), reconnect_interval_ms( 1000 )
+        {}
+    };
+
+    /**
+     * Constructor.
+     *
+     * The daemon doesn't need to be running, the socket is connected when it becomes available.
+     *
+     * @param[in] opts Configuration
+     * @param[in] logPriorityLimit Maximum priority of the messages sent to the daemon
+     * @throw ext::runtime_error if the path of the socket is too long
+     */
+    syslog_log_sink( const options& opts = options(), int logPriorityLimit = LOG_PRIORITY_ALLOC );
+
+    virtual ~syslog_log_sink();
+
+    /**
+     * Returns the path of the socket of the daemon.
+     */
+    const std::string& get_socket_path() const noexcept;
+
+    /**
+     * Indicates if the socket is currently connected to the daemon.
+     */
+    bool is_connected() const noexcept;
+
+    /**
+     * Returns the number of messages discarded because the daemon couldn't accept them.
+     */
+    unsigned long long get_dropped_count() const noexcept;
+
+    /**
+     * Returns the syslog severity corresponding to a log priority.
+     */
+    static int get_severity( int prio ) noexcept;
+
+    virtual bool process_record( const log_record& record ) override;
+
+    virtual void process_batch( const log_record* const* records, size_t count, bool* toConsole ) override;
+
+private:
+    syslog_log_sink( const syslog_log_sink& ) = delete;
+    syslog_log_sink& operator=( const syslog_log_sink& ) = delete;
+
+    struct impl;
+
+    std::unique_ptr<impl> m_impl;
+};
+
+} // namespace
+
+///@}
+
+#endif // header guard
@@ -72,7 +72,7 @@ public:
      * objects.
      *
      * @param[in] category Category of the error message (may be NULL)
-     * @param[in] function Name of the function or method where the error is thrown
+     * @param[in] function Simplified name of the function or method where the error is thrown
      * @param[in] log_on_throw If @c true, the error is logged immediately
      * @param[in] msg Textual description of the error
      */
@@ -92,7 +92,7 @@ public:
      * objects.
      *
      * @param[in] category Category of the error message (may be NULL)
-     * @param[in] function Name of the function or method where the error is thrown
+     * @param[in] function Simplified name of the function or method where the error is thrown
      * @param[in] log_on_throw If @c true, the error is logged immediately
      * @param[in] format Format string for the error message
      * @param[in] ... Variable parameters for the format string
@@ -163,12 +163,20 @@ private:
 
 ///@cond INTERNAL
 #define THROW_EXCEPTION( exception, str, ... ) \
-    throw exception( LOG_CATEGORY, __FUNCTION_INFO__, false, str, ##__VA_ARGS__ )
+    do \
+    { \
+        LOG_DECLARE_FUNCTION_NAME( __ext_throw_function ); \
+        throw exception( LOG_CATEGORY, __ext_throw_function.value, false, str, ##__VA_ARGS__ ); \
+    } while( 0 )
 
 #if LOG_PRIORITY_MAX >= LOG_PRIORITY_ERROR
 
 #define THROW_EXCEPTION_LOG( exception, str, ... ) \
-    throw exception( LOG_CATEGORY, __FUNCTION_INFO__, true, str, ##__VA_ARGS__ )
+    do \
+    { \
+        LOG_DECLARE_FUNCTION_NAME( __ext_throw_function ); \
+        throw exception( LOG_CATEGORY, __ext_throw_function.value, true, str, ##__VA_ARGS__ ); \
+    } while( 0 )
 
 #else
 
@@ -51,6 +51,16 @@ public:
      * @param[in] priority Priority of the thread
      */
     void set_priority( ThreadPriority priority );
+
+    /**
+     * Sets the name of the calling thread.
+     *
+     * The name is shown in the log messages generated by the thread, and it's also set as the name of the
+     * thread for the operating system where supported (truncated to 15 characters on Linux).
+     *
+     * @param[in] name Name of the thread
+     */
+    static void set_current_name( const char* name );
 };
 
 #ifdef _MSC_VER
@@ -0,0 +1,217 @@
+/**
+ * @file
+ * @brief      Implementation of the watcher that applies the log configuration file when it changes
+ * @authors    Jesus Gonzalez <jgonzalez@gdr-sistemas.com>
+ * @copyright  Copyright (c) 2003-2016 Jesus Gonzalez
+ * @license    See LICENSE.txt
+ */
+
+#include "../local_log.hpp"
+#include "Extended/log_config_watcher.hpp"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+#include "Extended/runtime_error.hpp"
+
+using namespace ext;
+
+#define EVENTS_BUFFER_SIZE  4096
+
+struct log_config_watcher::impl
+{
+    impl( const char* configPath, const log_config::sink_map& configSinks )
+    : path( configPath ), sinks( configSinks ), inotifyFd( -1 ), appliedCount( 0 )
+    {
+        stopPipe[0] = -1;
+        stopPipe[1] = -1;
+    }
+
+    ~impl()
+    {
+        close_fd( inotifyFd );
+        close_fd( stopPipe[0] );
+        close_fd( stopPipe[1] );
+    }
+
+    static void close_fd( int fd )
+    {
+        if( fd >= 0 )
+        {
+            close( fd );
+        }
+    }
+
+    void reload();
+    void watcher_main();
+
+    const std::string path;
+    std::string fileName;
+    const log_config::sink_map sinks;
+
+    int inotifyFd;
+    int stopPipe[2];
+
+    std::atomic<unsigned long long> appliedCount;
+
+    mutable std::mutex mutex;           // Protects lastError
+    std::string lastError;
+
+    std::thread watcher;
+};
+
+/**
+ * Reads the configuration file and applies it, unless it's not valid.
+ */
+void log_config_watcher::impl::reload()
+{
+    std::string error;
+
+    try
+    {
+        log_config::load( path.c_str() ).apply( sinks );
+        appliedCount.fetch_add( 1, std::memory_order_relaxed );
+    }
+    catch( ext::runtime_error& e )
+    {
+        error = e.what();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock( mutex );
+        lastError = error;
+    }
+
+    if( error.empty() )
+    {
+        log::log_message( LOG_PRIORITY_INFO, LOG_CATEGORY, "ext::log_config_watcher",
+                          "Log configuration applied from '%s'", path.c_str() );
+    }
+    else
+    {
+        log::log_message( LOG_PRIORITY_WARN, LOG_CATEGORY, "ext::log_config_watcher",
+                          "Log configuration not applied: %s", error.c_str() );
+    }
+}
+
+void log_config_watcher::impl::watcher_main()
+{
+    alignas( struct inotify_event ) char buffer[EVENTS_BUFFER_SIZE];
+
+    struct pollfd fds[2];
+    fds[0].fd = inotifyFd;
+    fds[0].events = POLLIN;
+    fds[1].fd = stopPipe[0];
+    fds[1].events = POLLIN;
+
+    for(;;)
+    {
+        if( poll( fds, 2, -1 ) < 0 )
+        {
+            // LCOV_EXCL_START
+            if( errno == EINTR )
+            {
+                continue;
+            }
+            break;
+            // LCOV_EXCL_STOP
+        }
+
+        if( fds[1].revents != 0 )
+        {
+            break;
+        }
+
+        // Several events are usually generated by a single change, the file is reloaded only once for all of them
+        bool changed = false;
+        ssize_t len;
+        while( ( len = read( inotifyFd, buffer, sizeof( buffer ) ) ) > 0 )
+        {
+            for( char* ptr = buffer; ptr < buffer + len; )
+            {
+                const struct inotify_event* event = (const struct inotify_event*) ptr;
+                if( ( event->len > 0 ) && ( fileName == event->name ) )
+                {
+                    changed = true;
+                }
+                ptr += sizeof( struct inotify_event ) + event->len;
+            }
+        }
+
+        if( changed )
+        {
+            reload();
+        }
+    }
+}
+
+log_config_watcher::log_config_watcher( const char* path, const log_config::sink_map& sinks )
+: m_impl( new impl( path, sinks ) )
+{
+    // The directory is watched instead of the file, so that replacing the file (which is how most editors and
+    // deployment tools change it) is also detected
+    std::string dir;
+    size_t slash = m_impl->path.rfind( '/' );
+    if( slash == std::string::npos )
+    {
+        dir = ".";
+        m_impl->fileName = m_impl->path;
+    }
+    else
+    {
+        dir = ( slash == 0 ) ? "/" : m_impl->path.substr( 0, slash );
+        m_impl->fileName = m_impl->path.substr( slash + 1 );
+    }
+
+    m_impl->inotifyFd = inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
+    if( ( m_impl->inotifyFd < 0 ) || m_impl->fileName.empty() ||
+        ( inotify_add_watch( m_impl->inotifyFd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO ) < 0 ) )
+    {
+        THROW_ERROR( "Error watching log configuration file '%s'", path );
+    }
+
+    if( pipe2( m_impl->stopPipe, O_CLOEXEC ) != 0 )
+    {
+        THROW_ERROR( "Error watching log configuration file '%s'", path ); // LCOV_EXCL_LINE
+    }
+
+    if( access( path, F_OK ) == 0 )
+    {
+        m_impl->reload();
+    }
+
+    m_impl->watcher = std::thread( &impl::watcher_main, m_impl.get() );
+}
+
+log_config_watcher::~log_config_watcher()
+{
+    // Wakes up the watcher thread (the pipe can't be full, nothing else is written to it)
+    char stop = 0;
+    ssize_t written = write( m_impl->stopPipe[1], &stop, 1 );
+    (void) written;
+
+    m_impl->watcher.join();
+}
+
+const std::string& log_config_watcher::get_path() const noexcept
+{
+    return m_impl->path;
+}
+
+unsigned long long log_config_watcher::get_applied_count() const noexcept
+{
+    return m_impl->appliedCount.load( std::memory_order_relaxed );
+}
+
+std::string log_config_watcher::get_last_error() const
+{
+    std::lock_guard<std::mutex> lock( m_impl->mutex );
+
+    return m_impl->lastError;
+}
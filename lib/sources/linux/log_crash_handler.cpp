@@ -0,0 +1,419 @@
+/**
+ * @file
+ * @brief      Implementation of the fatal signal handler of the log management system
+ * @authors    Jesus Gonzalez <jgonzalez@gdr-sistemas.com>
+ * @copyright  Copyright (c) 2003-2016 Jesus Gonzalez
+ * @license    See LICENSE.txt
+ */
+
+#include "../local_log.hpp"
+#include "Extended/log_crash_handler.hpp"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <execinfo.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <atomic>
+
+#include "Extended/runtime_error.hpp"
+#include "../log_internal.hpp"
+#include "../log_symbolizer.hpp"
+
+using namespace ext;
+using namespace ext::log_internal;
+
+#define CRASH_BACKTRACE_SIZE    64
+#define CRASH_LINE_SIZE         512
+
+namespace
+{
+
+/**
+ * Composes lines of text in a fixed buffer and writes them with raw system calls (async-signal-safe).
+ */
+class crash_writer
+{
+public:
+    explicit crash_writer( int fd ) noexcept
+    : m_fd( fd ), m_len( 0 )
+    {}
+
+    crash_writer& append( const char* str, size_t len ) noexcept
+    {
+        if( len > sizeof( m_buffer ) - m_len )
+        {
+            len = sizeof( m_buffer ) - m_len;
+        }
+        memcpy( m_buffer + m_len, str, len );
+        m_len += len;
+        return *this;
+    }
+
+    crash_writer& append( const char* str ) noexcept
+    {
+        return append( str, strlen( str ) );
+    }
+
+    crash_writer& append_dec( unsigned long long value ) noexcept
+    {
+        char digits[20];
+        size_t count = 0;
+        do
+        {
+            digits[sizeof( digits ) - ++count] = (char) ( '0' + ( value % 10 ) );
+            value /= 10;
+        } while( value > 0 );
+        return append( digits + sizeof( digits ) - count, count );
+    }
+
+    crash_writer& append_hex( uintptr_t value ) noexcept
+    {
+        static const char hexDigits[] = "0123456789abcdef";
+        char digits[2 + 2 * sizeof( uintptr_t )];
+        size_t count = 0;
+        do
+        {
+            digits[sizeof( digits ) - ++count] = hexDigits[value & 0xF];
+            value >>= 4;
+        } while( value > 0 );
+        digits[sizeof( digits ) - ++count] = 'x';
+        digits[sizeof( digits ) - ++count] = '0';
+        return append( digits + sizeof( digits ) - count, count );
+    }
+
+    /**
+     * Writes the composed text, and empties the buffer.
+     */
+    void flush() noexcept
+    {
+        const char* data = m_buffer;
+        size_t pending = m_len;
+        while( pending > 0 )
+        {
+            ssize_t written = write( m_fd, data, pending );
+            if( written <= 0 )
+            {
+                if( ( written < 0 ) && ( errno == EINTR ) )
+                {
+                    continue;
+                }
+                break;
+            }
+            data += written;
+            pending -= written;
+        }
+        m_len = 0;
+    }
+
+private:
+    const int m_fd;
+    char m_buffer[CRASH_LINE_SIZE];
+    size_t m_len;
+};
+
+/**
+ * Alternate signal stack of a thread.
+ */
+class alternate_stack
+{
+public:
+    alternate_stack() noexcept
+    : m_memory( NULL )
+    {}
+
+    ~alternate_stack()
+    {
+        if( m_memory != NULL )
+        {
+            stack_t ss;
+            memset( &ss, 0, sizeof( ss ) );
+            ss.ss_flags = SS_DISABLE;
+            sigaltstack( &ss, NULL );
+            free( m_memory );
+        }
+    }
+
+    void prepare( size_t size )
+    {
+        if( m_memory != NULL )
+        {
+            return;
+        }
+
+        if( size < (size_t) MINSIGSTKSZ )
+        {
+            size = MINSIGSTKSZ; // LCOV_EXCL_LINE
+        }
+
+        void* memory = malloc( size );
+        if( memory == NULL )
+        {
+            THROW_ERROR( "Error allocating the alternate signal stack" ); // LCOV_EXCL_LINE
+        }
+
+        stack_t ss;
+        memset( &ss, 0, sizeof( ss ) );
+        ss.ss_sp = memory;
+        ss.ss_size = size;
+        if( sigaltstack( &ss, NULL ) != 0 )
+        {
+            // LCOV_EXCL_START
+            free( memory );
+            THROW_ERROR( "Error setting the alternate signal stack (errno = %d)", errno );
+            // LCOV_EXCL_STOP
+        }
+
+        m_memory = memory;
+    }
+
+private:
+    void* m_memory;
+};
+
+} // namespace
+
+static const int g_signals[] = { SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT };
+static const char* const g_signalNames[] = { "SIGSEGV", "SIGBUS", "SIGFPE", "SIGILL", "SIGABRT" };
+
+static std::atomic<bool> g_installed( false );
+static log_crash_handler::options g_options;
+
+// Thread that is handling a fatal signal (0 = none)
+static std::atomic<long> g_crashingThread( 0 );
+
+static thread_local alternate_stack t_stack;
+
+static const char* get_signal_name( int sig ) noexcept
+{
+    for( size_t i = 0; i < sizeof( g_signals ) / sizeof( g_signals[0] ); i++ )
+    {
+        if( g_signals[i] == sig )
+        {
+            return g_signalNames[i];
+        }
+    }
+    return "unknown";
+}
+
+static void sleep_ms( unsigned int ms ) noexcept
+{
+    struct timespec delay = { (time_t) ( ms / 1000 ), (long) ( ms % 1000 ) * 1000000L };
+    while( ( nanosleep( &delay, &delay ) != 0 ) && ( errno == EINTR ) )
+    {
+    }
+}
+
+static void write_header( crash_writer& out, int sig, const siginfo_t* info, long tid ) noexcept
+{
+    out.append( "*** Fatal signal " ).append_dec( sig ).append( " (" ).append( get_signal_name( sig ) ).append( ")" );
+
+    if( sig != SIGABRT )
+    {
+        out.append( ", code " ).append_dec( info->si_code ).append( ", address " ).append_hex( (uintptr_t) info->si_addr );
+    }
+
+    char name[16] = { 0 };
+    prctl( PR_GET_NAME, name, 0, 0, 0 );
+
+    out.append( ", pid " ).append_dec( getpid() ).append( ", thread " ).append_dec( tid );
+    if( name[0] != '\0' )
+    {
+        out.append( " (" ).append( name ).append( ")" );
+    }
+    out.append( " ***\n" );
+    out.flush();
+}
+
+static void write_backtrace( crash_writer& out ) noexcept
+{
+    void* frames[CRASH_BACKTRACE_SIZE];
+    int count = backtrace( frames, CRASH_BACKTRACE_SIZE );
+
+    out.append( "Backtrace:\n" );
+    out.flush();
+
+    for( int i = 0; i < count; i++ )
+    {
+        out.append( "[" ).append_dec( i ).append( "]: " ).append_hex( (uintptr_t) frames[i] );
+
+        // Symbols were loaded when the handler was installed, names can't be demangled without allocating
+        const char* module;
+        const char* function;
+        uintptr_t offset;
+        if( symbolize_raw( frames[i], module, function, offset ) )
+        {
+            out.append( " " ).append( module ).append( "(" );
+            if( function != NULL )
+            {
+                out.append( function );
+            }
+            out.append( "+" ).append_hex( offset ).append( ")" );
+        }
+
+        out.append( "\n" );
+        out.flush();
+    }
+}
+
+/**
+ * Copies the executable mappings from /proc/self/maps, which locate the modules the addresses of the
+ * backtrace belong to.
+ */
+static void write_mappings( crash_writer& out ) noexcept
+{
+    int fd = open( "/proc/self/maps", O_RDONLY | O_CLOEXEC );
+    if( fd < 0 )
+    {
+        return; // LCOV_EXCL_LINE
+    }
+
+    out.append( "Executable mappings:\n" );
+    out.flush();
+
+    char chunk[1024];
+    char line[CRASH_LINE_SIZE];
+    size_t lineLen = 0;
+    ssize_t size;
+
+    while( ( size = read( fd, chunk, sizeof( chunk ) ) ) > 0 )
+    {
+        for( ssize_t i = 0; i < size; i++ )
+        {
+            if( lineLen < sizeof( line ) - 1 )
+            {
+                line[lineLen++] = chunk[i];
+            }
+
+            if( chunk[i] == '\n' )
+            {
+                // Lines start with "<start>-<end> <perms>", where the third permission is 'x' for code
+                const char* perms = (const char*) memchr( line, ' ', lineLen );
+                if( ( perms != NULL ) && ( perms + 3 < line + lineLen ) && ( perms[3] == 'x' ) )
+                {
+                    if( line[lineLen - 1] != '\n' )
+                    {
+                        line[lineLen++] = '\n';
+                    }
+                    out.append( line, lineLen );
+                    out.flush();
+                }
+                lineLen = 0;
+            }
+        }
+    }
+
+    close( fd );
+}
+
+/**
+ * Waits (for a bounded time) until the writer thread has processed the messages queued in asynchronous
+ * mode, and then writes the data buffered by the sinks.
+ */
+static void flush_logs() noexcept
+{
+    if( !async_is_writer_thread() )
+    {
+        for( unsigned int elapsed = 0; !async_is_drained() && ( elapsed < g_options.flush_timeout_ms ); elapsed++ )
+        {
+            sleep_ms( 1 );
+        }
+    }
+
+    crash_flush_all();
+}
+
+static void crash_signal_handler( int sig, siginfo_t* info, void* context ) noexcept
+{
+    (void) context;
+
+    long tid = (long) syscall( SYS_gettid );
+
+    long expected = 0;
+    if( !g_crashingThread.compare_exchange_strong( expected, tid ) && ( expected != tid ) )
+    {
+        // Other thread is already handling a crash, and it will terminate the process
+        for(;;)
+        {
+            sleep_ms( 1000 );
+        }
+    }
+
+    // A crash while handling a crash terminates the process immediately
+    if( expected != tid )
+    {
+        crash_writer out( g_options.fd );
+
+        write_header( out, sig, info, tid );
+        write_backtrace( out );
+        write_mappings( out );
+
+        flush_logs();
+
+        out.append( "*** End of crash report ***\n" );
+        out.flush();
+    }
+
+    // The signal is blocked while it's being handled, therefore it's delivered again (with the default
+    // action) when the handler returns
+    signal( sig, SIG_DFL );
+    raise( sig );
+}
+
+void log_crash_handler::install( const options& opts )
+{
+    t_stack.prepare( opts.stack_size );
+
+    g_options = opts;
+
+    // The first call to backtrace() may allocate memory to load the unwinder, therefore it's done now
+    void* frames[1];
+    backtrace( frames, 1 );
+
+    preload_symbols();
+
+    struct sigaction action;
+    memset( &action, 0, sizeof( action ) );
+    action.sa_sigaction = crash_signal_handler;
+    action.sa_flags = SA_SIGINFO | SA_ONSTACK;
+    sigemptyset( &action.sa_mask );
+
+    for( int sig : g_signals )
+    {
+        if( sigaction( sig, &action, NULL ) != 0 )
+        {
+            // LCOV_EXCL_START
+            uninstall();
+            THROW_ERROR( "Error installing the handler for signal %d (errno = %d)", sig, errno );
+            // LCOV_EXCL_STOP
+        }
+    }
+
+    g_installed.store( true );
+}
+
+void log_crash_handler::uninstall() noexcept
+{
+    for( int sig : g_signals )
+    {
+        signal( sig, SIG_DFL );
+    }
+
+    g_installed.store( false );
+}
+
+bool log_crash_handler::is_installed() noexcept
+{
+    return g_installed.load();
+}
+
+void log_crash_handler::prepare_thread()
+{
+    t_stack.prepare( g_options.stack_size );
+}
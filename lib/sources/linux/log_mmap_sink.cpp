@@ -0,0 +1,429 @@
+/**
+ * @file
+ * @brief      Implementation of the memory-mapped log file sink
+ * @authors    Jesus Gonzalez <jgonzalez@gdr-sistemas.com>
+ * @copyright  Copyright (c) 2003-2016 Jesus Gonzalez
+ * @license    See LICENSE.txt
+ */
+
+#include "../local_log.hpp"
+#include "Extended/log_mmap_sink.hpp"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <vector>
+#include <algorithm>
+
+#include "Extended/runtime_error.hpp"
+#include "../log_internal.hpp"
+#include "../log_rcu.hpp"
+#include "../log_line.hpp"
+
+using namespace ext;
+using namespace ext::log_internal;
+
+#define RECOVERY_CHUNK_SIZE 65536
+
+namespace
+{
+
+/**
+ * Mapped file segment.
+ *
+ * Logging threads access the current segment inside a read section, therefore once a segment has been
+ * replaced and retired, it's destroyed (unmapped and truncated) only after all the copies into it have
+ * finished.
+ */
+class log_segment : public rcu_object
+{
+public:
+    log_segment( int fd, char* base, uint64_t size ) noexcept
+    : m_fd( fd ), m_base( base ), m_size( size ), m_offset( 0 ), m_used( UINT64_MAX )
+    {}
+
+    virtual ~log_segment()
+    {
+        munmap( m_base, m_size );
+
+        uint64_t used = m_used.load( std::memory_order_relaxed );
+        if( used == UINT64_MAX )
+        {
+            used = std::min( m_offset.load( std::memory_order_relaxed ), m_size );
+        }
+        if( ftruncate( m_fd, used ) != 0 )
+        {
+            // Nothing can be done, the padding can be removed later with recover_file()
+        }
+        close( m_fd );
+    }
+
+    /**
+     * Reserves space for @p len bytes.
+     *
+     * @return Pointer to the reserved space, or NULL if there isn't enough space in the segment
+     */
+    char* reserve( uint64_t len ) noexcept
+    {
+        uint64_t start = m_offset.fetch_add( len, std::memory_order_relaxed );
+
+        if( start + len <= m_size )
+        {
+            return m_base + start;
+        }
+
+        // Reservations are consecutive, therefore only the first reservation that doesn't fit can start
+        // inside the segment, and its start is the size actually used
+        if( start <= m_size )
+        {
+            m_used.store( start, std::memory_order_relaxed );
+        }
+
+        return NULL;
+    }
+
+    uint64_t get_size() const noexcept
+    {
+        return m_size;
+    }
+
+private:
+    const int m_fd;
+    char* const m_base;
+    const uint64_t m_size;
+    std::atomic<uint64_t> m_offset;
+    std::atomic<uint64_t> m_used;
+};
+
+} // namespace
+
+struct mmap_log_sink::impl
+{
+    impl( const char* filePath, const options& sinkOptions )
+    : path( filePath ), opts( sinkOptions ), current( NULL ), droppedCount( 0 ), stop( false )
+    {}
+
+    log_segment* create_segment();
+    bool roll( log_segment* full );
+    char* reserve( uint64_t len );
+    void write( const log_line& line );
+    void retirer_main();
+
+    const std::string path;
+    const options opts;
+
+    std::atomic<log_segment*> current;
+    std::atomic<unsigned long long> droppedCount;
+
+    std::mutex mutex;                   // Serializes rolling the segments
+    std::condition_variable retirerCv;
+    std::vector<log_segment*> retired;  // Segments pending to be destroyed
+    bool stop;
+    std::thread retirer;
+};
+
+/**
+ * Creates a new segment, keeping the current file as a backup.
+ *
+ * @return The new segment, or NULL if it couldn't be created
+ */
+log_segment* mmap_log_sink::impl::create_segment()
+{
+    // A previous attempt that failed may have already moved the file to the backups
+    if( access( path.c_str(), F_OK ) == 0 )
+    {
+        shift_backup_files( path, opts.max_backup_files );
+    }
+
+    // The file of the previous segment may be still mapped, therefore a new file must be created
+    unlink( path.c_str() );
+
+    int fd = open( path.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644 );
+    if( fd < 0 )
+    {
+        return NULL;
+    }
+
+    if( ftruncate( fd, opts.segment_size ) != 0 )
+    {
+        // LCOV_EXCL_START
+        close( fd );
+        return NULL;
+        // LCOV_EXCL_STOP
+    }
+
+    void* base = mmap( NULL, opts.segment_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+    if( base == MAP_FAILED )
+    {
+        // LCOV_EXCL_START
+        close( fd );
+        return NULL;
+        // LCOV_EXCL_STOP
+    }
+
+    return new log_segment( fd, (char*) base, opts.segment_size );
+}
+
+/**
+ * Replaces a full segment by a new one (unless another thread has already done it).
+ *
+ * If the new segment can't be created, the full segment is kept as the current one, so that the creation is
+ * retried on the next reservation.
+ *
+ * @return false if the new segment couldn't be created
+ */
+bool mmap_log_sink::impl::roll( log_segment* full )
+{
+    std::lock_guard<std::mutex> lock( mutex );
+
+    if( current.load( std::memory_order_relaxed ) != full )
+    {
+        return true;
+    }
+
+    log_segment* segment = create_segment();
+    if( segment == NULL )
+    {
+        return false;
+    }
+
+    current.store( segment, std::memory_order_release );
+
+    // The calling thread is inside a read section, therefore the segment must be destroyed by other thread
+    retired.push_back( full );
+    retirerCv.notify_one();
+
+    return true;
+}
+
+/**
+ * Reserves space in the current segment, rolling to a new segment if needed (must be called inside a read
+ * section, which must not be exited until the reserved space has been filled).
+ *
+ * @return Pointer to the reserved space, or NULL if the space couldn't be reserved
+ */
+char* mmap_log_sink::impl::reserve( uint64_t len )
+{
+    for(;;)
+    {
+        log_segment* segment = current.load( std::memory_order_acquire );
+
+        if( ( segment == NULL ) || ( len > segment->get_size() ) )
+        {
+            return NULL;
+        }
+
+        char* dst = segment->reserve( len );
+        if( dst != NULL )
+        {
+            return dst;
+        }
+
+        if( !roll( segment ) )
+        {
+            return NULL;
+        }
+    }
+}
+
+/**
+ * Writes a line into the current segment (must be called inside a read section).
+ */
+void mmap_log_sink::impl::write( const log_line& line )
+{
+    char* dst = reserve( line.size() );
+    if( dst != NULL )
+    {
+        line.copy_to( dst );
+        stats_count_bytes( line.size() );
+    }
+    else
+    {
+        droppedCount.fetch_add( 1, std::memory_order_relaxed );
+    }
+}
+
+void mmap_log_sink::impl::retirer_main()
+{
+    std::vector<log_segment*> segments;
+
+    std::unique_lock<std::mutex> lock( mutex );
+
+    for(;;)
+    {
+        while( retired.empty() && !stop )
+        {
+            retirerCv.wait( lock );
+        }
+
+        if( retired.empty() )
+        {
+            break;
+        }
+
+        segments.swap( retired );
+
+        lock.unlock();
+
+        for( log_segment* segment : segments )
+        {
+            rcu_retire( segment );
+        }
+        segments.clear();
+
+        lock.lock();
+    }
+}
+
+mmap_log_sink::mmap_log_sink( const char* path, const options& opts, int logPriorityLimit )
+: log_sink( logPriorityLimit ), m_impl( new impl( path, opts ) )
+{
+    recover_file( path );
+
+    log_segment* segment = m_impl->create_segment();
+    if( segment == NULL )
+    {
+        THROW_ERROR( "Error creating log file '%s'", path );
+    }
+
+    m_impl->current.store( segment, std::memory_order_release );
+    m_impl->retirer = std::thread( &impl::retirer_main, m_impl.get() );
+}
+
+mmap_log_sink::~mmap_log_sink()
+{
+    {
+        std::lock_guard<std::mutex> lock( m_impl->mutex );
+        m_impl->stop = true;
+        m_impl->retirerCv.notify_one();
+    }
+
+    m_impl->retirer.join();
+
+    rcu_retire( m_impl->current.exchange( NULL ) );
+}
+
+const std::string& mmap_log_sink::get_path() const noexcept
+{
+    return m_impl->path;
+}
+
+unsigned long long mmap_log_sink::get_dropped_count() const noexcept
+{
+    return m_impl->droppedCount.load( std::memory_order_relaxed );
+}
+
+bool mmap_log_sink::recover_file( const char* path )
+{
+    int fd = open( path, O_RDWR | O_CLOEXEC );
+    if( fd < 0 )
+    {
+        return ( errno == ENOENT );
+    }
+
+    struct stat st;
+    if( fstat( fd, &st ) != 0 )
+    {
+        // LCOV_EXCL_START
+        close( fd );
+        return false;
+        // LCOV_EXCL_STOP
+    }
+
+    // Look backwards for the last character that is not padding
+    char buffer[RECOVERY_CHUNK_SIZE];
+    off_t end = st.st_size;
+    off_t used = 0;
+    while( end > 0 )
+    {
+        off_t start = ( end > RECOVERY_CHUNK_SIZE ) ? ( end - RECOVERY_CHUNK_SIZE ) : 0;
+        ssize_t size = pread( fd, buffer, end - start, start );
+        if( size != ( end - start ) )
+        {
+            // LCOV_EXCL_START
+            close( fd );
+            return false;
+            // LCOV_EXCL_STOP
+        }
+
+        ssize_t i = size;
+        while( ( i > 0 ) && ( buffer[i - 1] == '\0' ) )
+        {
+            i--;
+        }
+
+        if( i > 0 )
+        {
+            used = start + i;
+            break;
+        }
+
+        end = start;
+    }
+
+    bool ret = ( used == st.st_size ) || ( ftruncate( fd, used ) == 0 );
+
+    close( fd );
+
+    return ret;
+}
+
+bool mmap_log_sink::process_record( const log_record& record )
+{
+    log_line line( record );
+
+    rcu_read_guard guard;
+
+    m_impl->write( line );
+
+    return false;
+}
+
+void mmap_log_sink::process_batch( const log_record* const* records, size_t count, bool* toConsole )
+{
+    // Each line is composed only once, because the console format can be changed concurrently and the lines
+    // copied must have exactly the size reserved for them
+    log_line lines[LOG_BATCH_SIZE];
+
+    for( size_t base = 0; base < count; base += LOG_BATCH_SIZE )
+    {
+        size_t lineCount = std::min( count - base, (size_t) LOG_BATCH_SIZE );
+        size_t size = 0;
+
+        for( size_t i = 0; i < lineCount; i++ )
+        {
+            lines[i].compose( *records[base + i] );
+            size += lines[i].size();
+            toConsole[base + i] = false;
+        }
+
+        rcu_read_guard guard;
+
+        // The lines are written with a single reservation, unless they don't fit into a segment
+        char* dst = m_impl->reserve( size );
+        if( dst == NULL )
+        {
+            for( size_t i = 0; i < lineCount; i++ )
+            {
+                m_impl->write( lines[i] );
+            }
+            continue;
+        }
+
+        for( size_t i = 0; i < lineCount; i++ )
+        {
+            dst = lines[i].copy_to( dst );
+        }
+
+        stats_count_bytes( size );
+    }
+}
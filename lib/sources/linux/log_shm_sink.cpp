@@ -0,0 +1,400 @@
+/**
+ * @file
+ * @brief      Implementation of the log sink that publishes the log messages into a shared memory ring
+ * @authors    Jesus Gonzalez <jgonzalez@gdr-sistemas.com>
+ * @copyright  Copyright (c) 2003-2016 Jesus Gonzalez
+ * @license    See LICENSE.txt
+ */
+
+#include "../local_log.hpp"
+#include "Extended/log_shm_sink.hpp"
+
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <atomic>
+#include <new>
+
+#include "Extended/runtime_error.hpp"
+#include "../log_internal.hpp"
+#include "../log_line.hpp"
+
+using namespace ext;
+using namespace ext::log_internal;
+
+#define RING_MAGIC          "EXTLOGR1"
+#define RING_MAGIC_SIZE     8
+#define RING_DATA_OFFSET    128
+#define SLOT_HEADER_SIZE    16
+#define MIN_SLOT_SIZE       32
+
+#define SLOT_FLAG_TRUNCATED 1
+
+#if ATOMIC_LLONG_LOCK_FREE != 2
+#error "Lock-free 64-bit atomics are required to share them between processes"
+#endif
+
+namespace
+{
+
+/**
+ * Header at the start of the shared memory, followed by the slots (at RING_DATA_OFFSET).
+ *
+ * The magic is written last, once the rest of the ring has been initialized.
+ */
+struct ring_header
+{
+    char magic[RING_MAGIC_SIZE];
+    uint32_t slotSize;
+    uint32_t reserved;
+    uint64_t slotCount;
+    alignas( 64 ) std::atomic<uint64_t> writeIndex;     // Index of the next slot to be claimed
+};
+
+/**
+ * Header of a slot, followed by the characters of the line.
+ *
+ * The sequence number of a slot is 0 while it has never been used; while the line with a given index is
+ * being written it's (index + 1) * 2, and once published (index + 1) * 2 + 1. Readers check it before
+ * and after accessing the line, so that they can detect that the line was overwritten meanwhile.
+ */
+struct slot_header
+{
+    std::atomic<uint64_t> sequence;
+    uint32_t length;
+    int16_t priority;
+    uint16_t flags;
+};
+
+static_assert( sizeof( ring_header ) <= RING_DATA_OFFSET, "Ring header doesn't fit" );
+static_assert( sizeof( slot_header ) == SLOT_HEADER_SIZE, "Unexpected slot header size" );
+
+} // namespace
+
+static uint64_t get_writing_sequence( uint64_t index )
+{
+    return ( index + 1 ) * 2;
+}
+
+static uint64_t get_published_sequence( uint64_t index )
+{
+    return ( index + 1 ) * 2 + 1;
+}
+
+static size_t get_ring_size( uint64_t slotCount, uint64_t slotSize )
+{
+    return RING_DATA_OFFSET + slotCount * slotSize;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Sink
+//////////////////////////////////////////////////////////////////////////////
+
+struct shm_log_sink::impl
+{
+    impl( const char* shmName, const options& sinkOptions )
+    : name( shmName ), opts( sinkOptions ), base( NULL ), size( 0 ), header( NULL ), slotCount( 2 ),
+      slotSize( 0 ), droppedCount( 0 )
+    {}
+
+    slot_header* get_slot( uint64_t index ) const
+    {
+        return (slot_header*) ( base + RING_DATA_OFFSET + ( index & ( slotCount - 1 ) ) * slotSize );
+    }
+
+    void publish( const log_record& record );
+
+    const std::string name;
+    const options opts;
+
+    char* base;
+    size_t size;
+    ring_header* header;
+    uint64_t slotCount;
+    uint64_t slotSize;
+
+    std::atomic<unsigned long long> droppedCount;
+};
+
+void shm_log_sink::impl::publish( const log_record& record )
+{
+    log_line line( record );
+
+    uint64_t index = header->writeIndex.fetch_add( 1, std::memory_order_relaxed );
+    slot_header* slot = get_slot( index );
+
+    // The slot may hold the line of any earlier lap (e.g. if the writer of the previous lap dropped its line),
+    // but it can't be claimed while another writer is copying its line, or if a later lap has already claimed it
+    uint64_t writing = get_writing_sequence( index );
+    uint64_t current = slot->sequence.load( std::memory_order_relaxed );
+    do
+    {
+        if( ( ( current != 0 ) && ( ( current & 1 ) == 0 ) ) || ( current >= writing ) )
+        {
+            droppedCount.fetch_add( 1, std::memory_order_relaxed );
+            return;
+        }
+    }
+    while( !slot->sequence.compare_exchange_weak( current, writing, std::memory_order_relaxed ) );
+
+    // Readers must see the slot as being written before any of its contents changes
+    std::atomic_thread_fence( std::memory_order_release );
+
+    size_t maxLength = slotSize - SLOT_HEADER_SIZE;
+    slot->length = (uint32_t) line.copy_to( (char*) ( slot + 1 ), maxLength );
+    slot->priority = (int16_t) record.priority();
+    slot->flags = ( line.size() > maxLength ) ? SLOT_FLAG_TRUNCATED : 0;
+
+    slot->sequence.store( get_published_sequence( index ), std::memory_order_release );
+
+    stats_count_bytes( slot->length );
+}
+
+shm_log_sink::shm_log_sink( const char* name, const options& opts, int logPriorityLimit )
+: log_sink( logPriorityLimit ), m_impl( new impl( name, opts ) )
+{
+    while( m_impl->slotCount < opts.slot_count )
+    {
+        m_impl->slotCount <<= 1;
+    }
+    m_impl->slotSize = ( std::max( opts.slot_size, (size_t) MIN_SLOT_SIZE ) + SLOT_HEADER_SIZE - 1 ) & ~( (size_t) SLOT_HEADER_SIZE - 1 );
+    m_impl->size = get_ring_size( m_impl->slotCount, m_impl->slotSize );
+
+    // Readers of a previous ring with the same name keep their mapping
+    shm_unlink( name );
+
+    int fd = shm_open( name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644 );
+    if( fd < 0 )
+    {
+        THROW_ERROR( "Error creating shared memory '%s'", name );
+    }
+
+    void* base = MAP_FAILED;
+    if( ftruncate( fd, m_impl->size ) == 0 )
+    {
+        base = mmap( NULL, m_impl->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+    }
+    close( fd );
+
+    if( base == MAP_FAILED )
+    {
+        // LCOV_EXCL_START
+        shm_unlink( name );
+        THROW_ERROR( "Error mapping shared memory '%s'", name );
+        // LCOV_EXCL_STOP
+    }
+
+    // The memory is zero-filled, therefore all the slots have sequence number 0
+    m_impl->base = (char*) base;
+    m_impl->header = new( base ) ring_header();
+    m_impl->header->slotSize = (uint32_t) m_impl->slotSize;
+    m_impl->header->slotCount = m_impl->slotCount;
+    m_impl->header->writeIndex.store( 0, std::memory_order_relaxed );
+
+    std::atomic_thread_fence( std::memory_order_release );
+    memcpy( m_impl->header->magic, RING_MAGIC, RING_MAGIC_SIZE );
+}
+
+shm_log_sink::~shm_log_sink()
+{
+    munmap( m_impl->base, m_impl->size );
+
+    if( m_impl->opts.remove_on_close )
+    {
+        shm_unlink( m_impl->name.c_str() );
+    }
+}
+
+const std::string& shm_log_sink::get_name() const noexcept
+{
+    return m_impl->name;
+}
+
+unsigned long long shm_log_sink::get_dropped_count() const noexcept
+{
+    return m_impl->droppedCount.load( std::memory_order_relaxed );
+}
+
+bool shm_log_sink::process_record( const log_record& record )
+{
+    m_impl->publish( record );
+
+    return false;
+}
+
+void shm_log_sink::process_batch( const log_record* const* records, size_t count, bool* toConsole )
+{
+    for( size_t i = 0; i < count; i++ )
+    {
+        m_impl->publish( *records[i] );
+        toConsole[i] = false;
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Reader
+//////////////////////////////////////////////////////////////////////////////
+
+struct shm_log_reader::impl
+{
+    impl()
+    : base( NULL ), size( 0 ), header( NULL ), slotCount( 0 ), slotSize( 0 ), next( 0 ), lostCount( 0 )
+    {}
+
+    const slot_header* get_slot( uint64_t index ) const
+    {
+        return (const slot_header*) ( base + RING_DATA_OFFSET + ( index & ( slotCount - 1 ) ) * slotSize );
+    }
+
+    void skip_overwritten();
+
+    const char* base;
+    size_t size;
+    const ring_header* header;
+    uint64_t slotCount;
+    uint64_t slotSize;
+    uint64_t next;
+    unsigned long long lostCount;
+};
+
+/**
+ * Skips the lines that have been (or are about to be) overwritten, advancing to the oldest line still
+ * in the ring.
+ */
+void shm_log_reader::impl::skip_overwritten()
+{
+    uint64_t writeIndex = header->writeIndex.load( std::memory_order_acquire );
+    uint64_t oldest = ( writeIndex > slotCount ) ? ( writeIndex - slotCount ) : 0;
+
+    if( oldest <= next )
+    {
+        oldest = next + 1; // LCOV_EXCL_LINE
+    }
+
+    lostCount += oldest - next;
+    next = oldest;
+}
+
+shm_log_reader::shm_log_reader( const char* name, bool fromOldest )
+: m_impl( new impl() )
+{
+    int fd = shm_open( name, O_RDONLY | O_CLOEXEC, 0 );
+    if( fd < 0 )
+    {
+        THROW_ERROR( "Error opening shared memory '%s'", name );
+    }
+
+    struct stat st;
+    void* base = MAP_FAILED;
+    if( ( fstat( fd, &st ) == 0 ) && ( (size_t) st.st_size >= RING_DATA_OFFSET ) )
+    {
+        base = mmap( NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+    }
+    close( fd );
+
+    if( base == MAP_FAILED )
+    {
+        THROW_ERROR( "Shared memory '%s' is not a log ring", name );
+    }
+
+    m_impl->base = (const char*) base;
+    m_impl->size = st.st_size;
+    m_impl->header = (const ring_header*) base;
+
+    bool valid = ( memcmp( m_impl->header->magic, RING_MAGIC, RING_MAGIC_SIZE ) == 0 );
+    std::atomic_thread_fence( std::memory_order_acquire );
+
+    if( valid )
+    {
+        m_impl->slotCount = m_impl->header->slotCount;
+        m_impl->slotSize = m_impl->header->slotSize;
+        valid = ( m_impl->slotCount > 0 ) && ( ( m_impl->slotCount & ( m_impl->slotCount - 1 ) ) == 0 ) &&
+                ( m_impl->slotSize >= MIN_SLOT_SIZE ) && ( get_ring_size( m_impl->slotCount, m_impl->slotSize ) <= m_impl->size );
+    }
+
+    if( !valid )
+    {
+        munmap( base, m_impl->size );
+        THROW_ERROR( "Shared memory '%s' is not a log ring", name );
+    }
+
+    uint64_t writeIndex = m_impl->header->writeIndex.load( std::memory_order_acquire );
+    if( fromOldest )
+    {
+        m_impl->next = ( writeIndex > m_impl->slotCount ) ? ( writeIndex - m_impl->slotCount ) : 0;
+    }
+    else
+    {
+        m_impl->next = writeIndex;
+    }
+}
+
+shm_log_reader::~shm_log_reader()
+{
+    munmap( (void*) m_impl->base, m_impl->size );
+}
+
+bool shm_log_reader::peek( line_view& view ) noexcept
+{
+    for(;;)
+    {
+        const slot_header* slot = m_impl->get_slot( m_impl->next );
+        uint64_t sequence = slot->sequence.load( std::memory_order_acquire );
+        uint64_t expected = get_published_sequence( m_impl->next );
+
+        if( sequence == expected )
+        {
+            view.text = (const char*) ( slot + 1 );
+            view.length = std::min( (uint64_t) slot->length, m_impl->slotSize - SLOT_HEADER_SIZE );
+            view.priority = slot->priority;
+            view.truncated = ( slot->flags & SLOT_FLAG_TRUNCATED ) != 0;
+            view.sequence = m_impl->next;
+            return true;
+        }
+
+        uint64_t writeIndex = m_impl->header->writeIndex.load( std::memory_order_acquire );
+        if( ( sequence < expected ) && ( writeIndex <= m_impl->next + m_impl->slotCount ) )
+        {
+            if( ( ( sequence & 1 ) == 0 ) || ( writeIndex <= m_impl->next ) )
+            {
+                // Not published yet
+                return false;
+            }
+
+            // The line has been claimed but the slot still holds a line of an earlier lap: its writer abandoned
+            // it because the slot was busy (or has not claimed the slot yet, which is treated the same way
+            // rather than waiting for a whole lap)
+            m_impl->lostCount++;
+            m_impl->next++;
+            continue;
+        }
+
+        // Already reused by a later line
+        m_impl->skip_overwritten();
+    }
+}
+
+bool shm_log_reader::consume() noexcept
+{
+    // The line has been read, now check that the slot was not claimed again meanwhile
+    std::atomic_thread_fence( std::memory_order_acquire );
+    uint64_t sequence = m_impl->get_slot( m_impl->next )->sequence.load( std::memory_order_relaxed );
+    bool intact = ( sequence == get_published_sequence( m_impl->next ) );
+
+    if( !intact )
+    {
+        m_impl->lostCount++;
+    }
+
+    m_impl->next++;
+
+    return intact;
+}
+
+unsigned long long shm_log_reader::get_lost_count() const noexcept
+{
+    return m_impl->lostCount;
+}
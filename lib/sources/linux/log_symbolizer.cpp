@@ -0,0 +1,437 @@
+/**
+ * @file
+ * @brief      Implementation of the symbolizer of backtrace addresses
+ * @authors    Jesus Gonzalez <jgonzalez@gdr-sistemas.com>
+ * @copyright  Copyright (c) 2003-2016 Jesus Gonzalez
+ * @license    See LICENSE.txt
+ */
+
+#include "../log_symbolizer.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <link.h>
+#include <unistd.h>
+#include <cxxabi.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+using namespace ext::log_internal;
+
+namespace
+{
+
+/**
+ * Function symbol of a module.
+ */
+struct elf_symbol
+{
+    uintptr_t address;  // Relative to the load address of the module
+    uintptr_t size;
+    uint32_t name;      // Offset of the name in the pool of names of the module
+
+    bool operator<( const elf_symbol& other ) const
+    {
+        return address < other.address;
+    }
+};
+
+/**
+ * Module (executable or shared object) loaded in the process.
+ */
+class elf_module
+{
+public:
+    elf_module( const std::string& path, uintptr_t base )
+    : m_path( path ), m_base( base ), m_loaded( false )
+    {}
+
+    const std::string& get_path() const noexcept
+    {
+        return m_path;
+    }
+
+    uintptr_t get_base() const noexcept
+    {
+        return m_base;
+    }
+
+    bool is_loaded() const noexcept
+    {
+        return m_loaded;
+    }
+
+    void add_segment( uintptr_t start, uintptr_t end )
+    {
+        m_segments.push_back( std::make_pair( start, end ) );
+    }
+
+    bool contains( uintptr_t address ) const noexcept
+    {
+        for( const std::pair<uintptr_t, uintptr_t>& segment : m_segments )
+        {
+            if( ( address >= segment.first ) && ( address < segment.second ) )
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void load_symbols();
+
+    const elf_symbol* find_symbol( uintptr_t address ) const noexcept;
+
+    const char* get_name( const elf_symbol& symbol ) const noexcept
+    {
+        return m_names.c_str() + symbol.name;
+    }
+
+    const std::string& get_demangled_name( const elf_symbol& symbol );
+
+private:
+    void load_symbol_table( const char* image, size_t imageSize, const ElfW(Shdr)* sections, size_t sectionCount,
+                            const ElfW(Shdr)& table );
+
+    const std::string m_path;
+    const uintptr_t m_base;
+    std::vector<std::pair<uintptr_t, uintptr_t>> m_segments;
+
+    bool m_loaded;
+    std::vector<elf_symbol> m_symbols;
+    std::string m_names;
+    std::unordered_map<uint32_t, std::string> m_demangled;
+};
+
+} // namespace
+
+/**
+ * Loads the symbols of the module from its file (only done once, even if it fails).
+ */
+void elf_module::load_symbols()
+{
+    if( m_loaded )
+    {
+        return;
+    }
+    m_loaded = true;
+
+    int fd = open( m_path.c_str(), O_RDONLY | O_CLOEXEC );
+    if( fd < 0 )
+    {
+        return;
+    }
+
+    struct stat st;
+    void* image = MAP_FAILED;
+    if( ( fstat( fd, &st ) == 0 ) && ( (size_t) st.st_size >= sizeof( ElfW(Ehdr) ) ) )
+    {
+        image = mmap( NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+    }
+    close( fd );
+
+    if( image == MAP_FAILED )
+    {
+        return;
+    }
+
+    size_t imageSize = st.st_size;
+    const ElfW(Ehdr)* header = (const ElfW(Ehdr)*) image;
+
+    bool valid = ( memcmp( header->e_ident, ELFMAG, SELFMAG ) == 0 ) &&
+                 ( header->e_ident[EI_CLASS] == ( sizeof( void* ) == 8 ? ELFCLASS64 : ELFCLASS32 ) ) &&
+                 ( header->e_shentsize == sizeof( ElfW(Shdr) ) ) &&
+                 ( header->e_shoff + (size_t) header->e_shnum * sizeof( ElfW(Shdr) ) <= imageSize );
+
+    if( valid )
+    {
+        const ElfW(Shdr)* sections = (const ElfW(Shdr)*) ( (const char*) image + header->e_shoff );
+
+        for( size_t i = 0; i < header->e_shnum; i++ )
+        {
+            if( ( sections[i].sh_type == SHT_SYMTAB ) || ( sections[i].sh_type == SHT_DYNSYM ) )
+            {
+                load_symbol_table( (const char*) image, imageSize, sections, header->e_shnum, sections[i] );
+            }
+        }
+
+        // Aliases have the same address, only the first one found is kept (.symtab precedes .dynsym)
+        std::stable_sort( m_symbols.begin(), m_symbols.end() );
+        m_symbols.erase( std::unique( m_symbols.begin(), m_symbols.end(),
+                                      []( const elf_symbol& a, const elf_symbol& b ) { return a.address == b.address; } ),
+                         m_symbols.end() );
+        m_symbols.shrink_to_fit();
+    }
+
+    munmap( image, imageSize );
+}
+
+void elf_module::load_symbol_table( const char* image, size_t imageSize, const ElfW(Shdr)* sections,
+                                    size_t sectionCount, const ElfW(Shdr)& table )
+{
+    if( ( table.sh_link >= sectionCount ) || ( table.sh_entsize != sizeof( ElfW(Sym) ) ) ||
+        ( table.sh_offset + table.sh_size > imageSize ) )
+    {
+        return; // LCOV_EXCL_LINE
+    }
+
+    const ElfW(Shdr)& strings = sections[table.sh_link];
+    if( strings.sh_offset + strings.sh_size > imageSize )
+    {
+        return; // LCOV_EXCL_LINE
+    }
+
+    const ElfW(Sym)* symbols = (const ElfW(Sym)*) ( image + table.sh_offset );
+    size_t count = table.sh_size / sizeof( ElfW(Sym) );
+    const char* names = image + strings.sh_offset;
+
+    for( size_t i = 0; i < count; i++ )
+    {
+        const ElfW(Sym)& symbol = symbols[i];
+        unsigned char type = ELF64_ST_TYPE( symbol.st_info );    // Same definition for 32 bits
+
+        if( ( ( type != STT_FUNC ) && ( type != STT_GNU_IFUNC ) ) || ( symbol.st_shndx == SHN_UNDEF ) ||
+            ( symbol.st_value == 0 ) || ( symbol.st_name >= strings.sh_size ) )
+        {
+            continue;
+        }
+
+        const char* name = names + symbol.st_name;
+        size_t nameLen = strnlen( name, strings.sh_size - symbol.st_name );
+
+        elf_symbol entry = { (uintptr_t) symbol.st_value, (uintptr_t) symbol.st_size, (uint32_t) m_names.size() };
+        m_symbols.push_back( entry );
+        m_names.append( name, nameLen );
+        m_names.push_back( '\0' );
+    }
+}
+
+const elf_symbol* elf_module::find_symbol( uintptr_t address ) const noexcept
+{
+    elf_symbol key = { address - m_base, 0, 0 };
+
+    std::vector<elf_symbol>::const_iterator it = std::upper_bound( m_symbols.begin(), m_symbols.end(), key );
+    if( it == m_symbols.begin() )
+    {
+        return NULL;
+    }
+    --it;
+
+    // Symbols without size (e.g. some assembler functions) extend until the next symbol
+    if( ( it->size > 0 ) && ( key.address >= it->address + it->size ) )
+    {
+        return NULL;
+    }
+
+    return &*it;
+}
+
+const std::string& elf_module::get_demangled_name( const elf_symbol& symbol )
+{
+    std::unordered_map<uint32_t, std::string>::iterator it = m_demangled.find( symbol.name );
+    if( it != m_demangled.end() )
+    {
+        return it->second;
+    }
+
+    const char* name = get_name( symbol );
+    int status;
+    char* demangled = abi::__cxa_demangle( name, NULL, NULL, &status );
+
+    std::string& cached = m_demangled[symbol.name];
+    cached = ( ( demangled != NULL ) && ( status == 0 ) ) ? demangled : name;
+    free( demangled );
+
+    return cached;
+}
+
+static std::mutex g_mutex;
+static std::vector<std::unique_ptr<elf_module>> g_modules;
+
+static int add_module( struct dl_phdr_info* info, size_t size, void* data )
+{
+    (void) size;
+
+    std::vector<std::unique_ptr<elf_module>>& modules = *static_cast<std::vector<std::unique_ptr<elf_module>>*>( data );
+
+    std::string path = ( info->dlpi_name != NULL ) ? info->dlpi_name : "";
+    if( path.empty() )
+    {
+        // The main executable is reported without name
+        if( !modules.empty() )
+        {
+            return 0;
+        }
+
+        char exePath[4096];
+        ssize_t len = readlink( "/proc/self/exe", exePath, sizeof( exePath ) - 1 );
+        if( len <= 0 )
+        {
+            return 0; // LCOV_EXCL_LINE
+        }
+        path.assign( exePath, len );
+    }
+
+    // Modules already known keep their loaded symbols
+    std::unique_ptr<elf_module> module;
+    for( std::unique_ptr<elf_module>& known : g_modules )
+    {
+        if( known && ( known->get_base() == info->dlpi_addr ) && ( known->get_path() == path ) )
+        {
+            module.swap( known );
+            break;
+        }
+    }
+
+    if( !module )
+    {
+        module.reset( new elf_module( path, info->dlpi_addr ) );
+
+        for( ElfW(Half) i = 0; i < info->dlpi_phnum; i++ )
+        {
+            const ElfW(Phdr)& segment = info->dlpi_phdr[i];
+            if( segment.p_type == PT_LOAD )
+            {
+                uintptr_t start = info->dlpi_addr + segment.p_vaddr;
+                module->add_segment( start, start + segment.p_memsz );
+            }
+        }
+    }
+
+    modules.push_back( std::move( module ) );
+
+    return 0;
+}
+
+/**
+ * Enumerates the loaded modules (must be called with the mutex locked).
+ */
+static void list_modules()
+{
+    std::vector<std::unique_ptr<elf_module>> modules;
+    dl_iterate_phdr( add_module, &modules );
+    g_modules.swap( modules );
+}
+
+/**
+ * Finds the module that contains an address (must be called with the mutex locked).
+ */
+static elf_module* find_module( uintptr_t address ) noexcept
+{
+    for( const std::unique_ptr<elf_module>& module : g_modules )
+    {
+        if( module->contains( address ) )
+        {
+            return module.get();
+        }
+    }
+    return NULL;
+}
+
+bool ext::log_internal::symbolize( const void* address, symbol_info& info )
+{
+    std::lock_guard<std::mutex> lock( g_mutex );
+
+    uintptr_t addr = (uintptr_t) address;
+
+    elf_module* module = g_modules.empty() ? NULL : find_module( addr );
+    if( module == NULL )
+    {
+        // The address may belong to a module loaded after the modules were enumerated
+        list_modules();
+        module = find_module( addr );
+        if( module == NULL )
+        {
+            return false;
+        }
+    }
+
+    module->load_symbols();
+
+    info.module = module->get_path();
+    info.module_offset = addr - module->get_base();
+
+    const elf_symbol* symbol = module->find_symbol( addr );
+    if( symbol != NULL )
+    {
+        info.function = module->get_demangled_name( *symbol );
+        info.function_offset = addr - module->get_base() - symbol->address;
+    }
+    else
+    {
+        info.function.clear();
+        info.function_offset = 0;
+    }
+
+    return true;
+}
+
+std::string ext::log_internal::format_backtrace_frame( const void* address )
+{
+    char buffer[64];
+    symbol_info info;
+
+    if( !symbolize( address, info ) )
+    {
+        snprintf( buffer, sizeof( buffer ), "[%p]", address );
+        return buffer;
+    }
+
+    std::string frame = info.module + "(";
+    if( !info.function.empty() )
+    {
+        snprintf( buffer, sizeof( buffer ), "+0x%lx) [%p]", (unsigned long) info.function_offset, address );
+        frame += info.function;
+    }
+    else
+    {
+        snprintf( buffer, sizeof( buffer ), "+0x%lx) [%p]", (unsigned long) info.module_offset, address );
+    }
+    frame += buffer;
+
+    return frame;
+}
+
+void ext::log_internal::preload_symbols()
+{
+    std::lock_guard<std::mutex> lock( g_mutex );
+
+    list_modules();
+
+    for( std::unique_ptr<elf_module>& module : g_modules )
+    {
+        module->load_symbols();
+    }
+}
+
+bool ext::log_internal::symbolize_raw( const void* address, const char*& module, const char*& function,
+                                       uintptr_t& offset ) noexcept
+{
+    if( !g_mutex.try_lock() )
+    {
+        return false;
+    }
+
+    uintptr_t addr = (uintptr_t) address;
+
+    elf_module* found = find_module( addr );
+    if( found != NULL )
+    {
+        const elf_symbol* symbol = found->is_loaded() ? found->find_symbol( addr ) : NULL;
+
+        module = found->get_path().c_str();
+        function = ( symbol != NULL ) ? found->get_name( *symbol ) : NULL;
+        offset = addr - found->get_base() - ( ( symbol != NULL ) ? symbol->address : 0 );
+    }
+
+    g_mutex.unlock();
+
+    return ( found != NULL );
+}
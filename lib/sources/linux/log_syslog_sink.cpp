@@ -0,0 +1,508 @@
+/**
+ * @file
+ * @brief      Implementation of the log sink that sends the log messages to the local syslog / journald daemon
+ * @authors    Jesus Gonzalez <jgonzalez@gdr-sistemas.com>
+ * @copyright  Copyright (c) 2003-2016 Jesus Gonzalez
+ * @license    See LICENSE.txt
+ */
+
+#include "../local_log.hpp"
+#include "Extended/log_syslog_sink.hpp"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <vector>
+
+#include "Extended/runtime_error.hpp"
+#include "../log_internal.hpp"
+
+using namespace ext;
+using namespace ext::log_internal;
+
+#define RFC5424_SOCKET_PATH     "/dev/log"
+#define JOURNALD_SOCKET_PATH    "/run/systemd/journal/socket"
+
+// Example private enterprise number (RFC 5612), used to identify the structured data of the messages
+#define STRUCTURED_DATA_ID      "ext@32473"
+
+#define MAX_APP_NAME_LENGTH     48
+#define MAX_MSGID_LENGTH        32
+#define MAX_PARAM_NAME_LENGTH   32
+
+// Maximum number of datagrams sent with a single system call
+#define MAX_SEND_BATCH          64
+
+/**
+ * Appends a header field of a syslog message, replacing the characters that are not allowed
+ * (or the NILVALUE if empty).
+ */
+static void append_header_field( std::string& out, const char* value, size_t maxLength )
+{
+    size_t length = strnlen( value, maxLength );
+
+    if( length == 0 )
+    {
+        out += '-';
+        return;
+    }
+
+    for( size_t i = 0; i < length; i++ )
+    {
+        char c = value[i];
+        out += ( ( c > ' ' ) && ( c < 127 ) ) ? c : '_';
+    }
+}
+
+/**
+ * Appends the name of a structured data parameter, replacing the characters that are not allowed.
+ */
+static void append_param_name( std::string& out, const char* name )
+{
+    size_t length = strnlen( name, MAX_PARAM_NAME_LENGTH );
+
+    for( size_t i = 0; i < length; i++ )
+    {
+        char c = name[i];
+        out += ( ( c > ' ' ) && ( c < 127 ) && ( c != '=' ) && ( c != ']' ) && ( c != '"' ) ) ? c : '_';
+    }
+}
+
+/**
+ * Appends a structured data parameter (e.g. @c " name="value""), escaping its value.
+ */
+static void append_param( std::string& out, const char* name, const char* value, size_t length )
+{
+    out += ' ';
+    append_param_name( out, name );
+    out += "=\"";
+
+    for( size_t i = 0; i < length; i++ )
+    {
+        char c = value[i];
+        if( ( c == '"' ) || ( c == '\\' ) || ( c == ']' ) )
+        {
+            out += '\\';
+        }
+        out += c;
+    }
+
+    out += '"';
+}
+
+/**
+ * Appends a timestamp in the format required by RFC 5424 (e.g. "2016-03-01T12:34:56.123456Z").
+ */
+static void append_rfc5424_timestamp( std::string& out, uint64_t timestamp )
+{
+    uint64_t wallNs = log::timestamp_to_wall_ns( timestamp );
+    time_t seconds = (time_t) ( wallNs / 1000000000 );
+
+    struct tm t;
+    gmtime_r( &seconds, &t );
+
+    char text[64];
+    snprintf( text, sizeof( text ), "%04d-%02d-%02dT%02d:%02d:%02d.%06uZ", t.tm_year + 1900, t.tm_mon + 1, t.tm_mday,
+              t.tm_hour, t.tm_min, t.tm_sec, (unsigned int) ( ( wallNs % 1000000000 ) / 1000 ) );
+    out += text;
+}
+
+/**
+ * Appends a field of a journal entry, using the binary form if the value contains newlines.
+ */
+static void append_journal_field( std::string& out, const char* key, const char* value, size_t length )
+{
+    out += key;
+
+    if( memchr( value, '\n', length ) == NULL )
+    {
+        out += '=';
+        out.append( value, length );
+    }
+    else
+    {
+        out += '\n';
+        for( unsigned int i = 0; i < 8; i++ )
+        {
+            out += (char) ( ( (uint64_t) length >> ( i * 8 ) ) & 0xFF ); // Little endian
+        }
+        out.append( value, length );
+    }
+
+    out += '\n';
+}
+
+static void append_journal_field( std::string& out, const char* key, const std::string& value )
+{
+    append_journal_field( out, key, value.data(), value.size() );
+}
+
+/**
+ * Appends to a string the name of a journal field for a field of a structured message, converted to
+ * the allowed characters (uppercase letters, digits and underscores, not starting with a digit nor an
+ * underscore).
+ */
+static void append_journal_key( std::string& out, const char* key )
+{
+    if( !( ( ( key[0] >= 'a' ) && ( key[0] <= 'z' ) ) || ( ( key[0] >= 'A' ) && ( key[0] <= 'Z' ) ) ) )
+    {
+        out += "F_";
+    }
+
+    for( const char* p = key; *p != '\0'; p++ )
+    {
+        char c = *p;
+        if( ( c >= 'a' ) && ( c <= 'z' ) )
+        {
+            out += (char) ( c - 'a' + 'A' );
+        }
+        else if( ( ( c >= 'A' ) && ( c <= 'Z' ) ) || ( ( c >= '0' ) && ( c <= '9' ) ) )
+        {
+            out += c;
+        }
+        else
+        {
+            out += '_';
+        }
+    }
+}
+
+struct syslog_log_sink::impl
+{
+    impl( const options& sinkOptions );
+    ~impl();
+
+    bool connect_socket();
+    void disconnect_socket();
+    void compose_rfc5424( std::string& out, const log_record& record );
+    void compose_journald( std::string& out, const log_record& record );
+    void compose( size_t index, const log_record& record );
+    void send( size_t count );
+
+    const options opts;
+    std::string socketPath;
+    std::string hostname;
+    std::string appName;
+    std::string procId;
+
+    std::atomic<unsigned long long> droppedCount;
+    std::atomic<bool> connected;
+
+    std::mutex mutex;           // Serializes composing and sending the datagrams
+    int fd;
+    std::chrono::steady_clock::time_point nextConnect;
+    std::vector<std::string> datagrams;
+    std::string fieldValue;
+};
+
+syslog_log_sink::impl::impl( const options& sinkOptions )
+: opts( sinkOptions ), droppedCount( 0 ), connected( false ), fd( -1 ), nextConnect( std::chrono::steady_clock::now() ),
+  datagrams( MAX_SEND_BATCH )
+{
+    socketPath = !opts.socket_path.empty() ? opts.socket_path :
+                 ( opts.format == PROTOCOL_JOURNALD ) ? JOURNALD_SOCKET_PATH : RFC5424_SOCKET_PATH;
+
+    char name[256];
+    if( gethostname( name, sizeof( name ) ) == 0 )
+    {
+        name[sizeof( name ) - 1] = '\0';
+        hostname = name;
+    }
+
+    appName = !opts.app_name.empty() ? opts.app_name : get_program_name();
+    procId = std::to_string( (long) getpid() );
+}
+
+syslog_log_sink::impl::~impl()
+{
+    disconnect_socket();
+}
+
+/**
+ * Connects the socket to the daemon, unless the last attempt failed less than the reconnection
+ * interval ago (the mutex must be locked).
+ */
+bool syslog_log_sink::impl::connect_socket()
+{
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if( now < nextConnect )
+    {
+        return false;
+    }
+
+    struct sockaddr_un addr;
+    memset( &addr, 0, sizeof( addr ) );
+    addr.sun_family = AF_UNIX;
+    memcpy( addr.sun_path, socketPath.c_str(), socketPath.size() );
+
+    fd = socket( AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0 );
+    if( ( fd >= 0 ) && ( connect( fd, (struct sockaddr*) &addr, sizeof( addr ) ) == 0 ) )
+    {
+        connected.store( true, std::memory_order_relaxed );
+        return true;
+    }
+
+    disconnect_socket();
+    nextConnect = now + std::chrono::milliseconds( opts.reconnect_interval_ms );
+    return false;
+}
+
+void syslog_log_sink::impl::disconnect_socket()
+{
+    if( fd >= 0 )
+    {
+        close( fd );
+        fd = -1;
+    }
+
+    connected.store( false, std::memory_order_relaxed );
+}
+
+void syslog_log_sink::impl::compose_rfc5424( std::string& out, const log_record& record )
+{
+    out += '<';
+    out += std::to_string( opts.facility * 8 + get_severity( record.priority() ) );
+    out += ">1 ";
+    if( record.timestamp() != 0 )
+    {
+        append_rfc5424_timestamp( out, record.timestamp() );
+    }
+    else
+    {
+        out += '-';
+    }
+    out += ' ';
+    append_header_field( out, hostname.c_str(), 255 );
+    out += ' ';
+    append_header_field( out, appName.c_str(), MAX_APP_NAME_LENGTH );
+    out += ' ';
+    out += procId;
+    out += ' ';
+    append_header_field( out, ( record.category() != NULL ) ? record.category() : "", MAX_MSGID_LENGTH );
+
+    out += " [" STRUCTURED_DATA_ID;
+    append_param( out, "function", record.function(), strlen( record.function() ) );
+    if( ( record.thread_id() != 0 ) && log::are_thread_tags_enabled() )
+    {
+        std::string threadId = std::to_string( record.thread_id() );
+        append_param( out, "thread_id", threadId.data(), threadId.size() );
+        if( record.thread_name()[0] != '\0' )
+        {
+            append_param( out, "thread", record.thread_name(), strlen( record.thread_name() ) );
+        }
+    }
+    for( size_t i = 0; i < record.field_count(); i++ )
+    {
+        fieldValue.clear();
+        append_field_text( fieldValue, record.fields()[i] );
+        append_param( out, record.fields()[i].key(), fieldValue.data(), fieldValue.size() );
+    }
+    out += "] ";
+
+    out += record.base_message();
+}
+
+void syslog_log_sink::impl::compose_journald( std::string& out, const log_record& record )
+{
+    append_journal_field( out, "MESSAGE", record.base_message(), strlen( record.base_message() ) );
+    append_journal_field( out, "PRIORITY", std::to_string( get_severity( record.priority() ) ) );
+    append_journal_field( out, "SYSLOG_FACILITY", std::to_string( opts.facility ) );
+    append_journal_field( out, "SYSLOG_IDENTIFIER", appName );
+    if( record.category() != NULL )
+    {
+        append_journal_field( out, "CATEGORY", record.category(), strlen( record.category() ) );
+    }
+    append_journal_field( out, "CODE_FUNC", record.function(), strlen( record.function() ) );
+    if( ( record.thread_id() != 0 ) && log::are_thread_tags_enabled() )
+    {
+        append_journal_field( out, "TID", std::to_string( record.thread_id() ) );
+        if( record.thread_name()[0] != '\0' )
+        {
+            append_journal_field( out, "THREAD_NAME", record.thread_name(), strlen( record.thread_name() ) );
+        }
+    }
+    for( size_t i = 0; i < record.field_count(); i++ )
+    {
+        std::string key;
+        append_journal_key( key, record.fields()[i].key() );
+        fieldValue.clear();
+        append_field_text( fieldValue, record.fields()[i] );
+        append_journal_field( out, key.c_str(), fieldValue );
+    }
+}
+
+/**
+ * Composes the datagram for a message in the buffer at the given index (the mutex must be locked).
+ */
+void syslog_log_sink::impl::compose( size_t index, const log_record& record )
+{
+    std::string& out = datagrams[index];
+    out.clear();
+
+    if( opts.format == PROTOCOL_JOURNALD )
+    {
+        compose_journald( out, record );
+    }
+    else
+    {
+        compose_rfc5424( out, record );
+    }
+}
+
+/**
+ * Sends the first @p count composed datagrams (the mutex must be locked).
+ *
+ * Datagrams that can't be sent without blocking are discarded.
+ */
+void syslog_log_sink::impl::send( size_t count )
+{
+    if( ( fd < 0 ) && !connect_socket() )
+    {
+        droppedCount.fetch_add( count, std::memory_order_relaxed );
+        return;
+    }
+
+    struct iovec iovecs[MAX_SEND_BATCH];
+    struct mmsghdr headers[MAX_SEND_BATCH];
+    memset( headers, 0, sizeof( headers[0] ) * count );
+
+    for( size_t i = 0; i < count; i++ )
+    {
+        iovecs[i].iov_base = (void*) datagrams[i].data();
+        iovecs[i].iov_len = datagrams[i].size();
+        headers[i].msg_hdr.msg_iov = &iovecs[i];
+        headers[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    size_t sent = 0;
+    bool reconnected = false;
+
+    while( sent < count )
+    {
+        int ret = sendmmsg( fd, &headers[sent], (unsigned int) ( count - sent ), MSG_DONTWAIT | MSG_NOSIGNAL );
+        if( ret > 0 )
+        {
+            for( int i = 0; i < ret; i++ )
+            {
+                stats_count_bytes( headers[sent + i].msg_len );
+            }
+            sent += ret;
+        }
+        else if( errno == EINTR )
+        {
+            continue; // LCOV_EXCL_LINE
+        }
+        else if( ( errno == EAGAIN ) || ( errno == EWOULDBLOCK ) || ( errno == ENOBUFS ) )
+        {
+            // The daemon is not keeping up, the logging threads must not wait for it
+            break;
+        }
+        else if( ( errno == ECONNREFUSED ) || ( errno == ENOTCONN ) || ( errno == ENOENT ) || ( errno == EPIPE ) )
+        {
+            // The daemon has been restarted (or stopped), its new socket must be connected
+            disconnect_socket();
+            if( reconnected || !connect_socket() )
+            {
+                break;
+            }
+            reconnected = true;
+        }
+        else
+        {
+            // The datagram can't be sent (e.g. it's too long)
+            droppedCount.fetch_add( 1, std::memory_order_relaxed );
+            sent++;
+        }
+    }
+
+    droppedCount.fetch_add( count - sent, std::memory_order_relaxed );
+}
+
+syslog_log_sink::syslog_log_sink( const options& opts, int logPriorityLimit )
+: log_sink( logPriorityLimit ), m_impl( new impl( opts ) )
+{
+    if( m_impl->socketPath.size() >= sizeof( ( (struct sockaddr_un*) NULL )->sun_path ) )
+    {
+        THROW_ERROR( "Socket path '%s' is too long", m_impl->socketPath.c_str() );
+    }
+
+    std::lock_guard<std::mutex> lock( m_impl->mutex );
+    m_impl->connect_socket();
+}
+
+syslog_log_sink::~syslog_log_sink()
+{
+}
+
+const std::string& syslog_log_sink::get_socket_path() const noexcept
+{
+    return m_impl->socketPath;
+}
+
+bool syslog_log_sink::is_connected() const noexcept
+{
+    return m_impl->connected.load( std::memory_order_relaxed );
+}
+
+unsigned long long syslog_log_sink::get_dropped_count() const noexcept
+{
+    return m_impl->droppedCount.load( std::memory_order_relaxed );
+}
+
+int syslog_log_sink::get_severity( int prio ) noexcept
+{
+    switch( prio )
+    {
+    case LOG_PRIORITY_ERROR:
+        return 3; // Error
+    case LOG_PRIORITY_WARN:
+        return 4; // Warning
+    case LOG_PRIORITY_INFO:
+        return 6; // Informational
+    default:
+        return ( prio < LOG_PRIORITY_ERROR ) ? 2 : 7; // Critical / Debug
+    }
+}
+
+bool syslog_log_sink::process_record( const log_record& record )
+{
+    std::lock_guard<std::mutex> lock( m_impl->mutex );
+
+    m_impl->compose( 0, record );
+    m_impl->send( 1 );
+
+    return false;
+}
+
+void syslog_log_sink::process_batch( const log_record* const* records, size_t count, bool* toConsole )
+{
+    std::lock_guard<std::mutex> lock( m_impl->mutex );
+
+    size_t pending = 0;
+
+    for( size_t i = 0; i < count; i++ )
+    {
+        m_impl->compose( pending++, *records[i] );
+        toConsole[i] = false;
+
+        if( pending == MAX_SEND_BATCH )
+        {
+            m_impl->send( pending );
+            pending = 0;
+        }
+    }
+
+    if( pending > 0 )
+    {
+        m_impl->send( pending );
+    }
+}
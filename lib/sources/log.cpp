@@ -14,16 +14,21 @@
 #include <stdlib.h>
 #include <exception>
 #include <errno.h>
+#include <atomic>
 
 #include "Extended/string.hpp"
 #include "Extended/runtime_error.hpp"
+#include "log_internal.hpp"
+#include "log_format.hpp"
+#include "log_rcu.hpp"
 
 using namespace ext;
+using namespace ext::log_internal;
 
 #if defined(__GNUC__) && !defined(WIN32)
     #define STACKTRACE_SUPPORTED
     #include <execinfo.h>
-    #include <cxxabi.h>
+    #include "log_symbolizer.hpp"
 #endif
 
 static std::string program_name;
@@ -96,75 +101,317 @@ static const char* get_prio_end( int prio )
     }
 }
 
-static int g_priorityLimit = LOG_PRIORITY_ALLOC;
-static std::shared_ptr<log_handler> g_logHandler = NULL;
+namespace
+{
 
-#ifdef __GNUC__
+/**
+ * Log handler published to the logging threads.
+ */
+struct handler_snapshot : public rcu_object
+{
+    explicit handler_snapshot( const std::shared_ptr<log_handler>& h )
+    : handler( h )
+    {}
+
+    const std::shared_ptr<log_handler> handler;
+};
+
+} // namespace
+
+static std::atomic<handler_snapshot*> g_logHandler( NULL );
+
+std::string ext::log_internal::simplify_function( const char* function )
+{
+    size_t len = strlen( function );
+    size_t begin = function_name_begin( function, len );
+    return std::string( function + begin, function_name_end( function, len ) - begin );
+}
+
+const char* ext::log_internal::get_program_name()
+{
+    return program_name.c_str();
+}
 
-static std::string simplify_function(const char* function)
+const char* ext::log_internal::get_priority_tag( int prio )
 {
-    std::string func(function);
-    unsigned int epos = func.rfind('(');
-    if( epos == std::string::npos )
+    switch( prio )
     {
-        return func;
+    case LOG_PRIORITY_ERROR:
+        return "[ERROR]";
+    case LOG_PRIORITY_WARN:
+        return "[WARN]";
+    case LOG_PRIORITY_INFO:
+        return "[INFO]";
+    case LOG_PRIORITY_TRACE:
+        return "[TRACE]";
+    case LOG_PRIORITY_DEBUG:
+        return "[DEBUG]";
+    case LOG_PRIORITY_DEBUG_EXTRA:
+        return "[XTDBG]";
+    case LOG_PRIORITY_ALLOC:
+        return "[ALLOC]";
+    default:
+        return "[UNKNOWN]"; // LCOV_EXCL_LINE
     }
+}
 
-    unsigned int bpos = func.rfind(' ', epos-1);
-    if( bpos == std::string::npos )
+void ext::log_internal::append_log_line( std::string& out, const log_record& record, const char* program, bool colors )
+{
+    char timestampText[LOG_TIMESTAMP_SIZE];
+    out.append( timestampText, format_timestamp( record.timestamp(), timestampText ) );
+    out += colors ? get_prio_header( record.priority() ) : get_priority_tag( record.priority() );
+    out += " {";
+    out += program;
+    if( record.category() != NULL )
     {
-        bpos = 0;
+        out += ':';
+        out += record.category();
     }
-    else
+    out += "} ";
+    char threadTag[LOG_THREAD_TAG_SIZE];
+    out.append( threadTag, format_thread_tag( record, threadTag ) );
+    out += '<';
+    out += record.function();
+    out += "> ";
+    out += record.message();
+    if( colors )
     {
-        bpos++;
+        out += get_prio_end( record.priority() );
     }
+    out += '\n';
+}
 
-    return func.substr( bpos, epos-bpos );
+std::string ext::log_internal::compose_log_line( int prio, const char* program, const char* category, const char* function, const char* msg,
+                                                 uint64_t wallNs, unsigned long threadId, const char* threadName )
+{
+    char timestampText[LOG_TIMESTAMP_SIZE];
+    std::string line( timestampText, format_wall_timestamp( wallNs, timestampText ) );
+    append_log_line( line, log_record( prio, category, function, msg, 0, threadId, threadName ), program, true );
+    return line;
 }
 
-#else
-#define simplify_function(x) x
-#endif
+log_record::log_record( const log_site& site, const char* format, va_list* args, uint64_t timestamp,
+                        unsigned long threadId, const char* threadName ) noexcept
+: m_prio( site.get_priority() ), m_category( site.get_category() ), m_function( site.get_function() ),
+  m_msg( NULL ), m_timestamp( timestamp ), m_threadId( threadId ),
+  m_threadName( ( threadName != NULL ) ? threadName : "" ), m_fields( NULL ), m_fieldCount( 0 ), m_site( &site ),
+  m_format( format ), m_args( args ), m_capturedArgs( NULL ), m_capturedArgsLen( 0 ), m_hasMsg( false ),
+  m_hasText( false )
+{}
+
+log_record::log_record( const log_site& site, const char* format, const char* args, size_t argsLen, uint64_t timestamp,
+                        unsigned long threadId, const char* threadName ) noexcept
+: m_prio( site.get_priority() ), m_category( site.get_category() ), m_function( site.get_function() ),
+  m_msg( NULL ), m_timestamp( timestamp ), m_threadId( threadId ),
+  m_threadName( ( threadName != NULL ) ? threadName : "" ), m_fields( NULL ), m_fieldCount( 0 ), m_site( &site ),
+  m_format( format ), m_args( NULL ), m_capturedArgs( args ), m_capturedArgsLen( argsLen ), m_hasMsg( false ),
+  m_hasText( false )
+{}
+
+const char* log_record::render_message() const
+{
+    if( !m_hasMsg )
+    {
+        if( m_format == NULL )
+        {
+            // Structured message
+            m_renderedMsg = m_msg;
+            append_fields_logfmt( m_renderedMsg, m_fields, m_fieldCount );
+        }
+        else
+        {
+            const format_plan* plan = m_site->get_format_plan( m_format );
+            if( m_args != NULL )
+            {
+                if( plan != NULL )
+                {
+                    plan->render( *m_args, m_renderedMsg );
+                }
+                else
+                {
+                    m_renderedMsg = vformat( m_format, *m_args );
+                }
+            }
+            else if( plan != NULL )
+            {
+                plan->render_captured( m_capturedArgs, m_capturedArgsLen, m_renderedMsg );
+            }
+            else
+            {
+                render_format_args( m_format, m_capturedArgs, m_capturedArgsLen, m_renderedMsg );
+            }
+        }
+        m_hasMsg = true;
+    }
 
-void do_log_msg( int prio, const char* category, const char* function, const char* msg )
+    return m_renderedMsg.c_str();
+}
+
+const std::string& log_record::text() const
 {
-    if( prio > log::get_priority_limit() )
+    if( !m_hasText )
     {
-        return; // LCOV_EXCL_LINE
+        append_log_line( m_text, *this, program_name.c_str(), true );
+        m_hasText = true;
     }
 
-    std::string sfunc = simplify_function(function);
+    return m_text;
+}
 
+static void write_to_console( const log_record& record )
+{
+#ifdef WIN32
+    __OutputDebugString( record.text().c_str() );
+#else
+    puts( record.text().c_str() );
+#endif
+    stats_count_bytes( record.text().size() );
+}
+
+static void process_record( const log_record& record )
+{
     bool log_to_console = true;
-    if( log::get_log_handler() )
+
     {
-        log_to_console = log::get_log_handler()->process( prio, category, sfunc.c_str(), msg );
+        rcu_read_guard guard;
+
+        handler_snapshot* snapshot = g_logHandler.load( std::memory_order_acquire );
+        if( snapshot != NULL )
+        {
+            uint64_t start = stats_clock_ns();
+            log_to_console = snapshot->handler->dispatch( record );
+            stats_count_handler( stats_clock_ns() - start );
+        }
     }
 
     if( log_to_console )
     {
-        std::string logText;
-        if( category == NULL )
+        write_to_console( record );
+    }
+}
+
+void ext::log_internal::process_log_msg( int prio, const char* category, const char* function, const char* msg,
+                                         uint64_t timestamp )
+{
+    const thread_identity& thread = get_thread_identity();
+    process_record( log_record( prio, category, function, msg, timestamp, thread.id, thread.name ) );
+}
+
+void ext::log_internal::process_log_format( const log_site& site, const char* format, va_list* args, uint64_t timestamp )
+{
+    const thread_identity& thread = get_thread_identity();
+    process_record( log_record( site, format, args, timestamp, thread.id, thread.name ) );
+}
+
+void ext::log_internal::process_log_fields( int prio, const char* category, const char* function, const char* msg,
+                                            const log_field* fields, size_t count, uint64_t timestamp )
+{
+    const thread_identity& thread = get_thread_identity();
+    process_record( log_record( prio, category, function, msg, fields, count, timestamp, thread.id, thread.name ) );
+}
+
+void ext::log_internal::emit_log_msg( int prio, const char* category, const char* function, const char* msg,
+                                      uint64_t timestamp )
+{
+    if( !async_push_text( prio, category, function, msg, timestamp ) )
+    {
+        process_log_msg( prio, category, function, msg, timestamp );
+    }
+}
+
+/**
+ * Logs a message generated by the log management system on behalf of a call site.
+ */
+static void log_site_text( const log_site& site, const char* msg, uint64_t timestamp )
+{
+    emit_log_msg( site.get_priority(), site.get_category(), site.get_function(), msg, timestamp );
+}
+
+bool log::pass_rate_limit( const log_site& site, uint64_t hash, uint64_t timestamp )
+{
+    unsigned int repeated;
+    unsigned int suppressed;
+    if( !site.check_rate_limit( hash, repeated, suppressed ) )
+    {
+        return false;
+    }
+
+    if( repeated > 0 )
+    {
+        log_site_text( site, ext::format( "Last message repeated %u times", repeated ).c_str(), timestamp );
+    }
+
+    if( suppressed > 0 )
+    {
+        log_site_text( site, ext::format( "%u similar messages suppressed", suppressed ).c_str(), timestamp );
+    }
+
+    return true;
+}
+
+void ext::log_internal::process_log_batch( const log_record* const* records, size_t count )
+{
+    bool log_to_console[LOG_BATCH_SIZE];
+
+    for( size_t i = 0; i < count; i++ )
+    {
+        log_to_console[i] = true;
+    }
+
+    {
+        rcu_read_guard guard;
+
+        handler_snapshot* snapshot = g_logHandler.load( std::memory_order_acquire );
+        if( snapshot != NULL )
         {
-            logText = format( "%s {%s} <%s> %s%s\n", get_prio_header(prio), program_name.c_str(), sfunc.c_str(), msg, get_prio_end(prio) );
+            uint64_t start = stats_clock_ns();
+            snapshot->handler->process_batch( records, count, log_to_console );
+            stats_count_handler( stats_clock_ns() - start );
         }
-        else
+    }
+
+    for( size_t i = 0; i < count; i++ )
+    {
+        if( log_to_console[i] )
         {
-            logText = format( "%s {%s:%s} <%s> %s%s\n", get_prio_header(prio), program_name.c_str(), category, sfunc.c_str(), msg, get_prio_end(prio) );
+            write_to_console( *records[i] );
         }
-#ifdef WIN32
-        __OutputDebugString( logText.c_str() );
-#else
-        puts( logText.c_str() );
-#endif
     }
 }
 
+void do_log_msg( int prio, const char* category, const char* function, const char* msg )
+{
+    if( prio > log::get_category_priority_limit( category ) )
+    {
+        stats_count_filtered( prio, get_category_index( category ) );
+        return;
+    }
+
+    stats_count_emitted( prio, get_category_index( category ) );
+
+    if( prio == LOG_PRIORITY_ERROR )
+    {
+        // The context that led to the error is logged before it
+        flight_dump();
+    }
+
+    uint64_t timestamp = log::get_timestamp();
+
+    if( log::is_async_mode() && async_push_text( prio, category, function, msg, timestamp ) )
+    {
+        return;
+    }
+
+    process_log_msg( prio, category, function, msg, timestamp );
+}
+
 void log::log_message( int prio, const char* category, const char* function, const char* format, ... )
 {
-    if( prio > g_priorityLimit )
+    latency_probe probe;
+
+    if( prio > get_category_priority_limit( category ) )
     {
+        stats_count_filtered( prio, get_category_index( category ) );
         return;
     }
 
@@ -173,56 +420,175 @@ void log::log_message( int prio, const char* category, const char* function, con
     std::string msg = vformat( format, args );
     va_end( args );
 
-    do_log_msg( prio, category, function, msg.c_str() );
+    do_log_msg( prio, category, simplify_function( function ).c_str(), msg.c_str() );
 }
 
-int ext::log::get_priority_limit() noexcept
+void log::log_site_vmessage( const log_site& site, const char* format, va_list args )
 {
-    return g_priorityLimit;
+    uint64_t timestamp = log::get_timestamp();
+
+    if( site.m_state.load( std::memory_order_relaxed ) == log_site::STATE_RECORDED )
+    {
+        stats_count_filtered( site.get_priority(), site.m_categoryIndex );
+        flight_record( site, format, args, timestamp );
+        return;
+    }
+
+    // Rate limits are checked before formatting the message, so that suppressed messages are cheap
+    if( site.m_rate.enabled.load( std::memory_order_relaxed ) )
+    {
+        uint64_t hash = site.m_rate.collapse.load( std::memory_order_relaxed ) ? hash_message( format, args ) : 0;
+        if( !pass_rate_limit( site, hash, timestamp ) )
+        {
+            return;
+        }
+    }
+
+    stats_count_emitted( site.get_priority(), site.m_categoryIndex );
+
+    if( site.get_priority() == LOG_PRIORITY_ERROR )
+    {
+        // The context that led to the error is logged before it
+        flight_dump();
+    }
+
+    // In asynchronous mode the arguments are just captured, the message is formatted by the writer thread.
+    // Otherwise, it's formatted only if requested by the log handler or written to console.
+    if( !async_push_deferred( site, format, args, timestamp ) )
+    {
+        va_list argsCopy;
+        va_copy( argsCopy, args );
+        process_log_format( site, format, &argsCopy, timestamp );
+        va_end( argsCopy );
+    }
 }
 
-void ext::log::set_priority_limit( int logPriorityLimit ) noexcept
+void log::log_site_message( const log_site& site, const char* format, ... )
 {
-    g_priorityLimit = logPriorityLimit;
+    va_list args;
+    va_start( args, format );
+    log_site_vmessage( site, format, args );
+    va_end( args );
 }
 
-const std::shared_ptr<log_handler>& ext::log::get_log_handler() noexcept
+void log::log_message( const log_site& site, const char* format, ... )
 {
-    return g_logHandler;
+    latency_probe probe;
+
+    va_list args;
+    va_start( args, format );
+
+    if( site.m_literalFormat )
+    {
+        log_site_vmessage( site, format, args );
+    }
+    else
+    {
+        // The format string may not outlive the call (e.g. a temporary string), therefore the message is formatted
+        // right away and passed as the argument of a format string with static storage duration
+        std::string msg = vformat( format, args );
+        log_site_message( site, "%s", msg.c_str() );
+    }
+
+    va_end( args );
 }
 
-void ext::log::set_log_handler( const std::shared_ptr<log_handler>& userLogHandler ) noexcept
+void log::log_fields( const log_site& site, const char* msg, const log_field* fields, size_t count )
 {
-    g_logHandler = userLogHandler;
+    latency_probe probe;
+
+    // Structured messages are not captured by the flight recorder, because their fields don't outlive the call
+    if( site.m_state.load( std::memory_order_relaxed ) == log_site::STATE_RECORDED )
+    {
+        stats_count_filtered( site.get_priority(), site.m_categoryIndex );
+        return;
+    }
+
+    uint64_t timestamp = log::get_timestamp();
+
+    if( site.m_rate.enabled.load( std::memory_order_relaxed ) )
+    {
+        uint64_t hash = site.m_rate.collapse.load( std::memory_order_relaxed ) ? hash_fields( msg, fields, count ) : 0;
+        if( !pass_rate_limit( site, hash, timestamp ) )
+        {
+            return;
+        }
+    }
+
+    stats_count_emitted( site.get_priority(), site.m_categoryIndex );
+
+    if( site.get_priority() == LOG_PRIORITY_ERROR )
+    {
+        // The context that led to the error is logged before it
+        flight_dump();
+    }
+
+    // In asynchronous mode the fields are just copied, the message is rendered by the writer thread
+    if( !async_push_fields( site.get_priority(), site.get_category(), site.get_function(), msg, fields, count,
+                            timestamp ) )
+    {
+        process_log_fields( site.get_priority(), site.get_category(), site.get_function(), msg, fields, count,
+                            timestamp );
+    }
 }
 
-#ifndef UTIL_LOG_NO_TERMINATE_OVERRIDE
+std::shared_ptr<log_handler> ext::log::get_log_handler() noexcept
+{
+    rcu_read_guard guard;
 
-#ifndef UTIL_LOG_BACKTRACE_SIZE
-#define UTIL_LOG_BACKTRACE_SIZE 50
-#endif
+    handler_snapshot* snapshot = g_logHandler.load( std::memory_order_acquire );
+    return ( snapshot != NULL ) ? snapshot->handler : std::shared_ptr<log_handler>();
+}
 
-#ifdef STACKTRACE_SUPPORTED
-static std::string demangle(const char* line)
+void ext::log::set_log_handler( const std::shared_ptr<log_handler>& userLogHandler ) noexcept
 {
-    std::string buf(line);
-    int fPos = buf.rfind('(');
-    int e2Pos = buf.rfind(')');
-    int ePos = buf.rfind('+', e2Pos);
+    handler_snapshot* snapshot = userLogHandler ? new handler_snapshot( userLogHandler ) : NULL;
+
+    rcu_retire( g_logHandler.exchange( snapshot ) );
+}
 
-    size_t len = ePos-fPos-1;
-    int status;
-    std::string symbol = buf.substr(fPos+1, len);
-    char* demangled = abi::__cxa_demangle( symbol.c_str(), NULL, NULL, &status );
-    if( demangled != NULL && status == 0 )
+static std::atomic<crash_flusher*> g_crashFlushers[LOG_MAX_CRASH_FLUSHERS];
+
+void ext::log_internal::register_crash_flusher( crash_flusher* flusher ) noexcept
+{
+    for( std::atomic<crash_flusher*>& slot : g_crashFlushers )
     {
-        return buf.substr(0, fPos+1) + demangled + buf.substr(ePos, std::string::npos);
+        crash_flusher* expected = NULL;
+        if( slot.compare_exchange_strong( expected, flusher ) )
+        {
+            return;
+        }
     }
-    else
+}
+
+void ext::log_internal::unregister_crash_flusher( crash_flusher* flusher ) noexcept
+{
+    for( std::atomic<crash_flusher*>& slot : g_crashFlushers )
     {
-        return line;
+        crash_flusher* expected = flusher;
+        if( slot.compare_exchange_strong( expected, NULL ) )
+        {
+            return;
+        }
     }
 }
+
+void ext::log_internal::crash_flush_all() noexcept
+{
+    for( std::atomic<crash_flusher*>& slot : g_crashFlushers )
+    {
+        crash_flusher* flusher = slot.load();
+        if( flusher != NULL )
+        {
+            flusher->crash_flush();
+        }
+    }
+}
+
+#ifndef UTIL_LOG_NO_TERMINATE_OVERRIDE
+
+#ifndef UTIL_LOG_BACKTRACE_SIZE
+#define UTIL_LOG_BACKTRACE_SIZE 50
 #endif
 
 // LCOV_EXCL_START
@@ -230,6 +596,12 @@ static void _ex_terminate()
 {
     static bool already_tried = false;
 
+    // Messages still queued in asynchronous mode must be processed before aborting
+    async_emergency_drain();
+
+    // The messages captured by the flight recorder give the context of the failure
+    flight_dump();
+
     log::set_log_handler(NULL);
 
     try
@@ -247,10 +619,10 @@ static void _ex_terminate()
     }
     catch (const std::exception &e)
     {
-        do_log_msg( LOG_PRIORITY_ERROR, NULL, typeid(e).name(), e.what() );
+        process_log_msg( LOG_PRIORITY_ERROR, NULL, typeid(e).name(), e.what(), log::get_timestamp() );
     }
     catch (...) {
-        do_log_msg( LOG_PRIORITY_ERROR, NULL, "Unknown", "Unknown exception" );
+        process_log_msg( LOG_PRIORITY_ERROR, NULL, "Unknown", "Unknown exception", log::get_timestamp() );
     }
 
     fprintf( stderr, "Unhandled exception, program terminated\n" );
@@ -262,18 +634,11 @@ static void _ex_terminate()
     void* fnAddr[UTIL_LOG_BACKTRACE_SIZE];
     int size = backtrace(fnAddr, UTIL_LOG_BACKTRACE_SIZE);
 
-    char** fnSyms = backtrace_symbols(fnAddr, size);
-
-    if( fnSyms != NULL )
+    // We skip the first call in the stack, which is the call to this
+    // function
+    for (int i=1; i < size; i++)
     {
-        // We skip the first call in the stack, which is the call to this
-        // function
-        for (int i=1; i < size; i++)
-        {
-            fprintf( stderr,"[%d]: %s\n", i, demangle(fnSyms[i]).c_str() );
-        }
-
-        free(fnSyms);
+        fprintf( stderr,"[%d]: %s\n", i, format_backtrace_frame(fnAddr[i]).c_str() );
     }
 
 #endif
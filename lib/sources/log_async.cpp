@@ -0,0 +1,1349 @@
+/**
+ * @file
+ * @brief      Implementation of the asynchronous log mode
+ * @authors    Jesus Gonzalez <jgonzalez@gdr-sistemas.com>
+ * @copyright  Copyright (c) 2003-2016 Jesus Gonzalez
+ * @license    See LICENSE.txt
+ */
+
+#include "local_log.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <vector>
+#include <new>
+
+#include "Extended/string.hpp"
+#include "Extended/runtime_error.hpp"
+#include "log_internal.hpp"
+#include "log_format.hpp"
+#include "log_binary.hpp"
+
+using namespace ext;
+using namespace ext::log_internal;
+
+#define WRITER_IDLE_TIMEOUT_MS  100
+#define EMERGENCY_DRAIN_SPINS   100000
+#define DROP_REPORT_PERIOD_S    1
+
+#define BUFFER_FREE             0u
+#define BUFFER_OWNED            1u
+#define BUFFER_ORPHANED         2u
+#define BUFFER_STATE_MASK       3u
+
+namespace
+{
+
+/**
+ * Log message queued in the ring buffer.
+ *
+ * Records are filled and consumed in place, so that their strings keep their capacity between uses
+ * and, once warmed up, queuing a message doesn't need to allocate memory.
+ */
+struct async_record
+{
+    int prio;
+    uint64_t timestamp;
+    thread_identity thread;     // Copied, because the record is processed by the writer thread
+    bool deferred;              // data holds the arguments captured for format, otherwise the message text
+    bool owns_names;            // Category and function were copied into category_copy and function_copy
+    const char* category;
+    const char* function;
+    const char* format;
+    const log_site* site;       // Call site that generated a deferred message
+    std::string data;
+    std::string fields;         // Fields of a structured message encoded with encode_fields() (empty otherwise)
+    std::string category_copy;
+    std::string function_copy;
+
+    const char* get_category() const
+    {
+        return owns_names ? ( category ? category_copy.c_str() : NULL ) : category;
+    }
+
+    const char* get_function() const
+    {
+        return owns_names ? function_copy.c_str() : function;
+    }
+};
+
+/**
+ * Bounded multi-producer / multi-consumer ring buffer of log records.
+ *
+ * Positions increase monotonically during all the life of the program. Each cell has a sequence number
+ * which indicates if it's free for the producer of a given position (sequence == pos) or if it holds the
+ * record for that position (sequence == pos + 1).
+ *
+ * The ring is closed by setting CLOSED_FLAG in the enqueue position, which makes any further reservation
+ * fail. Once all the reserved positions have been consumed and released, the cells can be freed.
+ *
+ * Records are released as soon as they are extracted, but the consumer may still hold them (e.g. in a batch
+ * not yet passed to the log handler), therefore it reports separately when it has completely processed them.
+ */
+class log_ring
+{
+public:
+    enum push_result
+    {
+        PUSHED,
+        FULL,
+        CLOSED
+    };
+
+    static const uint64_t CLOSED_FLAG = 1ULL << 63;
+
+    log_ring()
+    : m_cells( NULL ), m_mask( 0 ), m_enqueuePos( CLOSED_FLAG ), m_dequeuePos( 0 ), m_released( 0 ), m_processed( 0 )
+    {}
+
+    /**
+     * Opens the ring (must be closed and completely released).
+     */
+    void open( size_t capacity )
+    {
+        uint64_t base = m_dequeuePos.load( std::memory_order_relaxed );
+        uint64_t mask = capacity - 1;
+        cell* cells = new cell[capacity];
+
+        for( uint64_t i = 0; i < capacity; i++ )
+        {
+            cells[(base + i) & mask].sequence.store( base + i, std::memory_order_relaxed );
+        }
+
+        // Released, so that peek_timestamp() can check the cells without synchronizing with the enqueue position
+        m_mask.store( mask, std::memory_order_relaxed );
+        m_cells.store( cells, std::memory_order_release );
+        m_enqueuePos.store( base, std::memory_order_release );
+    }
+
+    /**
+     * Closes the ring for further reservations.
+     *
+     * @return The position following the last one reserved
+     */
+    uint64_t close()
+    {
+        return m_enqueuePos.fetch_or( CLOSED_FLAG ) & ~CLOSED_FLAG;
+    }
+
+    /**
+     * Frees the cells (must be closed and completely released).
+     */
+    void destroy()
+    {
+        delete [] m_cells.exchange( NULL );
+    }
+
+    bool is_open() const
+    {
+        return ( m_enqueuePos.load( std::memory_order_relaxed ) & CLOSED_FLAG ) == 0;
+    }
+
+    uint64_t get_enqueue_position() const
+    {
+        return m_enqueuePos.load( std::memory_order_acquire ) & ~CLOSED_FLAG;
+    }
+
+    uint64_t get_released_count() const
+    {
+        return m_released.load( std::memory_order_acquire );
+    }
+
+    /**
+     * Gets the number of records completely processed by the consumer (or discarded).
+     */
+    uint64_t get_processed_count() const
+    {
+        return m_processed.load( std::memory_order_acquire );
+    }
+
+    /**
+     * Reports that @p count records extracted from the ring have been completely processed.
+     */
+    void mark_processed( uint64_t count )
+    {
+        m_processed.fetch_add( count, std::memory_order_release );
+    }
+
+    /**
+     * Indicates if all the reserved positions have been consumed and released.
+     */
+    bool is_drained() const
+    {
+        return get_released_count() >= get_enqueue_position();
+    }
+
+    /**
+     * Reserves a position and calls @p fill to write its record in place.
+     */
+    template<typename F>
+    push_result push( F& fill )
+    {
+        uint64_t pos = m_enqueuePos.load( std::memory_order_acquire );
+
+        for(;;)
+        {
+            if( pos & CLOSED_FLAG )
+            {
+                return CLOSED;
+            }
+
+            int64_t used = (int64_t) ( pos - m_dequeuePos.load( std::memory_order_acquire ) );
+            if( used > (int64_t) m_mask.load( std::memory_order_relaxed ) )
+            {
+                uint64_t current = m_enqueuePos.load( std::memory_order_acquire );
+                if( current == pos )
+                {
+                    return FULL;
+                }
+                pos = current;
+            }
+            else if( m_enqueuePos.compare_exchange_weak( pos, pos + 1, std::memory_order_acq_rel, std::memory_order_acquire ) )
+            {
+                break;
+            }
+        }
+
+        // The cells can't be freed while there are reserved positions not released
+        cell* c = &m_cells.load( std::memory_order_relaxed )[pos & m_mask.load( std::memory_order_relaxed )];
+
+        // Wait until the consumer of the previous lap finishes with the cell
+        while( c->sequence.load( std::memory_order_acquire ) != pos )
+        {
+            std::this_thread::yield(); // LCOV_EXCL_LINE
+        }
+
+        fill( c->record );
+        c->sequence.store( pos + 1, std::memory_order_release );
+
+        return PUSHED;
+    }
+
+    /**
+     * Extracts the oldest record, if available, calling @p consume to process it in place.
+     *
+     * Must only be called from threads that can't race with destroy().
+     */
+    template<typename F>
+    bool pop( F& consume )
+    {
+        cell* cells = m_cells.load( std::memory_order_relaxed );
+        uint64_t mask = m_mask.load( std::memory_order_relaxed );
+        uint64_t pos = m_dequeuePos.load( std::memory_order_relaxed );
+
+        for(;;)
+        {
+            cell* c = &cells[pos & mask];
+            int64_t diff = (int64_t) ( c->sequence.load( std::memory_order_acquire ) - ( pos + 1 ) );
+
+            if( diff == 0 )
+            {
+                if( m_dequeuePos.compare_exchange_weak( pos, pos + 1, std::memory_order_acq_rel, std::memory_order_relaxed ) )
+                {
+                    consume( c->record );
+                    c->sequence.store( pos + mask + 1, std::memory_order_release );
+                    m_released.fetch_add( 1, std::memory_order_release );
+                    return true;
+                }
+            }
+            else if( diff < 0 )
+            {
+                // Empty, or the oldest record is not yet completely written
+                return false;
+            }
+            else
+            {
+                pos = m_dequeuePos.load( std::memory_order_relaxed ); // LCOV_EXCL_LINE
+            }
+        }
+    }
+
+    /**
+     * Indicates if the oldest record is available to be extracted.
+     *
+     * Must only be called from threads that can't race with destroy().
+     */
+    bool has_pending() const
+    {
+        uint64_t pos = m_dequeuePos.load( std::memory_order_relaxed );
+        const cell& c = m_cells.load( std::memory_order_relaxed )[pos & m_mask.load( std::memory_order_relaxed )];
+        return c.sequence.load( std::memory_order_acquire ) == ( pos + 1 );
+    }
+
+    /**
+     * Gets the timestamp of the oldest record, if available.
+     *
+     * Must only be called from the single consumer of the ring, but it's safe to call it even if the ring
+     * has never been opened or while it's being opened.
+     */
+    bool peek_timestamp( uint64_t& timestamp ) const
+    {
+        const cell* cells = m_cells.load( std::memory_order_acquire );
+        if( cells == NULL )
+        {
+            return false;
+        }
+
+        uint64_t pos = m_dequeuePos.load( std::memory_order_acquire );
+        const cell& c = cells[pos & m_mask.load( std::memory_order_relaxed )];
+        if( c.sequence.load( std::memory_order_acquire ) != ( pos + 1 ) )
+        {
+            return false;
+        }
+
+        timestamp = c.record.timestamp;
+
+        // The owner of the ring may have discarded the record meanwhile (OVERFLOW_DROP_OLDEST)
+        return m_dequeuePos.load( std::memory_order_acquire ) == pos;
+    }
+
+    /**
+     * Discards the oldest record if the ring is still full from the point of view of a producer that
+     * observed the enqueue position @p seenPos.
+     *
+     * Safe to be called from producers: the cells are only accessed after claiming a position that
+     * is not yet released.
+     *
+     * @retval true if a record was discarded
+     * @retval false otherwise
+     */
+    bool discard_oldest( uint64_t seenPos )
+    {
+        uint64_t pos = m_dequeuePos.load( std::memory_order_acquire );
+
+        if( (int64_t) ( seenPos - pos ) <= (int64_t) m_mask.load( std::memory_order_relaxed ) )
+        {
+            return false;
+        }
+
+        if( !m_dequeuePos.compare_exchange_strong( pos, pos + 1, std::memory_order_acq_rel, std::memory_order_relaxed ) )
+        {
+            return false;
+        }
+
+        uint64_t mask = m_mask.load( std::memory_order_relaxed );
+        cell* c = &m_cells.load( std::memory_order_relaxed )[pos & mask];
+
+        // The position was reserved, wait until the record is completely written
+        while( c->sequence.load( std::memory_order_acquire ) != ( pos + 1 ) )
+        {
+            std::this_thread::yield(); // LCOV_EXCL_LINE
+        }
+
+        c->sequence.store( pos + mask + 1, std::memory_order_release );
+        m_released.fetch_add( 1, std::memory_order_release );
+        m_processed.fetch_add( 1, std::memory_order_release );
+
+        return true;
+    }
+
+private:
+    struct cell
+    {
+        std::atomic<uint64_t> sequence;
+        async_record record;
+    };
+
+    std::atomic<cell*> m_cells;
+    std::atomic<uint64_t> m_mask;
+
+    // Kept in separate cache lines to avoid false sharing between producers and consumers
+    alignas(64) std::atomic<uint64_t> m_enqueuePos;
+    alignas(64) std::atomic<uint64_t> m_dequeuePos;
+    alignas(64) std::atomic<uint64_t> m_released;
+    std::atomic<uint64_t> m_processed;
+};
+
+/**
+ * Fills a record with an already formatted message.
+ */
+struct text_filler
+{
+    int prio;
+    const char* category;
+    const char* function;
+    const char* msg;
+    uint64_t timestamp;
+
+    void operator()( async_record& rec ) const
+    {
+        rec.prio = prio;
+        rec.timestamp = timestamp;
+        rec.thread = get_thread_identity();
+        rec.deferred = false;
+        rec.owns_names = true;
+        rec.category = category;
+        rec.function = function;
+        rec.category_copy.assign( category ? category : "" );
+        rec.function_copy.assign( function );
+        rec.data.assign( msg );
+        rec.fields.clear();
+    }
+};
+
+/**
+ * Fills a record with the arguments of a message to be formatted later.
+ */
+struct deferred_filler
+{
+    const log_site* site;
+    const char* format;
+    va_list* args;
+    uint64_t timestamp;
+
+    void operator()( async_record& rec ) const
+    {
+        rec.prio = site->get_priority();
+        rec.timestamp = timestamp;
+        rec.thread = get_thread_identity();
+        rec.owns_names = false;
+        rec.category = site->get_category();
+        rec.function = site->get_function();
+        rec.format = format;
+        rec.site = site;
+        rec.fields.clear();
+        rec.data.clear();
+        rec.deferred = capture_format_args( format, *args, rec.data );
+        if( !rec.deferred )
+        {
+            // The format uses features that can't be deferred, therefore it must be formatted right now
+            rec.data = vformat( format, *args );
+        }
+    }
+};
+
+/**
+ * Fills a record with a structured message, to be rendered later.
+ */
+struct fields_filler
+{
+    int prio;
+    const char* category;
+    const char* function;
+    const char* msg;
+    const log_field* fields;
+    size_t count;
+    uint64_t timestamp;
+
+    void operator()( async_record& rec ) const
+    {
+        rec.prio = prio;
+        rec.timestamp = timestamp;
+        rec.thread = get_thread_identity();
+        rec.deferred = false;
+        rec.owns_names = false;
+        rec.category = category;
+        rec.function = function;
+        rec.data.assign( msg );
+        encode_fields( rec.fields, fields, count );
+    }
+};
+
+} // namespace
+
+static log_ring g_ring;
+static std::atomic<int> g_overflowPolicy( log::OVERFLOW_BLOCK );
+static std::atomic<unsigned long long> g_droppedCount( 0 );
+
+static std::mutex g_controlMutex; // Serializes enabling / disabling the asynchronous mode
+static std::thread g_writer;
+static std::atomic<std::thread::id> g_writerId;
+static std::atomic<bool> g_writerStop( false );
+
+static std::mutex g_wakeMutex;
+static std::condition_variable g_writerCv;
+static std::condition_variable g_flushCv;
+static std::atomic<bool> g_writerIdle( false );
+static std::atomic<int> g_flushWaiters( 0 );
+
+// Only opened and closed while the writer thread is not running
+static binary_log_writer g_binaryWriter;
+
+namespace
+{
+
+/**
+ * Ring buffer owned by a single producer thread (in QUEUE_PER_THREAD mode).
+ *
+ * Buffers are linked into a list that only grows, so that the writer thread can traverse it without
+ * locking, and they are never freed: when its thread exits the buffer is orphaned, and once the writer
+ * thread has drained it, it's recycled for the next thread that needs one.
+ *
+ * The state holds the activation generation of the owner in the upper bits, so that the thread_local
+ * references left behind by a previous activation of the asynchronous mode don't affect the buffer.
+ */
+struct thread_buffer
+{
+    log_ring ring;
+    std::atomic<unsigned int> state;
+    thread_buffer* next;
+};
+
+/**
+ * Reference of a thread to its buffer, which orphans it when the thread exits.
+ */
+struct thread_buffer_ref
+{
+    thread_buffer* buffer;
+    unsigned int generation;
+
+    ~thread_buffer_ref();
+};
+
+} // namespace
+
+static unsigned int make_buffer_state( unsigned int generation, unsigned int state )
+{
+    return ( generation << 2 ) | state;
+}
+
+static std::atomic<thread_buffer*> g_threadBuffers( NULL );
+static std::atomic<bool> g_threadQueueOpen( false );
+static std::atomic<unsigned int> g_bufferGeneration( 0 );
+static size_t g_bufferCapacity = 0;
+static std::mutex g_bufferMutex; // Serializes claiming and closing the per-thread buffers
+
+// Only modified while the writer thread is not running
+static log::queue_mode g_queueMode = log::QUEUE_SHARED;
+
+static thread_local thread_buffer_ref t_threadBuffer;
+
+thread_buffer_ref::~thread_buffer_ref()
+{
+    if( buffer != NULL )
+    {
+        // If the asynchronous mode has been restarted meanwhile the buffer doesn't belong to this thread any more
+        unsigned int owned = make_buffer_state( generation, BUFFER_OWNED );
+        buffer->state.compare_exchange_strong( owned, make_buffer_state( generation, BUFFER_ORPHANED ) );
+    }
+}
+
+/**
+ * Claims a free buffer for the calling thread (allocating a new one if none is available).
+ *
+ * @return Ring of the buffer, or NULL if the per-thread queues are closed
+ */
+static log_ring* claim_thread_buffer( thread_buffer_ref& ref )
+{
+    std::lock_guard<std::mutex> lock( g_bufferMutex );
+
+    if( !g_threadQueueOpen.load( std::memory_order_relaxed ) )
+    {
+        return NULL;
+    }
+
+    unsigned int generation = g_bufferGeneration.load( std::memory_order_relaxed );
+    unsigned int owned = make_buffer_state( generation, BUFFER_OWNED );
+    thread_buffer* claimed = NULL;
+
+    for( thread_buffer* buffer = g_threadBuffers.load( std::memory_order_relaxed ); buffer != NULL; buffer = buffer->next )
+    {
+        unsigned int state = buffer->state.load();
+        if( ( ( state & BUFFER_STATE_MASK ) == BUFFER_FREE ) && buffer->state.compare_exchange_strong( state, owned ) )
+        {
+            claimed = buffer;
+            break;
+        }
+    }
+
+    if( claimed == NULL )
+    {
+        // Buffers are never freed, and the alignment of the ring must be kept to avoid false sharing
+        uintptr_t storage = (uintptr_t) ::operator new( sizeof( thread_buffer ) + alignof( thread_buffer ) );
+        claimed = new( (void*) ( ( storage + alignof( thread_buffer ) - 1 ) & ~( (uintptr_t) alignof( thread_buffer ) - 1 ) ) ) thread_buffer();
+        claimed->state.store( owned );
+        claimed->next = g_threadBuffers.load( std::memory_order_relaxed );
+        g_threadBuffers.store( claimed, std::memory_order_release );
+    }
+
+    if( !claimed->ring.is_open() )
+    {
+        claimed->ring.open( g_bufferCapacity );
+    }
+
+    ref.buffer = claimed;
+    ref.generation = generation;
+
+    return &claimed->ring;
+}
+
+/**
+ * Gets the ring where the calling thread queues its messages.
+ *
+ * @return Ring of the buffer of the thread, or NULL if the per-thread queues are closed
+ */
+static log_ring* get_thread_ring()
+{
+    thread_buffer_ref& ref = t_threadBuffer;
+
+    if( ( ref.buffer != NULL ) && ( ref.generation == g_bufferGeneration.load( std::memory_order_acquire ) ) )
+    {
+        // The ring is closed (and the push fails) when the asynchronous mode is being disabled
+        return &ref.buffer->ring;
+    }
+
+    if( !g_threadQueueOpen.load( std::memory_order_acquire ) )
+    {
+        return NULL;
+    }
+
+    return claim_thread_buffer( ref );
+}
+
+static bool is_async_open()
+{
+    return g_ring.is_open() || g_threadQueueOpen.load( std::memory_order_relaxed );
+}
+
+static void wake_writer()
+{
+    std::atomic_thread_fence( std::memory_order_seq_cst );
+    if( g_writerIdle.load( std::memory_order_relaxed ) )
+    {
+        std::lock_guard<std::mutex> lock( g_wakeMutex );
+        g_writerCv.notify_one();
+    }
+}
+
+namespace
+{
+
+/**
+ * Processes the records extracted from the ring buffer, either passing them to the log handler or
+ * writing them to the binary log file.
+ *
+ * Records passed to the log handler are accumulated and passed in batches when flush() is called
+ * (or when the batch is full).
+ */
+class record_processor
+{
+public:
+    record_processor() : m_count( 0 )
+    {
+        m_records.reserve( LOG_BATCH_SIZE );
+    }
+
+    void operator()( const async_record& rec )
+    {
+        if( g_binaryWriter.is_open() )
+        {
+            if( rec.deferred )
+            {
+                g_binaryWriter.write_message( rec.prio, rec.timestamp, rec.thread.id, rec.thread.name, rec.get_category(),
+                                              rec.get_function(), rec.format, rec.data.data(), rec.data.size() );
+            }
+            else if( !rec.fields.empty() )
+            {
+                m_fields.clear();
+                decode_fields( rec.fields, m_fields );
+                m_text = rec.data;
+                append_fields_logfmt( m_text, m_fields.data(), m_fields.size() );
+                g_binaryWriter.write_text( rec.prio, rec.timestamp, rec.thread.id, rec.thread.name, rec.get_category(),
+                                           rec.get_function(), m_text.c_str() );
+            }
+            else
+            {
+                g_binaryWriter.write_text( rec.prio, rec.timestamp, rec.thread.id, rec.thread.name, rec.get_category(),
+                                           rec.get_function(), rec.data.c_str() );
+            }
+            return;
+        }
+
+        // The record will be released back to the ring buffer, therefore its strings must be copied
+        pending_record& pending = m_pending[m_count++];
+        pending.prio = rec.prio;
+        pending.timestamp = rec.timestamp;
+        pending.thread = rec.thread;
+        if( rec.owns_names )
+        {
+            pending.category = rec.category ? assign( pending.category_copy, rec.category_copy ) : NULL;
+            pending.function = assign( pending.function_copy, rec.function_copy );
+        }
+        else
+        {
+            pending.category = rec.category;
+            pending.function = rec.function;
+        }
+        // Deferred messages are rendered only if requested by the log handler (msg holds the captured arguments)
+        pending.site = rec.deferred ? rec.site : NULL;
+        pending.format = rec.format;
+        pending.msg = rec.data;
+
+        pending.field_data = rec.fields;
+        if( !pending.field_data.empty() )
+        {
+            decode_fields( pending.field_data, pending.fields );
+        }
+
+        if( m_count == LOG_BATCH_SIZE )
+        {
+            flush();
+        }
+    }
+
+    void process_text( int prio, const char* category, const char* function, const char* msg )
+    {
+        if( g_binaryWriter.is_open() )
+        {
+            const thread_identity& thread = get_thread_identity();
+            g_binaryWriter.write_text( prio, log::get_timestamp(), thread.id, thread.name, category, function, msg );
+        }
+        else
+        {
+            flush();
+            process_log_msg( prio, category, function, msg, log::get_timestamp() );
+        }
+    }
+
+    void flush()
+    {
+        if( m_count == 0 )
+        {
+            return;
+        }
+
+        const log_record* records[LOG_BATCH_SIZE];
+
+        for( size_t i = 0; i < m_count; i++ )
+        {
+            const pending_record& pending = m_pending[i];
+            if( pending.site != NULL )
+            {
+                m_records.emplace_back( *pending.site, pending.format, pending.msg.data(), pending.msg.size(),
+                                        pending.timestamp, pending.thread.id, pending.thread.name );
+            }
+            else if( pending.field_data.empty() )
+            {
+                m_records.emplace_back( pending.prio, pending.category, pending.function, pending.msg.c_str(), pending.timestamp,
+                                        pending.thread.id, pending.thread.name );
+            }
+            else
+            {
+                m_records.emplace_back( pending.prio, pending.category, pending.function, pending.msg.c_str(),
+                                        pending.fields.data(), pending.fields.size(), pending.timestamp,
+                                        pending.thread.id, pending.thread.name );
+            }
+            records[i] = &m_records.back();
+        }
+
+        process_log_batch( records, m_count );
+
+        m_records.clear();
+        m_count = 0;
+    }
+
+private:
+    struct pending_record
+    {
+        int prio;
+        uint64_t timestamp;
+        thread_identity thread;
+        const char* category;
+        const char* function;
+        const log_site* site;           // Call site of a deferred message (NULL if msg holds the message text)
+        const char* format;
+        std::string msg;
+        std::string field_data;
+        std::vector<log_field> fields;  // Decoded from field_data
+        std::string category_copy;
+        std::string function_copy;
+    };
+
+    static const char* assign( std::string& dst, const std::string& src )
+    {
+        dst = src;
+        return dst.c_str();
+    }
+
+    // Strings are reused to avoid allocations
+    pending_record m_pending[LOG_BATCH_SIZE];
+    size_t m_count;
+    std::vector<log_record> m_records;
+    std::vector<log_field> m_fields;
+    std::string m_text;
+};
+
+} // namespace
+
+namespace
+{
+
+/**
+ * Rings from which the records of a batch have been extracted, to report them as processed once the
+ * batch has been passed to the log handler.
+ */
+class batch_origin
+{
+public:
+    batch_origin() : m_count( 0 ), m_total( 0 ) {}
+
+    void add( log_ring* ring )
+    {
+        if( ( m_count == 0 ) || ( m_entries[m_count - 1].ring != ring ) )
+        {
+            m_entries[m_count].ring = ring;
+            m_entries[m_count].count = 0;
+            m_count++;
+        }
+        m_entries[m_count - 1].count++;
+        m_total++;
+    }
+
+    uint64_t get_total() const
+    {
+        return m_total;
+    }
+
+    void mark_processed()
+    {
+        for( size_t i = 0; i < m_count; i++ )
+        {
+            m_entries[i].ring->mark_processed( m_entries[i].count );
+        }
+        m_count = 0;
+        m_total = 0;
+    }
+
+private:
+    struct entry
+    {
+        log_ring* ring;
+        uint64_t count;
+    };
+
+    entry m_entries[LOG_BATCH_SIZE];
+    size_t m_count;
+    uint64_t m_total;
+};
+
+} // namespace
+
+static void notify_flush_waiters()
+{
+    if( g_flushWaiters.load() > 0 )
+    {
+        std::lock_guard<std::mutex> lock( g_wakeMutex );
+        g_flushCv.notify_all();
+    }
+}
+
+/**
+ * Extracts a batch of records from the per-thread buffers, merging them by timestamp.
+ *
+ * Records are ordered among those completely written when they are merged: a record still being written
+ * by its producer is taken in a later batch, even if older than the ones taken in this one.
+ */
+static void merge_thread_buffers( record_processor& processor, batch_origin& origin )
+{
+    while( origin.get_total() < LOG_BATCH_SIZE )
+    {
+        log_ring* oldest = NULL;
+        uint64_t oldestTimestamp = 0;
+
+        for( thread_buffer* buffer = g_threadBuffers.load( std::memory_order_acquire ); buffer != NULL; buffer = buffer->next )
+        {
+            uint64_t timestamp;
+            if( buffer->ring.peek_timestamp( timestamp ) && ( ( oldest == NULL ) || ( timestamp < oldestTimestamp ) ) )
+            {
+                oldest = &buffer->ring;
+                oldestTimestamp = timestamp;
+            }
+        }
+
+        if( ( oldest == NULL ) || !oldest->pop( processor ) )
+        {
+            break;
+        }
+
+        origin.add( oldest );
+    }
+}
+
+/**
+ * Releases the buffers of the threads that have exited, once all their records have been processed.
+ */
+static void recycle_thread_buffers()
+{
+    for( thread_buffer* buffer = g_threadBuffers.load( std::memory_order_acquire ); buffer != NULL; buffer = buffer->next )
+    {
+        unsigned int state = buffer->state.load();
+        if( ( ( state & BUFFER_STATE_MASK ) == BUFFER_ORPHANED ) && buffer->ring.is_drained() )
+        {
+            // The ring is kept open, ready to be claimed by another thread
+            buffer->state.compare_exchange_strong( state, BUFFER_FREE );
+        }
+    }
+}
+
+static bool has_pending_records()
+{
+    if( g_queueMode != log::QUEUE_PER_THREAD )
+    {
+        return g_ring.has_pending();
+    }
+
+    for( thread_buffer* buffer = g_threadBuffers.load( std::memory_order_acquire ); buffer != NULL; buffer = buffer->next )
+    {
+        uint64_t timestamp;
+        if( buffer->ring.peek_timestamp( timestamp ) )
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void writer_main()
+{
+    set_thread_name( "log writer" );
+
+    record_processor processor;
+    batch_origin origin;
+    unsigned long long reportedDrops = g_droppedCount.load();
+    std::chrono::steady_clock::time_point lastDropReport = std::chrono::steady_clock::now();
+
+    for(;;)
+    {
+        if( g_queueMode == log::QUEUE_PER_THREAD )
+        {
+            merge_thread_buffers( processor, origin );
+        }
+        else
+        {
+            while( ( origin.get_total() < LOG_BATCH_SIZE ) && g_ring.pop( processor ) )
+            {
+                origin.add( &g_ring );
+            }
+        }
+
+        processor.flush();
+
+        uint64_t count = origin.get_total();
+        if( count > 0 )
+        {
+            // Reported only once the log handler has received them, so that flush() waits for the whole batch
+            origin.mark_processed();
+            notify_flush_waiters();
+        }
+
+        // Discarded messages are reported periodically, and when the writer is stopped
+        unsigned long long drops = g_droppedCount.load( std::memory_order_relaxed );
+        bool stopping = ( count == 0 ) && g_writerStop.load( std::memory_order_acquire );
+        if( drops != reportedDrops )
+        {
+            std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+            if( stopping || ( now - lastDropReport >= std::chrono::seconds( DROP_REPORT_PERIOD_S ) ) )
+            {
+                processor.process_text( LOG_PRIORITY_WARN, LOG_CATEGORY, "ext::log",
+                                        format( "%llu log messages discarded because the ring buffer was full",
+                                                drops - reportedDrops ).c_str() );
+                reportedDrops = drops;
+                lastDropReport = now;
+            }
+        }
+
+        if( count > 0 )
+        {
+            continue;
+        }
+
+        if( stopping )
+        {
+            break;
+        }
+
+        if( g_queueMode == log::QUEUE_PER_THREAD )
+        {
+            recycle_thread_buffers();
+        }
+
+        std::unique_lock<std::mutex> lock( g_wakeMutex );
+        g_writerIdle.store( true, std::memory_order_relaxed );
+        std::atomic_thread_fence( std::memory_order_seq_cst );
+        if( !has_pending_records() && !g_writerStop.load( std::memory_order_acquire ) )
+        {
+            g_writerCv.wait_for( lock, std::chrono::milliseconds( WRITER_IDLE_TIMEOUT_MS ) );
+        }
+        g_writerIdle.store( false, std::memory_order_relaxed );
+    }
+}
+
+static void async_atexit()
+{
+    log::disable_async_mode();
+}
+
+template<typename F>
+static bool async_push( const F& fill )
+{
+    if( !is_async_open() || ( std::this_thread::get_id() == g_writerId.load( std::memory_order_relaxed ) ) )
+    {
+        // Messages generated by the writer thread itself (e.g. by the log handler) are processed immediately
+        return false;
+    }
+
+    log_ring* ring = &g_ring;
+    if( !g_ring.is_open() )
+    {
+        ring = get_thread_ring();
+        if( ring == NULL )
+        {
+            return false;
+        }
+    }
+
+    for( unsigned int attempt = 0; ; attempt++ )
+    {
+        switch( ring->push( fill ) )
+        {
+        case log_ring::PUSHED:
+            wake_writer();
+            return true;
+
+        case log_ring::CLOSED:
+            return false;
+
+        case log_ring::FULL:
+            switch( g_overflowPolicy.load( std::memory_order_relaxed ) )
+            {
+            case log::OVERFLOW_DROP_NEWEST:
+                g_droppedCount.fetch_add( 1, std::memory_order_relaxed );
+                return true;
+
+            case log::OVERFLOW_DROP_OLDEST:
+                if( ring->discard_oldest( ring->get_enqueue_position() ) )
+                {
+                    g_droppedCount.fetch_add( 1, std::memory_order_relaxed );
+                    notify_flush_waiters();
+                }
+                break;
+
+            default:
+                wake_writer();
+                if( attempt < 100 )
+                {
+                    std::this_thread::yield();
+                }
+                else
+                {
+                    std::this_thread::sleep_for( std::chrono::microseconds( 100 ) );
+                }
+                break;
+            }
+            break;
+        }
+    }
+}
+
+bool ext::log_internal::async_push_text( int prio, const char* category, const char* function, const char* msg,
+                                         uint64_t timestamp )
+{
+    const text_filler fill = { prio, category, function, msg, timestamp };
+    return async_push( fill );
+}
+
+bool ext::log_internal::async_push_deferred( const log_site& site, const char* format, va_list args, uint64_t timestamp )
+{
+    va_list argsCopy;
+    va_copy( argsCopy, args );
+    const deferred_filler fill = { &site, format, &argsCopy, timestamp };
+    bool queued = async_push( fill );
+    va_end( argsCopy );
+    return queued;
+}
+
+bool ext::log_internal::async_push_fields( int prio, const char* category, const char* function, const char* msg,
+                                           const log_field* fields, size_t count, uint64_t timestamp )
+{
+    const fields_filler fill = { prio, category, function, msg, fields, count, timestamp };
+    return async_push( fill );
+}
+
+/**
+ * Processes the records still queued after a ring has been closed.
+ *
+ * @param[in] ring Ring to be drained
+ * @param[in] end Position following the last one reserved
+ * @param[in] maxSpins Maximum number of attempts to wait for records not yet completely written (0 = unbounded)
+ */
+static void drain_closed_ring( log_ring& ring, uint64_t end, unsigned int maxSpins )
+{
+    record_processor processor;
+    uint64_t count = 0;
+
+    for( unsigned int spins = 0; ( ring.get_released_count() < end ) && ( ( maxSpins == 0 ) || ( spins < maxSpins ) ); spins++ )
+    {
+        if( ring.pop( processor ) )
+        {
+            count++;
+        }
+        else
+        {
+            std::this_thread::yield(); // LCOV_EXCL_LINE
+        }
+    }
+
+    processor.flush();
+
+    ring.mark_processed( count );
+    notify_flush_waiters();
+}
+
+// LCOV_EXCL_START
+void ext::log_internal::async_emergency_drain()
+{
+    if( !is_async_open() )
+    {
+        return;
+    }
+
+    // The writer thread may be still running and consuming records, or some producer may be stuck in
+    // the middle of writing a record, therefore the number of attempts is bounded
+    if( g_ring.is_open() )
+    {
+        drain_closed_ring( g_ring, g_ring.close(), EMERGENCY_DRAIN_SPINS );
+    }
+    else
+    {
+        // The buffer mutex can't be taken, but buffers are never unlinked from the list
+        g_threadQueueOpen.store( false );
+        for( thread_buffer* buffer = g_threadBuffers.load( std::memory_order_acquire ); buffer != NULL; buffer = buffer->next )
+        {
+            if( buffer->ring.is_open() )
+            {
+                drain_closed_ring( buffer->ring, buffer->ring.close(), EMERGENCY_DRAIN_SPINS );
+            }
+        }
+    }
+
+    g_binaryWriter.flush();
+}
+// LCOV_EXCL_STOP
+
+bool ext::log_internal::async_is_drained() noexcept
+{
+    if( g_ring.is_open() )
+    {
+        return g_ring.is_drained();
+    }
+
+    for( thread_buffer* buffer = g_threadBuffers.load( std::memory_order_acquire ); buffer != NULL; buffer = buffer->next )
+    {
+        if( !buffer->ring.is_drained() )
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool ext::log_internal::async_is_writer_thread() noexcept
+{
+    return ( std::this_thread::get_id() == g_writerId.load( std::memory_order_relaxed ) );
+}
+
+static void start_async_mode( size_t capacity, log::overflow_policy policy, log::queue_mode queue )
+{
+    size_t roundedCapacity = 2;
+    while( roundedCapacity < capacity )
+    {
+        roundedCapacity <<= 1;
+    }
+
+    static bool atexitRegistered = false;
+    if( !atexitRegistered )
+    {
+        atexit( async_atexit );
+        atexitRegistered = true;
+    }
+
+    g_overflowPolicy.store( policy, std::memory_order_relaxed );
+    g_queueMode = queue;
+    if( queue == log::QUEUE_PER_THREAD )
+    {
+        // Rings are opened when claimed by their threads
+        std::lock_guard<std::mutex> lock( g_bufferMutex );
+        g_bufferCapacity = roundedCapacity;
+        g_threadQueueOpen.store( true );
+    }
+    else
+    {
+        g_ring.open( roundedCapacity );
+    }
+    g_writerStop.store( false );
+    g_writer = std::thread( writer_main );
+    g_writerId.store( g_writer.get_id() );
+}
+
+static void stop_async_mode()
+{
+    if( !g_writer.joinable() )
+    {
+        return;
+    }
+
+    uint64_t end = 0;
+    std::vector<uint64_t> bufferEnds;
+
+    if( g_queueMode == log::QUEUE_PER_THREAD )
+    {
+        // Buffers claimed from now on belong to the next activation
+        std::lock_guard<std::mutex> lock( g_bufferMutex );
+        g_threadQueueOpen.store( false );
+        g_bufferGeneration.fetch_add( 1 );
+        for( thread_buffer* buffer = g_threadBuffers.load( std::memory_order_relaxed ); buffer != NULL; buffer = buffer->next )
+        {
+            bufferEnds.push_back( buffer->ring.close() );
+        }
+    }
+    else
+    {
+        end = g_ring.close();
+    }
+
+    {
+        std::lock_guard<std::mutex> wakeLock( g_wakeMutex );
+        g_writerStop.store( true, std::memory_order_release );
+        g_writerCv.notify_one();
+    }
+
+    g_writer.join();
+    g_writerId.store( std::thread::id() );
+
+    // Process the records that the writer could not extract because producers were still writing them
+    if( g_queueMode == log::QUEUE_PER_THREAD )
+    {
+        // No buffers can be linked once the queues are closed, therefore the list matches the recorded ends
+        std::vector<uint64_t>::const_iterator bufferEnd = bufferEnds.begin();
+        for( thread_buffer* buffer = g_threadBuffers.load( std::memory_order_relaxed ); buffer != NULL; buffer = buffer->next )
+        {
+            drain_closed_ring( buffer->ring, *bufferEnd++, 0 );
+            buffer->ring.destroy();
+            buffer->state.store( BUFFER_FREE );
+        }
+    }
+    else
+    {
+        drain_closed_ring( g_ring, end, 0 );
+        g_ring.destroy();
+    }
+    g_binaryWriter.close();
+}
+
+void log::enable_async_mode( size_t capacity, overflow_policy policy, queue_mode queue )
+{
+    std::lock_guard<std::mutex> lock( g_controlMutex );
+
+    g_overflowPolicy.store( policy, std::memory_order_relaxed );
+
+    if( is_async_open() )
+    {
+        return;
+    }
+
+    start_async_mode( capacity, policy, queue );
+}
+
+void log::enable_binary_mode( const char* path, size_t capacity, overflow_policy policy )
+{
+    std::lock_guard<std::mutex> lock( g_controlMutex );
+
+    stop_async_mode();
+
+    if( !g_binaryWriter.open( path, get_program_name() ) )
+    {
+        THROW_ERROR( "Error creating binary log file '%s'", path );
+    }
+
+    start_async_mode( capacity, policy, QUEUE_SHARED );
+}
+
+void log::disable_async_mode()
+{
+    std::lock_guard<std::mutex> lock( g_controlMutex );
+
+    stop_async_mode();
+}
+
+bool log::is_async_mode() noexcept
+{
+    return is_async_open();
+}
+
+namespace
+{
+
+/**
+ * Position up to which a ring must be processed to consider flushed the records queued before.
+ */
+struct flush_target
+{
+    const log_ring* ring;
+    uint64_t position;
+};
+
+} // namespace
+
+static bool is_flushed( const std::vector<flush_target>& targets )
+{
+    for( std::vector<flush_target>::const_iterator it = targets.begin(); it != targets.end(); ++it )
+    {
+        if( it->ring->get_processed_count() < it->position )
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void log::flush()
+{
+    if( is_async_open() && ( std::this_thread::get_id() != g_writerId.load( std::memory_order_relaxed ) ) )
+    {
+        std::vector<flush_target> targets;
+
+        if( g_ring.is_open() )
+        {
+            const flush_target target = { &g_ring, g_ring.get_enqueue_position() };
+            targets.push_back( target );
+        }
+        else
+        {
+            // Rings are never freed, and their positions keep increasing when they are recycled
+            for( thread_buffer* buffer = g_threadBuffers.load( std::memory_order_acquire ); buffer != NULL; buffer = buffer->next )
+            {
+                const flush_target target = { &buffer->ring, buffer->ring.get_enqueue_position() };
+                targets.push_back( target );
+            }
+        }
+
+        g_flushWaiters.fetch_add( 1 );
+        {
+            std::unique_lock<std::mutex> lock( g_wakeMutex );
+            g_writerCv.notify_one();
+            while( !is_flushed( targets ) )
+            {
+                g_flushCv.wait_for( lock, std::chrono::milliseconds( WRITER_IDLE_TIMEOUT_MS ) );
+            }
+        }
+        g_flushWaiters.fetch_sub( 1 );
+
+        g_binaryWriter.flush();
+    }
+
+    fflush( stdout );
+}
+
+unsigned long long log::get_dropped_count() noexcept
+{
+    return g_droppedCount.load( std::memory_order_relaxed );
+}
@@ -0,0 +1,382 @@
+/**
+ * @file
+ * @brief      Implementation of the binary log files
+ * @authors    Jesus Gonzalez <jgonzalez@gdr-sistemas.com>
+ * @copyright  Copyright (c) 2003-2016 Jesus Gonzalez
+ * @license    See LICENSE.txt
+ */
+
+#include "log_binary.hpp"
+
+#include <string.h>
+
+#include "Extended/log.hpp"
+#include "log_format.hpp"
+
+using namespace ext::log_internal;
+
+#define NULL_STRING_LENGTH  0xFFFFFFFFu
+#define FILE_BUFFER_SIZE    ( 1024 * 1024 )
+#define MAX_STRING_LENGTH   ( 64 * 1024 * 1024 )
+
+/**
+ * Converts a timestamp of the log clock to wall-clock time, which is meaningful outside of the process.
+ */
+static uint64_t to_wall_ns( uint64_t timestamp )
+{
+    return ( timestamp != 0 ) ? ext::log::timestamp_to_wall_ns( timestamp ) : 0;
+}
+
+binary_log_writer::binary_log_writer()
+: m_file( NULL ), m_threadCount( 0 )
+{}
+
+binary_log_writer::~binary_log_writer()
+{
+    close();
+}
+
+bool binary_log_writer::open( const char* path, const char* programName )
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+
+    if( m_file != NULL )
+    {
+        fclose( m_file ); // LCOV_EXCL_LINE
+    }
+
+    m_sites.clear();
+    m_threads.clear();
+    m_threadCount = 0;
+
+    m_file = fopen( path, "wb" );
+    if( m_file == NULL )
+    {
+        return false;
+    }
+
+    m_fileBuffer.resize( FILE_BUFFER_SIZE );
+    setvbuf( m_file, m_fileBuffer.data(), _IOFBF, m_fileBuffer.size() );
+
+    fwrite( BINLOG_MAGIC, 1, BINLOG_MAGIC_LENGTH, m_file );
+    write_u32( BINLOG_BYTE_ORDER_MARK );
+    write_string( programName );
+
+    return true;
+}
+
+void binary_log_writer::close()
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+
+    if( m_file != NULL )
+    {
+        fclose( m_file );
+        m_file = NULL;
+    }
+
+    // Release the memory until the next file is opened
+    std::vector<char>().swap( m_fileBuffer );
+    std::unordered_map<site_key, uint32_t, site_key_hash>().swap( m_sites );
+    std::unordered_map<unsigned long, thread_ref>().swap( m_threads );
+}
+
+void binary_log_writer::write_message( int prio, uint64_t timestamp, unsigned long threadId, const char* threadName,
+                                       const char* category, const char* function, const char* format, const char* args,
+                                       size_t argsLen )
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+
+    if( m_file == NULL )
+    {
+        return; // LCOV_EXCL_LINE
+    }
+
+    site_key key = { category, function, format };
+    std::unordered_map<site_key, uint32_t, site_key_hash>::const_iterator it = m_sites.find( key );
+    uint32_t siteId;
+
+    if( it == m_sites.end() )
+    {
+        siteId = (uint32_t) m_sites.size();
+        m_sites[key] = siteId;
+
+        write_u8( BINLOG_SITE );
+        write_u32( siteId );
+        write_string( category );
+        write_string( function );
+        write_string( format );
+    }
+    else
+    {
+        siteId = it->second;
+    }
+
+    uint32_t threadRef = get_thread_ref( threadId, threadName );
+
+    write_u8( BINLOG_MESSAGE );
+    write_u32( siteId );
+    write_u8( (uint8_t) prio );
+    write_u64( to_wall_ns( timestamp ) );
+    write_u32( threadRef );
+    write_u32( (uint32_t) argsLen );
+    fwrite( args, 1, argsLen, m_file );
+}
+
+void binary_log_writer::write_text( int prio, uint64_t timestamp, unsigned long threadId, const char* threadName,
+                                    const char* category, const char* function, const char* msg )
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+
+    if( m_file == NULL )
+    {
+        return; // LCOV_EXCL_LINE
+    }
+
+    uint32_t threadRef = get_thread_ref( threadId, threadName );
+
+    write_u8( BINLOG_TEXT );
+    write_u8( (uint8_t) prio );
+    write_u64( to_wall_ns( timestamp ) );
+    write_u32( threadRef );
+    write_string( category );
+    write_string( function );
+    write_string( msg );
+}
+
+void binary_log_writer::flush()
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+
+    if( m_file != NULL )
+    {
+        fflush( m_file );
+    }
+}
+
+/**
+ * Returns the reference of a thread, writing a thread record if the thread has not been written yet or its
+ * name has changed since (the writer must be locked).
+ */
+uint32_t binary_log_writer::get_thread_ref( unsigned long threadId, const char* threadName )
+{
+    if( threadName == NULL )
+    {
+        threadName = "";
+    }
+
+    std::unordered_map<unsigned long, thread_ref>::iterator it = m_threads.find( threadId );
+    if( ( it != m_threads.end() ) && ( it->second.name == threadName ) )
+    {
+        return it->second.ref;
+    }
+
+    thread_ref& thread = m_threads[threadId];
+    thread.ref = m_threadCount++;
+    thread.name = threadName;
+
+    write_u8( BINLOG_THREAD );
+    write_u32( thread.ref );
+    write_u64( threadId );
+    write_string( threadName );
+
+    return thread.ref;
+}
+
+void binary_log_writer::write_u8( uint8_t value )
+{
+    fputc( value, m_file );
+}
+
+void binary_log_writer::write_u32( uint32_t value )
+{
+    fwrite( &value, sizeof( value ), 1, m_file );
+}
+
+void binary_log_writer::write_u64( uint64_t value )
+{
+    fwrite( &value, sizeof( value ), 1, m_file );
+}
+
+void binary_log_writer::write_string( const char* str )
+{
+    if( str == NULL )
+    {
+        write_u32( NULL_STRING_LENGTH );
+    }
+    else
+    {
+        uint32_t len = (uint32_t) strlen( str );
+        write_u32( len );
+        fwrite( str, 1, len, m_file );
+    }
+}
+
+binary_log_reader::binary_log_reader()
+: m_file( NULL )
+{}
+
+binary_log_reader::~binary_log_reader()
+{
+    if( m_file != NULL )
+    {
+        fclose( m_file );
+    }
+}
+
+bool binary_log_reader::open( const char* path )
+{
+    m_file = fopen( path, "rb" );
+    if( m_file == NULL )
+    {
+        return false;
+    }
+
+    char magic[BINLOG_MAGIC_LENGTH];
+    uint32_t bom;
+
+    return ( fread( magic, 1, sizeof( magic ), m_file ) == sizeof( magic ) ) &&
+           ( memcmp( magic, BINLOG_MAGIC, BINLOG_MAGIC_LENGTH ) == 0 ) &&
+           read_u32( bom ) && ( bom == BINLOG_BYTE_ORDER_MARK ) &&
+           read_string( m_programName );
+}
+
+bool binary_log_reader::read_next( binary_log_entry& entry )
+{
+    uint8_t type;
+
+    while( read_u8( type ) )
+    {
+        switch( type )
+        {
+        case BINLOG_SITE:
+        {
+            uint32_t siteId;
+            site s;
+            bool categoryIsNull;
+            if( !read_u32( siteId ) || ( siteId != m_sites.size() ) || !read_string( s.category, &categoryIsNull ) ||
+                !read_string( s.function ) || !read_string( s.format ) )
+            {
+                return false;
+            }
+            s.has_category = !categoryIsNull;
+            m_sites.push_back( s );
+            break;
+        }
+
+        case BINLOG_THREAD:
+        {
+            uint32_t threadRef;
+            uint64_t threadId;
+            thread t;
+            if( !read_u32( threadRef ) || ( threadRef != m_threads.size() ) || !read_u64( threadId ) ||
+                !read_string( t.name ) )
+            {
+                return false;
+            }
+            t.id = (unsigned long) threadId;
+            m_threads.push_back( t );
+            break;
+        }
+
+        case BINLOG_MESSAGE:
+        {
+            uint32_t siteId;
+            uint8_t prio;
+            uint32_t threadRef;
+            uint32_t argsLen;
+            if( !read_u32( siteId ) || ( siteId >= m_sites.size() ) || !read_u8( prio ) || !read_u64( entry.timestamp ) ||
+                !read_u32( threadRef ) || ( threadRef >= m_threads.size() ) || !read_u32( argsLen ) ||
+                ( argsLen > MAX_STRING_LENGTH ) )
+            {
+                return false;
+            }
+            m_args.resize( argsLen );
+            if( ( argsLen > 0 ) && ( fread( &m_args[0], 1, argsLen, m_file ) != argsLen ) )
+            {
+                return false;
+            }
+
+            const site& s = m_sites[siteId];
+            entry.prio = prio;
+            entry.thread_id = m_threads[threadRef].id;
+            entry.thread_name = m_threads[threadRef].name;
+            entry.has_category = s.has_category;
+            entry.category = s.category;
+            entry.function = s.function;
+            entry.msg.clear();
+            render_format_args( s.format.c_str(), m_args.data(), m_args.size(), entry.msg );
+            return true;
+        }
+
+        case BINLOG_TEXT:
+        {
+            uint8_t prio;
+            uint32_t threadRef;
+            bool categoryIsNull;
+            if( !read_u8( prio ) || !read_u64( entry.timestamp ) || !read_u32( threadRef ) ||
+                ( threadRef >= m_threads.size() ) || !read_string( entry.category, &categoryIsNull ) ||
+                !read_string( entry.function ) || !read_string( entry.msg ) )
+            {
+                return false;
+            }
+            entry.prio = prio;
+            entry.thread_id = m_threads[threadRef].id;
+            entry.thread_name = m_threads[threadRef].name;
+            entry.has_category = !categoryIsNull;
+            return true;
+        }
+
+        default:
+            return false;
+        }
+    }
+
+    return false;
+}
+
+bool binary_log_reader::read_u8( uint8_t& value )
+{
+    int c = fgetc( m_file );
+    value = (uint8_t) c;
+    return ( c != EOF );
+}
+
+bool binary_log_reader::read_u32( uint32_t& value )
+{
+    return fread( &value, sizeof( value ), 1, m_file ) == 1;
+}
+
+bool binary_log_reader::read_u64( uint64_t& value )
+{
+    return fread( &value, sizeof( value ), 1, m_file ) == 1;
+}
+
+bool binary_log_reader::read_string( std::string& str, bool* isNull )
+{
+    uint32_t len;
+
+    if( !read_u32( len ) )
+    {
+        return false;
+    }
+
+    if( isNull != NULL )
+    {
+        *isNull = ( len == NULL_STRING_LENGTH );
+    }
+
+    if( len == NULL_STRING_LENGTH )
+    {
+        str.clear();
+        return true;
+    }
+
+    if( len > MAX_STRING_LENGTH )
+    {
+        return false;
+    }
+
+    str.resize( len );
+    return ( len == 0 ) || ( fread( &str[0], 1, len, m_file ) == len );
+}
@@ -0,0 +1,222 @@
+/**
+ * @file
+ * @brief      Internal header for the binary log files
+ * @authors    Jesus Gonzalez <jgonzalez@gdr-sistemas.com>
+ * @copyright  Copyright (c) 2003-2016 Jesus Gonzalez
+ * @license    See LICENSE.txt
+ *
+ * A binary log file starts with a header:
+ *   - Magic: the 8 characters "EXTLOGB2"
+ *   - Byte order mark: 32-bit value 0x01020304 (all values are stored in the byte order of the writer)
+ *   - Name of the program
+ *
+ * And it's followed by a sequence of records, each one starting with an 8-bit record type:
+ *   - BINLOG_SITE: 32-bit site identifier, category, function, format
+ *   - BINLOG_THREAD: 32-bit thread reference, 64-bit thread identifier, thread name
+ *   - BINLOG_MESSAGE: 32-bit site identifier, 8-bit priority, 64-bit timestamp, 32-bit thread reference,
+ *                     32-bit length and captured arguments
+ *   - BINLOG_TEXT: 8-bit priority, 64-bit timestamp, 32-bit thread reference, category, function, message text
+ *
+ * Timestamps are wall-clock times in nanoseconds since the epoch (0 = unknown), converted from the log
+ * clock when the record is written. Threads are referenced by the number of BINLOG_THREAD records written
+ * before theirs (i.e. a thread whose name changes gets a new reference).
+ *
+ * Strings are stored as a 32-bit length followed by the characters (without terminator); a length
+ * of 0xFFFFFFFF represents a NULL string. Captured arguments are encoded as described in
+ * capture_format_args().
+ */
+
+#ifndef Extended_log_binary_hpp_
+#define Extended_log_binary_hpp_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <unordered_map>
+
+#define BINLOG_MAGIC            "EXTLOGB2"
+#define BINLOG_MAGIC_LENGTH     8
+#define BINLOG_BYTE_ORDER_MARK  0x01020304u
+
+namespace ext
+{
+namespace log_internal
+{
+
+enum binlog_record_type
+{
+    BINLOG_SITE = 1,
+    BINLOG_MESSAGE = 2,
+    BINLOG_TEXT = 3,
+    BINLOG_THREAD = 4
+};
+
+/**
+ * Writer of binary log files.
+ *
+ * Sites (i.e. combinations of category, function and format) are written to the file the first time
+ * they are used, and are referenced by their identifier afterwards, so that messages only require the
+ * captured arguments to be written. Threads (i.e. combinations of thread identifier and name) are
+ * written and referenced the same way.
+ */
+class binary_log_writer
+{
+public:
+    binary_log_writer();
+    ~binary_log_writer();
+
+    /**
+     * Creates a binary log file and writes its header.
+     *
+     * @retval true on success
+     * @retval false if the file couldn't be created
+     */
+    bool open( const char* path, const char* programName );
+
+    void close();
+
+    bool is_open() const
+    {
+        return m_file != NULL;
+    }
+
+    /**
+     * Writes a message whose arguments were captured with capture_format_args().
+     *
+     * @param[in] timestamp Time when the message was generated, from log::get_timestamp() (0 = unknown)
+     */
+    void write_message( int prio, uint64_t timestamp, unsigned long threadId, const char* threadName, const char* category,
+                        const char* function, const char* format, const char* args, size_t argsLen );
+
+    /**
+     * Writes an already formatted message.
+     *
+     * @param[in] timestamp Time when the message was generated, from log::get_timestamp() (0 = unknown)
+     */
+    void write_text( int prio, uint64_t timestamp, unsigned long threadId, const char* threadName, const char* category,
+                     const char* function, const char* msg );
+
+    void flush();
+
+private:
+    struct site_key
+    {
+        const char* category;
+        const char* function;
+        const char* format;
+
+        bool operator==( const site_key& other ) const
+        {
+            return ( category == other.category ) && ( function == other.function ) && ( format == other.format );
+        }
+    };
+
+    struct site_key_hash
+    {
+        size_t operator()( const site_key& key ) const
+        {
+            size_t h = reinterpret_cast<size_t>( key.format );
+            h = ( h * 31 ) ^ reinterpret_cast<size_t>( key.function );
+            h = ( h * 31 ) ^ reinterpret_cast<size_t>( key.category );
+            return h;
+        }
+    };
+
+    struct thread_ref
+    {
+        uint32_t ref;
+        std::string name;
+    };
+
+    uint32_t get_thread_ref( unsigned long threadId, const char* threadName );
+    void write_u8( uint8_t value );
+    void write_u32( uint32_t value );
+    void write_u64( uint64_t value );
+    void write_string( const char* str );
+
+    FILE* m_file;
+    std::vector<char> m_fileBuffer;
+    std::mutex m_mutex;
+    std::unordered_map<site_key, uint32_t, site_key_hash> m_sites;
+    std::unordered_map<unsigned long, thread_ref> m_threads;    // Last reference written for each thread
+    uint32_t m_threadCount;
+};
+
+/**
+ * Message read from a binary log file.
+ */
+struct binary_log_entry
+{
+    int prio;
+    uint64_t timestamp;         // Wall-clock time in nanoseconds since the epoch (0 = unknown)
+    unsigned long thread_id;    // 0 = unknown
+    std::string thread_name;
+    bool has_category;
+    std::string category;
+    std::string function;
+    std::string msg;
+};
+
+/**
+ * Reader of binary log files.
+ */
+class binary_log_reader
+{
+public:
+    binary_log_reader();
+    ~binary_log_reader();
+
+    /**
+     * Opens a binary log file and reads its header.
+     *
+     * @retval true on success
+     * @retval false if the file couldn't be opened or is not a valid binary log file
+     */
+    bool open( const char* path );
+
+    const std::string& get_program_name() const
+    {
+        return m_programName;
+    }
+
+    /**
+     * Reads the next message, rendering its text.
+     *
+     * @retval true if a message was read
+     * @retval false at the end of the file, or if the rest of the file is truncated or corrupted
+     */
+    bool read_next( binary_log_entry& entry );
+
+private:
+    struct site
+    {
+        bool has_category;
+        std::string category;
+        std::string function;
+        std::string format;
+    };
+
+    struct thread
+    {
+        unsigned long id;
+        std::string name;
+    };
+
+    bool read_u8( uint8_t& value );
+    bool read_u32( uint32_t& value );
+    bool read_u64( uint64_t& value );
+    bool read_string( std::string& str, bool* isNull = NULL );
+
+    FILE* m_file;
+    std::string m_programName;
+    std::vector<site> m_sites;
+    std::vector<thread> m_threads;
+    std::string m_args;
+};
+
+} // namespace
+} // namespace
+
+#endif // header guard
@@ -0,0 +1,287 @@
+/**
+ * @file
+ * @brief      Implementation of the log clock and the formatting of timestamps
+ * @authors    Jesus Gonzalez <jgonzalez@gdr-sistemas.com>
+ * @copyright  Copyright (c) 2003-2016 Jesus Gonzalez
+ * @license    See LICENSE.txt
+ */
+
+#include "Extended/log.hpp"
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+
+#include "log_internal.hpp"
+
+#if defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) )
+    #include <x86intrin.h>
+    #include <cpuid.h>
+    #define TSC_SUPPORTED
+#elif defined(_MSC_VER) && ( defined(_M_X64) || defined(_M_IX86) )
+    #include <intrin.h>
+    #define TSC_SUPPORTED
+#endif
+
+using namespace ext;
+using namespace ext::log_internal;
+
+namespace
+{
+
+enum clock_mode
+{
+    MODE_UNINITIALIZED = 0,
+    MODE_TSC = 1,
+    MODE_MONOTONIC = 2
+};
+
+/**
+ * Cache of the date and time text (up to the seconds) of the last timestamp formatted by a thread.
+ */
+struct date_cache
+{
+    uint64_t second;    // Seconds since the epoch of the cached text (0 = nothing cached)
+    char text[20];      // "YYYY-MM-DD HH:MM:SS"
+};
+
+} // namespace
+
+static std::atomic<int> g_clockMode( MODE_UNINITIALIZED );
+static std::once_flag g_clockInit;
+
+// Reference points taken when the clock is initialized
+static uint64_t g_baseTicks;
+static uint64_t g_baseMonotonicNs;
+static uint64_t g_baseWallNs;
+
+// TSC calibration, refined each time the time elapsed since the reference point doubles
+static std::mutex g_calibrationMutex;
+static std::atomic<double> g_nsPerTick( 0.0 );
+static std::atomic<uint64_t> g_calibrationSpan( 0 );
+
+static std::atomic<bool> g_timestampsEnabled( LOG_TIMESTAMPS_DEFAULT != 0 );
+
+static thread_local date_cache t_dateCache;
+
+static uint64_t get_monotonic_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+static uint64_t get_wall_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch() ).count();
+}
+
+#ifdef TSC_SUPPORTED
+
+/**
+ * Indicates if the TSC runs at a constant rate, independent of the power state of the processor.
+ */
+static bool is_tsc_invariant()
+{
+#ifdef _MSC_VER
+    int regs[4];
+    __cpuid( regs, 0x80000000 );
+    if( (unsigned int) regs[0] < 0x80000007 )
+    {
+        return false;
+    }
+    __cpuid( regs, 0x80000007 );
+    return ( regs[3] & ( 1 << 8 ) ) != 0;
+#else
+    unsigned int eax, ebx, ecx, edx;
+    if( !__get_cpuid( 0x80000007, &eax, &ebx, &ecx, &edx ) )
+    {
+        return false;
+    }
+    return ( edx & ( 1 << 8 ) ) != 0;
+#endif
+}
+
+#endif
+
+static void init_clock()
+{
+    int mode = MODE_MONOTONIC;
+
+#ifdef TSC_SUPPORTED
+    if( is_tsc_invariant() )
+    {
+        mode = MODE_TSC;
+        g_baseTicks = __rdtsc();
+    }
+#endif
+
+    g_baseMonotonicNs = get_monotonic_ns();
+    g_baseWallNs = get_wall_ns();
+
+    if( mode == MODE_MONOTONIC )
+    {
+        g_baseTicks = g_baseMonotonicNs;
+    }
+
+    g_clockMode.store( mode, std::memory_order_release );
+}
+
+static int get_clock_mode()
+{
+    int mode = g_clockMode.load( std::memory_order_acquire );
+    if( mode == MODE_UNINITIALIZED )
+    {
+        std::call_once( g_clockInit, init_clock );
+        mode = g_clockMode.load( std::memory_order_acquire );
+    }
+    return mode;
+}
+
+uint64_t ext::log::get_timestamp() noexcept
+{
+#ifdef TSC_SUPPORTED
+    if( get_clock_mode() == MODE_TSC )
+    {
+        return __rdtsc();
+    }
+#endif
+
+    return get_monotonic_ns();
+}
+
+#ifdef TSC_SUPPORTED
+
+/**
+ * Calibrates the TSC frequency against the monotonic clock, over the time elapsed since the clock was
+ * initialized.
+ *
+ * @param[in] span Ticks elapsed since the reference point of the timestamp being converted
+ */
+static double calibrate_tsc( uint64_t span )
+{
+    std::lock_guard<std::mutex> lock( g_calibrationMutex );
+
+    double nsPerTick = g_nsPerTick.load( std::memory_order_relaxed );
+    if( ( nsPerTick != 0.0 ) && ( span <= g_calibrationSpan.load( std::memory_order_relaxed ) * 2 ) )
+    {
+        return nsPerTick; // Already calibrated by another thread
+    }
+
+    // The error of the calibration is bounded by the jitter of reading the clocks, therefore it's
+    // negligible for timestamps within the calibrated span, however short it is
+    uint64_t ticks = __rdtsc();
+    uint64_t elapsedNs = get_monotonic_ns() - g_baseMonotonicNs;
+
+    uint64_t elapsedTicks = ticks - g_baseTicks;
+    nsPerTick = ( elapsedTicks > 0 ) ? ( (double) elapsedNs / (double) elapsedTicks ) : 1.0;
+
+    g_calibrationSpan.store( elapsedTicks, std::memory_order_relaxed );
+    g_nsPerTick.store( nsPerTick, std::memory_order_relaxed );
+
+    return nsPerTick;
+}
+
+#endif
+
+uint64_t ext::log::timestamp_to_wall_ns( uint64_t timestamp ) noexcept
+{
+    int mode = get_clock_mode();
+
+    int64_t elapsed = (int64_t) ( timestamp - g_baseTicks );
+
+#ifdef TSC_SUPPORTED
+    if( mode == MODE_TSC )
+    {
+        uint64_t span = ( elapsed > 0 ) ? elapsed : -elapsed;
+        double nsPerTick = g_nsPerTick.load( std::memory_order_relaxed );
+        if( ( nsPerTick == 0.0 ) || ( span > g_calibrationSpan.load( std::memory_order_relaxed ) * 2 ) )
+        {
+            nsPerTick = calibrate_tsc( span );
+        }
+        elapsed = (int64_t) ( (double) elapsed * nsPerTick );
+    }
+#else
+    (void) mode;
+#endif
+
+    return g_baseWallNs + elapsed;
+}
+
+void ext::log::set_timestamps_enabled( bool enabled ) noexcept
+{
+    g_timestampsEnabled.store( enabled, std::memory_order_relaxed );
+}
+
+bool ext::log::are_timestamps_enabled() noexcept
+{
+    return g_timestampsEnabled.load( std::memory_order_relaxed );
+}
+
+static void write_digits( char* out, unsigned int value, unsigned int digits )
+{
+    for( unsigned int i = digits; i > 0; i-- )
+    {
+        out[i - 1] = (char) ( '0' + ( value % 10 ) );
+        value /= 10;
+    }
+}
+
+size_t ext::log_internal::format_timestamp( uint64_t timestamp, char* out )
+{
+    if( ( timestamp == 0 ) || !g_timestampsEnabled.load( std::memory_order_relaxed ) )
+    {
+        out[0] = '\0';
+        return 0;
+    }
+
+    return format_wall_timestamp( log::timestamp_to_wall_ns( timestamp ), out );
+}
+
+size_t ext::log_internal::format_wall_timestamp( uint64_t wallNs, char* out )
+{
+    if( ( wallNs == 0 ) || !g_timestampsEnabled.load( std::memory_order_relaxed ) )
+    {
+        out[0] = '\0';
+        return 0;
+    }
+
+    uint64_t second = wallNs / 1000000000ull;
+
+    // The date and time are only rendered once per second, only the microseconds are rendered per line
+    date_cache& cache = t_dateCache;
+    if( cache.second != second )
+    {
+        time_t t = (time_t) second;
+        struct tm local;
+#ifdef WIN32
+        localtime_s( &local, &t );
+#else
+        localtime_r( &t, &local );
+#endif
+        write_digits( &cache.text[0], local.tm_year + 1900, 4 );
+        cache.text[4] = '-';
+        write_digits( &cache.text[5], local.tm_mon + 1, 2 );
+        cache.text[7] = '-';
+        write_digits( &cache.text[8], local.tm_mday, 2 );
+        cache.text[10] = ' ';
+        write_digits( &cache.text[11], local.tm_hour, 2 );
+        cache.text[13] = ':';
+        write_digits( &cache.text[14], local.tm_min, 2 );
+        cache.text[16] = ':';
+        write_digits( &cache.text[17], local.tm_sec, 2 );
+        cache.text[19] = '\0';
+        cache.second = second;
+    }
+
+    memcpy( out, cache.text, 19 );
+    out[19] = '.';
+    write_digits( &out[20], (unsigned int) ( ( wallNs % 1000000000ull ) / 1000 ), 6 );
+    out[26] = ' ';
+    out[27] = '\0';
+
+    return 27;
+}
@@ -0,0 +1,255 @@
+/**
+ * @file
+ * @brief      Implementation of the log configuration read from text
+ * @authors    Jesus Gonzalez <jgonzalez@gdr-sistemas.com>
+ * @copyright  Copyright (c) 2003-2016 Jesus Gonzalez
+ * @license    See LICENSE.txt
+ */
+
+#include "Extended/log_config.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "Extended/runtime_error.hpp"
+#include "Extended/string.hpp"
+
+using namespace ext;
+
+namespace
+{
+
+enum config_section
+{
+    SECTION_GENERAL,
+    SECTION_CATEGORIES,
+    SECTION_SINKS
+};
+
+} // namespace
+
+static const char* const g_priorityNames[] =
+{
+    "OFF", "ERROR", "WARN", "INFO", "DEBUG", "TRACE", "DEBUG_EXTRA", "ALLOC"
+};
+
+/**
+ * Parses a priority given by name or by numeric value.
+ *
+ * @return The priority, or -1 if not valid
+ */
+static int parse_priority( const std::string& value )
+{
+    std::string name = to_uppercase( value );
+
+    for( int i = 0; i <= LOG_PRIORITY_ALLOC; i++ )
+    {
+        if( name == g_priorityNames[i] )
+        {
+            return i;
+        }
+    }
+
+    char* end;
+    long priority = strtol( value.c_str(), &end, 10 );
+    if( value.empty() || ( *end != '\0' ) || ( priority < 0 ) || ( priority > LOG_PRIORITY_ALLOC ) )
+    {
+        return -1;
+    }
+
+    return (int) priority;
+}
+
+/**
+ * Parses a switch ("on" / "off").
+ *
+ * @return 1 or 0, or -1 if not valid
+ */
+static int parse_switch( const std::string& value )
+{
+    std::string name = to_lowercase( value );
+
+    if( ( name == "on" ) || ( name == "true" ) || ( name == "1" ) )
+    {
+        return 1;
+    }
+    else if( ( name == "off" ) || ( name == "false" ) || ( name == "0" ) )
+    {
+        return 0;
+    }
+    else
+    {
+        return -1;
+    }
+}
+
+log_config::log_config() noexcept
+: m_priorityLimit( -1 ), m_timestamps( -1 ), m_threadTags( -1 )
+{
+}
+
+log_config log_config::parse( const std::string& text )
+{
+    log_config config;
+    config_section section = SECTION_GENERAL;
+    unsigned int lineNumber = 0;
+    size_t start = 0;
+
+    while( start < text.size() )
+    {
+        size_t end = text.find( '\n', start );
+        if( end == std::string::npos )
+        {
+            end = text.size();
+        }
+
+        std::string line = trim( text.substr( start, end - start ) );
+        start = end + 1;
+        lineNumber++;
+
+        if( line.empty() || ( line[0] == '#' ) || ( line[0] == ';' ) )
+        {
+            continue;
+        }
+
+        if( line[0] == '[' )
+        {
+            std::string name = ( line.back() == ']' ) ? to_lowercase( trim( line.substr( 1, line.size() - 2 ) ) ) : "";
+
+            if( name == "categories" )
+            {
+                section = SECTION_CATEGORIES;
+            }
+            else if( name == "sinks" )
+            {
+                section = SECTION_SINKS;
+            }
+            else
+            {
+                THROW_ERROR( "Invalid log configuration (line %u): unknown section '%s'", lineNumber, line.c_str() );
+            }
+            continue;
+        }
+
+        size_t separator = line.find( '=' );
+        if( separator == std::string::npos )
+        {
+            THROW_ERROR( "Invalid log configuration (line %u): expected 'name = value'", lineNumber );
+        }
+
+        std::string key = trim( line.substr( 0, separator ) );
+        std::string value = trim( line.substr( separator + 1 ) );
+
+        if( key.empty() )
+        {
+            THROW_ERROR( "Invalid log configuration (line %u): expected 'name = value'", lineNumber );
+        }
+
+        if( ( section == SECTION_GENERAL ) && ( ( key == "timestamps" ) || ( key == "thread_tags" ) ) )
+        {
+            int enabled = parse_switch( value );
+            if( enabled < 0 )
+            {
+                THROW_ERROR( "Invalid log configuration (line %u): invalid value '%s' (expected 'on' or 'off')",
+                             lineNumber, value.c_str() );
+            }
+
+            ( ( key == "timestamps" ) ? config.m_timestamps : config.m_threadTags ) = enabled;
+            continue;
+        }
+
+        if( ( section == SECTION_GENERAL ) && ( key != "priority" ) )
+        {
+            THROW_ERROR( "Invalid log configuration (line %u): unknown setting '%s'", lineNumber, key.c_str() );
+        }
+
+        int priority = parse_priority( value );
+        if( priority < 0 )
+        {
+            THROW_ERROR( "Invalid log configuration (line %u): invalid priority '%s'", lineNumber, value.c_str() );
+        }
+
+        if( section == SECTION_GENERAL )
+        {
+            config.m_priorityLimit = priority;
+        }
+        else if( section == SECTION_CATEGORIES )
+        {
+            config.m_categoryLimits.push_back( std::make_pair( key, priority ) );
+        }
+        else
+        {
+            config.m_sinkLimits.push_back( std::make_pair( key, priority ) );
+        }
+    }
+
+    return config;
+}
+
+log_config log_config::load( const char* path )
+{
+    FILE* file = fopen( path, "rb" );
+    if( file == NULL )
+    {
+        THROW_ERROR( "Error reading log configuration file '%s'", path );
+    }
+
+    std::string text;
+    char buffer[1024];
+    size_t size;
+    while( ( size = fread( buffer, 1, sizeof( buffer ), file ) ) > 0 )
+    {
+        text.append( buffer, size );
+    }
+
+    bool failed = ( ferror( file ) != 0 );
+    fclose( file );
+
+    if( failed )
+    {
+        THROW_ERROR( "Error reading log configuration file '%s'", path ); // LCOV_EXCL_LINE
+    }
+
+    return parse( text );
+}
+
+void log_config::apply( const sink_map& sinks ) const
+{
+    if( m_timestamps >= 0 )
+    {
+        log::set_timestamps_enabled( m_timestamps != 0 );
+    }
+
+    if( m_threadTags >= 0 )
+    {
+        log::set_thread_tags_enabled( m_threadTags != 0 );
+    }
+
+    for( const std::pair<std::string, int>& limit : m_sinkLimits )
+    {
+        sink_map::const_iterator it = sinks.find( limit.first );
+        if( ( it != sinks.end() ) && it->second )
+        {
+            it->second->set_priority_limit( limit.second );
+        }
+    }
+
+    int priorityLimit = ( m_priorityLimit >= 0 ) ? m_priorityLimit : log::get_priority_limit();
+
+    log::set_priority_limits( priorityLimit, m_categoryLimits );
+}
+
+int log_config::get_priority_limit() const noexcept
+{
+    return m_priorityLimit;
+}
+
+const std::vector<std::pair<std::string, int>>& log_config::get_category_limits() const noexcept
+{
+    return m_categoryLimits;
+}
+
+const std::vector<std::pair<std::string, int>>& log_config::get_sink_limits() const noexcept
+{
+    return m_sinkLimits;
+}
@@ -0,0 +1,507 @@
+/**
+ * @file
+ * @brief      Implementation of the rendering and encoding of the fields of structured log messages
+ * @authors    Jesus Gonzalez <jgonzalez@gdr-sistemas.com>
+ * @copyright  Copyright (c) 2003-2016 Jesus Gonzalez
+ * @license    See LICENSE.txt
+ */
+
+#include "Extended/log.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "log_internal.hpp"
+
+using namespace ext;
+using namespace ext::log_internal;
+
+#define NUMBER_BUFFER_SIZE  32
+
+static const char g_digitPairs[] =
+        "00010203040506070809"
+        "10111213141516171819"
+        "20212223242526272829"
+        "30313233343536373839"
+        "40414243444546474849"
+        "50515253545556575859"
+        "60616263646566676869"
+        "70717273747576777879"
+        "80818283848586878889"
+        "90919293949596979899";
+
+/**
+ * Renders an unsigned integer backwards from the end of a buffer, two digits at a time.
+ *
+ * @return Pointer to the first character of the text
+ */
+static char* render_uint( uint64_t value, char* end )
+{
+    char* p = end;
+
+    while( value >= 100 )
+    {
+        unsigned int pair = (unsigned int) ( value % 100 ) * 2;
+        value /= 100;
+        *--p = g_digitPairs[pair + 1];
+        *--p = g_digitPairs[pair];
+    }
+
+    if( value >= 10 )
+    {
+        unsigned int pair = (unsigned int) value * 2;
+        *--p = g_digitPairs[pair + 1];
+        *--p = g_digitPairs[pair];
+    }
+    else
+    {
+        *--p = (char) ( '0' + value );
+    }
+
+    return p;
+}
+
+static void append_uint( std::string& out, uint64_t value )
+{
+    char buffer[NUMBER_BUFFER_SIZE];
+    char* end = buffer + sizeof( buffer );
+    char* start = render_uint( value, end );
+    out.append( start, end - start );
+}
+
+static void append_int( std::string& out, int64_t value )
+{
+    if( value < 0 )
+    {
+        out += '-';
+        append_uint( out, 0 - (uint64_t) value );
+    }
+    else
+    {
+        append_uint( out, (uint64_t) value );
+    }
+}
+
+/**
+ * Appends a floating point number, with the shortest text that converts back to the same number.
+ *
+ * Numbers with up to 6 decimals (which is the common case for measurements) are rendered with integer
+ * arithmetic, the rest are rendered with printf.
+ */
+static void append_double( std::string& out, double value, bool json )
+{
+    if( value != value )
+    {
+        out += json ? "null" : "NaN";
+        return;
+    }
+    else if( ( value == HUGE_VAL ) || ( value == -HUGE_VAL ) )
+    {
+        out += json ? "null" : ( ( value > 0 ) ? "+Inf" : "-Inf" );
+        return;
+    }
+
+    double magnitude = ( value < 0 ) ? -value : value;
+    if( magnitude < 1e12 )
+    {
+        uint64_t micros = (uint64_t) ( magnitude * 1e6 + 0.5 );
+        if( (double) micros / 1e6 == magnitude )
+        {
+            if( value < 0 )
+            {
+                out += '-';
+            }
+            append_uint( out, micros / 1000000 );
+
+            unsigned int fraction = (unsigned int) ( micros % 1000000 );
+            if( fraction != 0 )
+            {
+                char decimals[7];
+                for( int i = 5; i >= 0; i-- )
+                {
+                    decimals[i] = (char) ( '0' + ( fraction % 10 ) );
+                    fraction /= 10;
+                }
+                int len = 6;
+                while( decimals[len - 1] == '0' )
+                {
+                    len--;
+                }
+                out += '.';
+                out.append( decimals, len );
+            }
+            return;
+        }
+    }
+
+    char buffer[NUMBER_BUFFER_SIZE];
+    int len = snprintf( buffer, sizeof( buffer ), "%.15g", value );
+    if( strtod( buffer, NULL ) != value )
+    {
+        len = snprintf( buffer, sizeof( buffer ), "%.17g", value );
+    }
+    out.append( buffer, len );
+}
+
+static bool needs_quotes( const char* str, size_t len )
+{
+    if( len == 0 )
+    {
+        return true;
+    }
+
+    for( size_t i = 0; i < len; i++ )
+    {
+        unsigned char c = (unsigned char) str[i];
+        if( ( c <= ' ' ) || ( c == '"' ) || ( c == '=' ) || ( c == '\\' ) || ( c == 0x7F ) )
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void ext::log_internal::append_json_string( std::string& out, const char* str, size_t len )
+{
+    static const char hexDigits[] = "0123456789abcdef";
+
+    out += '"';
+
+    // Runs of characters that don't need to be escaped are appended at once
+    size_t start = 0;
+    for( size_t i = 0; i < len; i++ )
+    {
+        unsigned char c = (unsigned char) str[i];
+        if( ( c >= 0x20 ) && ( c != '"' ) && ( c != '\\' ) )
+        {
+            continue;
+        }
+
+        out.append( str + start, i - start );
+        start = i + 1;
+
+        switch( c )
+        {
+        case '"':
+            out += "\\\"";
+            break;
+        case '\\':
+            out += "\\\\";
+            break;
+        case '\n':
+            out += "\\n";
+            break;
+        case '\r':
+            out += "\\r";
+            break;
+        case '\t':
+            out += "\\t";
+            break;
+        default:
+            out += "\\u00";
+            out += hexDigits[c >> 4];
+            out += hexDigits[c & 0xF];
+            break;
+        }
+    }
+    out.append( str + start, len - start );
+
+    out += '"';
+}
+
+/**
+ * Appends a logfmt value, quoted only if needed.
+ */
+static void append_logfmt_string( std::string& out, const char* str, size_t len )
+{
+    if( needs_quotes( str, len ) )
+    {
+        append_json_string( out, str, len );
+    }
+    else
+    {
+        out.append( str, len );
+    }
+}
+
+static void append_value( std::string& out, const log_field& field, bool json )
+{
+    switch( field.type() )
+    {
+    case log_field::TYPE_INT:
+        append_int( out, field.int_value() );
+        break;
+    case log_field::TYPE_UINT:
+        append_uint( out, field.uint_value() );
+        break;
+    case log_field::TYPE_DOUBLE:
+        append_double( out, field.double_value(), json );
+        break;
+    case log_field::TYPE_BOOL:
+        out += field.bool_value() ? "true" : "false";
+        break;
+    case log_field::TYPE_STRING:
+        if( json )
+        {
+            append_json_string( out, field.string_value(), field.string_length() );
+        }
+        else
+        {
+            append_logfmt_string( out, field.string_value(), field.string_length() );
+        }
+        break;
+    }
+}
+
+void ext::log_internal::append_field_text( std::string& out, const log_field& field )
+{
+    if( field.type() == log_field::TYPE_STRING )
+    {
+        out.append( field.string_value(), field.string_length() );
+    }
+    else
+    {
+        append_value( out, field, false );
+    }
+}
+
+void ext::log_internal::append_fields_logfmt( std::string& out, const log_field* fields, size_t count )
+{
+    for( size_t i = 0; i < count; i++ )
+    {
+        out += ' ';
+        out += fields[i].key();
+        out += '=';
+        append_value( out, fields[i], false );
+    }
+}
+
+void ext::log_internal::append_fields_json( std::string& out, const log_field* fields, size_t count )
+{
+    for( size_t i = 0; i < count; i++ )
+    {
+        out += ',';
+        append_json_string( out, fields[i].key(), strlen( fields[i].key() ) );
+        out += ':';
+        append_value( out, fields[i], true );
+    }
+}
+
+static uint64_t hash_bytes( uint64_t hash, const void* data, size_t len )
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>( data );
+    for( size_t i = 0; i < len; i++ )
+    {
+        hash = ( hash ^ bytes[i] ) * 1099511628211ull;
+    }
+    return hash;
+}
+
+uint64_t ext::log_internal::hash_fields( const char* msg, const log_field* fields, size_t count ) noexcept
+{
+    // FNV-1a of the message text and the values of the fields (keys are constant for a call site)
+    uint64_t hash = hash_bytes( 14695981039346656037ull, msg, strlen( msg ) );
+
+    for( size_t i = 0; i < count; i++ )
+    {
+        const log_field& field = fields[i];
+        if( field.type() == log_field::TYPE_STRING )
+        {
+            hash = hash_bytes( hash, field.string_value(), field.string_length() );
+            hash = hash_bytes( hash, "", 1 );
+        }
+        else
+        {
+            uint64_t value = field.uint_value();
+            if( field.type() == log_field::TYPE_DOUBLE )
+            {
+                double d = field.double_value();
+                memcpy( &value, &d, sizeof( value ) );
+            }
+            else if( field.type() == log_field::TYPE_BOOL )
+            {
+                value = field.bool_value();
+            }
+            hash = hash_bytes( hash, &value, sizeof( value ) );
+        }
+    }
+
+    return ( hash != 0 ) ? hash : 1;
+}
+
+/*
+ * Encoding of each field: type (1 byte), key (null-terminated), and value (8 bytes, or for strings, its
+ * length in 8 bytes followed by its characters).
+ */
+
+void ext::log_internal::encode_fields( std::string& out, const log_field* fields, size_t count )
+{
+    out.clear();
+
+    for( size_t i = 0; i < count; i++ )
+    {
+        const log_field& field = fields[i];
+
+        out += (char) field.type();
+        out.append( field.key(), strlen( field.key() ) + 1 );
+
+        uint64_t value;
+        switch( field.type() )
+        {
+        case log_field::TYPE_DOUBLE:
+        {
+            double d = field.double_value();
+            memcpy( &value, &d, sizeof( value ) );
+            break;
+        }
+        case log_field::TYPE_BOOL:
+            value = field.bool_value();
+            break;
+        case log_field::TYPE_STRING:
+            value = field.string_length();
+            break;
+        default:
+            value = field.uint_value();
+            break;
+        }
+        out.append( reinterpret_cast<const char*>( &value ), sizeof( value ) );
+
+        if( field.type() == log_field::TYPE_STRING )
+        {
+            out.append( field.string_value(), field.string_length() );
+        }
+    }
+}
+
+void ext::log_internal::decode_fields( const std::string& data, std::vector<log_field>& fields )
+{
+    fields.clear();
+
+    const char* p = data.data();
+    const char* end = p + data.size();
+
+    while( p < end )
+    {
+        log_field::field_type type = (log_field::field_type) *p++;
+        const char* key = p;
+        p += strlen( key ) + 1;
+
+        uint64_t value;
+        memcpy( &value, p, sizeof( value ) );
+        p += sizeof( value );
+
+        switch( type )
+        {
+        case log_field::TYPE_INT:
+            fields.push_back( log_field( key, (long long) value ) );
+            break;
+        case log_field::TYPE_UINT:
+            fields.push_back( log_field( key, (unsigned long long) value ) );
+            break;
+        case log_field::TYPE_DOUBLE:
+        {
+            double d;
+            memcpy( &d, &value, sizeof( d ) );
+            fields.push_back( log_field( key, d ) );
+            break;
+        }
+        case log_field::TYPE_BOOL:
+            fields.push_back( log_field( key, value != 0 ) );
+            break;
+        case log_field::TYPE_STRING:
+            fields.push_back( log_field( key, p, (size_t) value ) );
+            p += value;
+            break;
+        }
+    }
+}
+
+/**
+ * Returns the name of a priority (e.g. "ERROR"), taken from its tag.
+ */
+static std::string get_level_name( int prio )
+{
+    const char* tag = get_priority_tag( prio );
+    return std::string( tag + 1, strlen( tag ) - 2 );
+}
+
+void ext::log_internal::append_json_line( std::string& out, const log_record& record, const char* program )
+{
+    char timestampText[LOG_TIMESTAMP_SIZE];
+    size_t timestampLen = format_timestamp( record.timestamp(), timestampText );
+
+    out += '{';
+    if( timestampLen > 0 )
+    {
+        out += "\"ts\":";
+        append_json_string( out, timestampText, timestampLen - 1 );
+        out += ',';
+    }
+    out += "\"level\":\"";
+    out += get_level_name( record.priority() );
+    out += "\",\"program\":";
+    append_json_string( out, program, strlen( program ) );
+    if( record.category() != NULL )
+    {
+        out += ",\"category\":";
+        append_json_string( out, record.category(), strlen( record.category() ) );
+    }
+    out += ",\"function\":";
+    append_json_string( out, record.function(), strlen( record.function() ) );
+    if( ( record.thread_id() != 0 ) && log::are_thread_tags_enabled() )
+    {
+        out += ",\"thread_id\":";
+        append_uint( out, record.thread_id() );
+        if( record.thread_name()[0] != '\0' )
+        {
+            out += ",\"thread\":";
+            append_json_string( out, record.thread_name(), strlen( record.thread_name() ) );
+        }
+    }
+    out += ",\"msg\":";
+    append_json_string( out, record.base_message(), strlen( record.base_message() ) );
+    append_fields_json( out, record.fields(), record.field_count() );
+    out += "}\n";
+}
+
+void ext::log_internal::append_logfmt_line( std::string& out, const log_record& record, const char* program )
+{
+    char timestampText[LOG_TIMESTAMP_SIZE];
+    size_t timestampLen = format_timestamp( record.timestamp(), timestampText );
+
+    if( timestampLen > 0 )
+    {
+        out += "ts=";
+        append_json_string( out, timestampText, timestampLen - 1 );
+        out += ' ';
+    }
+    out += "level=";
+    out += get_level_name( record.priority() );
+    out += " program=";
+    append_logfmt_string( out, program, strlen( program ) );
+    if( record.category() != NULL )
+    {
+        out += " category=";
+        append_logfmt_string( out, record.category(), strlen( record.category() ) );
+    }
+    out += " function=";
+    append_logfmt_string( out, record.function(), strlen( record.function() ) );
+    if( ( record.thread_id() != 0 ) && log::are_thread_tags_enabled() )
+    {
+        out += " thread_id=";
+        append_uint( out, record.thread_id() );
+        if( record.thread_name()[0] != '\0' )
+        {
+            out += " thread=";
+            append_logfmt_string( out, record.thread_name(), strlen( record.thread_name() ) );
+        }
+    }
+    out += " msg=";
+    append_logfmt_string( out, record.base_message(), strlen( record.base_message() ) );
+    append_fields_logfmt( out, record.fields(), record.field_count() );
+    out += '\n';
+}
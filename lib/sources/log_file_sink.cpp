@@ -0,0 +1,498 @@
+/**
+ * @file
+ * @brief      Implementation of the buffered log file sink
+ * @authors    Jesus Gonzalez <jgonzalez@gdr-sistemas.com>
+ * @copyright  Copyright (c) 2003-2016 Jesus Gonzalez
+ * @license    See LICENSE.txt
+ */
+
+#include "local_log.hpp"
+#include "Extended/log_file_sink.hpp"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <chrono>
+#include <vector>
+
+#ifdef WIN32
+    #include <io.h>
+#else
+    #include <unistd.h>
+    #include <sys/uio.h>
+#endif
+
+#include "Extended/string.hpp"
+#include "Extended/runtime_error.hpp"
+#include "log_internal.hpp"
+
+using namespace ext;
+using namespace ext::log_internal;
+
+#define MAX_QUEUED_BUFFERS  8   // Logging threads wait for the writer thread when exceeded
+#define MAX_SPARE_BUFFERS   4
+
+#ifdef WIN32
+    #define OPEN_FLAGS  ( _O_WRONLY | _O_CREAT | _O_APPEND | _O_BINARY )
+    #define TRUNC_FLAG  _O_TRUNC
+    #define OPEN_MODE   ( _S_IREAD | _S_IWRITE )
+    #define open        _open
+    #define close       _close
+    #define fstat       _fstat
+    #define stat_t      struct _stat
+#else
+    #define OPEN_FLAGS  ( O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC )
+    #define TRUNC_FLAG  O_TRUNC
+    #define OPEN_MODE   0644
+    #define stat_t      struct stat
+#endif
+
+void ext::log_internal::shift_backup_files( const std::string& path, unsigned int maxBackupFiles )
+{
+    // Older backups are shifted, and the oldest one is overwritten
+    for( unsigned int i = maxBackupFiles; i > 0; i-- )
+    {
+        std::string from = ( i > 1 ) ? format( "%s.%u", path.c_str(), i - 1 ) : path;
+        std::string to = format( "%s.%u", path.c_str(), i );
+#ifdef WIN32
+        remove( to.c_str() );
+#endif
+        rename( from.c_str(), to.c_str() );
+    }
+}
+
+struct file_log_sink::impl : public crash_flusher
+{
+    impl( const char* filePath, const options& fileOptions )
+    : path( filePath ), opts( fileOptions ), queuedCount( 0 ), writtenCount( 0 ), stop( false ), droppedBytes( 0 ),
+      fd( -1 ), fileSize( 0 )
+    {}
+
+    void append( const log_record& record );
+    void queue_active();
+    void hand_off( std::unique_lock<std::mutex>& lock );
+    bool open_file( bool truncate );
+    void rotate_file();
+    void write_buffers( const std::vector<std::string>& buffers, size_t size );
+    void writer_main();
+
+    void crash_write( std::string& buffer ) noexcept;
+    virtual void crash_flush() noexcept override;
+
+    const std::string path;
+    const options opts;
+
+    std::mutex mutex;
+    std::condition_variable writerCv;
+    std::condition_variable writtenCv;
+    std::string active;                 // Buffer where messages are appended
+    std::vector<std::string> queue;     // Buffers pending to be written
+    std::vector<std::string> spare;     // Buffers already written, kept to avoid allocations
+    uint64_t queuedCount;
+    uint64_t writtenCount;
+    bool stop;
+
+    std::atomic<unsigned long long> droppedBytes;
+
+    // Only used by the writer thread (once started)
+    std::thread writer;
+    int fd;
+    uint64_t fileSize;
+    std::chrono::steady_clock::time_point openTime;
+};
+
+void file_log_sink::impl::append( const log_record& record )
+{
+    switch( opts.format )
+    {
+    case FORMAT_JSON:
+        append_json_line( active, record, get_program_name() );
+        break;
+    case FORMAT_LOGFMT:
+        append_logfmt_line( active, record, get_program_name() );
+        break;
+    default:
+        append_log_line( active, record, get_program_name(), false );
+        break;
+    }
+}
+
+/**
+ * Moves the active buffer to the queue of buffers pending to be written (the mutex must be locked).
+ */
+void file_log_sink::impl::queue_active()
+{
+    queue.push_back( std::string() );
+    queue.back().swap( active );
+    if( !spare.empty() )
+    {
+        active.swap( spare.back() );
+        spare.pop_back();
+    }
+    else
+    {
+        active.reserve( opts.buffer_size + 1024 );
+    }
+    queuedCount++;
+}
+
+/**
+ * Hands the active buffer to the writer thread (the mutex must be locked).
+ */
+void file_log_sink::impl::hand_off( std::unique_lock<std::mutex>& lock )
+{
+    while( queue.size() >= MAX_QUEUED_BUFFERS )
+    {
+        writtenCv.wait( lock );
+    }
+
+    queue_active();
+
+    writerCv.notify_one();
+}
+
+bool file_log_sink::impl::open_file( bool truncate )
+{
+    fd = open( path.c_str(), OPEN_FLAGS | ( truncate ? TRUNC_FLAG : 0 ), OPEN_MODE );
+    if( fd < 0 )
+    {
+        return false;
+    }
+
+    stat_t st;
+    fileSize = ( fstat( fd, &st ) == 0 ) ? st.st_size : 0;
+    openTime = std::chrono::steady_clock::now();
+
+    return true;
+}
+
+void file_log_sink::impl::rotate_file()
+{
+    close( fd );
+    fd = -1;
+    fileSize = 0;
+
+    shift_backup_files( path, opts.max_backup_files );
+
+    open_file( true );
+}
+
+/**
+ * Writes the buffers into the file, which is reopened first if that failed when it was rotated.
+ *
+ * The bytes that can't be written are counted as dropped.
+ */
+void file_log_sink::impl::write_buffers( const std::vector<std::string>& buffers, size_t size )
+{
+    if( ( fd < 0 ) && !open_file( false ) )
+    {
+        droppedBytes.fetch_add( size, std::memory_order_relaxed );
+        return;
+    }
+
+    uint64_t initialFileSize = fileSize;
+
+#ifdef WIN32
+    for( const std::string& buffer : buffers )
+    {
+        const char* data = buffer.data();
+        size_t pending = buffer.size();
+        while( pending > 0 )
+        {
+            int written = _write( fd, data, (unsigned int) pending );
+            if( written <= 0 )
+            {
+                // LCOV_EXCL_START
+                droppedBytes.fetch_add( size - ( fileSize - initialFileSize ), std::memory_order_relaxed );
+                return;
+                // LCOV_EXCL_STOP
+            }
+            data += written;
+            pending -= written;
+            fileSize += written;
+            stats_count_bytes( written );
+        }
+    }
+#else
+    struct iovec iov[MAX_QUEUED_BUFFERS + 1];
+    int iovCount = 0;
+
+    for( const std::string& buffer : buffers )
+    {
+        if( !buffer.empty() )
+        {
+            iov[iovCount].iov_base = const_cast<char*>( buffer.data() );
+            iov[iovCount].iov_len = buffer.size();
+            iovCount++;
+        }
+    }
+
+    struct iovec* pendingIov = iov;
+    while( iovCount > 0 )
+    {
+        ssize_t written = writev( fd, pendingIov, iovCount );
+        if( written < 0 )
+        {
+            // LCOV_EXCL_START
+            if( errno == EINTR )
+            {
+                continue;
+            }
+            droppedBytes.fetch_add( size - ( fileSize - initialFileSize ), std::memory_order_relaxed );
+            return;
+            // LCOV_EXCL_STOP
+        }
+
+        fileSize += written;
+        stats_count_bytes( written );
+
+        // Skip what has been written, in case of partial writes
+        while( ( iovCount > 0 ) && ( (size_t) written >= pendingIov->iov_len ) )
+        {
+            written -= pendingIov->iov_len;
+            pendingIov++;
+            iovCount--;
+        }
+        if( iovCount > 0 )
+        {
+            // LCOV_EXCL_START
+            pendingIov->iov_base = (char*) pendingIov->iov_base + written;
+            pendingIov->iov_len -= written;
+            // LCOV_EXCL_STOP
+        }
+    }
+#endif
+}
+
+void file_log_sink::impl::writer_main()
+{
+    std::vector<std::string> buffers;
+
+    std::unique_lock<std::mutex> lock( mutex );
+
+    for(;;)
+    {
+        bool timeout = false;
+
+        if( queue.empty() && !stop )
+        {
+            if( opts.flush_interval_ms > 0 )
+            {
+                timeout = ( writerCv.wait_for( lock, std::chrono::milliseconds( opts.flush_interval_ms ) ) == std::cv_status::timeout );
+            }
+            else
+            {
+                writerCv.wait( lock );
+            }
+        }
+
+        // When the flush interval expires the messages in the active buffer must be written as well
+        if( ( timeout || stop ) && !active.empty() )
+        {
+            queue_active();
+        }
+
+        if( queue.empty() )
+        {
+            if( stop )
+            {
+                break;
+            }
+            continue;
+        }
+
+        buffers.swap( queue );
+        uint64_t count = queuedCount;
+
+        lock.unlock();
+
+        size_t size = 0;
+        for( const std::string& buffer : buffers )
+        {
+            size += buffer.size();
+        }
+
+        if( fileSize > 0 )
+        {
+            bool sizeExceeded = ( opts.max_file_size > 0 ) && ( fileSize + size > opts.max_file_size );
+            bool ageExceeded = ( opts.rotation_interval_s > 0 ) &&
+                               ( std::chrono::steady_clock::now() - openTime >= std::chrono::seconds( opts.rotation_interval_s ) );
+            if( sizeExceeded || ageExceeded )
+            {
+                rotate_file();
+            }
+        }
+
+        write_buffers( buffers, size );
+
+        lock.lock();
+
+        for( std::string& buffer : buffers )
+        {
+            if( spare.size() < MAX_SPARE_BUFFERS )
+            {
+                buffer.clear();
+                spare.push_back( std::string() );
+                spare.back().swap( buffer );
+            }
+        }
+        buffers.clear();
+
+        writtenCount = count;
+        writtenCv.notify_all();
+    }
+}
+
+/**
+ * Writes a buffer directly into the file and clears it (async-signal-safe).
+ */
+void file_log_sink::impl::crash_write( std::string& buffer ) noexcept
+{
+    const char* data = buffer.data();
+    size_t pending = buffer.size();
+    while( pending > 0 )
+    {
+#ifdef WIN32
+        int written = _write( fd, data, (unsigned int) pending );
+#else
+        ssize_t written = write( fd, data, pending );
+#endif
+        if( written <= 0 )
+        {
+            if( ( written < 0 ) && ( errno == EINTR ) )
+            {
+                continue;
+            }
+            break;
+        }
+        data += written;
+        pending -= written;
+    }
+
+    // Clearing doesn't release the memory
+    buffer.clear();
+}
+
+/**
+ * Writes the buffered messages directly into the file.
+ *
+ * If the mutex is held (e.g. the program crashed while a message was being appended) the buffers can't
+ * be accessed safely, and they are skipped.
+ */
+void file_log_sink::impl::crash_flush() noexcept
+{
+    if( !mutex.try_lock() )
+    {
+        return;
+    }
+
+    if( fd >= 0 )
+    {
+        for( std::string& buffer : queue )
+        {
+            crash_write( buffer );
+        }
+        crash_write( active );
+    }
+
+    mutex.unlock();
+}
+
+file_log_sink::file_log_sink( const char* path, const options& opts, int logPriorityLimit )
+: log_sink( logPriorityLimit ), m_impl( new impl( path, opts ) )
+{
+    if( !m_impl->open_file( false ) )
+    {
+        THROW_ERROR( "Error opening log file '%s'", path );
+    }
+
+    m_impl->active.reserve( opts.buffer_size + 1024 );
+    m_impl->writer = std::thread( &impl::writer_main, m_impl.get() );
+
+    register_crash_flusher( m_impl.get() );
+}
+
+file_log_sink::~file_log_sink()
+{
+    unregister_crash_flusher( m_impl.get() );
+
+    {
+        std::lock_guard<std::mutex> lock( m_impl->mutex );
+        m_impl->stop = true;
+        m_impl->writerCv.notify_one();
+    }
+
+    m_impl->writer.join();
+
+    close( m_impl->fd );
+}
+
+void file_log_sink::flush()
+{
+    std::unique_lock<std::mutex> lock( m_impl->mutex );
+
+    if( !m_impl->active.empty() )
+    {
+        m_impl->hand_off( lock );
+    }
+
+    uint64_t target = m_impl->queuedCount;
+    while( m_impl->writtenCount < target )
+    {
+        m_impl->writtenCv.wait( lock );
+    }
+}
+
+const std::string& file_log_sink::get_path() const noexcept
+{
+    return m_impl->path;
+}
+
+unsigned long long file_log_sink::get_dropped_bytes() const noexcept
+{
+    return m_impl->droppedBytes.load( std::memory_order_relaxed );
+}
+
+bool file_log_sink::process_record( const log_record& record )
+{
+    std::unique_lock<std::mutex> lock( m_impl->mutex );
+
+    m_impl->append( record );
+
+    if( ( m_impl->active.size() >= m_impl->opts.buffer_size ) || ( record.priority() <= m_impl->opts.flush_priority ) )
+    {
+        m_impl->hand_off( lock );
+    }
+
+    return false;
+}
+
+void file_log_sink::process_batch( const log_record* const* records, size_t count, bool* toConsole )
+{
+    std::unique_lock<std::mutex> lock( m_impl->mutex );
+
+    bool urgent = false;
+
+    for( size_t i = 0; i < count; i++ )
+    {
+        m_impl->append( *records[i] );
+        urgent = urgent || ( records[i]->priority() <= m_impl->opts.flush_priority );
+        toConsole[i] = false;
+
+        if( m_impl->active.size() >= m_impl->opts.buffer_size )
+        {
+            m_impl->hand_off( lock );
+        }
+    }
+
+    if( urgent && !m_impl->active.empty() )
+    {
+        m_impl->hand_off( lock );
+    }
+}
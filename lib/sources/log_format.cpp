@@ -0,0 +1,1156 @@
+/**
+ * @file
+ * @brief      Implementation of the deferred formatting of log messages
+ * @authors    Jesus Gonzalez <jgonzalez@gdr-sistemas.com>
+ * @copyright  Copyright (c) 2003-2016 Jesus Gonzalez
+ * @license    See LICENSE.txt
+ */
+
+#include "log_format.hpp"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <wchar.h>
+
+#include "Extended/string.hpp"
+
+using namespace ext::log_internal;
+
+#define NULL_STRING_LENGTH  0xFFFFFFFFu
+#define MISSING_ARG_TEXT    "<?>"
+#define NULL_STRING_TEXT    "(null)"
+
+namespace
+{
+
+enum arg_kind
+{
+    ARG_NONE,           // Literal '%'
+    ARG_INT32,
+    ARG_UINT32,
+    ARG_INT64,
+    ARG_UINT64,
+    ARG_DOUBLE,
+    ARG_LONG_DOUBLE,
+    ARG_POINTER,
+    ARG_STRING,
+    ARG_WSTRING,
+    ARG_WCHAR,
+    ARG_UNSUPPORTED
+};
+
+/**
+ * Parsed printf conversion specification.
+ */
+struct conversion
+{
+    const char* begin;          // Position of the '%'
+    const char* lengthBegin;    // Position of the length modifier (or of the conversion character)
+    const char* end;            // Position following the conversion character
+    int stars;                  // Number of '*' used for width and precision
+    bool starPrecision;         // Precision is given by an argument
+    int precision;              // Precision given in the format (-1 if none)
+    char length;                // Length modifier ('H' = hh, 'q' = ll / I64, 'w' = I32, 'Z' = z / I)
+    char conv;                  // Conversion character
+    arg_kind kind;
+};
+
+bool is_digit( char c )
+{
+    return ( c >= '0' ) && ( c <= '9' );
+}
+
+/**
+ * Skips a sequence of digits, returning @c true if it's followed by '$' (positional argument).
+ */
+bool skip_number( const char*& p, int* value = NULL )
+{
+    int v = 0;
+    while( is_digit( *p ) )
+    {
+        v = ( v * 10 ) + ( *p - '0' );
+        p++;
+    }
+    if( value )
+    {
+        *value = v;
+    }
+    return ( *p == '$' );
+}
+
+arg_kind classify( char conv, char length )
+{
+    switch( conv )
+    {
+    case 'd':
+    case 'i':
+        return ( ( length == 0 ) || ( length == 'H' ) || ( length == 'h' ) || ( length == 'w' ) ) ? ARG_INT32 : ARG_INT64;
+
+    case 'u':
+    case 'o':
+    case 'x':
+    case 'X':
+        return ( ( length == 0 ) || ( length == 'H' ) || ( length == 'h' ) || ( length == 'w' ) ) ? ARG_UINT32 : ARG_UINT64;
+
+    case 'e':
+    case 'E':
+    case 'f':
+    case 'F':
+    case 'g':
+    case 'G':
+    case 'a':
+    case 'A':
+        return ( length == 'L' ) ? ARG_LONG_DOUBLE : ARG_DOUBLE;
+
+    case 'c':
+        return ( length == 'l' ) ? ARG_WCHAR : ARG_INT32;
+
+    case 's':
+        return ( length == 'l' ) ? ARG_WSTRING : ARG_STRING;
+
+    case 'p':
+        return ARG_POINTER;
+
+    default:
+        // %n, %m and platform specific conversions can't be deferred
+        return ARG_UNSUPPORTED;
+    }
+}
+
+/**
+ * Parses the conversion specification starting at @p p (which must point to a '%').
+ */
+void parse_conversion( const char* p, conversion& c )
+{
+    c.begin = p++;
+    c.stars = 0;
+    c.starPrecision = false;
+    c.precision = -1;
+    c.length = 0;
+    c.kind = ARG_UNSUPPORTED;
+
+    if( *p == '%' )
+    {
+        c.lengthBegin = p;
+        c.conv = '%';
+        c.end = p + 1;
+        c.kind = ARG_NONE;
+        return;
+    }
+
+    // Positional argument
+    if( is_digit( *p ) )
+    {
+        const char* q = p;
+        if( skip_number( q ) )
+        {
+            c.lengthBegin = c.end = q;
+            c.conv = 0;
+            return;
+        }
+    }
+
+    // Flags
+    while( ( *p != 0 ) && ( strchr( "-+ #0'", *p ) != NULL ) )
+    {
+        p++;
+    }
+
+    // Width
+    if( *p == '*' )
+    {
+        c.stars++;
+        p++;
+        if( is_digit( *p ) && skip_number( p ) )
+        {
+            c.lengthBegin = c.end = p;
+            c.conv = 0;
+            return;
+        }
+    }
+    else
+    {
+        skip_number( p );
+    }
+
+    // Precision
+    if( *p == '.' )
+    {
+        p++;
+        if( *p == '*' )
+        {
+            c.stars++;
+            c.starPrecision = true;
+            p++;
+            if( is_digit( *p ) && skip_number( p ) )
+            {
+                c.lengthBegin = c.end = p;
+                c.conv = 0;
+                return;
+            }
+        }
+        else
+        {
+            skip_number( p, &c.precision );
+        }
+    }
+
+    // Length modifier
+    c.lengthBegin = p;
+    switch( *p )
+    {
+    case 'h':
+        p++;
+        if( *p == 'h' )
+        {
+            c.length = 'H';
+            p++;
+        }
+        else
+        {
+            c.length = 'h';
+        }
+        break;
+
+    case 'l':
+        p++;
+        if( *p == 'l' )
+        {
+            c.length = 'q';
+            p++;
+        }
+        else
+        {
+            c.length = 'l';
+        }
+        break;
+
+    case 'q':
+    case 'j':
+    case 't':
+        c.length = ( *p == 'q' ) ? 'q' : *p;
+        p++;
+        break;
+
+    case 'z':
+    case 'Z':
+        c.length = 'Z';
+        p++;
+        break;
+
+    case 'L':
+        c.length = 'L';
+        p++;
+        break;
+
+    case 'I':
+        p++;
+        if( ( p[0] == '6' ) && ( p[1] == '4' ) )
+        {
+            c.length = 'q';
+            p += 2;
+        }
+        else if( ( p[0] == '3' ) && ( p[1] == '2' ) )
+        {
+            c.length = 'w';
+            p += 2;
+        }
+        else
+        {
+            c.length = 'Z';
+        }
+        break;
+
+    default:
+        break;
+    }
+
+    c.conv = *p;
+    c.end = ( *p != 0 ) ? p + 1 : p;
+
+    // 'L' applied to integers is a synonym of 'll'
+    if( ( c.length == 'L' ) && ( strchr( "diouxX", c.conv ) != NULL ) )
+    {
+        c.length = 'q';
+    }
+
+    c.kind = classify( c.conv, c.length );
+}
+
+/**
+ * Output for the captured arguments that writes into a fixed-size buffer, truncating what doesn't fit.
+ */
+class buffer_output
+{
+public:
+    buffer_output( char* buffer, size_t size ) : m_buffer( buffer ), m_size( size ), m_len( 0 )
+    {}
+
+    void append( const char* data, size_t len )
+    {
+        if( len > m_size - m_len )
+        {
+            len = m_size - m_len;
+        }
+        memcpy( m_buffer + m_len, data, len );
+        m_len += len;
+    }
+
+    size_t size() const
+    {
+        return m_len;
+    }
+
+private:
+    char* m_buffer;
+    size_t m_size;
+    size_t m_len;
+};
+
+template<typename O, typename T>
+void append_value( O& out, const T& value )
+{
+    out.append( reinterpret_cast<const char*>( &value ), sizeof( value ) );
+}
+
+int64_t read_signed( char length, va_list& ap )
+{
+    switch( length )
+    {
+    case 'l':
+        return va_arg( ap, long );
+    case 'q':
+        return va_arg( ap, long long );
+    case 'j':
+        return va_arg( ap, intmax_t );
+    case 'Z':
+    case 't':
+        return va_arg( ap, ptrdiff_t );
+    default:
+        return va_arg( ap, int ); // LCOV_EXCL_LINE
+    }
+}
+
+uint64_t read_unsigned( char length, va_list& ap )
+{
+    switch( length )
+    {
+    case 'l':
+        return va_arg( ap, unsigned long );
+    case 'q':
+        return va_arg( ap, unsigned long long );
+    case 'j':
+        return va_arg( ap, uintmax_t );
+    case 'Z':
+    case 't':
+        return va_arg( ap, size_t );
+    default:
+        return va_arg( ap, unsigned int ); // LCOV_EXCL_LINE
+    }
+}
+
+/**
+ * Sequential reader of captured arguments.
+ */
+class arg_reader
+{
+public:
+    arg_reader( const char* data, size_t len )
+    : m_pos( data ), m_end( data + len )
+    {}
+
+    template<typename T>
+    bool read( T& value )
+    {
+        if( (size_t) ( m_end - m_pos ) < sizeof( T ) )
+        {
+            m_pos = m_end;
+            return false;
+        }
+        memcpy( &value, m_pos, sizeof( T ) );
+        m_pos += sizeof( T );
+        return true;
+    }
+
+    bool read_bytes( size_t len, const char*& bytes )
+    {
+        if( (size_t) ( m_end - m_pos ) < len )
+        {
+            m_pos = m_end;
+            return false;
+        }
+        bytes = m_pos;
+        m_pos += len;
+        return true;
+    }
+
+private:
+    const char* m_pos;
+    const char* m_end;
+};
+
+template<typename T>
+void append_conversion( std::string& out, const char* spec, int stars, const int32_t* starValues, T value )
+{
+    char buffer[256];
+    int n;
+
+    switch( stars )
+    {
+    case 0:
+        n = snprintf( buffer, sizeof( buffer ), spec, value );
+        break;
+    case 1:
+        n = snprintf( buffer, sizeof( buffer ), spec, starValues[0], value );
+        break;
+    default:
+        n = snprintf( buffer, sizeof( buffer ), spec, starValues[0], starValues[1], value );
+        break;
+    }
+
+    if( n < 0 )
+    {
+        return; // LCOV_EXCL_LINE
+    }
+
+    if( (size_t) n < sizeof( buffer ) )
+    {
+        out.append( buffer, n );
+        return;
+    }
+
+    // Didn't get enough space
+    size_t pos = out.size();
+    out.resize( pos + n + 1 );
+    switch( stars )
+    {
+    case 0:
+        snprintf( &out[pos], n + 1, spec, value );
+        break;
+    case 1:
+        snprintf( &out[pos], n + 1, spec, starValues[0], value );
+        break;
+    default:
+        snprintf( &out[pos], n + 1, spec, starValues[0], starValues[1], value );
+        break;
+    }
+    out.resize( pos + n );
+}
+
+/**
+ * Builds in @p spec the conversion specification to be used to render a captured argument, replacing
+ * the original length modifier by @p length.
+ */
+void build_spec( const conversion& c, const char* length, char* spec, size_t specSize )
+{
+    size_t prefixLen = c.lengthBegin - c.begin;
+    size_t lengthLen = strlen( length );
+
+    if( ( prefixLen + lengthLen + 2 ) > specSize )
+    {
+        // Absurdly long specification, just keep the conversion
+        prefixLen = 1; // LCOV_EXCL_LINE
+    }
+
+    memcpy( spec, c.begin, prefixLen );
+    memcpy( spec + prefixLen, length, lengthLen );
+    spec[prefixLen + lengthLen] = c.conv;
+    spec[prefixLen + lengthLen + 1] = 0;
+}
+
+bool render_conversion( const conversion& c, arg_reader& reader, std::string& out )
+{
+    int32_t starValues[2] = { 0, 0 };
+    char spec[64];
+
+    for( int i = 0; i < c.stars; i++ )
+    {
+        if( !reader.read( starValues[i] ) )
+        {
+            return false;
+        }
+    }
+
+    switch( c.kind )
+    {
+    case ARG_INT32:
+    {
+        int32_t v;
+        if( !reader.read( v ) ) return false;
+        build_spec( c, "", spec, sizeof( spec ) );
+        append_conversion( out, spec, c.stars, starValues, (int) v );
+        break;
+    }
+
+    case ARG_UINT32:
+    {
+        uint32_t v;
+        if( !reader.read( v ) ) return false;
+        build_spec( c, "", spec, sizeof( spec ) );
+        append_conversion( out, spec, c.stars, starValues, (unsigned int) v );
+        break;
+    }
+
+    case ARG_INT64:
+    {
+        int64_t v;
+        if( !reader.read( v ) ) return false;
+        build_spec( c, "ll", spec, sizeof( spec ) );
+        append_conversion( out, spec, c.stars, starValues, (long long) v );
+        break;
+    }
+
+    case ARG_UINT64:
+    {
+        uint64_t v;
+        if( !reader.read( v ) ) return false;
+        build_spec( c, "ll", spec, sizeof( spec ) );
+        append_conversion( out, spec, c.stars, starValues, (unsigned long long) v );
+        break;
+    }
+
+    case ARG_DOUBLE:
+    {
+        double v;
+        if( !reader.read( v ) ) return false;
+        build_spec( c, "", spec, sizeof( spec ) );
+        append_conversion( out, spec, c.stars, starValues, v );
+        break;
+    }
+
+    case ARG_LONG_DOUBLE:
+    {
+        long double v;
+        if( !reader.read( v ) ) return false;
+        build_spec( c, "L", spec, sizeof( spec ) );
+        append_conversion( out, spec, c.stars, starValues, v );
+        break;
+    }
+
+    case ARG_POINTER:
+    {
+        uint64_t v;
+        if( !reader.read( v ) ) return false;
+        build_spec( c, "", spec, sizeof( spec ) );
+        append_conversion( out, spec, c.stars, starValues, (void*) (uintptr_t) v );
+        break;
+    }
+
+    case ARG_WCHAR:
+    {
+        int32_t v;
+        if( !reader.read( v ) ) return false;
+        build_spec( c, "l", spec, sizeof( spec ) );
+        append_conversion( out, spec, c.stars, starValues, (wint_t) v );
+        break;
+    }
+
+    case ARG_STRING:
+    {
+        uint32_t len;
+        const char* chars;
+        if( !reader.read( len ) ) return false;
+        build_spec( c, "", spec, sizeof( spec ) );
+        if( len == NULL_STRING_LENGTH )
+        {
+            append_conversion( out, spec, c.stars, starValues, (const char*) NULL );
+        }
+        else
+        {
+            if( !reader.read_bytes( len, chars ) ) return false;
+            std::string str( chars, len );
+            append_conversion( out, spec, c.stars, starValues, str.c_str() );
+        }
+        break;
+    }
+
+    case ARG_WSTRING:
+    {
+        uint32_t len;
+        const char* chars;
+        if( !reader.read( len ) ) return false;
+        build_spec( c, "l", spec, sizeof( spec ) );
+        if( len == NULL_STRING_LENGTH )
+        {
+            append_conversion( out, spec, c.stars, starValues, (const wchar_t*) NULL );
+        }
+        else
+        {
+            if( !reader.read_bytes( len, chars ) ) return false;
+            std::wstring str( len / sizeof( wchar_t ), L'\0' );
+            memcpy( &str[0], chars, str.size() * sizeof( wchar_t ) );
+            append_conversion( out, spec, c.stars, starValues, str.c_str() );
+        }
+        break;
+    }
+
+    default:
+        return false; // LCOV_EXCL_LINE
+    }
+
+    return true;
+}
+
+/**
+ * Appends the decimal representation of an integer.
+ */
+void append_decimal( std::string& out, uint64_t value, bool negative )
+{
+    char buffer[24];
+    char* p = buffer + sizeof( buffer );
+    do
+    {
+        *--p = (char) ( '0' + ( value % 10 ) );
+        value /= 10;
+    } while( value != 0 );
+    if( negative )
+    {
+        *--p = '-';
+    }
+    out.append( p, buffer + sizeof( buffer ) - p );
+}
+
+void append_signed( std::string& out, int64_t value )
+{
+    append_decimal( out, ( value < 0 ) ? ( 0 - (uint64_t) value ) : (uint64_t) value, value < 0 );
+}
+
+/**
+ * Appends the hexadecimal representation of an integer.
+ */
+void append_hexadecimal( std::string& out, uint64_t value, bool uppercase )
+{
+    const char* digits = uppercase ? "0123456789ABCDEF" : "0123456789abcdef";
+    char buffer[16];
+    char* p = buffer + sizeof( buffer );
+    do
+    {
+        *--p = digits[value & 0xF];
+        value >>= 4;
+    } while( value != 0 );
+    out.append( p, buffer + sizeof( buffer ) - p );
+}
+
+/**
+ * Appends an unsigned integer for a conversion rendered directly.
+ */
+void append_unsigned( std::string& out, char conv, uint64_t value )
+{
+    if( conv == 'u' )
+    {
+        append_decimal( out, value, false );
+    }
+    else
+    {
+        append_hexadecimal( out, value, conv == 'X' );
+    }
+}
+
+} // namespace
+
+template<typename O>
+static bool capture_args( const char* format, va_list args, O& out )
+{
+    if( format == NULL )
+    {
+        return true;
+    }
+
+    va_list ap;
+    va_copy( ap, args );
+
+    bool ok = true;
+    conversion c;
+
+    for( const char* p = strchr( format, '%' ); ok && ( p != NULL ); p = strchr( c.end, '%' ) )
+    {
+        parse_conversion( p, c );
+
+        if( c.kind == ARG_UNSUPPORTED )
+        {
+            ok = false;
+            break;
+        }
+
+        int32_t precision = c.precision;
+
+        for( int i = 0; i < c.stars; i++ )
+        {
+            int32_t v = va_arg( ap, int );
+            append_value( out, v );
+            if( c.starPrecision && ( i == c.stars - 1 ) )
+            {
+                precision = v;
+            }
+        }
+
+        switch( c.kind )
+        {
+        case ARG_INT32:
+        {
+            int32_t v = va_arg( ap, int );
+            if( c.length == 'H' )
+            {
+                v = (signed char) v;
+            }
+            else if( c.length == 'h' )
+            {
+                v = (short) v;
+            }
+            append_value( out, v );
+            break;
+        }
+
+        case ARG_UINT32:
+        {
+            uint32_t v = va_arg( ap, unsigned int );
+            if( c.length == 'H' )
+            {
+                v = (unsigned char) v;
+            }
+            else if( c.length == 'h' )
+            {
+                v = (unsigned short) v;
+            }
+            append_value( out, v );
+            break;
+        }
+
+        case ARG_INT64:
+            append_value( out, read_signed( c.length, ap ) );
+            break;
+
+        case ARG_UINT64:
+            append_value( out, read_unsigned( c.length, ap ) );
+            break;
+
+        case ARG_DOUBLE:
+            append_value( out, va_arg( ap, double ) );
+            break;
+
+        case ARG_LONG_DOUBLE:
+            append_value( out, va_arg( ap, long double ) );
+            break;
+
+        case ARG_POINTER:
+            append_value( out, (uint64_t) (uintptr_t) va_arg( ap, void* ) );
+            break;
+
+        case ARG_WCHAR:
+            append_value( out, (int32_t) va_arg( ap, wint_t ) );
+            break;
+
+        case ARG_STRING:
+        {
+            const char* str = va_arg( ap, const char* );
+            if( str == NULL )
+            {
+                append_value( out, (uint32_t) NULL_STRING_LENGTH );
+            }
+            else
+            {
+                // With a precision the string is not required to be null-terminated
+                size_t len = 0;
+                while( ( ( precision < 0 ) || ( len < (size_t) precision ) ) && ( str[len] != 0 ) )
+                {
+                    len++;
+                }
+                append_value( out, (uint32_t) len );
+                out.append( str, len );
+            }
+            break;
+        }
+
+        case ARG_WSTRING:
+        {
+            const wchar_t* str = va_arg( ap, const wchar_t* );
+            if( str == NULL )
+            {
+                append_value( out, (uint32_t) NULL_STRING_LENGTH );
+            }
+            else
+            {
+                size_t len = 0;
+                while( ( ( precision < 0 ) || ( len < (size_t) precision ) ) && ( str[len] != 0 ) )
+                {
+                    len++;
+                }
+                append_value( out, (uint32_t) ( len * sizeof( wchar_t ) ) );
+                out.append( reinterpret_cast<const char*>( str ), len * sizeof( wchar_t ) );
+            }
+            break;
+        }
+
+        default:
+            break;
+        }
+    }
+
+    va_end( ap );
+
+    return ok;
+}
+
+bool ext::log_internal::capture_format_args( const char* format, va_list args, std::string& out )
+{
+    return capture_args( format, args, out );
+}
+
+bool ext::log_internal::capture_format_args( const char* format, va_list args, char* out, size_t outSize, size_t& outLen )
+{
+    buffer_output output( out, outSize );
+    bool ok = capture_args( format, args, output );
+    outLen = output.size();
+    return ok;
+}
+
+void ext::log_internal::render_format_args( const char* format, const char* args, size_t argsLen, std::string& out )
+{
+    if( format == NULL )
+    {
+        return;
+    }
+
+    arg_reader reader( args, argsLen );
+    conversion c;
+    const char* literal = format;
+
+    for( const char* p = strchr( format, '%' ); p != NULL; p = strchr( c.end, '%' ) )
+    {
+        out.append( literal, p - literal );
+
+        parse_conversion( p, c );
+        literal = c.end;
+
+        if( c.kind == ARG_NONE )
+        {
+            out += '%';
+        }
+        else if( ( c.kind == ARG_UNSUPPORTED ) || !render_conversion( c, reader, out ) )
+        {
+            out += MISSING_ARG_TEXT;
+        }
+    }
+
+    out.append( literal );
+}
+
+/**
+ * Conversion specification of a format plan, with the literal text that precedes it.
+ */
+struct format_plan::segment
+{
+    const char* literal;
+    size_t literalLen;
+    conversion conv;
+    bool direct;                // Rendered directly, without snprintf()
+    char spec[64];              // Specification for snprintf(), with the length modifier of the argument as read
+};
+
+format_plan::format_plan( const char* format )
+: m_format( format ), m_segmentCount( 0 ), m_tail( format ), m_supported( true )
+{
+    if( format == NULL )
+    {
+        m_tail = "";
+        return;
+    }
+
+    size_t count = 0;
+    conversion c;
+    for( const char* p = strchr( format, '%' ); p != NULL; p = strchr( c.end, '%' ) )
+    {
+        parse_conversion( p, c );
+        count++;
+    }
+
+    m_segments.reset( new segment[count] );
+
+    const char* literal = format;
+    for( const char* p = strchr( format, '%' ); p != NULL; p = strchr( c.end, '%' ) )
+    {
+        segment& seg = m_segments[m_segmentCount++];
+        parse_conversion( p, seg.conv );
+        c = seg.conv;
+
+        seg.literal = literal;
+        seg.literalLen = p - literal;
+        literal = c.end;
+
+        if( c.kind == ARG_UNSUPPORTED )
+        {
+            m_supported = false;
+        }
+
+        // Only conversions without flags, width nor precision can be rendered directly
+        bool plain = ( c.lengthBegin == c.begin + 1 );
+        switch( c.kind )
+        {
+        case ARG_INT32:
+            seg.direct = plain && ( c.length == 0 ) && ( c.conv != 'c' );
+            build_spec( c, "", seg.spec, sizeof( seg.spec ) );
+            break;
+        case ARG_UINT32:
+            seg.direct = plain && ( c.length == 0 ) && ( c.conv != 'o' );
+            build_spec( c, "", seg.spec, sizeof( seg.spec ) );
+            break;
+        case ARG_INT64:
+        case ARG_UINT64:
+            seg.direct = plain && ( c.conv != 'o' );
+            build_spec( c, "ll", seg.spec, sizeof( seg.spec ) );
+            break;
+        case ARG_LONG_DOUBLE:
+            seg.direct = false;
+            build_spec( c, "L", seg.spec, sizeof( seg.spec ) );
+            break;
+        case ARG_WCHAR:
+        case ARG_WSTRING:
+            seg.direct = false;
+            build_spec( c, "l", seg.spec, sizeof( seg.spec ) );
+            break;
+        case ARG_STRING:
+            seg.direct = plain;
+            build_spec( c, "", seg.spec, sizeof( seg.spec ) );
+            break;
+        default:
+            seg.direct = false;
+            build_spec( c, "", seg.spec, sizeof( seg.spec ) );
+            break;
+        }
+    }
+
+    m_tail = literal;
+}
+
+format_plan::~format_plan()
+{
+}
+
+void format_plan::render( va_list args, std::string& out ) const
+{
+    if( !m_supported )
+    {
+        out += vformat( m_format, args );
+        return;
+    }
+
+    va_list ap;
+    va_copy( ap, args );
+
+    for( size_t i = 0; i < m_segmentCount; i++ )
+    {
+        const segment& seg = m_segments[i];
+        const conversion& c = seg.conv;
+
+        out.append( seg.literal, seg.literalLen );
+
+        int32_t starValues[2] = { 0, 0 };
+        for( int j = 0; j < c.stars; j++ )
+        {
+            starValues[j] = va_arg( ap, int );
+        }
+
+        switch( c.kind )
+        {
+        case ARG_NONE:
+            out += '%';
+            break;
+
+        case ARG_INT32:
+        {
+            int v = va_arg( ap, int );
+            if( c.length == 'H' )
+            {
+                v = (signed char) v;
+            }
+            else if( c.length == 'h' )
+            {
+                v = (short) v;
+            }
+            if( seg.direct )
+            {
+                append_signed( out, v );
+            }
+            else
+            {
+                append_conversion( out, seg.spec, c.stars, starValues, v );
+            }
+            break;
+        }
+
+        case ARG_UINT32:
+        {
+            unsigned int v = va_arg( ap, unsigned int );
+            if( c.length == 'H' )
+            {
+                v = (unsigned char) v;
+            }
+            else if( c.length == 'h' )
+            {
+                v = (unsigned short) v;
+            }
+            if( seg.direct )
+            {
+                append_unsigned( out, c.conv, v );
+            }
+            else
+            {
+                append_conversion( out, seg.spec, c.stars, starValues, v );
+            }
+            break;
+        }
+
+        case ARG_INT64:
+        {
+            long long v = read_signed( c.length, ap );
+            if( seg.direct )
+            {
+                append_signed( out, v );
+            }
+            else
+            {
+                append_conversion( out, seg.spec, c.stars, starValues, v );
+            }
+            break;
+        }
+
+        case ARG_UINT64:
+        {
+            unsigned long long v = read_unsigned( c.length, ap );
+            if( seg.direct )
+            {
+                append_unsigned( out, c.conv, v );
+            }
+            else
+            {
+                append_conversion( out, seg.spec, c.stars, starValues, v );
+            }
+            break;
+        }
+
+        case ARG_DOUBLE:
+            append_conversion( out, seg.spec, c.stars, starValues, va_arg( ap, double ) );
+            break;
+
+        case ARG_LONG_DOUBLE:
+            append_conversion( out, seg.spec, c.stars, starValues, va_arg( ap, long double ) );
+            break;
+
+        case ARG_POINTER:
+            append_conversion( out, seg.spec, c.stars, starValues, va_arg( ap, void* ) );
+            break;
+
+        case ARG_WCHAR:
+            append_conversion( out, seg.spec, c.stars, starValues, va_arg( ap, wint_t ) );
+            break;
+
+        case ARG_STRING:
+        {
+            const char* str = va_arg( ap, const char* );
+            if( seg.direct )
+            {
+                out += ( str != NULL ) ? str : NULL_STRING_TEXT;
+            }
+            else
+            {
+                append_conversion( out, seg.spec, c.stars, starValues, str );
+            }
+            break;
+        }
+
+        case ARG_WSTRING:
+            append_conversion( out, seg.spec, c.stars, starValues, va_arg( ap, const wchar_t* ) );
+            break;
+
+        default:
+            break; // LCOV_EXCL_LINE
+        }
+    }
+
+    va_end( ap );
+
+    out += m_tail;
+}
+
+void format_plan::render_captured( const char* args, size_t argsLen, std::string& out ) const
+{
+    arg_reader reader( args, argsLen );
+
+    for( size_t i = 0; i < m_segmentCount; i++ )
+    {
+        const segment& seg = m_segments[i];
+        const conversion& c = seg.conv;
+
+        out.append( seg.literal, seg.literalLen );
+
+        if( c.kind == ARG_NONE )
+        {
+            out += '%';
+        }
+        else if( seg.direct )
+        {
+            bool ok = true;
+            switch( c.kind )
+            {
+            case ARG_INT32:
+            {
+                int32_t v;
+                ok = reader.read( v );
+                if( ok ) append_signed( out, v );
+                break;
+            }
+            case ARG_UINT32:
+            {
+                uint32_t v;
+                ok = reader.read( v );
+                if( ok ) append_unsigned( out, c.conv, v );
+                break;
+            }
+            case ARG_INT64:
+            {
+                int64_t v;
+                ok = reader.read( v );
+                if( ok ) append_signed( out, v );
+                break;
+            }
+            case ARG_UINT64:
+            {
+                uint64_t v;
+                ok = reader.read( v );
+                if( ok ) append_unsigned( out, c.conv, v );
+                break;
+            }
+            default:
+            {
+                uint32_t len;
+                const char* chars;
+                ok = reader.read( len );
+                if( ok && ( len == NULL_STRING_LENGTH ) )
+                {
+                    out += NULL_STRING_TEXT;
+                }
+                else if( ok && reader.read_bytes( len, chars ) )
+                {
+                    out.append( chars, len );
+                }
+                else
+                {
+                    ok = false;
+                }
+                break;
+            }
+            }
+            if( !ok )
+            {
+                out += MISSING_ARG_TEXT;
+            }
+        }
+        else if( ( c.kind == ARG_UNSUPPORTED ) || !render_conversion( c, reader, out ) )
+        {
+            out += MISSING_ARG_TEXT;
+        }
+    }
+
+    out += m_tail;
+}
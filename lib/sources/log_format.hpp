@@ -0,0 +1,124 @@
+/**
+ * @file
+ * @brief      Internal header for the deferred formatting of log messages
+ * @authors    Jesus Gonzalez <jgonzalez@gdr-sistemas.com>
+ * @copyright  Copyright (c) 2003-2016 Jesus Gonzalez
+ * @license    See LICENSE.txt
+ */
+
+#ifndef Extended_log_format_hpp_
+#define Extended_log_format_hpp_
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <memory>
+#include <string>
+
+namespace ext
+{
+namespace log_internal
+{
+
+/**
+ * Captures the arguments referenced by a printf format string into a compact binary form, so that the
+ * message can be rendered later (even by another process) with render_format_args().
+ *
+ * Integers are stored in 4 or 8 bytes depending on their length modifier, floating point values as
+ * @c double (or <tt>long double</tt>), pointers in 8 bytes and strings as a 4 byte length followed by their
+ * characters (without terminator). All values are stored in native byte order.
+ *
+ * @param[in] format Format string (using printf format)
+ * @param[in] args Variable arguments list (not modified)
+ * @param[out] out String where the captured arguments are appended
+ * @retval true if the arguments were captured
+ * @retval false if the format uses features that can't be deferred (e.g. positional arguments or @c \%n),
+ *         in which case the contents appended to @p out are meaningless
+ */
+bool capture_format_args( const char* format, va_list args, std::string& out );
+
+/**
+ * Captures the arguments referenced by a printf format string into a fixed-size buffer.
+ *
+ * Same as the previous function, but the captured arguments that don't fit into the buffer are truncated
+ * (which is tolerated by render_format_args()).
+ *
+ * @param[in] format Format string (using printf format)
+ * @param[in] args Variable arguments list (not modified)
+ * @param[out] out Buffer where the captured arguments are written
+ * @param[in] outSize Size of the buffer
+ * @param[out] outLen Length of the captured arguments written into the buffer
+ * @retval true if the arguments were captured
+ * @retval false if the format uses features that can't be deferred
+ */
+bool capture_format_args( const char* format, va_list args, char* out, size_t outSize, size_t& outLen );
+
+/**
+ * Renders a printf format string using arguments previously captured with capture_format_args().
+ *
+ * The output is the same that would have been produced by vsnprintf() with the original arguments.
+ * Conversions for which there is no captured data left (e.g. if @p args was truncated) are rendered
+ * as <tt>&lt;?&gt;</tt>.
+ *
+ * @param[in] format Format string (using printf format)
+ * @param[in] args Captured arguments
+ * @param[in] argsLen Length of the captured arguments
+ * @param[out] out String where the rendered text is appended
+ */
+void render_format_args( const char* format, const char* args, size_t argsLen, std::string& out );
+
+/**
+ * Format string parsed once into its literal text and conversion specifications, to render it repeatedly
+ * without parsing it again.
+ *
+ * Integer, character and string conversions without flags, width nor precision are rendered directly,
+ * the rest are rendered with snprintf() using only their conversion specification.
+ * The output is the same that would have been produced by vsnprintf().
+ */
+class format_plan
+{
+public:
+    /**
+     * Constructor.
+     *
+     * @param[in] format Format string (using printf format), it's not copied
+     */
+    explicit format_plan( const char* format );
+
+    ~format_plan();
+
+    const char* format() const noexcept
+    {
+        return m_format;
+    }
+
+    /**
+     * Renders the format string using a variable arguments list.
+     *
+     * @param[in] args Variable arguments list (not modified)
+     * @param[out] out String where the rendered text is appended
+     */
+    void render( va_list args, std::string& out ) const;
+
+    /**
+     * Renders the format string using arguments previously captured with capture_format_args().
+     *
+     * @param[in] args Captured arguments
+     * @param[in] argsLen Length of the captured arguments
+     * @param[out] out String where the rendered text is appended
+     */
+    void render_captured( const char* args, size_t argsLen, std::string& out ) const;
+
+private:
+    struct segment;
+
+    const char* m_format;
+    std::unique_ptr<segment[]> m_segments;
+    size_t m_segmentCount;
+    const char* m_tail;         // Literal text following the last conversion
+    bool m_supported;           // All the conversions can be rendered (otherwise vsnprintf() is used)
+};
+
+} // namespace
+} // namespace
+
+#endif // header guard
@@ -0,0 +1,513 @@
+/**
+ * @file
+ * @brief      Internal definitions shared by the log management implementation files
+ * @authors    Jesus Gonzalez <jgonzalez@gdr-sistemas.com>
+ * @copyright  Copyright (c) 2003-2016 Jesus Gonzalez
+ * @license    See LICENSE.txt
+ */
+
+#ifndef Extended_log_internal_hpp_
+#define Extended_log_internal_hpp_
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "Extended/log.hpp"
+
+/**
+ * Maximum number of messages processed at once by the asynchronous writer thread.
+ */
+#define LOG_BATCH_SIZE 64
+
+/**
+ * Maximum number of categories (including the entry for messages without category).
+ */
+#define LOG_MAX_CATEGORIES 256
+
+/**
+ * Size of the buffers passed to format_timestamp() (including the terminator).
+ */
+#define LOG_TIMESTAMP_SIZE 28
+
+/**
+ * Maximum size of the names of the threads (including the terminator).
+ */
+#define LOG_THREAD_NAME_SIZE 32
+
+/**
+ * Size of the buffers passed to format_thread_tag() (including the terminator).
+ */
+#define LOG_THREAD_TAG_SIZE 64
+
+/**
+ * Maximum number of objects registered with register_crash_flusher().
+ */
+#define LOG_MAX_CRASH_FLUSHERS 32
+
+/**
+ * Indicates if the lines of text start with a timestamp until log::set_timestamps_enabled() is called
+ * (can be defined as 0 when building the library, e.g. to get predictable lines of text in unit tests).
+ */
+#ifndef LOG_TIMESTAMPS_DEFAULT
+#define LOG_TIMESTAMPS_DEFAULT 1
+#endif
+
+/**
+ * Indicates if the lines of text include the thread tag until log::set_thread_tags_enabled() is called
+ * (can be defined as 0 when building the library).
+ */
+#ifndef LOG_THREAD_TAGS_DEFAULT
+#define LOG_THREAD_TAGS_DEFAULT 1
+#endif
+
+/**
+ * Logs an already formatted message.
+ *
+ * In asynchronous mode the message is queued to be processed by the writer thread, otherwise it's
+ * processed immediately.
+ *
+ * @param[in] prio Priority of the message
+ * @param[in] category Category of the message (may be NULL)
+ * @param[in] function Name of the function or method where the message was generated (already simplified)
+ * @param[in] msg Message text
+ */
+void do_log_msg( int prio, const char* category, const char* function, const char* msg );
+
+namespace ext
+{
+namespace log_internal
+{
+
+/**
+ * Identity of a thread, attached to the messages it generates.
+ */
+struct thread_identity
+{
+    unsigned long id;                   // Identifier of the thread for the operating system (0 = not yet known)
+    char name[LOG_THREAD_NAME_SIZE];
+};
+
+/**
+ * Returns the identity of the calling thread.
+ *
+ * The identity is obtained from the operating system only the first time, and cached in thread-local
+ * storage afterwards.
+ */
+const thread_identity& get_thread_identity() noexcept;
+
+/**
+ * Sets the name of the calling thread shown in the messages it generates (truncated to
+ * LOG_THREAD_NAME_SIZE - 1 characters).
+ */
+void set_thread_name( const char* name ) noexcept;
+
+/**
+ * Formats the tag that identifies the thread in the lines of text (e.g. "(1234:worker) ").
+ *
+ * @param[in] record Log message
+ * @param[out] out Buffer of at least LOG_THREAD_TAG_SIZE characters
+ * @return The length of the text, which is 0 if the thread is unknown or thread tags are disabled
+ */
+size_t format_thread_tag( const log_record& record, char* out );
+
+/**
+ * Returns the index of a category in the categories table, adding it if not yet present.
+ *
+ * @return The index, which is 0 for messages without category (and for the categories that don't fit
+ *         into the table)
+ */
+unsigned int get_category_index( const char* category ) noexcept;
+
+/**
+ * Returns the name of the category at an index of the categories table (NULL if there is none).
+ */
+const char* get_category_name( unsigned int index ) noexcept;
+
+/**
+ * Counts a message logged in the statistics.
+ */
+void stats_count_emitted( int prio, unsigned int categoryIndex ) noexcept;
+
+/**
+ * Counts a message discarded by the priority limits in the statistics.
+ */
+void stats_count_filtered( int prio, unsigned int categoryIndex ) noexcept;
+
+/**
+ * Counts bytes of text written in the statistics.
+ */
+void stats_count_bytes( size_t bytes ) noexcept;
+
+/**
+ * Counts a call to the log handler and the time spent in it in the statistics.
+ */
+void stats_count_handler( uint64_t elapsedNs ) noexcept;
+
+/**
+ * Returns the current time of the clock used by the statistics, in nanoseconds.
+ */
+uint64_t stats_clock_ns() noexcept;
+
+/**
+ * Decides if the latency of the message being logged by the calling thread must be sampled.
+ *
+ * @return The start time of the sample, or 0 if the message is not sampled
+ */
+uint64_t stats_latency_start() noexcept;
+
+/**
+ * Adds a latency sample to the statistics.
+ *
+ * @param[in] start Start time returned by stats_latency_start()
+ */
+void stats_latency_end( uint64_t start ) noexcept;
+
+/**
+ * Scoped sample of the latency of logging a message.
+ */
+class latency_probe
+{
+public:
+    latency_probe() noexcept
+    : m_start( stats_latency_start() )
+    {}
+
+    ~latency_probe()
+    {
+        if( m_start != 0 )
+        {
+            stats_latency_end( m_start );
+        }
+    }
+
+private:
+    latency_probe( const latency_probe& ) = delete;
+    latency_probe& operator=( const latency_probe& ) = delete;
+
+    const uint64_t m_start;
+};
+
+/**
+ * Logs an already formatted message bypassing the priority limits.
+ *
+ * In asynchronous mode the message is queued to be processed by the writer thread, otherwise it's
+ * processed immediately.
+ *
+ * @param[in] prio Priority of the message
+ * @param[in] category Category of the message (may be NULL)
+ * @param[in] function Name of the function or method where the message was generated (already simplified)
+ * @param[in] msg Message text
+ * @param[in] timestamp Time when the message was generated
+ */
+void emit_log_msg( int prio, const char* category, const char* function, const char* msg, uint64_t timestamp );
+
+/**
+ * Returns the name of the running program (without path).
+ */
+const char* get_program_name();
+
+/**
+ * Simplifies a function signature (as given by __PRETTY_FUNCTION__) to only its qualified name.
+ *
+ * This is the run-time counterpart of LOG_DECLARE_FUNCTION_NAME, for function names not known at compile time.
+ */
+std::string simplify_function( const char* function );
+
+/**
+ * Composes the line of text written to console for a message.
+ *
+ * @param[in] prio Priority of the message
+ * @param[in] program Name of the program
+ * @param[in] category Category of the message (may be NULL)
+ * @param[in] function Name of the function or method where the message was generated (already simplified)
+ * @param[in] msg Message text
+ * @param[in] wallNs Wall-clock time when the message was generated, in nanoseconds since the epoch (0 = unknown)
+ * @param[in] threadId Identifier of the thread that generated the message (0 = unknown)
+ * @param[in] threadName Name of the thread that generated the message (may be NULL)
+ */
+std::string compose_log_line( int prio, const char* program, const char* category, const char* function, const char* msg,
+                              uint64_t wallNs = 0, unsigned long threadId = 0, const char* threadName = NULL );
+
+/**
+ * Formats the timestamp that starts the lines of text (e.g. "2016-03-01 12:34:56.123456 ").
+ *
+ * The date and time are cached per thread, so that only the sub-second digits are rendered unless the
+ * second changes.
+ *
+ * @param[in] timestamp Time in ticks of the log clock
+ * @param[out] out Buffer of at least LOG_TIMESTAMP_SIZE characters
+ * @return The length of the text, which is 0 if @p timestamp is 0 or timestamps are disabled
+ */
+size_t format_timestamp( uint64_t timestamp, char* out );
+
+/**
+ * Formats the timestamp that starts the lines of text from a wall-clock time.
+ *
+ * @param[in] wallNs Time in nanoseconds since the epoch
+ * @param[out] out Buffer of at least LOG_TIMESTAMP_SIZE characters
+ * @return The length of the text, which is 0 if @p wallNs is 0 or timestamps are disabled
+ */
+size_t format_wall_timestamp( uint64_t wallNs, char* out );
+
+/**
+ * Returns the tag that identifies a priority in the lines of text (e.g. "[ERROR]").
+ */
+const char* get_priority_tag( int prio );
+
+/**
+ * Appends to a string the line of text for a message, in the same format written to console.
+ *
+ * @param[in,out] out String where the line is appended
+ * @param[in] record Log message (with the function name already simplified)
+ * @param[in] program Name of the program
+ * @param[in] colors Indicates if the priority must be highlighted with terminal color sequences
+ */
+void append_log_line( std::string& out, const log_record& record, const char* program, bool colors );
+
+/**
+ * Appends to a string the line for a message as a JSON object (JSON lines format), with the fields of
+ * structured messages as members of the object.
+ *
+ * @param[in,out] out String where the line is appended
+ * @param[in] record Log message (with the function name already simplified)
+ * @param[in] program Name of the program
+ */
+void append_json_line( std::string& out, const log_record& record, const char* program );
+
+/**
+ * Appends to a string the line for a message in logfmt format, with the fields of structured messages
+ * as additional keys.
+ *
+ * @param[in,out] out String where the line is appended
+ * @param[in] record Log message (with the function name already simplified)
+ * @param[in] program Name of the program
+ */
+void append_logfmt_line( std::string& out, const log_record& record, const char* program );
+
+/**
+ * Renames a log file to @p path.1, shifting the previous backups (@p path.1 to @p path.2, etc.).
+ *
+ * @param[in] path Path of the log file
+ * @param[in] maxBackupFiles Number of backups kept (if 0, the log file is left untouched)
+ */
+void shift_backup_files( const std::string& path, unsigned int maxBackupFiles );
+
+/**
+ * Passes a message to the log handler and writes it to console (if not suppressed by the handler).
+ *
+ * This is always performed in the calling thread.
+ *
+ * @param[in] prio Priority of the message
+ * @param[in] category Category of the message (may be NULL)
+ * @param[in] function Name of the function or method where the message was generated (already simplified)
+ * @param[in] msg Message text
+ * @param[in] timestamp Time when the message was generated
+ */
+void process_log_msg( int prio, const char* category, const char* function, const char* msg, uint64_t timestamp );
+
+/**
+ * Passes a message generated by a call site to the log handler and writes it to console (if not suppressed by the
+ * handler).
+ *
+ * The message is formatted only if it's requested by the log handler or written to console.
+ * This is always performed in the calling thread.
+ *
+ * @param[in] site Call site that generated the message
+ * @param[in] format Format string (using printf format)
+ * @param[in] args Arguments of the format string
+ * @param[in] timestamp Time when the message was generated
+ */
+void process_log_format( const ext::log_site& site, const char* format, va_list* args, uint64_t timestamp );
+
+/**
+ * Passes a structured message to the log handler and writes it to console (if not suppressed by the handler).
+ *
+ * This is always performed in the calling thread.
+ *
+ * @param[in] prio Priority of the message
+ * @param[in] category Category of the message (may be NULL)
+ * @param[in] function Name of the function or method where the message was generated (already simplified)
+ * @param[in] msg Message text without the fields
+ * @param[in] fields Fields of the message
+ * @param[in] count Number of fields
+ * @param[in] timestamp Time when the message was generated
+ */
+void process_log_fields( int prio, const char* category, const char* function, const char* msg, const log_field* fields,
+                         size_t count, uint64_t timestamp );
+
+/**
+ * Passes several messages to the log handler at once and writes them to console (those not suppressed
+ * by the handler).
+ *
+ * @param[in] records Messages (with function names already simplified)
+ * @param[in] count Number of messages (up to LOG_BATCH_SIZE)
+ */
+void process_log_batch( const ext::log_record* const* records, size_t count );
+
+/**
+ * Queues an already formatted message to be processed by the asynchronous writer thread.
+ *
+ * The function name must be already simplified. The strings pointed by @p category, @p function and
+ * @p msg are copied.
+ *
+ * @retval true if the message was queued or discarded according to the overflow policy
+ * @retval false if the asynchronous mode is not enabled (the message must be processed by the caller)
+ */
+bool async_push_text( int prio, const char* category, const char* function, const char* msg, uint64_t timestamp );
+
+/**
+ * Queues a message generated by a call site to be formatted and processed by the asynchronous writer thread.
+ *
+ * The arguments are captured using capture_format_args(), but the call site and the string pointed by
+ * @p format are not copied, therefore they must have static storage duration.
+ *
+ * @retval true if the message was queued or discarded according to the overflow policy
+ * @retval false if the asynchronous mode is not enabled (the message must be processed by the caller)
+ */
+bool async_push_deferred( const ext::log_site& site, const char* format, va_list args, uint64_t timestamp );
+
+/**
+ * Computes a hash of the message that would be generated by a format string and its arguments, without
+ * formatting it.
+ *
+ * @return The hash, or 0 if the arguments are too large to be hashed
+ */
+uint64_t hash_message( const char* format, va_list args ) noexcept;
+
+/**
+ * Computes a hash of a structured message.
+ *
+ * @return The hash (never 0)
+ */
+uint64_t hash_fields( const char* msg, const log_field* fields, size_t count ) noexcept;
+
+/**
+ * Appends the fields of a structured message in logfmt format (e.g. " fd=3 peer=\"host:80\"").
+ */
+void append_fields_logfmt( std::string& out, const log_field* fields, size_t count );
+
+/**
+ * Appends the fields of a structured message as members of a JSON object (e.g. ",\"fd\":3").
+ */
+void append_fields_json( std::string& out, const log_field* fields, size_t count );
+
+/**
+ * Appends the value of a field as plain text (strings are neither quoted nor escaped).
+ */
+void append_field_text( std::string& out, const log_field& field );
+
+/**
+ * Appends a string as a quoted and escaped JSON string.
+ */
+void append_json_string( std::string& out, const char* str, size_t len );
+
+/**
+ * Encodes the fields of a structured message into a buffer, copying their keys and string values.
+ *
+ * Once the buffer has grown enough, encoding doesn't need to allocate memory.
+ */
+void encode_fields( std::string& out, const log_field* fields, size_t count );
+
+/**
+ * Decodes the fields encoded by encode_fields().
+ *
+ * The keys and string values of the decoded fields point into @p data.
+ */
+void decode_fields( const std::string& data, std::vector<log_field>& fields );
+
+/**
+ * Queues a structured message to be processed by the asynchronous writer thread.
+ *
+ * The function name must be already simplified. The message and the fields are copied, but the strings
+ * pointed by @p category and @p function are not, therefore they must have static storage duration.
+ *
+ * @retval true if the message was queued or discarded according to the overflow policy
+ * @retval false if the asynchronous mode is not enabled (the message must be processed by the caller)
+ */
+bool async_push_fields( int prio, const char* category, const char* function, const char* msg, const log_field* fields,
+                        size_t count, uint64_t timestamp );
+
+/**
+ * Captures a message not logged because of the priority limits into the flight recorder ring buffer of the
+ * calling thread.
+ *
+ * The function name is taken already simplified from the call site, and the strings pointed by @p format
+ * must have static storage duration.
+ */
+void flight_record( const log_site& site, const char* format, va_list args, uint64_t timestamp ) noexcept;
+
+/**
+ * Logs the messages captured by the flight recorder in the calling thread, and clears them.
+ */
+void flight_dump();
+
+/**
+ * Sets the maximum number of messages logged when the flight recorder ring buffer is dumped.
+ */
+void set_flight_recorder_dump_count( unsigned int dumpCount ) noexcept;
+
+/**
+ * Disables the asynchronous mode without waiting for the writer thread, and processes in the calling
+ * thread all the messages still queued.
+ *
+ * Intended to be used when the program is going to be terminated.
+ */
+void async_emergency_drain();
+
+/**
+ * Checks whether all the messages queued in asynchronous mode have been processed by the writer thread
+ * (async-signal-safe).
+ *
+ * @retval true if the asynchronous mode is disabled, or if there aren't messages pending to be processed
+ * @retval false otherwise
+ */
+bool async_is_drained() noexcept;
+
+/**
+ * Checks whether the calling thread is the writer thread of the asynchronous mode (async-signal-safe).
+ */
+bool async_is_writer_thread() noexcept;
+
+/**
+ * Holder of log data which must be written out if the program crashes.
+ */
+class crash_flusher
+{
+public:
+    /**
+     * Writes out the data held by the object.
+     *
+     * Called from a signal handler, therefore it must be async-signal-safe (i.e. it must not allocate
+     * memory nor block). Data that can't be written safely must be skipped.
+     */
+    virtual void crash_flush() noexcept = 0;
+
+protected:
+    ~crash_flusher()
+    {}
+};
+
+/**
+ * Registers an object whose data must be written out if the program crashes.
+ *
+ * At most LOG_MAX_CRASH_FLUSHERS objects can be registered at once, further objects are ignored.
+ */
+void register_crash_flusher( crash_flusher* flusher ) noexcept;
+
+/**
+ * Unregisters an object registered with register_crash_flusher().
+ */
+void unregister_crash_flusher( crash_flusher* flusher ) noexcept;
+
+/**
+ * Calls crash_flush() for all the registered objects (async-signal-safe).
+ */
+void crash_flush_all() noexcept;
+
+} // namespace
+} // namespace
+
+#endif // header guard
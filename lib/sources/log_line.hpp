@@ -0,0 +1,123 @@
+/**
+ * @file
+ * @brief      Internal header for composing the lines of text of the log messages in place
+ * @authors    Jesus Gonzalez <jgonzalez@gdr-sistemas.com>
+ * @copyright  Copyright (c) 2003-2016 Jesus Gonzalez
+ * @license    See LICENSE.txt
+ */
+
+#ifndef Extended_log_line_hpp_
+#define Extended_log_line_hpp_
+
+#include <string.h>
+
+#include "Extended/log.hpp"
+#include "log_internal.hpp"
+
+namespace ext
+{
+namespace log_internal
+{
+
+/**
+ * Pieces of the line of text of a message (in the same format written to console), so that it can be
+ * copied into shared memory without formatting it into an intermediate buffer.
+ */
+class log_line
+{
+public:
+    log_line() noexcept
+    : m_count( 0 ), m_size( 0 )
+    {}
+
+    log_line( const log_record& record ) noexcept
+    : m_count( 0 ), m_size( 0 )
+    {
+        compose( record );
+    }
+
+    /**
+     * Composes the line of a message, replacing the previous contents of the line.
+     */
+    void compose( const log_record& record ) noexcept
+    {
+        m_count = 0;
+        m_size = 0;
+
+        if( format_timestamp( record.timestamp(), m_timestamp ) > 0 )
+        {
+            add( m_timestamp );
+        }
+        add( get_priority_tag( record.priority() ) );
+        add( " {" );
+        add( get_program_name() );
+        if( record.category() != NULL )
+        {
+            add( ":" );
+            add( record.category() );
+        }
+        add( "} " );
+        if( format_thread_tag( record, m_threadTag ) > 0 )
+        {
+            add( m_threadTag );
+        }
+        add( "<" );
+        add( record.function() );
+        add( "> " );
+        add( record.message() );
+        add( "\n" );
+    }
+
+    size_t size() const noexcept
+    {
+        return m_size;
+    }
+
+    char* copy_to( char* dst ) const noexcept
+    {
+        for( unsigned int i = 0; i < m_count; i++ )
+        {
+            memcpy( dst, m_pieces[i], m_lengths[i] );
+            dst += m_lengths[i];
+        }
+        return dst;
+    }
+
+    /**
+     * Copies the line truncated to @p maxSize characters.
+     *
+     * @return The number of characters copied
+     */
+    size_t copy_to( char* dst, size_t maxSize ) const noexcept
+    {
+        size_t copied = 0;
+        for( unsigned int i = 0; ( i < m_count ) && ( copied < maxSize ); i++ )
+        {
+            size_t length = ( m_lengths[i] < maxSize - copied ) ? m_lengths[i] : ( maxSize - copied );
+            memcpy( dst + copied, m_pieces[i], length );
+            copied += length;
+        }
+        return copied;
+    }
+
+private:
+    void add( const char* piece ) noexcept
+    {
+        m_pieces[m_count] = piece;
+        m_lengths[m_count] = strlen( piece );
+        m_size += m_lengths[m_count];
+        m_count++;
+    }
+
+    char m_timestamp[LOG_TIMESTAMP_SIZE];
+    char m_threadTag[LOG_THREAD_TAG_SIZE];
+    const char* m_pieces[13];
+    size_t m_lengths[13];
+    unsigned int m_count;
+    size_t m_size;
+};
+
+} // namespace
+} // namespace
+
+#endif // header guard
@@ -0,0 +1,176 @@
+/**
+ * @file
+ * @brief      Implementation of the log pipeline
+ * @authors    Jesus Gonzalez <jgonzalez@gdr-sistemas.com>
+ * @copyright  Copyright (c) 2003-2016 Jesus Gonzalez
+ * @license    See LICENSE.txt
+ */
+
+#include "Extended/log_pipeline.hpp"
+
+#include <vector>
+#include <algorithm>
+
+#include "log_internal.hpp"
+#include "log_rcu.hpp"
+
+using namespace ext;
+using namespace ext::log_internal;
+
+/**
+ * List of sinks of a pipeline.
+ *
+ * Lists are never modified once published; adding or removing a sink publishes a new list.
+ */
+struct log_pipeline::sink_list : public rcu_object
+{
+    std::vector< std::shared_ptr<log_sink> > sinks;
+};
+
+log_pipeline::log_pipeline() noexcept
+: m_sinks( NULL )
+{
+}
+
+log_pipeline::~log_pipeline()
+{
+    // The pipeline can't be in use anymore
+    delete m_sinks.load( std::memory_order_relaxed );
+}
+
+void log_pipeline::publish( sink_list* sinks )
+{
+    if( sinks->sinks.empty() )
+    {
+        delete sinks;
+        sinks = NULL;
+    }
+
+    rcu_retire( m_sinks.exchange( sinks ) );
+}
+
+void log_pipeline::add_sink( const std::shared_ptr<log_sink>& sink )
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+
+    sink_list* newSinks = new sink_list();
+    sink_list* sinks = m_sinks.load( std::memory_order_relaxed );
+    if( sinks != NULL )
+    {
+        newSinks->sinks = sinks->sinks;
+    }
+    newSinks->sinks.push_back( sink );
+
+    publish( newSinks );
+}
+
+bool log_pipeline::remove_sink( const std::shared_ptr<log_sink>& sink )
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+
+    sink_list* sinks = m_sinks.load( std::memory_order_relaxed );
+    if( ( sinks == NULL ) || ( std::find( sinks->sinks.begin(), sinks->sinks.end(), sink ) == sinks->sinks.end() ) )
+    {
+        return false;
+    }
+
+    sink_list* newSinks = new sink_list();
+    for( const std::shared_ptr<log_sink>& s : sinks->sinks )
+    {
+        if( s != sink )
+        {
+            newSinks->sinks.push_back( s );
+        }
+    }
+
+    publish( newSinks );
+
+    return true;
+}
+
+void log_pipeline::clear_sinks()
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+
+    rcu_retire( m_sinks.exchange( NULL ) );
+}
+
+size_t log_pipeline::get_sink_count() const noexcept
+{
+    rcu_read_guard guard;
+
+    sink_list* sinks = m_sinks.load( std::memory_order_acquire );
+    return ( sinks != NULL ) ? sinks->sinks.size() : 0;
+}
+
+bool log_pipeline::process_record( const log_record& record )
+{
+    rcu_read_guard guard;
+
+    bool toConsole = false;
+
+    sink_list* sinks = m_sinks.load( std::memory_order_acquire );
+    if( sinks != NULL )
+    {
+        for( const std::shared_ptr<log_sink>& sink : sinks->sinks )
+        {
+            if( sink->accepts( record.priority() ) )
+            {
+                // All the sinks must receive the message, even if a previous one already requested it to be logged to console
+                toConsole = sink->dispatch( record ) || toConsole;
+            }
+        }
+    }
+
+    return toConsole;
+}
+
+void log_pipeline::process_batch( const log_record* const* records, size_t count, bool* toConsole )
+{
+    rcu_read_guard guard;
+
+    for( size_t i = 0; i < count; i++ )
+    {
+        toConsole[i] = false;
+    }
+
+    sink_list* sinks = m_sinks.load( std::memory_order_acquire );
+    if( sinks == NULL )
+    {
+        return;
+    }
+
+    const log_record* sinkRecords[LOG_BATCH_SIZE];
+    size_t sinkIndexes[LOG_BATCH_SIZE];
+    bool sinkToConsole[LOG_BATCH_SIZE];
+
+    for( size_t base = 0; base < count; base += LOG_BATCH_SIZE )
+    {
+        size_t end = std::min( count, base + LOG_BATCH_SIZE );
+
+        for( const std::shared_ptr<log_sink>& sink : sinks->sinks )
+        {
+            size_t sinkCount = 0;
+
+            for( size_t i = base; i < end; i++ )
+            {
+                if( sink->accepts( records[i]->priority() ) )
+                {
+                    sinkRecords[sinkCount] = records[i];
+                    sinkIndexes[sinkCount] = i;
+                    sinkCount++;
+                }
+            }
+
+            if( sinkCount > 0 )
+            {
+                sink->process_batch( sinkRecords, sinkCount, sinkToConsole );
+
+                for( size_t i = 0; i < sinkCount; i++ )
+                {
+                    toConsole[sinkIndexes[i]] = toConsole[sinkIndexes[i]] || sinkToConsole[i];
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,204 @@
+/**
+ * @file
+ * @brief      Implementation of the read-copy-update publication of log objects
+ * @authors    Jesus Gonzalez <jgonzalez@gdr-sistemas.com>
+ * @copyright  Copyright (c) 2003-2016 Jesus Gonzalez
+ * @license    See LICENSE.txt
+ */
+
+#include "log_rcu.hpp"
+
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace ext::log_internal;
+
+#define MAX_READER_SLOTS    256
+
+namespace
+{
+
+/**
+ * Slot where a reader thread publishes the epoch in which it entered its current read section
+ * (0 when it's not inside a read section).
+ *
+ * Each slot is used by a single thread, and is kept in its own cache line to avoid false sharing.
+ */
+struct alignas(64) reader_slot
+{
+    std::atomic<uint64_t> epoch;
+    std::atomic<bool> used;
+};
+
+/**
+ * Per-thread reader state.
+ */
+struct thread_reader
+{
+    int slot;               // Index of the slot owned by the thread, or -1 if none
+    unsigned int depth;     // Nesting level of read sections
+
+    ~thread_reader();
+};
+
+} // namespace
+
+static reader_slot g_readerSlots[MAX_READER_SLOTS];
+
+// Readers of threads that couldn't get a slot (only if there are more than MAX_READER_SLOTS threads)
+static std::atomic<unsigned int> g_overflowReaders( 0 );
+
+static std::atomic<uint64_t> g_epoch( 1 );
+
+static std::mutex g_retireMutex;
+static std::vector<rcu_object*>* g_deferred = NULL;
+
+static thread_local thread_reader t_reader = { -1, 0 };
+
+thread_reader::~thread_reader()
+{
+    if( slot >= 0 )
+    {
+        g_readerSlots[slot].used.store( false, std::memory_order_release );
+        slot = -1;
+    }
+}
+
+static void acquire_slot( thread_reader& reader )
+{
+    for( int i = 0; i < MAX_READER_SLOTS; i++ )
+    {
+        bool expected = false;
+        if( !g_readerSlots[i].used.load( std::memory_order_relaxed ) &&
+            g_readerSlots[i].used.compare_exchange_strong( expected, true, std::memory_order_acquire ) )
+        {
+            reader.slot = i;
+            return;
+        }
+    }
+}
+
+void ext::log_internal::rcu_read_enter() noexcept
+{
+    thread_reader& reader = t_reader;
+
+    if( reader.depth++ > 0 )
+    {
+        return;
+    }
+
+    if( reader.slot < 0 )
+    {
+        acquire_slot( reader );
+    }
+
+    if( reader.slot >= 0 )
+    {
+        g_readerSlots[reader.slot].epoch.store( g_epoch.load( std::memory_order_acquire ), std::memory_order_relaxed );
+    }
+    else
+    {
+        g_overflowReaders.fetch_add( 1, std::memory_order_relaxed ); // LCOV_EXCL_LINE
+    }
+
+    // Pairs with the fence in wait_for_readers(): either the writer sees this reader, or this reader
+    // sees the pointers published by the writer
+    std::atomic_thread_fence( std::memory_order_seq_cst );
+}
+
+void ext::log_internal::rcu_read_exit() noexcept
+{
+    thread_reader& reader = t_reader;
+
+    if( --reader.depth > 0 )
+    {
+        return;
+    }
+
+    if( reader.slot >= 0 )
+    {
+        g_readerSlots[reader.slot].epoch.store( 0, std::memory_order_release );
+    }
+    else
+    {
+        g_overflowReaders.fetch_sub( 1, std::memory_order_release ); // LCOV_EXCL_LINE
+    }
+}
+
+bool ext::log_internal::rcu_in_read_section() noexcept
+{
+    return t_reader.depth > 0;
+}
+
+/**
+ * Waits until all the read sections started before the call have finished.
+ */
+static void wait_for_readers()
+{
+    // Read sections that start after the increment can't see the retired objects
+    uint64_t epoch = g_epoch.fetch_add( 1 ) + 1;
+
+    std::atomic_thread_fence( std::memory_order_seq_cst );
+
+    for( int i = 0; i < MAX_READER_SLOTS; i++ )
+    {
+        for(;;)
+        {
+            uint64_t readerEpoch = g_readerSlots[i].epoch.load( std::memory_order_acquire );
+            if( ( readerEpoch == 0 ) || ( readerEpoch >= epoch ) )
+            {
+                break;
+            }
+            std::this_thread::yield();
+        }
+    }
+
+    while( g_overflowReaders.load( std::memory_order_acquire ) > 0 )
+    {
+        std::this_thread::yield(); // LCOV_EXCL_LINE
+    }
+}
+
+void ext::log_internal::rcu_retire( rcu_object* obj ) noexcept
+{
+    std::unique_lock<std::mutex> lock( g_retireMutex );
+
+    if( rcu_in_read_section() )
+    {
+        if( obj != NULL )
+        {
+            if( g_deferred == NULL )
+            {
+                g_deferred = new std::vector<rcu_object*>();
+            }
+            g_deferred->push_back( obj );
+        }
+        return;
+    }
+
+    std::vector<rcu_object*>* deferred = g_deferred;
+    g_deferred = NULL;
+
+    lock.unlock();
+
+    if( ( obj == NULL ) && ( deferred == NULL ) )
+    {
+        return;
+    }
+
+    wait_for_readers();
+
+    delete obj;
+
+    if( deferred != NULL )
+    {
+        for( rcu_object* deferredObj : *deferred )
+        {
+            delete deferredObj;
+        }
+        delete deferred;
+    }
+}
@@ -0,0 +1,84 @@
+/**
+ * @file
+ * @brief      Internal header for the read-copy-update publication of log objects
+ * @authors    Jesus Gonzalez <jgonzalez@gdr-sistemas.com>
+ * @copyright  Copyright (c) 2003-2016 Jesus Gonzalez
+ * @license    See LICENSE.txt
+ *
+ * Objects read on the logging path (e.g. the log handler) are published through atomic pointers and
+ * are never modified once published. Readers access them inside a read section, which just marks
+ * a per-thread slot and doesn't take any lock nor touch any shared reference counter. Writers publish
+ * a new object and then retire the old one, which is destroyed once all the read sections that may
+ * be using it have finished (i.e. after a grace period).
+ */
+
+#ifndef Extended_log_rcu_hpp_
+#define Extended_log_rcu_hpp_
+
+namespace ext
+{
+namespace log_internal
+{
+
+/**
+ * Base class for the objects that can be retired.
+ */
+class rcu_object
+{
+public:
+    virtual ~rcu_object()
+    {}
+};
+
+/**
+ * Enters a read section. Read sections can be nested.
+ */
+void rcu_read_enter() noexcept;
+
+/**
+ * Exits a read section.
+ */
+void rcu_read_exit() noexcept;
+
+/**
+ * Indicates if the calling thread is inside a read section.
+ */
+bool rcu_in_read_section() noexcept;
+
+/**
+ * Destroys an object that is no longer published, once all the read sections that may be using it
+ * have finished.
+ *
+ * Must be called after the pointer to the object has been replaced. If the calling thread is inside
+ * a read section (e.g. the log handler is replaced by itself), waiting is not possible and the
+ * destruction is deferred until a later call.
+ *
+ * @param[in] obj Object to be destroyed (may be NULL)
+ */
+void rcu_retire( rcu_object* obj ) noexcept;
+
+/**
+ * Scoped read section.
+ */
+class rcu_read_guard
+{
+public:
+    rcu_read_guard() noexcept
+    {
+        rcu_read_enter();
+    }
+
+    ~rcu_read_guard()
+    {
+        rcu_read_exit();
+    }
+
+private:
+    rcu_read_guard( const rcu_read_guard& ) = delete;
+    rcu_read_guard& operator=( const rcu_read_guard& ) = delete;
+};
+
+} // namespace
+} // namespace
+
+#endif // header guard
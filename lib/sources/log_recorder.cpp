@@ -0,0 +1,237 @@
+/**
+ * @file
+ * @brief      Implementation of the flight recorder of log messages
+ * @authors    Jesus Gonzalez <jgonzalez@gdr-sistemas.com>
+ * @copyright  Copyright (c) 2003-2016 Jesus Gonzalez
+ * @license    See LICENSE.txt
+ */
+
+#include "local_log.hpp"
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <new>
+#include <string>
+
+#include "Extended/string.hpp"
+#include "log_internal.hpp"
+#include "log_format.hpp"
+
+using namespace ext;
+using namespace ext::log_internal;
+
+#ifndef LOG_FLIGHT_RECORDER_SIZE
+#define LOG_FLIGHT_RECORDER_SIZE    16384   // Size of the ring buffer of each thread (multiple of 8)
+#endif
+
+#define MAX_ENTRY_SIZE              ( LOG_FLIGHT_RECORDER_SIZE / 4 )
+#define PADDING_ARGS_LEN            UINT32_MAX
+
+namespace
+{
+
+/**
+ * Header of the entries of the ring buffer, which is followed by the captured arguments.
+ */
+struct entry_header
+{
+    uint32_t size;              // Total size of the entry (multiple of 8)
+    uint32_t argsLen;           // PADDING_ARGS_LEN for the padding at the end of the buffer (only 8 bytes are valid)
+    const log_site* site;
+    const char* format;
+    uint64_t timestamp;
+};
+
+/**
+ * Ring buffer of a thread.
+ *
+ * Positions increase monotonically, and entries are always contiguous in the buffer (the space at the end
+ * of the buffer that can't hold an entry is filled with padding). It's allocated when the thread captures
+ * its first message, so that threads that never do don't reserve its memory.
+ */
+struct flight_ring
+{
+    uint64_t head;              // Position where the next entry will be written
+    uint64_t tail;              // Position of the oldest entry
+    bool dumping;
+    alignas(8) char data[LOG_FLIGHT_RECORDER_SIZE];
+};
+
+/**
+ * Scoped mark of the ring buffer being dumped, so that the messages logged while dumping it (e.g. by the
+ * log handler) are not captured.
+ */
+class dumping_guard
+{
+public:
+    dumping_guard( flight_ring& ring ) : m_ring( ring )
+    {
+        m_ring.dumping = true;
+    }
+
+    ~dumping_guard()
+    {
+        m_ring.dumping = false;
+    }
+
+private:
+    flight_ring& m_ring;
+};
+
+/**
+ * Releases the ring buffer of a thread when it terminates.
+ */
+class ring_releaser
+{
+public:
+    ~ring_releaser();
+};
+
+} // namespace
+
+static thread_local flight_ring* t_ring = NULL;
+static thread_local bool t_ringReleased = false;
+
+ring_releaser::~ring_releaser()
+{
+    delete t_ring;
+    t_ring = NULL;
+    t_ringReleased = true;
+}
+
+/**
+ * Returns the ring buffer of the calling thread, allocating it if needed.
+ *
+ * @return The ring buffer, or NULL if it couldn't be allocated (or the thread is terminating)
+ */
+static flight_ring* get_ring() noexcept
+{
+    if( ( t_ring == NULL ) && !t_ringReleased )
+    {
+        static thread_local ring_releaser releaser;
+        (void) releaser;
+
+        t_ring = new (std::nothrow) flight_ring();
+    }
+
+    return t_ring;
+}
+
+static std::atomic<unsigned int> g_dumpCount( 64 );
+
+static entry_header* get_entry( flight_ring& ring, uint64_t pos )
+{
+    return reinterpret_cast<entry_header*>( &ring.data[pos % LOG_FLIGHT_RECORDER_SIZE] );
+}
+
+/**
+ * Discards the oldest entries until there is room for @p size bytes at the head.
+ */
+static void make_room( flight_ring& ring, uint64_t size )
+{
+    while( ring.head + size - ring.tail > LOG_FLIGHT_RECORDER_SIZE )
+    {
+        ring.tail += get_entry( ring, ring.tail )->size;
+    }
+}
+
+void ext::log_internal::flight_record( const log_site& site, const char* format, va_list args, uint64_t timestamp ) noexcept
+{
+    flight_ring* ringPtr = get_ring();
+    if( ( ringPtr == NULL ) || ringPtr->dumping )
+    {
+        return;
+    }
+
+    flight_ring& ring = *ringPtr;
+
+    // The arguments are captured directly into the buffer, therefore there must be room for the largest entry
+    uint64_t pos = ring.head % LOG_FLIGHT_RECORDER_SIZE;
+    if( LOG_FLIGHT_RECORDER_SIZE - pos < MAX_ENTRY_SIZE )
+    {
+        uint32_t paddingSize = (uint32_t) ( LOG_FLIGHT_RECORDER_SIZE - pos );
+        make_room( ring, paddingSize );
+
+        entry_header* padding = get_entry( ring, ring.head );
+        padding->size = paddingSize;
+        padding->argsLen = PADDING_ARGS_LEN;
+        ring.head += paddingSize;
+    }
+
+    make_room( ring, MAX_ENTRY_SIZE );
+
+    entry_header* entry = get_entry( ring, ring.head );
+    size_t argsLen = 0;
+    if( !capture_format_args( format, args, reinterpret_cast<char*>( entry + 1 ), MAX_ENTRY_SIZE - sizeof( entry_header ), argsLen ) )
+    {
+        argsLen = 0;
+    }
+
+    entry->size = (uint32_t) ( ( sizeof( entry_header ) + argsLen + 7 ) & ~(size_t) 7 );
+    entry->argsLen = (uint32_t) argsLen;
+    entry->site = &site;
+    entry->format = format;
+    entry->timestamp = timestamp;
+    ring.head += entry->size;
+}
+
+void ext::log_internal::flight_dump()
+{
+    flight_ring* ringPtr = t_ring;
+    if( ( ringPtr == NULL ) || ( ringPtr->head == ringPtr->tail ) || ringPtr->dumping )
+    {
+        return;
+    }
+
+    flight_ring& ring = *ringPtr;
+
+    dumping_guard guard( ring );
+
+    unsigned int count = 0;
+    for( uint64_t pos = ring.tail; pos != ring.head; pos += get_entry( ring, pos )->size )
+    {
+        if( get_entry( ring, pos )->argsLen != PADDING_ARGS_LEN )
+        {
+            count++;
+        }
+    }
+
+    unsigned int dumpCount = g_dumpCount.load( std::memory_order_relaxed );
+    unsigned int skip = ( count > dumpCount ) ? ( count - dumpCount ) : 0;
+
+    emit_log_msg( LOG_PRIORITY_INFO, LOG_CATEGORY, "ext::log",
+                  format( "Flight recorder: last %u messages not logged", count - skip ).c_str(), log::get_timestamp() );
+
+    std::string msg;
+    for( uint64_t pos = ring.tail; pos != ring.head; pos += get_entry( ring, pos )->size )
+    {
+        const entry_header* entry = get_entry( ring, pos );
+        if( entry->argsLen == PADDING_ARGS_LEN )
+        {
+            continue;
+        }
+        else if( skip > 0 )
+        {
+            skip--;
+            continue;
+        }
+
+        msg.clear();
+        render_format_args( entry->format, reinterpret_cast<const char*>( entry + 1 ), entry->argsLen, msg );
+        emit_log_msg( entry->site->get_priority(), entry->site->get_category(), entry->site->get_function(),
+                      msg.c_str(), entry->timestamp );
+    }
+
+    ring.tail = ring.head;
+}
+
+void ext::log_internal::set_flight_recorder_dump_count( unsigned int dumpCount ) noexcept
+{
+    g_dumpCount.store( dumpCount, std::memory_order_relaxed );
+}
+
+void ext::log::dump_flight_recorder()
+{
+    flight_dump();
+}
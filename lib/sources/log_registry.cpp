@@ -0,0 +1,645 @@
+/**
+ * @file
+ * @brief      Implementation of the registry of log call sites, categories, priority limits and rate limits
+ * @authors    Jesus Gonzalez <jgonzalez@gdr-sistemas.com>
+ * @copyright  Copyright (c) 2003-2016 Jesus Gonzalez
+ * @license    See LICENSE.txt
+ */
+
+#include "Extended/log.hpp"
+
+#include <string.h>
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "log_internal.hpp"
+#include "log_format.hpp"
+
+using namespace ext;
+using namespace ext::log_internal;
+
+#define NAMES_POOL_SIZE     ( 128 * 1024 )
+#define HASH_BUFFER_SIZE    256             // Maximum size of the captured arguments of collapsible messages
+
+namespace
+{
+
+/**
+ * Entry of the categories table.
+ *
+ * Categories are looked up without locking: once the name of an entry is published it never changes.
+ */
+struct category_entry
+{
+    std::atomic<const char*> name;
+    std::atomic<int> limit;
+};
+
+/**
+ * Rule to set the priority limit of the categories matching a pattern.
+ */
+struct category_rule
+{
+    std::string pattern;    // Without the trailing '*' for prefix patterns
+    bool prefix;
+    int limit;
+
+    bool matches( const char* category ) const
+    {
+        return prefix ? ( strncmp( category, pattern.c_str(), pattern.size() ) == 0 ) : ( pattern == category );
+    }
+};
+
+/**
+ * Rule to set the rate limit of the call sites of the categories matching a pattern.
+ */
+struct rate_rule
+{
+    std::string pattern;    // Without the trailing '*' for prefix patterns
+    bool prefix;
+    bool all;               // Applies to all the call sites
+    int priority;
+    uint64_t interval;
+    uint64_t tolerance;
+    bool collapse;
+
+    bool matches( int prio, const char* category ) const
+    {
+        if( prio < priority )
+        {
+            return false;
+        }
+        else if( all )
+        {
+            return true;
+        }
+        else if( category == NULL )
+        {
+            return false;
+        }
+        else
+        {
+            return prefix ? ( strncmp( category, pattern.c_str(), pattern.size() ) == 0 ) : ( pattern == category );
+        }
+    }
+};
+
+} // namespace
+
+static std::atomic<int> g_priorityLimit( LOG_PRIORITY_ALLOC );
+static std::atomic<int> g_recorderLimit( 0 ); // 0 = flight recorder disabled
+
+// The registry uses only static storage (apart from the rules), so that it can be used safely during
+// the whole life of the program, including its exit.
+static std::mutex g_registryMutex;
+static log_site* g_sites = NULL;
+
+// Open addressing hash table; entry 0 is used for messages without category and for the categories that
+// don't fit into the table, and starts with the initial priority limit
+static category_entry g_categories[LOG_MAX_CATEGORIES] = { { { NULL }, { LOG_PRIORITY_ALLOC } } };
+
+// Names of functions and categories copied by the registry
+static char g_namesPool[NAMES_POOL_SIZE];
+static size_t g_namesPoolUsed = 0;
+
+static std::vector<category_rule>* g_categoryRules = NULL;
+
+static std::vector<rate_rule>* g_rateRules = NULL;
+
+static std::atomic<unsigned long long> g_suppressedCount( 0 );
+
+static const char* store_name( const char* name, size_t len )
+{
+    if( g_namesPoolUsed + len + 1 > NAMES_POOL_SIZE )
+    {
+        return NULL; // LCOV_EXCL_LINE
+    }
+
+    char* stored = &g_namesPool[g_namesPoolUsed];
+    memcpy( stored, name, len );
+    stored[len] = '\0';
+    g_namesPoolUsed += len + 1;
+
+    return stored;
+}
+
+static unsigned int hash_name( const char* name )
+{
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for( ; *name != '\0'; name++ )
+    {
+        hash = ( hash ^ (uint8_t) *name ) * 16777619u;
+    }
+    return hash;
+}
+
+static unsigned int get_probe_index( unsigned int hash, unsigned int i )
+{
+    return 1 + ( ( hash + i ) % ( LOG_MAX_CATEGORIES - 1 ) );
+}
+
+/**
+ * Looks up a category in the table without locking.
+ *
+ * @return The index of the category, or 0 if not found
+ */
+static unsigned int find_category( const char* category )
+{
+    unsigned int hash = hash_name( category );
+
+    for( unsigned int i = 0; i < ( LOG_MAX_CATEGORIES - 1 ); i++ )
+    {
+        category_entry& entry = g_categories[get_probe_index( hash, i )];
+        const char* name = entry.name.load( std::memory_order_acquire );
+
+        if( name == NULL )
+        {
+            return 0;
+        }
+        else if( strcmp( name, category ) == 0 )
+        {
+            return get_probe_index( hash, i );
+        }
+    }
+
+    return 0; // LCOV_EXCL_LINE
+}
+
+/**
+ * Computes the priority limit of a category according to the rules (the registry must be locked).
+ */
+static int compute_category_limit( const char* category )
+{
+    int limit = g_priorityLimit.load( std::memory_order_relaxed );
+
+    if( g_categoryRules != NULL )
+    {
+        // Later rules override the previous ones
+        for( const category_rule& rule : *g_categoryRules )
+        {
+            if( rule.matches( category ) )
+            {
+                limit = rule.limit;
+            }
+        }
+    }
+
+    return limit;
+}
+
+/**
+ * Adds a category to the table if not yet present (the registry must be locked).
+ *
+ * @return The index of the category
+ */
+static unsigned int intern_category( const char* category )
+{
+    if( category == NULL )
+    {
+        return 0;
+    }
+
+    unsigned int hash = hash_name( category );
+
+    for( unsigned int i = 0; i < ( LOG_MAX_CATEGORIES - 1 ); i++ )
+    {
+        unsigned int index = get_probe_index( hash, i );
+        category_entry& entry = g_categories[index];
+        const char* name = entry.name.load( std::memory_order_relaxed );
+
+        if( name == NULL )
+        {
+            name = store_name( category, strlen( category ) );
+            if( name == NULL )
+            {
+                return 0; // LCOV_EXCL_LINE
+            }
+
+            entry.limit.store( compute_category_limit( category ), std::memory_order_relaxed );
+            entry.name.store( name, std::memory_order_release );
+            return index;
+        }
+        else if( strcmp( name, category ) == 0 )
+        {
+            return index;
+        }
+    }
+
+    return 0; // LCOV_EXCL_LINE
+}
+
+void log_site::refresh_all() noexcept
+{
+    g_categories[0].limit.store( g_priorityLimit.load( std::memory_order_relaxed ), std::memory_order_relaxed );
+
+    for( unsigned int i = 1; i < LOG_MAX_CATEGORIES; i++ )
+    {
+        const char* name = g_categories[i].name.load( std::memory_order_relaxed );
+        if( name != NULL )
+        {
+            g_categories[i].limit.store( compute_category_limit( name ), std::memory_order_relaxed );
+        }
+    }
+
+    for( log_site* site = g_sites; site != NULL; site = site->m_next )
+    {
+        site->m_state.store( site->compute_state(), std::memory_order_release );
+    }
+}
+
+int log_site::compute_state() const noexcept
+{
+    if( m_prio <= g_categories[m_categoryIndex].limit.load( std::memory_order_relaxed ) )
+    {
+        return STATE_ENABLED;
+    }
+    else if( m_prio <= g_recorderLimit.load( std::memory_order_relaxed ) )
+    {
+        return STATE_RECORDED;
+    }
+    else
+    {
+        return STATE_DISABLED;
+    }
+}
+
+bool log_site::register_site() noexcept
+{
+    std::lock_guard<std::mutex> lock( g_registryMutex );
+
+    // The call site may have been registered concurrently by another thread
+    if( m_state.load( std::memory_order_relaxed ) == STATE_UNREGISTERED )
+    {
+        m_categoryIndex = intern_category( m_category );
+        m_next = g_sites;
+        g_sites = this;
+
+        refresh_rate_limit();
+
+        m_state.store( compute_state(), std::memory_order_release );
+    }
+
+    return m_state.load( std::memory_order_relaxed ) != STATE_DISABLED;
+}
+
+const format_plan* log_site::get_format_plan( const char* format ) const
+{
+    const format_plan* plan = m_formatPlan.load( std::memory_order_acquire );
+    if( plan == NULL )
+    {
+        // Call sites are never destroyed, therefore neither are their plans
+        format_plan* newPlan = new format_plan( format );
+        if( m_formatPlan.compare_exchange_strong( plan, newPlan, std::memory_order_acq_rel ) )
+        {
+            plan = newPlan;
+        }
+        else
+        {
+            // Created concurrently by another thread
+            delete newPlan;
+        }
+    }
+
+    return ( plan->format() == format ) ? plan : NULL;
+}
+
+void log_site::refresh_rate_limit() noexcept
+{
+    const rate_rule* match = NULL;
+
+    if( g_rateRules != NULL )
+    {
+        // Later rules override the previous ones
+        for( const rate_rule& rule : *g_rateRules )
+        {
+            if( rule.matches( m_prio, m_category ) )
+            {
+                match = &rule;
+            }
+        }
+    }
+
+    m_rate.enabled.store( false, std::memory_order_relaxed );
+
+    if( match != NULL )
+    {
+        m_rate.interval.store( match->interval, std::memory_order_relaxed );
+        m_rate.tolerance.store( match->tolerance, std::memory_order_relaxed );
+        m_rate.collapse.store( match->collapse, std::memory_order_relaxed );
+        m_rate.enabled.store( true, std::memory_order_relaxed );
+    }
+}
+
+uint64_t ext::log_internal::hash_message( const char* format, va_list args ) noexcept
+{
+    char buffer[HASH_BUFFER_SIZE];
+    size_t len = 0;
+
+    va_list argsCopy;
+    va_copy( argsCopy, args );
+    bool captured = capture_format_args( format, argsCopy, buffer, sizeof( buffer ), len );
+    va_end( argsCopy );
+
+    if( !captured )
+    {
+        return 0;
+    }
+
+    // FNV-1a of the format string address and the captured arguments
+    uint64_t hash = 14695981039346656037ull;
+    uintptr_t formatAddress = (uintptr_t) format;
+    for( size_t i = 0; i < sizeof( formatAddress ); i++ )
+    {
+        hash = ( hash ^ (uint8_t) ( formatAddress >> ( i * 8 ) ) ) * 1099511628211ull;
+    }
+    for( size_t i = 0; i < len; i++ )
+    {
+        hash = ( hash ^ (uint8_t) buffer[i] ) * 1099511628211ull;
+    }
+
+    return ( hash != 0 ) ? hash : 1;
+}
+
+bool log_site::check_rate_limit( uint64_t hash, unsigned int& repeated, unsigned int& suppressed ) const noexcept
+{
+    repeated = 0;
+    suppressed = 0;
+
+    if( m_rate.collapse.load( std::memory_order_relaxed ) )
+    {
+        if( ( hash != 0 ) && ( m_rate.lastHash.exchange( hash, std::memory_order_relaxed ) == hash ) )
+        {
+            m_rate.repeated.fetch_add( 1, std::memory_order_relaxed );
+            g_suppressedCount.fetch_add( 1, std::memory_order_relaxed );
+            return false;
+        }
+        else if( hash == 0 )
+        {
+            m_rate.lastHash.store( 0, std::memory_order_relaxed );
+        }
+
+        repeated = m_rate.repeated.exchange( 0, std::memory_order_relaxed );
+    }
+
+    uint64_t interval = m_rate.interval.load( std::memory_order_relaxed );
+    if( interval != 0 )
+    {
+        uint64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch() ).count();
+        uint64_t tolerance = m_rate.tolerance.load( std::memory_order_relaxed );
+
+        uint64_t tat = m_rate.tat.load( std::memory_order_relaxed );
+        uint64_t next;
+        do
+        {
+            uint64_t start = std::max( tat, now );
+            if( start - now > tolerance )
+            {
+                // The repetitions not yet reported are reported as suppressed
+                m_rate.suppressed.fetch_add( 1 + repeated, std::memory_order_relaxed );
+                g_suppressedCount.fetch_add( 1, std::memory_order_relaxed );
+                repeated = 0;
+                return false;
+            }
+            next = start + interval;
+        }
+        while( !m_rate.tat.compare_exchange_weak( tat, next, std::memory_order_relaxed ) );
+
+        suppressed = m_rate.suppressed.exchange( 0, std::memory_order_relaxed );
+    }
+
+    return true;
+}
+
+int ext::log::get_priority_limit() noexcept
+{
+    return g_priorityLimit.load( std::memory_order_relaxed );
+}
+
+void ext::log::set_priority_limit( int logPriorityLimit ) noexcept
+{
+    std::lock_guard<std::mutex> lock( g_registryMutex );
+
+    g_priorityLimit.store( logPriorityLimit, std::memory_order_relaxed );
+
+    log_site::refresh_all();
+}
+
+int ext::log::get_category_priority_limit( const char* category ) noexcept
+{
+    if( category == NULL )
+    {
+        return g_priorityLimit.load( std::memory_order_relaxed );
+    }
+
+    unsigned int index = get_category_index( category );
+    if( index == 0 )
+    {
+        // LCOV_EXCL_START
+        std::lock_guard<std::mutex> lock( g_registryMutex );
+        return compute_category_limit( category );
+        // LCOV_EXCL_STOP
+    }
+
+    return g_categories[index].limit.load( std::memory_order_relaxed );
+}
+
+unsigned int ext::log_internal::get_category_index( const char* category ) noexcept
+{
+    if( category == NULL )
+    {
+        return 0;
+    }
+
+    unsigned int index = find_category( category );
+
+    if( index == 0 )
+    {
+        // Categories are registered the first time they are used
+        std::lock_guard<std::mutex> lock( g_registryMutex );
+
+        index = intern_category( category );
+    }
+
+    return index;
+}
+
+const char* ext::log_internal::get_category_name( unsigned int index ) noexcept
+{
+    return ( index < LOG_MAX_CATEGORIES ) ? g_categories[index].name.load( std::memory_order_acquire ) : NULL;
+}
+
+static category_rule make_category_rule( const std::string& pattern, int logPriorityLimit )
+{
+    category_rule rule;
+    rule.pattern = pattern;
+    rule.prefix = !rule.pattern.empty() && ( rule.pattern.back() == '*' );
+    rule.limit = logPriorityLimit;
+    if( rule.prefix )
+    {
+        rule.pattern.pop_back();
+    }
+
+    return rule;
+}
+
+void ext::log::set_category_priority_limit( const char* pattern, int logPriorityLimit )
+{
+    category_rule rule = make_category_rule( pattern, logPriorityLimit );
+
+    std::lock_guard<std::mutex> lock( g_registryMutex );
+
+    if( g_categoryRules == NULL )
+    {
+        g_categoryRules = new std::vector<category_rule>();
+    }
+
+    // A rule with the same pattern is replaced, and the new one takes precedence over the rest
+    for( std::vector<category_rule>::iterator it = g_categoryRules->begin(); it != g_categoryRules->end(); ++it )
+    {
+        if( ( it->prefix == rule.prefix ) && ( it->pattern == rule.pattern ) )
+        {
+            g_categoryRules->erase( it );
+            break;
+        }
+    }
+    g_categoryRules->push_back( rule );
+
+    log_site::refresh_all();
+}
+
+void ext::log::clear_category_priority_limits() noexcept
+{
+    std::lock_guard<std::mutex> lock( g_registryMutex );
+
+    delete g_categoryRules;
+    g_categoryRules = NULL;
+
+    log_site::refresh_all();
+}
+
+void ext::log::set_priority_limits( int logPriorityLimit, const std::vector<std::pair<std::string, int>>& categoryLimits )
+{
+    std::vector<category_rule>* rules = NULL;
+
+    if( !categoryLimits.empty() )
+    {
+        rules = new std::vector<category_rule>();
+        for( const std::pair<std::string, int>& limit : categoryLimits )
+        {
+            category_rule rule = make_category_rule( limit.first, limit.second );
+
+            // A later rule with the same pattern replaces the previous one
+            for( std::vector<category_rule>::iterator it = rules->begin(); it != rules->end(); ++it )
+            {
+                if( ( it->prefix == rule.prefix ) && ( it->pattern == rule.pattern ) )
+                {
+                    rules->erase( it );
+                    break;
+                }
+            }
+            rules->push_back( rule );
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock( g_registryMutex );
+
+        std::swap( rules, g_categoryRules );
+        g_priorityLimit.store( logPriorityLimit, std::memory_order_relaxed );
+
+        log_site::refresh_all();
+    }
+
+    delete rules;
+}
+
+void ext::log::enable_flight_recorder( int priorityLimit, unsigned int dumpCount ) noexcept
+{
+    set_flight_recorder_dump_count( dumpCount );
+
+    std::lock_guard<std::mutex> lock( g_registryMutex );
+
+    g_recorderLimit.store( priorityLimit, std::memory_order_relaxed );
+
+    log_site::refresh_all();
+}
+
+void ext::log::disable_flight_recorder() noexcept
+{
+    std::lock_guard<std::mutex> lock( g_registryMutex );
+
+    g_recorderLimit.store( 0, std::memory_order_relaxed );
+
+    log_site::refresh_all();
+}
+
+bool ext::log::is_flight_recorder_enabled() noexcept
+{
+    return g_recorderLimit.load( std::memory_order_relaxed ) > 0;
+}
+
+void ext::log::set_rate_limit( const char* pattern, int priority, unsigned int messagesPerSecond, unsigned int burst,
+                               bool collapseRepeats )
+{
+    rate_rule rule;
+    rule.all = ( pattern == NULL );
+    rule.pattern = rule.all ? "" : pattern;
+    rule.prefix = !rule.pattern.empty() && ( rule.pattern.back() == '*' );
+    rule.priority = priority;
+    rule.interval = ( messagesPerSecond > 0 ) ? ( 1000000000ull / messagesPerSecond ) : 0;
+    rule.tolerance = rule.interval * ( ( burst > 0 ) ? ( burst - 1 ) : 0 );
+    rule.collapse = collapseRepeats;
+    if( rule.prefix )
+    {
+        rule.pattern.pop_back();
+    }
+
+    std::lock_guard<std::mutex> lock( g_registryMutex );
+
+    if( g_rateRules == NULL )
+    {
+        g_rateRules = new std::vector<rate_rule>();
+    }
+
+    // A rule with the same pattern and priority is replaced, and the new one takes precedence over the rest
+    for( std::vector<rate_rule>::iterator it = g_rateRules->begin(); it != g_rateRules->end(); ++it )
+    {
+        if( ( it->all == rule.all ) && ( it->prefix == rule.prefix ) && ( it->pattern == rule.pattern ) &&
+            ( it->priority == rule.priority ) )
+        {
+            g_rateRules->erase( it );
+            break;
+        }
+    }
+    g_rateRules->push_back( rule );
+
+    for( log_site* site = g_sites; site != NULL; site = site->m_next )
+    {
+        site->refresh_rate_limit();
+    }
+}
+
+void ext::log::clear_rate_limits() noexcept
+{
+    std::lock_guard<std::mutex> lock( g_registryMutex );
+
+    delete g_rateRules;
+    g_rateRules = NULL;
+
+    for( log_site* site = g_sites; site != NULL; site = site->m_next )
+    {
+        site->refresh_rate_limit();
+    }
+}
+
+unsigned long long ext::log::get_suppressed_count() noexcept
+{
+    return g_suppressedCount.load( std::memory_order_relaxed );
+}
@@ -0,0 +1,305 @@
+/**
+ * @file
+ * @brief      Implementation of the statistics of the log management system
+ * @authors    Jesus Gonzalez <jgonzalez@gdr-sistemas.com>
+ * @copyright  Copyright (c) 2003-2016 Jesus Gonzalez
+ * @license    See LICENSE.txt
+ */
+
+#include "local_log.hpp"
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+
+#include "Extended/string.hpp"
+#include "log_internal.hpp"
+
+using namespace ext;
+using namespace ext::log_internal;
+
+#define STATS_SHARDS    8   // Number of shards of the counters (threads are assigned to them round-robin)
+
+namespace
+{
+
+/**
+ * Shard of the counters, in its own cache lines.
+ *
+ * All the members are zero-initialized, because shards have static storage duration.
+ */
+struct alignas(64) stats_shard
+{
+    std::atomic<uint64_t> emitted[LOG_PRIORITY_ALLOC + 1];
+    std::atomic<uint64_t> filtered[LOG_PRIORITY_ALLOC + 1];
+    std::atomic<uint64_t> bytes;
+    std::atomic<uint64_t> handlerCalls;
+    std::atomic<uint64_t> handlerNs;
+    std::atomic<uint64_t> latencySamples;
+    std::atomic<uint64_t> latency[LOG_LATENCY_BUCKETS];
+    std::atomic<uint64_t> categoryEmitted[LOG_MAX_CATEGORIES];
+    std::atomic<uint64_t> categoryFiltered[LOG_MAX_CATEGORIES];
+};
+
+} // namespace
+
+static stats_shard g_shards[STATS_SHARDS];
+static std::atomic<unsigned int> g_nextShard( 0 );
+
+static std::atomic<unsigned int> g_samplingInterval( 64 );
+
+// Values of the counters kept by other modules when the statistics were reset
+static std::atomic<unsigned long long> g_droppedBase( 0 );
+static std::atomic<unsigned long long> g_suppressedBase( 0 );
+
+static thread_local unsigned int t_shard;           // Index of the shard of the thread + 1 (0 = not yet assigned)
+static thread_local unsigned int t_sampleCountdown;
+
+static stats_shard& get_shard() noexcept
+{
+    unsigned int shard = t_shard;
+    if( shard == 0 )
+    {
+        shard = 1 + ( g_nextShard.fetch_add( 1, std::memory_order_relaxed ) % STATS_SHARDS );
+        t_shard = shard;
+    }
+    return g_shards[shard - 1];
+}
+
+static unsigned int get_priority_index( int prio ) noexcept
+{
+    return ( ( prio > 0 ) && ( prio <= LOG_PRIORITY_ALLOC ) ) ? prio : 0;
+}
+
+static void increment( std::atomic<uint64_t>& counter, uint64_t value = 1 ) noexcept
+{
+    counter.fetch_add( value, std::memory_order_relaxed );
+}
+
+void ext::log_internal::stats_count_emitted( int prio, unsigned int categoryIndex ) noexcept
+{
+    stats_shard& shard = get_shard();
+    increment( shard.emitted[get_priority_index( prio )] );
+    increment( shard.categoryEmitted[categoryIndex] );
+}
+
+void ext::log_internal::stats_count_filtered( int prio, unsigned int categoryIndex ) noexcept
+{
+    stats_shard& shard = get_shard();
+    increment( shard.filtered[get_priority_index( prio )] );
+    increment( shard.categoryFiltered[categoryIndex] );
+}
+
+void ext::log_internal::stats_count_bytes( size_t bytes ) noexcept
+{
+    increment( get_shard().bytes, bytes );
+}
+
+void ext::log_internal::stats_count_handler( uint64_t elapsedNs ) noexcept
+{
+    stats_shard& shard = get_shard();
+    increment( shard.handlerCalls );
+    increment( shard.handlerNs, elapsedNs );
+}
+
+uint64_t ext::log_internal::stats_clock_ns() noexcept
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+uint64_t ext::log_internal::stats_latency_start() noexcept
+{
+    unsigned int interval = g_samplingInterval.load( std::memory_order_relaxed );
+    if( interval == 0 )
+    {
+        return 0;
+    }
+
+    // Each thread samples one of every interval messages, without sharing any state with other threads (the
+    // countdown is restarted if the interval has been shortened)
+    if( ( t_sampleCountdown > 1 ) && ( t_sampleCountdown <= interval ) )
+    {
+        t_sampleCountdown--;
+        return 0;
+    }
+    t_sampleCountdown = interval;
+
+    uint64_t now = stats_clock_ns();
+    return ( now != 0 ) ? now : 1;
+}
+
+void ext::log_internal::stats_latency_end( uint64_t start ) noexcept
+{
+    uint64_t elapsed = stats_clock_ns() - start;
+
+    unsigned int bucket = 0;
+    while( ( elapsed >= 2 ) && ( bucket < ( LOG_LATENCY_BUCKETS - 1 ) ) )
+    {
+        elapsed >>= 1;
+        bucket++;
+    }
+
+    stats_shard& shard = get_shard();
+    increment( shard.latency[bucket] );
+    increment( shard.latencySamples );
+}
+
+unsigned long long log_statistics::latency_percentile( double fraction ) const noexcept
+{
+    if( latency_samples == 0 )
+    {
+        return 0;
+    }
+
+    unsigned long long target = (unsigned long long) ( fraction * latency_samples );
+    unsigned long long accumulated = 0;
+    for( unsigned int i = 0; i < LOG_LATENCY_BUCKETS; i++ )
+    {
+        accumulated += latency_histogram[i];
+        if( accumulated > target )
+        {
+            return 2ull << i;
+        }
+    }
+
+    return 2ull << ( LOG_LATENCY_BUCKETS - 1 );
+}
+
+static uint64_t sum( std::atomic<uint64_t> stats_shard::* counter )
+{
+    uint64_t total = 0;
+    for( const stats_shard& shard : g_shards )
+    {
+        total += ( shard.*counter ).load( std::memory_order_relaxed );
+    }
+    return total;
+}
+
+template<size_t N>
+static uint64_t sum( std::atomic<uint64_t> (stats_shard::* counters)[N], size_t index )
+{
+    uint64_t total = 0;
+    for( const stats_shard& shard : g_shards )
+    {
+        total += ( shard.*counters )[index].load( std::memory_order_relaxed );
+    }
+    return total;
+}
+
+log_statistics ext::log::get_statistics()
+{
+    log_statistics stats;
+
+    for( unsigned int prio = 0; prio <= LOG_PRIORITY_ALLOC; prio++ )
+    {
+        stats.emitted[prio] = sum( &stats_shard::emitted, prio );
+        stats.filtered[prio] = sum( &stats_shard::filtered, prio );
+    }
+
+    for( unsigned int i = 0; i < LOG_MAX_CATEGORIES; i++ )
+    {
+        unsigned long long emitted = sum( &stats_shard::categoryEmitted, i );
+        unsigned long long filtered = sum( &stats_shard::categoryFiltered, i );
+        if( ( emitted > 0 ) || ( filtered > 0 ) )
+        {
+            const char* name = get_category_name( i );
+            log_statistics::category_counters counters = { ( name != NULL ) ? name : "", emitted, filtered };
+            stats.categories.push_back( counters );
+        }
+    }
+
+    stats.bytes_written = sum( &stats_shard::bytes );
+    stats.handler_calls = sum( &stats_shard::handlerCalls );
+    stats.handler_time_ns = sum( &stats_shard::handlerNs );
+    stats.dropped = log::get_dropped_count() - g_droppedBase.load( std::memory_order_relaxed );
+    stats.suppressed = log::get_suppressed_count() - g_suppressedBase.load( std::memory_order_relaxed );
+
+    for( unsigned int i = 0; i < LOG_LATENCY_BUCKETS; i++ )
+    {
+        stats.latency_histogram[i] = sum( &stats_shard::latency, i );
+    }
+    stats.latency_samples = sum( &stats_shard::latencySamples );
+
+    return stats;
+}
+
+void ext::log::reset_statistics() noexcept
+{
+    for( stats_shard& shard : g_shards )
+    {
+        for( std::atomic<uint64_t>& counter : shard.emitted )
+        {
+            counter.store( 0, std::memory_order_relaxed );
+        }
+        for( std::atomic<uint64_t>& counter : shard.filtered )
+        {
+            counter.store( 0, std::memory_order_relaxed );
+        }
+        for( std::atomic<uint64_t>& counter : shard.categoryEmitted )
+        {
+            counter.store( 0, std::memory_order_relaxed );
+        }
+        for( std::atomic<uint64_t>& counter : shard.categoryFiltered )
+        {
+            counter.store( 0, std::memory_order_relaxed );
+        }
+        for( std::atomic<uint64_t>& counter : shard.latency )
+        {
+            counter.store( 0, std::memory_order_relaxed );
+        }
+        shard.bytes.store( 0, std::memory_order_relaxed );
+        shard.handlerCalls.store( 0, std::memory_order_relaxed );
+        shard.handlerNs.store( 0, std::memory_order_relaxed );
+        shard.latencySamples.store( 0, std::memory_order_relaxed );
+    }
+
+    g_droppedBase.store( log::get_dropped_count(), std::memory_order_relaxed );
+    g_suppressedBase.store( log::get_suppressed_count(), std::memory_order_relaxed );
+}
+
+void ext::log::set_latency_sampling( unsigned int interval ) noexcept
+{
+    g_samplingInterval.store( interval, std::memory_order_relaxed );
+}
+
+void ext::log::dump_statistics()
+{
+    static const char* const prioNames[] = { "UNKNOWN", "ERROR", "WARN", "INFO", "DEBUG", "TRACE", "XTDBG", "ALLOC" };
+
+    log_statistics stats = get_statistics();
+    uint64_t timestamp = get_timestamp();
+
+    std::string emitted;
+    std::string filtered;
+    for( unsigned int prio = 0; prio <= LOG_PRIORITY_ALLOC; prio++ )
+    {
+        if( stats.emitted[prio] > 0 )
+        {
+            emitted += format( " %s=%llu", prioNames[prio], stats.emitted[prio] );
+        }
+        if( stats.filtered[prio] > 0 )
+        {
+            filtered += format( " %s=%llu", prioNames[prio], stats.filtered[prio] );
+        }
+    }
+
+    emit_log_msg( LOG_PRIORITY_INFO, LOG_CATEGORY, "ext::log",
+                  format( "Statistics: emitted%s, filtered%s, %llu bytes written, %llu dropped, %llu suppressed",
+                          emitted.empty() ? " none" : emitted.c_str(), filtered.empty() ? " none" : filtered.c_str(),
+                          stats.bytes_written, stats.dropped, stats.suppressed ).c_str(), timestamp );
+
+    emit_log_msg( LOG_PRIORITY_INFO, LOG_CATEGORY, "ext::log",
+                  format( "Statistics: handler %llu calls, %llu us; latency p50 %llu ns, p99 %llu ns, p999 %llu ns (%llu samples)",
+                          stats.handler_calls, stats.handler_time_ns / 1000, stats.latency_percentile( 0.5 ),
+                          stats.latency_percentile( 0.99 ), stats.latency_percentile( 0.999 ), stats.latency_samples ).c_str(),
+                  timestamp );
+
+    for( const log_statistics::category_counters& category : stats.categories )
+    {
+        emit_log_msg( LOG_PRIORITY_INFO, LOG_CATEGORY, "ext::log",
+                      format( "Statistics: category '%s': %llu emitted, %llu filtered", category.name.c_str(),
+                              category.emitted, category.filtered ).c_str(), timestamp );
+    }
+}
@@ -0,0 +1,75 @@
+/**
+ * @file
+ * @brief      Internal header for the symbolizer of backtrace addresses
+ * @authors    Jesus Gonzalez <jgonzalez@gdr-sistemas.com>
+ * @copyright  Copyright (c) 2003-2016 Jesus Gonzalez
+ * @license    See LICENSE.txt
+ *
+ * Addresses are resolved by reading the ELF symbol tables (.symtab and .dynsym) of the main executable
+ * and the loaded shared objects, therefore static functions are also resolved and no external tools are
+ * needed. The modules are enumerated once, the symbols of each module are loaded into an index sorted by
+ * address the first time an address of the module is resolved, and demangled names are cached.
+ */
+
+#ifndef Extended_log_symbolizer_hpp_
+#define Extended_log_symbolizer_hpp_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+namespace ext
+{
+namespace log_internal
+{
+
+/**
+ * Symbol information of an address.
+ */
+struct symbol_info
+{
+    std::string module;         ///< Path of the module which contains the address
+    uintptr_t module_offset;    ///< Offset of the address from the load address of the module
+    std::string function;       ///< Demangled name of the function (empty if not found)
+    uintptr_t function_offset;  ///< Offset of the address from the start of the function
+};
+
+/**
+ * Resolves an address.
+ *
+ * @param[in] address Code address
+ * @param[out] info Symbol information
+ * @retval true if the address belongs to a loaded module (even if the function wasn't found)
+ * @retval false otherwise
+ */
+bool symbolize( const void* address, symbol_info& info );
+
+/**
+ * Resolves an address into a line of text for backtraces (<tt>module(function+0xoffset) [0xaddress]</tt>).
+ */
+std::string format_backtrace_frame( const void* address );
+
+/**
+ * Loads the symbols of all the loaded modules, so that symbolize_raw() can resolve their addresses.
+ */
+void preload_symbols();
+
+/**
+ * Resolves an address without allocating memory nor blocking (async-signal-safe).
+ *
+ * Only the symbols already loaded (see preload_symbols()) are used, and names are not demangled.
+ *
+ * @param[in] address Code address
+ * @param[out] module Path of the module which contains the address
+ * @param[out] function Mangled name of the function (NULL if not found)
+ * @param[out] offset Offset of the address from the start of the function, or from the load address of the
+ *                    module if the function wasn't found
+ * @retval true if the address belongs to a loaded module
+ * @retval false otherwise, or if the symbols are being loaded by other thread
+ */
+bool symbolize_raw( const void* address, const char*& module, const char*& function, uintptr_t& offset ) noexcept;
+
+} // namespace
+} // namespace
+
+#endif // header guard
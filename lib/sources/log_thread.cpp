@@ -0,0 +1,107 @@
+/**
+ * @file
+ * @brief      Implementation of the identity of the threads that generate log messages
+ * @authors    Jesus Gonzalez <jgonzalez@gdr-sistemas.com>
+ * @copyright  Copyright (c) 2003-2016 Jesus Gonzalez
+ * @license    See LICENSE.txt
+ */
+
+#include "Extended/log.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+
+#include "log_internal.hpp"
+
+#if defined(WIN32)
+    #include <Windows.h>
+#elif defined(__GNUC__)
+    #include <unistd.h>
+    #include <pthread.h>
+    #include <sys/syscall.h>
+#else
+    #error "Unsupported system"
+#endif
+
+using namespace ext;
+using namespace ext::log_internal;
+
+static std::atomic<bool> g_threadTagsEnabled( LOG_THREAD_TAGS_DEFAULT != 0 );
+
+// Trivially constructible, so that it doesn't require any initialization nor allocation when a thread is created
+static thread_local thread_identity t_identity;
+
+static void copy_name( char* dst, const char* src )
+{
+    size_t len = strlen( src );
+    if( len >= LOG_THREAD_NAME_SIZE )
+    {
+        len = LOG_THREAD_NAME_SIZE - 1;
+    }
+    memcpy( dst, src, len );
+    dst[len] = '\0';
+}
+
+const thread_identity& ext::log_internal::get_thread_identity() noexcept
+{
+    thread_identity& identity = t_identity;
+
+    if( identity.id == 0 )
+    {
+        // Only performed the first time a thread logs a message
+#ifdef WIN32
+        identity.id = GetCurrentThreadId();
+#else
+        identity.id = (unsigned long) syscall( SYS_gettid );
+
+        if( identity.name[0] == '\0' )
+        {
+            // Threads not named through ext::thread may have been named by other means
+            char name[16];
+            if( pthread_getname_np( pthread_self(), name, sizeof( name ) ) == 0 )
+            {
+                copy_name( identity.name, name );
+            }
+        }
+#endif
+    }
+
+    return identity;
+}
+
+void ext::log_internal::set_thread_name( const char* name ) noexcept
+{
+    copy_name( t_identity.name, ( name != NULL ) ? name : "" );
+}
+
+size_t ext::log_internal::format_thread_tag( const log_record& record, char* out )
+{
+    if( ( record.thread_id() == 0 ) || !g_threadTagsEnabled.load( std::memory_order_relaxed ) )
+    {
+        out[0] = '\0';
+        return 0;
+    }
+
+    int len;
+    if( record.thread_name()[0] != '\0' )
+    {
+        len = snprintf( out, LOG_THREAD_TAG_SIZE, "(%lu:%s) ", record.thread_id(), record.thread_name() );
+    }
+    else
+    {
+        len = snprintf( out, LOG_THREAD_TAG_SIZE, "(%lu) ", record.thread_id() );
+    }
+
+    return ( len < LOG_THREAD_TAG_SIZE ) ? len : ( LOG_THREAD_TAG_SIZE - 1 );
+}
+
+void ext::log::set_thread_tags_enabled( bool enabled ) noexcept
+{
+    g_threadTagsEnabled.store( enabled, std::memory_order_relaxed );
+}
+
+bool ext::log::are_thread_tags_enabled() noexcept
+{
+    return g_threadTagsEnabled.load( std::memory_order_relaxed );
+}
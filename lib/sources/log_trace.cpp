@@ -0,0 +1,355 @@
+/**
+ * @file
+ * @brief      Implementation of the recording and export of trace spans
+ * @authors    Jesus Gonzalez <jgonzalez@gdr-sistemas.com>
+ * @copyright  Copyright (c) 2003-2016 Jesus Gonzalez
+ * @license    See LICENSE.txt
+ */
+
+#include "Extended/log.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <string>
+
+#include "Extended/runtime_error.hpp"
+#include "log_internal.hpp"
+
+#if defined(WIN32)
+    #include <Windows.h>
+#elif defined(__GNUC__)
+    #include <unistd.h>
+#else
+    #error "Unsupported system"
+#endif
+
+using namespace ext;
+using namespace ext::log_internal;
+
+namespace
+{
+
+/**
+ * Span recorded by a thread.
+ */
+struct trace_event
+{
+    const trace_site* site;
+    uint64_t begin;
+    uint64_t end;
+};
+
+/**
+ * Buffer where a thread records its spans, followed by its events.
+ *
+ * Only the owner thread writes the events, and publishes them by incrementing the count, therefore the
+ * events below the count can be read by other threads. Buffers are never freed: when their thread exits
+ * they are kept (so that their spans can be exported) and reused by new threads once tracing is enabled again.
+ */
+struct trace_buffer
+{
+    trace_buffer* next;
+    std::atomic<bool> owned;
+    std::atomic<uint64_t> generation;   // Generation of the spans recorded (see g_traceGeneration)
+    size_t capacity;
+    std::atomic<size_t> count;
+    unsigned long threadId;
+    char threadName[LOG_THREAD_NAME_SIZE];
+
+    trace_event* events()
+    {
+        return reinterpret_cast<trace_event*>( this + 1 );
+    }
+};
+
+/**
+ * Reference from a thread to its buffer, which releases it when the thread exits.
+ */
+struct trace_buffer_ref
+{
+    trace_buffer* buffer;
+
+    ~trace_buffer_ref()
+    {
+        if( buffer != NULL )
+        {
+            buffer->owned.store( false, std::memory_order_release );
+        }
+    }
+};
+
+} // namespace
+
+static_assert( ( sizeof( trace_buffer ) % alignof( trace_event ) ) == 0, "Events would be misaligned" );
+
+// Protects the trace sites list, the buffers list and the reset of the buffers
+static std::mutex g_traceMutex;
+static trace_site* g_traceSites = NULL;
+static trace_buffer* g_traceBuffers = NULL;
+
+static bool g_tracingEnabled = false;
+static size_t g_traceCapacity = 0;
+
+// Incremented each time tracing is enabled, so that threads discard the spans of the previous session the
+// next time they record one (0 = tracing never enabled)
+static std::atomic<uint64_t> g_traceGeneration( 0 );
+
+static std::atomic<unsigned long long> g_traceDroppedCount( 0 );
+
+static thread_local trace_buffer_ref t_traceBuffer;
+
+/**
+ * Prepares a buffer of the calling thread for the current generation, reusing its current buffer or the
+ * buffer of a thread that has exited when possible (the trace registry must be locked).
+ *
+ * @return The buffer, or NULL if it couldn't be allocated
+ */
+static trace_buffer* claim_trace_buffer( trace_buffer* current, uint64_t generation )
+{
+    trace_buffer* buffer = NULL;
+
+    if( ( current != NULL ) && ( current->capacity == g_traceCapacity ) )
+    {
+        buffer = current;
+    }
+    else
+    {
+        if( current != NULL )
+        {
+            current->owned.store( false, std::memory_order_relaxed );
+        }
+
+        // The spans of a thread that exited are only discarded when they belong to a previous generation
+        for( trace_buffer* candidate = g_traceBuffers; candidate != NULL; candidate = candidate->next )
+        {
+            if( !candidate->owned.load( std::memory_order_acquire ) && ( candidate->capacity == g_traceCapacity ) &&
+                ( candidate->generation.load( std::memory_order_relaxed ) != generation ) )
+            {
+                buffer = candidate;
+                break;
+            }
+        }
+
+        if( buffer == NULL )
+        {
+            void* storage = ::operator new( sizeof( trace_buffer ) + g_traceCapacity * sizeof( trace_event ), std::nothrow );
+            if( storage == NULL )
+            {
+                return NULL; // LCOV_EXCL_LINE
+            }
+
+            buffer = new( storage ) trace_buffer();
+            buffer->capacity = g_traceCapacity;
+            buffer->next = g_traceBuffers;
+            g_traceBuffers = buffer;
+        }
+
+        buffer->owned.store( true, std::memory_order_relaxed );
+    }
+
+    const thread_identity& identity = get_thread_identity();
+    buffer->threadId = identity.id;
+    memcpy( buffer->threadName, identity.name, sizeof( buffer->threadName ) );
+
+    buffer->count.store( 0, std::memory_order_relaxed );
+    buffer->generation.store( generation, std::memory_order_relaxed );
+
+    return buffer;
+}
+
+static unsigned long get_process_id()
+{
+#ifdef WIN32
+    return GetCurrentProcessId();
+#else
+    return (unsigned long) getpid();
+#endif
+}
+
+/**
+ * Appends a time in nanoseconds as microseconds with 3 decimals.
+ */
+static void append_us( std::string& out, uint64_t ns )
+{
+    char buffer[32];
+    snprintf( buffer, sizeof( buffer ), "%llu.%03u", (unsigned long long) ( ns / 1000 ), (unsigned int) ( ns % 1000 ) );
+    out += buffer;
+}
+
+bool trace_site::register_site() noexcept
+{
+    std::lock_guard<std::mutex> lock( g_traceMutex );
+
+    // The trace site may have been registered concurrently by another thread
+    if( m_state.load( std::memory_order_relaxed ) == STATE_UNREGISTERED )
+    {
+        m_next = g_traceSites;
+        g_traceSites = this;
+
+        m_state.store( g_tracingEnabled ? STATE_ENABLED : STATE_DISABLED, std::memory_order_release );
+    }
+
+    return m_state.load( std::memory_order_relaxed ) == STATE_ENABLED;
+}
+
+void trace_site::refresh_all( bool enabled ) noexcept
+{
+    for( trace_site* site = g_traceSites; site != NULL; site = site->m_next )
+    {
+        site->m_state.store( enabled ? STATE_ENABLED : STATE_DISABLED, std::memory_order_release );
+    }
+}
+
+void ext::log::enable_tracing( size_t spansPerThread )
+{
+    std::lock_guard<std::mutex> lock( g_traceMutex );
+
+    g_traceCapacity = ( spansPerThread > 0 ) ? spansPerThread : 1;
+    g_traceGeneration.fetch_add( 1, std::memory_order_release );
+    g_traceDroppedCount.store( 0, std::memory_order_relaxed );
+    g_tracingEnabled = true;
+
+    trace_site::refresh_all( true );
+}
+
+void ext::log::disable_tracing() noexcept
+{
+    std::lock_guard<std::mutex> lock( g_traceMutex );
+
+    g_tracingEnabled = false;
+
+    trace_site::refresh_all( false );
+}
+
+bool ext::log::is_tracing_enabled() noexcept
+{
+    std::lock_guard<std::mutex> lock( g_traceMutex );
+
+    return g_tracingEnabled;
+}
+
+unsigned long long ext::log::get_trace_dropped_count() noexcept
+{
+    return g_traceDroppedCount.load( std::memory_order_relaxed );
+}
+
+void ext::log::record_span( const trace_site& site, uint64_t begin, uint64_t end ) noexcept
+{
+    trace_buffer* buffer = t_traceBuffer.buffer;
+    uint64_t generation = g_traceGeneration.load( std::memory_order_acquire );
+
+    if( ( buffer == NULL ) || ( buffer->generation.load( std::memory_order_relaxed ) != generation ) )
+    {
+        // Only the first span recorded by the thread in each tracing session gets here
+        std::lock_guard<std::mutex> lock( g_traceMutex );
+
+        buffer = claim_trace_buffer( buffer, generation );
+        t_traceBuffer.buffer = buffer;
+
+        if( buffer == NULL )
+        {
+            // LCOV_EXCL_START
+            g_traceDroppedCount.fetch_add( 1, std::memory_order_relaxed );
+            return;
+            // LCOV_EXCL_STOP
+        }
+    }
+
+    size_t count = buffer->count.load( std::memory_order_relaxed );
+    if( count >= buffer->capacity )
+    {
+        g_traceDroppedCount.fetch_add( 1, std::memory_order_relaxed );
+        return;
+    }
+
+    trace_event& event = buffer->events()[count];
+    event.site = &site;
+    event.begin = begin;
+    event.end = end;
+
+    buffer->count.store( count + 1, std::memory_order_release );
+}
+
+std::string ext::log::export_trace()
+{
+    std::string out = "{\"traceEvents\":[";
+    bool first = true;
+    std::string pid = std::to_string( get_process_id() );
+
+    std::lock_guard<std::mutex> lock( g_traceMutex );
+
+    uint64_t generation = g_traceGeneration.load( std::memory_order_relaxed );
+
+    for( trace_buffer* buffer = g_traceBuffers; buffer != NULL; buffer = buffer->next )
+    {
+        if( buffer->generation.load( std::memory_order_relaxed ) != generation )
+        {
+            continue;
+        }
+
+        size_t count = buffer->count.load( std::memory_order_acquire );
+        std::string tid = std::to_string( buffer->threadId );
+
+        if( buffer->threadName[0] != '\0' )
+        {
+            out += first ? "\n" : ",\n";
+            first = false;
+            out += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" + pid + ",\"tid\":" + tid + ",\"args\":{\"name\":";
+            append_json_string( out, buffer->threadName, strlen( buffer->threadName ) );
+            out += "}}";
+        }
+
+        for( size_t i = 0; i < count; i++ )
+        {
+            const trace_event& event = buffer->events()[i];
+            const trace_site& site = *event.site;
+            uint64_t beginNs = timestamp_to_wall_ns( event.begin );
+            uint64_t endNs = timestamp_to_wall_ns( event.end );
+
+            out += first ? "\n" : ",\n";
+            first = false;
+            out += "{\"name\":";
+            append_json_string( out, site.get_name(), strlen( site.get_name() ) );
+            if( site.get_category() != NULL )
+            {
+                out += ",\"cat\":";
+                append_json_string( out, site.get_category(), strlen( site.get_category() ) );
+            }
+            out += ",\"ph\":\"X\",\"ts\":";
+            append_us( out, beginNs );
+            out += ",\"dur\":";
+            append_us( out, ( endNs > beginNs ) ? ( endNs - beginNs ) : 0 );
+            out += ",\"pid\":" + pid + ",\"tid\":" + tid + ",\"args\":{\"function\":";
+            append_json_string( out, site.get_function(), strlen( site.get_function() ) );
+            out += ",\"file\":";
+            append_json_string( out, site.get_file(), strlen( site.get_file() ) );
+            out += ",\"line\":" + std::to_string( site.get_line() ) + "}}";
+        }
+    }
+
+    out += "\n],\"displayTimeUnit\":\"ns\"}\n";
+
+    return out;
+}
+
+void ext::log::export_trace( const char* path )
+{
+    std::string trace = export_trace();
+
+    FILE* file = fopen( path, "wb" );
+    if( file == NULL )
+    {
+        THROW_ERROR( "Error creating trace file '%s'", path );
+    }
+
+    bool written = ( fwrite( trace.data(), 1, trace.size(), file ) == trace.size() );
+    written = ( fclose( file ) == 0 ) && written;
+
+    if( !written )
+    {
+        THROW_ERROR( "Error writing trace file '%s'", path ); // LCOV_EXCL_LINE
+    }
+}
@@ -8,11 +8,10 @@
 
 #include "Extended/runtime_error.hpp"
 #include "Extended/string.hpp"
+#include "log_internal.hpp"
 
 using namespace ext;
 
-extern void do_log_msg( int prio, const char* category, const char* function, const char* msg );
-
 runtime_error::runtime_error( const char* category, const char* function, bool log_on_throw, const std::string &msg )
 : m_message( msg ), m_category( category ? category : "" ), m_function( function ), m_logged( log_on_throw )
 {
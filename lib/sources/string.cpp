@@ -14,29 +14,36 @@
 
 #include "local_log.hpp"
 
-#define _INITIAL_LENGTH    1024
+#define _INITIAL_LENGTH    256
 
 std::string ext::vformat( const char *fmt, va_list ap )
 {
     if ( !fmt ) return "";
 
-    char *buffer = new char[_INITIAL_LENGTH];
+    char buffer[_INITIAL_LENGTH];
 
-    int n = vsnprintf( buffer, _INITIAL_LENGTH, fmt, ap );
+    // The arguments list is traversed twice if the text doesn't fit into the buffer, therefore it's copied
+    va_list args;
+    va_copy( args, ap );
+    int n = vsnprintf( buffer, _INITIAL_LENGTH, fmt, args );
+    va_end( args );
 
-    if( n >= _INITIAL_LENGTH )
-    {
-        // Didn't get enough space
-        delete [] buffer;
-        buffer = new char [n + 1];
+    if( n < 0 ) return "";
 
-        n = vsnprintf( buffer, n + 1, fmt, ap );
+    if( n < _INITIAL_LENGTH )
+    {
+        return std::string( buffer, n );
     }
 
+    // Didn't get enough space
+    std::string ret( n + 1, '\0' );
+    va_copy( args, ap );
+    n = vsnprintf( &ret[0], n + 1, fmt, args );
+    va_end( args );
+
     if( n < 0 ) return "";
 
-    std::string ret( buffer );
-    delete [] buffer;
+    ret.resize( n );
     return ret;
 }
 
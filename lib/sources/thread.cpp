@@ -0,0 +1,32 @@
+/**
+ * @file
+ * @brief      Implementation of the platform independent part of the 'thread' class
+ * @authors    Jesus Gonzalez <jgonzalez@gdr-sistemas.com>
+ * @copyright  Copyright (c) 2016 Jesus Gonzalez
+ * @license    See LICENSE.txt
+ */
+
+#include "Extended/thread.hpp"
+
+#include <string.h>
+
+#if !defined(WIN32) && defined(__GNUC__)
+    #include <pthread.h>
+#endif
+
+#include "log_internal.hpp"
+
+using namespace ext;
+
+void thread::set_current_name( const char* name )
+{
+    log_internal::set_thread_name( name );
+
+#if !defined(WIN32) && defined(__GNUC__)
+    // The name of the thread for the operating system is limited to 15 characters
+    char osName[16];
+    strncpy( osName, name, sizeof( osName ) - 1 );
+    osName[sizeof( osName ) - 1] = '\0';
+    pthread_setname_np( pthread_self(), osName );
+#endif
+}
@@ -0,0 +1,48 @@
+/**
+ * @file
+ * @brief      Helpers for the unit tests that check the contents of files and the lines written by the log sinks
+ * @project    ExtendedLib
+ * @authors    Jesus Gonzalez <jgonzalez@gdr-sistemas.com>
+ * @copyright  Copyright (c) Jesus Gonzalez. All rights reserved.
+ * @license    See LICENSE.txt
+ */
+
+#ifndef Extended_test_file_helpers_hpp_
+#define Extended_test_file_helpers_hpp_
+
+#include <stdio.h>
+#include <string>
+
+#include "log_internal.hpp"
+
+/**
+ * Returns the contents of a file (empty if it can't be read).
+ */
+inline std::string read_file( const char* path )
+{
+    std::string contents;
+
+    FILE* file = fopen( path, "rb" );
+    if( file != NULL )
+    {
+        char buffer[1024];
+        size_t size;
+        while( ( size = fread( buffer, 1, sizeof( buffer ), file ) ) > 0 )
+        {
+            contents.append( buffer, size );
+        }
+        fclose( file );
+    }
+
+    return contents;
+}
+
+/**
+ * Returns the line written by the log sinks for a message without category generated by "TEST_FUNC".
+ */
+inline std::string expected_line( const char* prio, const char* msg )
+{
+    return std::string( prio ) + " {" + ext::log_internal::get_program_name() + "} <TEST_FUNC> " + msg + "\n";
+}
+
+#endif // header guard
@@ -0,0 +1,45 @@
+/**
+ * @file
+ * @brief      Test fixture for the unit tests of the log sinks that are fed through a log pipeline
+ * @project    ExtendedLib
+ * @authors    Jesus Gonzalez <jgonzalez@gdr-sistemas.com>
+ * @copyright  Copyright (c) Jesus Gonzalez. All rights reserved.
+ * @license    See LICENSE.txt
+ */
+
+#ifndef Extended_test_pipeline_fixture_hpp_
+#define Extended_test_pipeline_fixture_hpp_
+
+#include <memory>
+
+#include "Extended/log.hpp"
+#include "Extended/log_pipeline.hpp"
+
+#include <CppUTest/TestHarness.h>
+
+/**
+ * Base for the test groups (declared with TEST_GROUP_BASE) that install a fresh log pipeline as the log handler
+ * for each test.
+ *
+ * Groups that need additional setup or teardown shall call the base class methods from their own.
+ */
+class pipeline_fixture : public Utest
+{
+public:
+    virtual void setup()
+    {
+        pipeline = std::make_shared<ext::log_pipeline>();
+        ext::log::set_log_handler( pipeline );
+    }
+
+    virtual void teardown()
+    {
+        ext::log::set_log_handler( NULL );
+        pipeline.reset();
+    }
+
+protected:
+    std::shared_ptr<ext::log_pipeline> pipeline;
+};
+
+#endif // header guard
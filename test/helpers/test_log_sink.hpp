@@ -0,0 +1,26 @@
+/**
+ * @file
+ * @brief      Log sink for the unit tests that only need a sink instance to refer to
+ * @project    ExtendedLib
+ * @authors    Jesus Gonzalez <jgonzalez@gdr-sistemas.com>
+ * @copyright  Copyright (c) Jesus Gonzalez. All rights reserved.
+ * @license    See LICENSE.txt
+ */
+
+#ifndef Extended_test_test_log_sink_hpp_
+#define Extended_test_test_log_sink_hpp_
+
+#include "Extended/log_pipeline.hpp"
+
+/**
+ * Log sink that discards all the records.
+ */
+class TestLogSink : public ext::log_sink
+{
+public:
+    TestLogSink() {}
+
+    virtual ~TestLogSink() {}
+};
+
+#endif // header guard
@@ -11,7 +11,22 @@
  *                              INCLUDES
  *===========================================================================*/
 
+#define LOG_CATEGORY "TEST_CAT"
+
 #include "Extended/log.hpp"
+#include "Extended/runtime_error.hpp"
+#include "Extended/thread.hpp"
+#include "log_binary.hpp"
+#include "log_internal.hpp"
+
+#include <stdio.h>
+#include <time.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
 
 #include <CppUTest/TestHarness.h>
 #include <CppUTestExt/MockSupport.h>
@@ -124,6 +139,67 @@ TEST( log, FunctionSimplificationConstructor )
     // Cleanup
 }
 
+namespace simplification_test
+{
+
+template<typename T>
+class widget
+{
+public:
+    widget()
+    {
+        LOG_INFO( "TEST_CTOR" );
+    }
+
+    const char* method( T ) const
+    {
+        LOG_INFO( "TEST_METHOD" );
+        return NULL;
+    }
+};
+
+}
+
+class FunctionLogHandler : public ext::log_handler
+{
+public:
+    virtual bool process_record( const ext::log_record& record )
+    {
+        m_functions.push_back( record.function() );
+        return false;
+    }
+
+    std::vector<std::string> m_functions;
+};
+
+// The simplification must be resolved at compile time
+static_assert( ext::log_internal::function_name_begin( "int ns::f(char) const", 21 ) == 4, "Invalid name begin" );
+static_assert( ext::log_internal::function_name_end( "int ns::f(char) const", 21 ) == 9, "Invalid name end" );
+
+/*
+ * Check that the functions of call sites are simplified at compile time, including constructors and
+ * methods of class templates.
+ */
+TEST( log, FunctionSimplificationCallSite )
+{
+    // Prepare
+    std::shared_ptr<FunctionLogHandler> testLogHandler = std::make_shared<FunctionLogHandler>();
+    ext::log::set_log_handler( testLogHandler );
+
+    // Exercise
+    simplification_test::widget<int> w;
+    w.method( 1 );
+
+    // Verify
+    CHECK_EQUAL( 2, testLogHandler->m_functions.size() );
+    STRCMP_EQUAL( "simplification_test::widget<T>::widget", testLogHandler->m_functions[0].c_str() );
+    STRCMP_EQUAL( "simplification_test::widget<T>::method", testLogHandler->m_functions[1].c_str() );
+
+    // Cleanup
+    ext::log::set_log_handler( NULL );
+    testLogHandler.reset();
+}
+
 #endif // __GNUC__
 
 /*
@@ -201,3 +277,1288 @@ TEST( log, WithLogHandler_ConsoleOutput )
     ext::log::set_log_handler( NULL );
     testLogHandler.reset();
 }
+
+/*
+ * Check that in asynchronous mode messages are passed to the log handler after flushing.
+ */
+TEST( log, AsyncMode_Flush )
+{
+    // Prepare
+    std::shared_ptr<TestLogHandler> testLogHandler = std::make_shared<TestLogHandler>();
+    ext::log::set_log_handler( testLogHandler );
+
+    mock().expectOneCall( "TestLogHandler::process" ).onObject( testLogHandler.get() ).withParameter( "prio", LOG_PRIORITY_ERROR )
+                         .withParameter( "category", "TEST_CAT" ).withParameter( "function", "TEST_FUNC" )
+                         .withParameter( "msg", "TEST_MSG 42" ).andReturnValue( false );
+
+    // Exercise
+    ext::log::enable_async_mode( 16, ext::log::OVERFLOW_BLOCK );
+
+    // Verify
+    CHECK_TRUE( ext::log::is_async_mode() );
+
+    // Exercise
+    ext::log::log_message( LOG_PRIORITY_ERROR, "TEST_CAT", "TEST_FUNC", "TEST_MSG %d", 42 );
+    ext::log::flush();
+
+    // Verify
+    mock().checkExpectations();
+
+    // Cleanup
+    ext::log::disable_async_mode();
+    ext::log::set_log_handler( NULL );
+    testLogHandler.reset();
+}
+
+/*
+ * Check that disabling the asynchronous mode processes all the queued messages.
+ */
+TEST( log, AsyncMode_DisableProcessesQueued )
+{
+    // Prepare
+    std::shared_ptr<TestLogHandler> testLogHandler = std::make_shared<TestLogHandler>();
+    ext::log::set_log_handler( testLogHandler );
+
+    mock().expectNCalls( 3, "TestLogHandler::process" ).onObject( testLogHandler.get() ).withParameter( "prio", LOG_PRIORITY_WARN )
+                         .withParameter( "category", "TEST_CAT" ).withParameter( "function", "TEST_FUNC" )
+                         .withParameter( "msg", "TEST_MSG" ).andReturnValue( false );
+
+    ext::log::enable_async_mode( 4, ext::log::OVERFLOW_BLOCK );
+
+    // Exercise
+    for( int i = 0; i < 3; i++ )
+    {
+        ext::log::log_message( LOG_PRIORITY_WARN, "TEST_CAT", "TEST_FUNC", "TEST_MSG" );
+    }
+    ext::log::disable_async_mode();
+
+    // Verify
+    CHECK_FALSE( ext::log::is_async_mode() );
+    mock().checkExpectations();
+
+    // Cleanup
+    ext::log::set_log_handler( NULL );
+    testLogHandler.reset();
+}
+
+/*
+ * Check that once the asynchronous mode is disabled messages are processed immediately again.
+ */
+TEST( log, AsyncMode_Disabled )
+{
+    // Prepare
+    ext::log::enable_async_mode();
+    ext::log::disable_async_mode();
+
+    mock().expectOneCall( "::OutputDebugString" ).withParameter( "lpOutputString", "[ERROR] {ExtendedLib.Test.log.exe:TEST_CAT} <TEST_FUNC> TEST_MSG\n" );
+
+    // Exercise
+    ext::log::log_message( LOG_PRIORITY_ERROR, "TEST_CAT", "TEST_FUNC", "TEST_MSG" );
+
+    // Verify
+    mock().checkExpectations();
+
+    // Cleanup
+}
+
+/*
+ * Check that in asynchronous mode the messages are formatted properly by the writer thread.
+ */
+TEST( log, AsyncMode_DeferredFormatting )
+{
+    // Prepare
+    std::shared_ptr<TestLogHandler> testLogHandler = std::make_shared<TestLogHandler>();
+    ext::log::set_log_handler( testLogHandler );
+
+    mock().expectOneCall( "TestLogHandler::process" ).onObject( testLogHandler.get() ).withParameter( "prio", LOG_PRIORITY_INFO )
+                         .withParameter( "category", "TEST_CAT" ).withParameter( "function", "TEST_log_AsyncMode_DeferredFormatting_Test::testBody" )
+                         .withParameter( "msg", "TEST_MSG [  -7] [0x00ff] [12345678901] [2.50] [abc] [(null)] [x] [100%]" ).andReturnValue( false );
+
+    ext::log::enable_async_mode( 16, ext::log::OVERFLOW_BLOCK );
+
+    // Exercise
+    char text[] = "abcdef";
+    LOG_INFO( "TEST_MSG [%*d] [0x%04x] [%lld] [%.2f] [%.3s] [%s] [%c] [100%%]",
+              4, -7, 255u, 12345678901LL, 2.5, text, (const char*) NULL, 'x' );
+    text[0] = 'X'; // The argument must have been captured when logging
+    ext::log::flush();
+
+    // Verify
+    mock().checkExpectations();
+
+    // Cleanup
+    ext::log::disable_async_mode();
+    ext::log::set_log_handler( NULL );
+    testLogHandler.reset();
+}
+
+/*
+ * Check that in binary mode the messages are written to the binary log file instead of being processed.
+ */
+TEST( log, BinaryMode )
+{
+    // Prepare
+    const char* path = "log_test_binary_mode.bin";
+    std::shared_ptr<TestLogHandler> testLogHandler = std::make_shared<TestLogHandler>();
+    ext::log::set_log_handler( testLogHandler );
+    const ext::log_internal::thread_identity& thread = ext::log_internal::get_thread_identity();
+    unsigned long workerId = 0;
+
+    // Exercise
+    ext::log::enable_binary_mode( path, 16, ext::log::OVERFLOW_BLOCK );
+
+    uint64_t before = ext::log::timestamp_to_wall_ns( ext::log::get_timestamp() );
+    for( int i = 0; i < 2; i++ )
+    {
+        LOG_WARN( "TEST_MSG %d %s", i, "xyz" );
+    }
+    std::thread worker( [&]()
+    {
+        ext::log_internal::set_thread_name( "TEST_THREAD" );
+        workerId = ext::log_internal::get_thread_identity().id;
+        LOG_INFO( "TEST_MSG3" );
+    } );
+    worker.join();
+    ext::log::log_message( LOG_PRIORITY_ERROR, NULL, "TEST_FUNC2", "TEST_MSG2" );
+    uint64_t after = ext::log::timestamp_to_wall_ns( ext::log::get_timestamp() );
+
+    ext::log::disable_async_mode();
+
+    // Verify
+    mock().checkExpectations();
+
+    ext::log_internal::binary_log_reader reader;
+    ext::log_internal::binary_log_entry entry;
+
+    CHECK_TRUE( reader.open( path ) );
+    STRCMP_EQUAL( "ExtendedLib.Test.log.exe", reader.get_program_name().c_str() );
+
+    // The conversions to wall-clock time may differ slightly if the clock is recalibrated in between
+    const uint64_t tolerance = 1000000;
+
+    for( int i = 0; i < 2; i++ )
+    {
+        CHECK_TRUE( reader.read_next( entry ) );
+        CHECK_EQUAL( LOG_PRIORITY_WARN, entry.prio );
+        CHECK_TRUE( ( entry.timestamp + tolerance >= before ) && ( entry.timestamp <= after + tolerance ) );
+        CHECK_EQUAL( thread.id, entry.thread_id );
+        STRCMP_EQUAL( thread.name, entry.thread_name.c_str() );
+        CHECK_TRUE( entry.has_category );
+        STRCMP_EQUAL( "TEST_CAT", entry.category.c_str() );
+        STRCMP_EQUAL( "TEST_log_BinaryMode_Test::testBody", entry.function.c_str() );
+        STRCMP_EQUAL( StringFromFormat( "TEST_MSG %d xyz", i ).asCharString(), entry.msg.c_str() );
+    }
+
+    CHECK_TRUE( reader.read_next( entry ) );
+    CHECK_EQUAL( LOG_PRIORITY_INFO, entry.prio );
+    CHECK_EQUAL( workerId, entry.thread_id );
+    STRCMP_EQUAL( "TEST_THREAD", entry.thread_name.c_str() );
+    STRCMP_EQUAL( "TEST_MSG3", entry.msg.c_str() );
+
+    // The decoded lines have the same layout as the lines written to console
+    ext::log::set_timestamps_enabled( true );
+    ext::log::set_thread_tags_enabled( true );
+    std::string line = ext::log_internal::compose_log_line( entry.prio, reader.get_program_name().c_str(), NULL,
+                                                            entry.function.c_str(), entry.msg.c_str(), entry.timestamp,
+                                                            entry.thread_id, entry.thread_name.c_str() );
+    char timestampText[LOG_TIMESTAMP_SIZE];
+    ext::log_internal::format_wall_timestamp( entry.timestamp, timestampText );
+    CHECK_EQUAL( 0, line.find( timestampText ) );
+    CHECK_TRUE( line.find( StringFromFormat( "{ExtendedLib.Test.log.exe} (%lu:TEST_THREAD) <", workerId ).asCharString() ) !=
+                std::string::npos );
+    ext::log::set_timestamps_enabled( false );
+    ext::log::set_thread_tags_enabled( false );
+
+    CHECK_TRUE( reader.read_next( entry ) );
+    CHECK_EQUAL( LOG_PRIORITY_ERROR, entry.prio );
+    CHECK_TRUE( ( entry.timestamp + tolerance >= before ) && ( entry.timestamp <= after + tolerance ) );
+    CHECK_EQUAL( thread.id, entry.thread_id );
+    CHECK_FALSE( entry.has_category );
+    STRCMP_EQUAL( "TEST_FUNC2", entry.function.c_str() );
+    STRCMP_EQUAL( "TEST_MSG2", entry.msg.c_str() );
+
+    CHECK_FALSE( reader.read_next( entry ) );
+
+    // Cleanup
+    ext::log::set_log_handler( NULL );
+    testLogHandler.reset();
+    remove( path );
+}
+
+/*
+ * Check that enabling the binary mode fails if the binary log file can't be created.
+ */
+TEST( log, BinaryMode_Error )
+{
+    // Prepare
+    mock().expectOneCall( "::OutputDebugString" ).withParameter( "lpOutputString",
+            "[ERROR] {ExtendedLib.Test.log.exe:ExtendedLib} <ext::log::enable_binary_mode> Error creating binary log file 'non_existent_dir/log_test.bin'\n" );
+
+    // Exercise
+    try
+    {
+        ext::log::enable_binary_mode( "non_existent_dir/log_test.bin" );
+        FAIL( "Should have thrown an exception" );
+    }
+    catch( ext::runtime_error &e )
+    {
+        e.log();
+    }
+
+    // Verify
+    CHECK_FALSE( ext::log::is_async_mode() );
+    mock().checkExpectations();
+
+    // Cleanup
+}
+
+static int g_evaluatedArguments = 0;
+
+static int evaluate_argument( int value )
+{
+    g_evaluatedArguments++;
+    return value;
+}
+
+/*
+ * Check that the arguments of the logging macros are only evaluated if the message is going to be logged,
+ * and that the call sites are updated when the priority limit changes.
+ */
+TEST( log, CallSite_PriorityLimit )
+{
+    // Prepare
+    g_evaluatedArguments = 0;
+
+    for( int i = 0; i < 4; i++ )
+    {
+        bool enabled = ( i % 2 ) != 0;
+
+        ext::log::set_priority_limit( enabled ? LOG_PRIORITY_INFO : LOG_PRIORITY_WARN );
+
+        if( enabled )
+        {
+            mock().expectOneCall( "::OutputDebugString" ).withParameter( "lpOutputString",
+                    StringFromFormat( "[INFO] {ExtendedLib.Test.log.exe:TEST_CAT} <TEST_log_CallSite_PriorityLimit_Test::testBody> TEST_MSG %d\n", i ).asCharString() );
+        }
+
+        // Exercise
+        LOG_INFO( "TEST_MSG %d", evaluate_argument( i ) );
+
+        // Verify
+        mock().checkExpectations();
+        CHECK_EQUAL( ( i + 1 ) / 2, g_evaluatedArguments );
+    }
+
+    // Cleanup
+    ext::log::set_priority_limit( LOG_PRIORITY_MAX );
+}
+
+/*
+ * Check that the priority limit set for a category only applies to that category.
+ */
+TEST( log, CategoryPriorityLimit_Exact )
+{
+    // Prepare
+    ext::log::set_priority_limit( LOG_PRIORITY_INFO );
+
+    // Exercise
+    ext::log::set_category_priority_limit( "TEST_CAT", LOG_PRIORITY_WARN );
+
+    // Verify
+    CHECK_EQUAL( LOG_PRIORITY_WARN, ext::log::get_category_priority_limit( "TEST_CAT" ) );
+    CHECK_EQUAL( LOG_PRIORITY_INFO, ext::log::get_category_priority_limit( "TEST_CAT2" ) );
+    CHECK_EQUAL( LOG_PRIORITY_INFO, ext::log::get_category_priority_limit( NULL ) );
+
+    // Prepare
+    mock().expectOneCall( "::OutputDebugString" ).withParameter( "lpOutputString", "[INFO] {ExtendedLib.Test.log.exe:TEST_CAT2} <TEST_FUNC> TEST_MSG\n" );
+    mock().expectOneCall( "::OutputDebugString" ).withParameter( "lpOutputString", "[INFO] {ExtendedLib.Test.log.exe} <TEST_FUNC> TEST_MSG\n" );
+
+    // Exercise
+    ext::log::log_message( LOG_PRIORITY_INFO, "TEST_CAT", "TEST_FUNC", "TEST_MSG" );
+    ext::log::log_message( LOG_PRIORITY_INFO, "TEST_CAT2", "TEST_FUNC", "TEST_MSG" );
+    ext::log::log_message( LOG_PRIORITY_INFO, NULL, "TEST_FUNC", "TEST_MSG" );
+
+    // Verify
+    mock().checkExpectations();
+
+    // Cleanup
+    ext::log::clear_category_priority_limits();
+    ext::log::set_priority_limit( LOG_PRIORITY_MAX );
+}
+
+/*
+ * Check that the priority limit set for a prefix pattern is applied to the call sites of the matching
+ * categories, and that the most recently set pattern takes precedence.
+ */
+TEST( log, CategoryPriorityLimit_Pattern )
+{
+    // Prepare
+    ext::log::set_priority_limit( LOG_PRIORITY_WARN );
+
+    for( int i = 0; i < 3; i++ )
+    {
+        if( i == 0 )
+        {
+            ext::log::set_category_priority_limit( "TEST_*", LOG_PRIORITY_DEBUG );
+        }
+        else if( i == 1 )
+        {
+            ext::log::set_category_priority_limit( "TEST_CAT", LOG_PRIORITY_INFO );
+        }
+        else
+        {
+            ext::log::clear_category_priority_limits();
+        }
+
+        if( i == 0 )
+        {
+            mock().expectOneCall( "::OutputDebugString" ).withParameter( "lpOutputString",
+                    "[DEBUG] {ExtendedLib.Test.log.exe:TEST_CAT} <TEST_log_CategoryPriorityLimit_Pattern_Test::testBody> TEST_MSG\n" );
+        }
+
+        // Exercise
+        LOG_DEBUG( "TEST_MSG" );
+
+        // Verify
+        mock().checkExpectations();
+    }
+
+    CHECK_EQUAL( LOG_PRIORITY_WARN, ext::log::get_category_priority_limit( "TEST_CAT" ) );
+
+    // Cleanup
+    ext::log::set_priority_limit( LOG_PRIORITY_MAX );
+}
+
+/*
+ * Check that the general priority limit and the category priority limits can be replaced at once.
+ */
+TEST( log, SetPriorityLimits )
+{
+    // Prepare
+    ext::log::set_category_priority_limit( "TEST_CAT", LOG_PRIORITY_ERROR );
+    ext::log::set_category_priority_limit( "OTHER_CAT", LOG_PRIORITY_ERROR );
+
+    std::vector<std::pair<std::string, int>> limits;
+    limits.push_back( std::make_pair( std::string( "TEST_*" ), LOG_PRIORITY_DEBUG ) );
+    limits.push_back( std::make_pair( std::string( "TEST_CAT2" ), LOG_PRIORITY_WARN ) );
+
+    // Exercise
+    ext::log::set_priority_limits( LOG_PRIORITY_INFO, limits );
+
+    // Verify
+    CHECK_EQUAL( LOG_PRIORITY_INFO, ext::log::get_priority_limit() );
+    CHECK_EQUAL( LOG_PRIORITY_DEBUG, ext::log::get_category_priority_limit( "TEST_CAT" ) );
+    CHECK_EQUAL( LOG_PRIORITY_WARN, ext::log::get_category_priority_limit( "TEST_CAT2" ) );
+    CHECK_EQUAL( LOG_PRIORITY_INFO, ext::log::get_category_priority_limit( "OTHER_CAT" ) );
+
+    // Exercise
+    ext::log::set_priority_limits( LOG_PRIORITY_WARN, std::vector<std::pair<std::string, int>>() );
+
+    // Verify
+    CHECK_EQUAL( LOG_PRIORITY_WARN, ext::log::get_category_priority_limit( "TEST_CAT" ) );
+    CHECK_EQUAL( LOG_PRIORITY_WARN, ext::log::get_category_priority_limit( "TEST_CAT2" ) );
+
+    // Cleanup
+    ext::log::set_priority_limit( LOG_PRIORITY_MAX );
+}
+
+class SwappingLogHandler : public ext::log_handler
+{
+public:
+    explicit SwappingLogHandler( const std::shared_ptr<ext::log_handler>& next )
+    : m_next( next )
+    {}
+
+    virtual bool process( int prio, const char* category, const char* function, const char* msg )
+    {
+        mock().actualCall( "SwappingLogHandler::process" ).withParameter( "msg", msg );
+        ext::log::set_log_handler( m_next );
+        return false;
+    }
+
+private:
+    std::shared_ptr<ext::log_handler> m_next;
+};
+
+/*
+ * Check that the log handler can be replaced from the log handler itself.
+ */
+TEST( log, WithLogHandler_ReplacedByItself )
+{
+    // Prepare
+    std::shared_ptr<TestLogHandler> testLogHandler = std::make_shared<TestLogHandler>();
+    ext::log::set_log_handler( std::make_shared<SwappingLogHandler>( testLogHandler ) );
+
+    mock().expectOneCall( "SwappingLogHandler::process" ).withParameter( "msg", "TEST_MSG1" );
+    mock().expectOneCall( "TestLogHandler::process" ).onObject( testLogHandler.get() ).withParameter( "prio", LOG_PRIORITY_ERROR )
+                         .withParameter( "category", "TEST_CAT" ).withParameter( "function", "TEST_FUNC" )
+                         .withParameter( "msg", "TEST_MSG2" ).andReturnValue( false );
+
+    // Exercise
+    ext::log::log_message( LOG_PRIORITY_ERROR, "TEST_CAT", "TEST_FUNC", "TEST_MSG1" );
+    ext::log::log_message( LOG_PRIORITY_ERROR, "TEST_CAT", "TEST_FUNC", "TEST_MSG2" );
+
+    // Verify
+    mock().checkExpectations();
+    CHECK_EQUAL( testLogHandler.get(), ext::log::get_log_handler().get() );
+
+    // Cleanup
+    ext::log::set_log_handler( NULL );
+    testLogHandler.reset();
+}
+
+/*
+ * Check that the messages not logged because of the priority limits are captured by the flight recorder,
+ * and that they are logged before an error message.
+ */
+TEST( log, FlightRecorder_DumpOnError )
+{
+    // Prepare
+    ext::log::set_priority_limit( LOG_PRIORITY_WARN );
+    ext::log::enable_flight_recorder( LOG_PRIORITY_DEBUG );
+
+    // Exercise
+    LOG_INFO( "TEST_MSG %d", 1 );
+    LOG_DEBUG( "TEST_MSG %s", "2" );
+
+    // Verify
+    CHECK_TRUE( ext::log::is_flight_recorder_enabled() );
+    mock().checkExpectations();
+
+    // Prepare
+    mock().expectOneCall( "::OutputDebugString" ).withParameter( "lpOutputString",
+            "[INFO] {ExtendedLib.Test.log.exe:ExtendedLib} <ext::log> Flight recorder: last 2 messages not logged\n" );
+    mock().expectOneCall( "::OutputDebugString" ).withParameter( "lpOutputString",
+            "[INFO] {ExtendedLib.Test.log.exe:TEST_CAT} <TEST_log_FlightRecorder_DumpOnError_Test::testBody> TEST_MSG 1\n" );
+    mock().expectOneCall( "::OutputDebugString" ).withParameter( "lpOutputString",
+            "[DEBUG] {ExtendedLib.Test.log.exe:TEST_CAT} <TEST_log_FlightRecorder_DumpOnError_Test::testBody> TEST_MSG 2\n" );
+    mock().expectOneCall( "::OutputDebugString" ).withParameter( "lpOutputString",
+            "[ERROR] {ExtendedLib.Test.log.exe:TEST_CAT} <TEST_log_FlightRecorder_DumpOnError_Test::testBody> TEST_MSG 3\n" );
+
+    // Exercise
+    LOG_ERROR( "TEST_MSG %d", 3 );
+
+    // Verify
+    mock().checkExpectations();
+
+    // Exercise (the ring buffer has been cleared)
+    ext::log::dump_flight_recorder();
+
+    // Verify
+    mock().checkExpectations();
+
+    // Cleanup
+    ext::log::disable_flight_recorder();
+    ext::log::set_priority_limit( LOG_PRIORITY_MAX );
+}
+
+/*
+ * Check that only the last messages captured by the flight recorder are logged when it's dumped, and that
+ * messages are not captured when it's disabled.
+ */
+TEST( log, FlightRecorder_DumpCount )
+{
+    // Prepare
+    ext::log::set_priority_limit( LOG_PRIORITY_WARN );
+    ext::log::enable_flight_recorder( LOG_PRIORITY_DEBUG, 2 );
+
+    // Enough messages to wrap around the ring buffer
+    for( int i = 0; i < 1000; i++ )
+    {
+        LOG_INFO( "TEST_MSG %d", i );
+    }
+
+    ext::log::disable_flight_recorder();
+
+    LOG_INFO( "TEST_MSG %d", 1000 );
+
+    mock().expectOneCall( "::OutputDebugString" ).withParameter( "lpOutputString",
+            "[INFO] {ExtendedLib.Test.log.exe:ExtendedLib} <ext::log> Flight recorder: last 2 messages not logged\n" );
+    mock().expectOneCall( "::OutputDebugString" ).withParameter( "lpOutputString",
+            "[INFO] {ExtendedLib.Test.log.exe:TEST_CAT} <TEST_log_FlightRecorder_DumpCount_Test::testBody> TEST_MSG 998\n" );
+    mock().expectOneCall( "::OutputDebugString" ).withParameter( "lpOutputString",
+            "[INFO] {ExtendedLib.Test.log.exe:TEST_CAT} <TEST_log_FlightRecorder_DumpCount_Test::testBody> TEST_MSG 999\n" );
+
+    // Exercise
+    ext::log::dump_flight_recorder();
+
+    // Verify
+    mock().checkExpectations();
+    CHECK_FALSE( ext::log::is_flight_recorder_enabled() );
+
+    // Cleanup
+    ext::log::set_priority_limit( LOG_PRIORITY_MAX );
+}
+
+/*
+ * Check that the messages exceeding the rate limit of a call site are suppressed, and that they are
+ * reported before the next message logged.
+ */
+TEST( log, RateLimit )
+{
+    // Prepare
+    ext::log::set_rate_limit( "TEST_*", LOG_PRIORITY_WARN, 10, 2, false );
+    unsigned long long suppressedCount = ext::log::get_suppressed_count();
+
+    for( int i = 0; i < 4; i++ )
+    {
+        if( i == 3 )
+        {
+            // Verify
+            mock().checkExpectations();
+            CHECK_EQUAL( suppressedCount + 1, ext::log::get_suppressed_count() );
+
+            // Prepare
+            std::this_thread::sleep_for( std::chrono::milliseconds( 150 ) );
+
+            mock().expectOneCall( "::OutputDebugString" ).withParameter( "lpOutputString",
+                    "[INFO] {ExtendedLib.Test.log.exe:TEST_CAT} <TEST_log_RateLimit_Test::testBody> 1 similar messages suppressed\n" );
+        }
+
+        if( i != 2 )
+        {
+            mock().expectOneCall( "::OutputDebugString" ).withParameter( "lpOutputString",
+                    StringFromFormat( "[INFO] {ExtendedLib.Test.log.exe:TEST_CAT} <TEST_log_RateLimit_Test::testBody> TEST_MSG %d\n", i ).asCharString() );
+        }
+
+        // Exercise
+        LOG_INFO( "TEST_MSG %d", i );
+    }
+
+    // Verify
+    mock().checkExpectations();
+
+    // Prepare
+    mock().expectNCalls( 3, "::OutputDebugString" ).withParameter( "lpOutputString",
+            "[ERROR] {ExtendedLib.Test.log.exe:TEST_CAT} <TEST_log_RateLimit_Test::testBody> TEST_MSG\n" );
+
+    // Exercise (not rate limited, because it's more severe than the limit)
+    for( int i = 0; i < 3; i++ )
+    {
+        LOG_ERROR( "TEST_MSG" );
+    }
+
+    // Verify
+    mock().checkExpectations();
+
+    // Cleanup
+    ext::log::clear_rate_limits();
+}
+
+/*
+ * Check that identical consecutive messages of a call site are collapsed.
+ */
+TEST( log, RateLimit_CollapseRepeats )
+{
+    // Prepare
+    ext::log::set_rate_limit( NULL, LOG_PRIORITY_ERROR, 0 );
+
+    mock().expectOneCall( "::OutputDebugString" ).withParameter( "lpOutputString",
+            "[INFO] {ExtendedLib.Test.log.exe:TEST_CAT} <TEST_log_RateLimit_CollapseRepeats_Test::testBody> TEST_MSG A 1\n" );
+    mock().expectOneCall( "::OutputDebugString" ).withParameter( "lpOutputString",
+            "[INFO] {ExtendedLib.Test.log.exe:TEST_CAT} <TEST_log_RateLimit_CollapseRepeats_Test::testBody> Last message repeated 2 times\n" );
+    mock().expectOneCall( "::OutputDebugString" ).withParameter( "lpOutputString",
+            "[INFO] {ExtendedLib.Test.log.exe:TEST_CAT} <TEST_log_RateLimit_CollapseRepeats_Test::testBody> TEST_MSG B 1\n" );
+    mock().expectOneCall( "::OutputDebugString" ).withParameter( "lpOutputString",
+            "[INFO] {ExtendedLib.Test.log.exe:TEST_CAT} <TEST_log_RateLimit_CollapseRepeats_Test::testBody> TEST_MSG B 2\n" );
+
+    const char* args[] = { "A", "A", "A", "B", "B" };
+
+    // Exercise
+    for( int i = 0; i < 5; i++ )
+    {
+        LOG_INFO( "TEST_MSG %s %d", args[i], ( i < 4 ) ? 1 : 2 );
+    }
+
+    // Verify
+    mock().checkExpectations();
+
+    // Cleanup
+    ext::log::clear_rate_limits();
+}
+
+class TextLogHandler : public ext::log_handler
+{
+public:
+    virtual bool process_record( const ext::log_record& record )
+    {
+        m_timestamp = record.timestamp();
+        m_threadId = record.thread_id();
+        m_threadName = record.thread_name();
+        m_text = record.text();
+        return false;
+    }
+
+    uint64_t m_timestamp;
+    unsigned long m_threadId;
+    std::string m_threadName;
+    std::string m_text;
+};
+
+static uint64_t get_wall_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch() ).count();
+}
+
+/*
+ * Check that messages carry the time when they were generated, which starts their lines of text.
+ */
+TEST( log, Timestamps )
+{
+    // Prepare
+    std::shared_ptr<TextLogHandler> testLogHandler = std::make_shared<TextLogHandler>();
+    ext::log::set_log_handler( testLogHandler );
+    ext::log::set_timestamps_enabled( true );
+
+    uint64_t before = get_wall_ns();
+
+    // Exercise
+    LOG_INFO( "TEST_MSG" );
+
+    // Verify
+    uint64_t after = get_wall_ns();
+    uint64_t wallNs = ext::log::timestamp_to_wall_ns( testLogHandler->m_timestamp );
+
+    CHECK_TRUE( ext::log::are_timestamps_enabled() );
+    CHECK_TRUE( wallNs + 1000000 >= before );
+    CHECK_TRUE( wallNs <= after + 1000000 );
+
+    time_t seconds = (time_t) ( wallNs / 1000000000 );
+    char dateTime[32];
+    strftime( dateTime, sizeof( dateTime ), "%Y-%m-%d %H:%M:%S", localtime( &seconds ) );
+    std::string expected = StringFromFormat( "%s.%06u ", dateTime, (unsigned int) ( ( wallNs % 1000000000 ) / 1000 ) ).asCharString();
+
+    STRCMP_EQUAL( expected.c_str(), testLogHandler->m_text.substr( 0, expected.size() ).c_str() );
+
+    // Cleanup
+    ext::log::set_timestamps_enabled( false );
+    ext::log::set_log_handler( NULL );
+    testLogHandler.reset();
+}
+
+/*
+ * Check that messages carry the identity of the thread that generated them, which is shown in their lines
+ * of text.
+ */
+TEST( log, ThreadTags )
+{
+    // Prepare
+    std::shared_ptr<TextLogHandler> testLogHandler = std::make_shared<TextLogHandler>();
+    ext::log::set_log_handler( testLogHandler );
+    ext::log::set_thread_tags_enabled( true );
+
+    // Exercise
+    std::thread worker( []()
+    {
+        ext::thread::set_current_name( "TEST_THREAD" );
+        LOG_INFO( "TEST_MSG" );
+    } );
+    worker.join();
+
+    // Verify
+    CHECK_TRUE( ext::log::are_thread_tags_enabled() );
+    CHECK_TRUE( testLogHandler->m_threadId != 0 );
+    STRCMP_EQUAL( "TEST_THREAD", testLogHandler->m_threadName.c_str() );
+
+    std::string expected = StringFromFormat( "{ExtendedLib.Test.log.exe:TEST_CAT} (%lu:TEST_THREAD) <",
+                                             testLogHandler->m_threadId ).asCharString();
+    CHECK_TRUE( testLogHandler->m_text.find( expected ) != std::string::npos );
+
+    // Cleanup
+    ext::log::set_thread_tags_enabled( false );
+    ext::log::set_log_handler( NULL );
+    testLogHandler.reset();
+}
+
+class FieldsLogHandler : public ext::log_handler
+{
+public:
+    virtual bool process_fields( const ext::log_record& record, const ext::log_field* fields, size_t count )
+    {
+        m_msg = record.message();
+        m_baseMsg = record.base_message();
+        m_fields.clear();
+        for( size_t i = 0; i < count; i++ )
+        {
+            const ext::log_field& field = fields[i];
+            switch( field.type() )
+            {
+            case ext::log_field::TYPE_INT:
+                m_fields += StringFromFormat( "%s:int:%lld;", field.key(), (long long) field.int_value() ).asCharString();
+                break;
+            case ext::log_field::TYPE_UINT:
+                m_fields += StringFromFormat( "%s:uint:%llu;", field.key(), (unsigned long long) field.uint_value() ).asCharString();
+                break;
+            case ext::log_field::TYPE_DOUBLE:
+                m_fields += StringFromFormat( "%s:double:%g;", field.key(), field.double_value() ).asCharString();
+                break;
+            case ext::log_field::TYPE_BOOL:
+                m_fields += StringFromFormat( "%s:bool:%d;", field.key(), (int) field.bool_value() ).asCharString();
+                break;
+            case ext::log_field::TYPE_STRING:
+                m_fields += StringFromFormat( "%s:string:%.*s;", field.key(), (int) field.string_length(),
+                                              field.string_value() ).asCharString();
+                break;
+            }
+        }
+        return false;
+    }
+
+    std::string m_msg;
+    std::string m_baseMsg;
+    std::string m_fields;
+};
+
+/*
+ * Check that the typed fields of structured messages are passed to the log handler.
+ */
+TEST( log, StructuredMessage )
+{
+    // Prepare
+    std::shared_ptr<FieldsLogHandler> testLogHandler = std::make_shared<FieldsLogHandler>();
+    ext::log::set_log_handler( testLogHandler );
+
+    std::string peer( "host:80" );
+
+    // Exercise
+    LOG_INFO_KV( "TEST_MSG", "fd", 3, "delta", -12L, "bytes", 4096ull, "ratio", 0.25, "ok", true, "peer", peer,
+                 "state", "open" );
+
+    // Verify
+    STRCMP_EQUAL( "TEST_MSG", testLogHandler->m_baseMsg.c_str() );
+    STRCMP_EQUAL( "TEST_MSG fd=3 delta=-12 bytes=4096 ratio=0.25 ok=true peer=host:80 state=open", testLogHandler->m_msg.c_str() );
+    STRCMP_EQUAL( "fd:int:3;delta:int:-12;bytes:uint:4096;ratio:double:0.25;ok:bool:1;peer:string:host:80;state:string:open;",
+                  testLogHandler->m_fields.c_str() );
+
+    // Cleanup
+    ext::log::set_log_handler( NULL );
+    testLogHandler.reset();
+}
+
+/*
+ * Check that the fields of structured messages are written to console in logfmt format.
+ */
+TEST( log, StructuredMessage_Console )
+{
+    // Prepare
+    mock().expectOneCall( "::OutputDebugString" ).withParameter( "lpOutputString",
+            "[WARN] {ExtendedLib.Test.log.exe:TEST_CAT} <TEST_log_StructuredMessage_Console_Test::testBody> "
+            "TEST_MSG count=0 value=-1.5 big=1e+20 text=\"a \\\"b\\\"\" empty=\"\"\n" );
+
+    // Exercise
+    LOG_WARN_KV( "TEST_MSG", "count", 0u, "value", -1.5, "big", 1e20, "text", "a \"b\"", "empty", "" );
+
+    // Verify
+    mock().checkExpectations();
+}
+
+/*
+ * Check that in asynchronous mode the fields of structured messages are copied when logging, and passed
+ * to log handlers that don't handle fields as part of the message text.
+ */
+TEST( log, StructuredMessage_AsyncMode )
+{
+    // Prepare
+    std::shared_ptr<TestLogHandler> testLogHandler = std::make_shared<TestLogHandler>();
+    ext::log::set_log_handler( testLogHandler );
+
+    mock().expectOneCall( "TestLogHandler::process" ).onObject( testLogHandler.get() ).withParameter( "prio", LOG_PRIORITY_INFO )
+                         .withParameter( "category", "TEST_CAT" ).withParameter( "function", "TEST_log_StructuredMessage_AsyncMode_Test::testBody" )
+                         .withParameter( "msg", "TEST_MSG id=7 name=abc" ).andReturnValue( false );
+
+    ext::log::enable_async_mode( 16, ext::log::OVERFLOW_BLOCK );
+
+    // Exercise
+    char name[] = "abc";
+    LOG_INFO_KV( "TEST_MSG", "id", 7, "name", name );
+    name[0] = 'X'; // The field must have been copied when logging
+    ext::log::flush();
+
+    // Verify
+    mock().checkExpectations();
+
+    // Cleanup
+    ext::log::disable_async_mode();
+    ext::log::set_log_handler( NULL );
+    testLogHandler.reset();
+}
+
+class LazyLogHandler : public ext::log_handler
+{
+public:
+    LazyLogHandler( bool render ) : m_render( render ), m_line( 0 ), m_cached( false ) {}
+
+    virtual bool process_record( const ext::log_record& record )
+    {
+        m_format = ( record.format() != NULL ) ? record.format() : "";
+        m_line = ( record.site() != NULL ) ? record.site()->get_line() : 0;
+        if( m_render )
+        {
+            const char* msg = record.message();
+            m_msg = msg;
+            m_cached = ( record.message() == msg ) && ( record.base_message() == msg );
+        }
+        return false;
+    }
+
+    bool m_render;
+    std::string m_format;
+    int m_line;
+    std::string m_msg;
+    bool m_cached;
+};
+
+/*
+ * Check that messages generated by call sites are passed to log handlers unformatted, and that their text
+ * is rendered only when requested, and only once.
+ */
+TEST( log, LazyFormatting )
+{
+    // Prepare
+    std::shared_ptr<LazyLogHandler> filteringHandler = std::make_shared<LazyLogHandler>( false );
+    std::shared_ptr<LazyLogHandler> renderingHandler = std::make_shared<LazyLogHandler>( true );
+
+    // Exercise
+    ext::log::set_log_handler( filteringHandler );
+    LOG_INFO( "TEST_MSG %d %s", 5, "abc" ); int line1 = __LINE__;
+    ext::log::set_log_handler( renderingHandler );
+    LOG_INFO( "TEST_MSG %d %s", 6, "def" ); int line2 = __LINE__;
+
+    // Verify
+    STRCMP_EQUAL( "TEST_MSG %d %s", filteringHandler->m_format.c_str() );
+    CHECK_EQUAL( line1, filteringHandler->m_line );
+    STRCMP_EQUAL( "", filteringHandler->m_msg.c_str() );
+
+    STRCMP_EQUAL( "TEST_MSG %d %s", renderingHandler->m_format.c_str() );
+    CHECK_EQUAL( line2, renderingHandler->m_line );
+    STRCMP_EQUAL( "TEST_MSG 6 def", renderingHandler->m_msg.c_str() );
+    CHECK_TRUE( renderingHandler->m_cached );
+
+    // Cleanup
+    ext::log::set_log_handler( NULL );
+    filteringHandler.reset();
+    renderingHandler.reset();
+}
+
+/*
+ * Check that in asynchronous mode messages generated by call sites are also passed to log handlers
+ * unformatted, and rendered from their captured arguments when requested.
+ */
+TEST( log, LazyFormatting_AsyncMode )
+{
+    // Prepare
+    std::shared_ptr<LazyLogHandler> testLogHandler = std::make_shared<LazyLogHandler>( true );
+    ext::log::set_log_handler( testLogHandler );
+
+    ext::log::enable_async_mode( 16, ext::log::OVERFLOW_BLOCK );
+
+    // Exercise
+    char text[] = "abc";
+    LOG_INFO( "TEST_MSG %d %s", 7, text ); int line = __LINE__;
+    text[0] = 'X'; // The argument must have been captured when logging
+    ext::log::flush();
+
+    // Verify
+    STRCMP_EQUAL( "TEST_MSG %d %s", testLogHandler->m_format.c_str() );
+    CHECK_EQUAL( line, testLogHandler->m_line );
+    STRCMP_EQUAL( "TEST_MSG 7 abc", testLogHandler->m_msg.c_str() );
+    CHECK_TRUE( testLogHandler->m_cached );
+
+    // Cleanup
+    ext::log::disable_async_mode();
+    ext::log::set_log_handler( NULL );
+    testLogHandler.reset();
+}
+
+/*
+ * Check that format strings that are not string literals are accepted by the logging macros, and that
+ * they are not used after the logging call (even in asynchronous mode).
+ */
+TEST( log, NonLiteralFormat )
+{
+    // Prepare
+    std::shared_ptr<LazyLogHandler> testLogHandler = std::make_shared<LazyLogHandler>( true );
+    ext::log::set_log_handler( testLogHandler );
+
+    const char* format = "TEST_MSG %d %s";
+
+    // Exercise
+    LOG_INFO( format, 8, "abc" ); int line = __LINE__;
+
+    // Verify
+    CHECK_EQUAL( line, testLogHandler->m_line );
+    STRCMP_EQUAL( "TEST_MSG 8 abc", testLogHandler->m_msg.c_str() );
+
+    // Prepare
+    ext::log::enable_async_mode( 16, ext::log::OVERFLOW_BLOCK );
+
+    // Exercise
+    {
+        std::string text = "TEST_MSG 9";
+        LOG_INFO( text.c_str() );
+        text.assign( "XXXXXXXXXX" ); // The format string must not be used after logging
+    }
+    ext::log::flush();
+
+    // Verify
+    STRCMP_EQUAL( "TEST_MSG 9", testLogHandler->m_msg.c_str() );
+
+    // Cleanup
+    ext::log::disable_async_mode();
+    ext::log::set_log_handler( NULL );
+    testLogHandler.reset();
+}
+
+class OrderLogHandler : public ext::log_handler
+{
+public:
+    OrderLogHandler()
+    : m_blocked( false ), m_released( false )
+    {}
+
+    virtual bool process_record( const ext::log_record& record )
+    {
+        if( strcmp( record.message(), "BLOCK" ) == 0 )
+        {
+            // Holds the writer thread, so that the messages queued meanwhile are merged together
+            std::unique_lock<std::mutex> lock( m_mutex );
+            m_blocked = true;
+            m_cv.notify_all();
+            while( !m_released )
+            {
+                m_cv.wait( lock );
+            }
+        }
+
+        m_timestamps.push_back( record.timestamp() );
+        m_msgs.push_back( record.message() );
+        return false;
+    }
+
+    void wait_blocked()
+    {
+        std::unique_lock<std::mutex> lock( m_mutex );
+        while( !m_blocked )
+        {
+            m_cv.wait( lock );
+        }
+    }
+
+    void release()
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        m_released = true;
+        m_cv.notify_all();
+    }
+
+    std::vector<uint64_t> m_timestamps;
+    std::vector<std::string> m_msgs;
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    bool m_blocked;
+    bool m_released;
+};
+
+static void log_thread_messages( const char* name, int count )
+{
+    for( int i = 0; i < count; i++ )
+    {
+        LOG_INFO( "%s %d", name, i );
+    }
+}
+
+/*
+ * Check that each thread captures the messages into its own flight recorder ring buffer.
+ */
+TEST( log, FlightRecorder_Threads )
+{
+    // Prepare
+    ext::log::set_priority_limit( LOG_PRIORITY_WARN );
+    ext::log::enable_flight_recorder( LOG_PRIORITY_DEBUG );
+    LOG_INFO( "TEST_MSG %d", 1 );
+
+    mock().expectOneCall( "::OutputDebugString" ).withParameter( "lpOutputString",
+            "[INFO] {ExtendedLib.Test.log.exe:ExtendedLib} <ext::log> Flight recorder: last 2 messages not logged\n" );
+    mock().expectOneCall( "::OutputDebugString" ).withParameter( "lpOutputString",
+            "[INFO] {ExtendedLib.Test.log.exe:TEST_CAT} <log_thread_messages> T1 0\n" );
+    mock().expectOneCall( "::OutputDebugString" ).withParameter( "lpOutputString",
+            "[INFO] {ExtendedLib.Test.log.exe:TEST_CAT} <log_thread_messages> T1 1\n" );
+
+    // Exercise
+    std::thread worker( []()
+    {
+        log_thread_messages( "T1", 2 );
+        ext::log::dump_flight_recorder();
+    } );
+    worker.join();
+
+    // Verify
+    mock().checkExpectations();
+
+    // Prepare
+    mock().expectOneCall( "::OutputDebugString" ).withParameter( "lpOutputString",
+            "[INFO] {ExtendedLib.Test.log.exe:ExtendedLib} <ext::log> Flight recorder: last 1 messages not logged\n" );
+    mock().expectOneCall( "::OutputDebugString" ).withParameter( "lpOutputString",
+            "[INFO] {ExtendedLib.Test.log.exe:TEST_CAT} <TEST_log_FlightRecorder_Threads_Test::testBody> TEST_MSG 1\n" );
+
+    // Exercise
+    ext::log::dump_flight_recorder();
+
+    // Verify
+    mock().checkExpectations();
+
+    // Cleanup
+    ext::log::disable_flight_recorder();
+    ext::log::set_priority_limit( LOG_PRIORITY_MAX );
+}
+
+/*
+ * Check that with per-thread queues the messages of all the threads are passed to the log handler
+ * ordered by their timestamps.
+ */
+TEST( log, AsyncMode_PerThreadQueues )
+{
+    // Prepare
+    std::shared_ptr<OrderLogHandler> testLogHandler = std::make_shared<OrderLogHandler>();
+    ext::log::set_log_handler( testLogHandler );
+
+    ext::log::enable_async_mode( 64, ext::log::OVERFLOW_BLOCK, ext::log::QUEUE_PER_THREAD );
+
+    // Verify
+    CHECK_TRUE( ext::log::is_async_mode() );
+
+    // Exercise
+    LOG_INFO( "BLOCK" );
+    testLogHandler->wait_blocked();
+
+    std::thread thread1( log_thread_messages, "T1", 50 );
+    std::thread thread2( log_thread_messages, "T2", 50 );
+    log_thread_messages( "MAIN", 50 );
+    thread1.join();
+    thread2.join();
+
+    testLogHandler->release();
+    ext::log::flush();
+
+    // Verify
+    CHECK_EQUAL( 151, testLogHandler->m_msgs.size() );
+    STRCMP_EQUAL( "BLOCK", testLogHandler->m_msgs[0].c_str() );
+
+    int next[3] = { 0, 0, 0 };
+    const char* names[3] = { "T1", "T2", "MAIN" };
+    for( size_t i = 1; i < testLogHandler->m_msgs.size(); i++ )
+    {
+        CHECK_TRUE( testLogHandler->m_timestamps[i - 1] <= testLogHandler->m_timestamps[i] );
+
+        bool found = false;
+        for( int t = 0; t < 3; t++ )
+        {
+            if( testLogHandler->m_msgs[i] == StringFromFormat( "%s %d", names[t], next[t] ).asCharString() )
+            {
+                next[t]++;
+                found = true;
+            }
+        }
+        CHECK_TRUE( found );
+    }
+
+    // Cleanup
+    ext::log::disable_async_mode();
+    ext::log::set_log_handler( NULL );
+    testLogHandler.reset();
+}
+
+/*
+ * Check that with per-thread queues the messages of threads that have exited are processed, and that
+ * their buffers can be reused by new threads and after restarting the asynchronous mode.
+ */
+TEST( log, AsyncMode_PerThreadQueues_ThreadExit )
+{
+    // Prepare
+    std::shared_ptr<OrderLogHandler> testLogHandler = std::make_shared<OrderLogHandler>();
+    ext::log::set_log_handler( testLogHandler );
+    testLogHandler->release();
+
+    ext::log::enable_async_mode( 4, ext::log::OVERFLOW_BLOCK, ext::log::QUEUE_PER_THREAD );
+
+    // Exercise
+    for( int i = 0; i < 20; i++ )
+    {
+        std::thread thread( log_thread_messages, "T", 10 );
+        thread.join();
+    }
+    ext::log::flush();
+
+    // Verify
+    CHECK_EQUAL( 200, testLogHandler->m_msgs.size() );
+    STRCMP_EQUAL( "T 9", testLogHandler->m_msgs[199].c_str() );
+
+    // Exercise
+    ext::log::disable_async_mode();
+    std::thread thread( log_thread_messages, "T", 1 );
+    thread.join();
+    ext::log::enable_async_mode( 4, ext::log::OVERFLOW_BLOCK, ext::log::QUEUE_PER_THREAD );
+    log_thread_messages( "MAIN", 10 );
+    ext::log::disable_async_mode();
+
+    // Verify
+    CHECK_FALSE( ext::log::is_async_mode() );
+    CHECK_EQUAL( 211, testLogHandler->m_msgs.size() );
+    STRCMP_EQUAL( "MAIN 9", testLogHandler->m_msgs[210].c_str() );
+
+    // Cleanup
+    ext::log::set_log_handler( NULL );
+    testLogHandler.reset();
+}
+
+/*
+ * Check that flushing waits until the log handler has received the queued messages, both with per-thread
+ * queues and with the shared queue (used after a session with per-thread queues).
+ */
+TEST( log, AsyncMode_FlushWaitsForHandler )
+{
+    const ext::log::queue_mode modes[2] = { ext::log::QUEUE_PER_THREAD, ext::log::QUEUE_SHARED };
+
+    for( int m = 0; m < 2; m++ )
+    {
+        // Prepare
+        std::shared_ptr<OrderLogHandler> testLogHandler = std::make_shared<OrderLogHandler>();
+        ext::log::set_log_handler( testLogHandler );
+
+        ext::log::enable_async_mode( 16, ext::log::OVERFLOW_BLOCK, modes[m] );
+
+        LOG_INFO( "BLOCK" );
+        testLogHandler->wait_blocked();
+        LOG_INFO( "AFTER" );
+
+        std::thread releaser( [testLogHandler]()
+        {
+            std::this_thread::sleep_for( std::chrono::milliseconds( 50 ) );
+            testLogHandler->release();
+        } );
+
+        // Exercise
+        ext::log::flush();
+        std::vector<std::string> msgs = testLogHandler->m_msgs;
+        releaser.join();
+
+        // Verify
+        CHECK_EQUAL( 2, msgs.size() );
+        STRCMP_EQUAL( "BLOCK", msgs[0].c_str() );
+        STRCMP_EQUAL( "AFTER", msgs[1].c_str() );
+
+        // Cleanup
+        ext::log::disable_async_mode();
+        ext::log::set_log_handler( NULL );
+        testLogHandler.reset();
+    }
+}
+
+/*
+ * Check that the statistics count the messages logged and discarded, and the calls to the log handler.
+ */
+TEST( log, Statistics )
+{
+    // Prepare
+    std::shared_ptr<TextLogHandler> testLogHandler = std::make_shared<TextLogHandler>();
+    ext::log::set_log_handler( testLogHandler );
+    ext::log::set_priority_limit( LOG_PRIORITY_INFO );
+    ext::log::set_latency_sampling( 1 );
+    ext::log::reset_statistics();
+
+    // Exercise
+    for( int i = 0; i < 3; i++ )
+    {
+        LOG_INFO( "TEST_MSG %d", i );
+    }
+    LOG_WARN_KV( "TEST_MSG", "value", 1 );
+    ext::log::log_message( LOG_PRIORITY_DEBUG, "TEST_CAT", "TEST_FUNC", "TEST_MSG" );
+    ext::log::log_message( LOG_PRIORITY_ERROR, NULL, "TEST_FUNC", "TEST_MSG" );
+
+    // Verify
+    ext::log_statistics stats = ext::log::get_statistics();
+
+    CHECK_EQUAL( 1, stats.emitted[LOG_PRIORITY_ERROR] );
+    CHECK_EQUAL( 1, stats.emitted[LOG_PRIORITY_WARN] );
+    CHECK_EQUAL( 3, stats.emitted[LOG_PRIORITY_INFO] );
+    CHECK_EQUAL( 0, stats.emitted[LOG_PRIORITY_DEBUG] );
+    CHECK_EQUAL( 1, stats.filtered[LOG_PRIORITY_DEBUG] );
+    CHECK_EQUAL( 0, stats.filtered[LOG_PRIORITY_INFO] );
+
+    LONGS_EQUAL( 2, stats.categories.size() );
+    STRCMP_EQUAL( "", stats.categories[0].name.c_str() );
+    CHECK_EQUAL( 1, stats.categories[0].emitted );
+    CHECK_EQUAL( 0, stats.categories[0].filtered );
+    STRCMP_EQUAL( "TEST_CAT", stats.categories[1].name.c_str() );
+    CHECK_EQUAL( 4, stats.categories[1].emitted );
+    CHECK_EQUAL( 1, stats.categories[1].filtered );
+
+    CHECK_EQUAL( 5, stats.handler_calls );
+    CHECK_EQUAL( 0, stats.bytes_written );
+    CHECK_EQUAL( 0, stats.dropped );
+    CHECK_EQUAL( 0, stats.suppressed );
+
+    CHECK_EQUAL( 6, stats.latency_samples );
+    unsigned long long samples = 0;
+    for( unsigned int i = 0; i < LOG_LATENCY_BUCKETS; i++ )
+    {
+        samples += stats.latency_histogram[i];
+    }
+    CHECK_EQUAL( 6, samples );
+    CHECK_TRUE( stats.latency_percentile( 0.5 ) > 0 );
+    CHECK_TRUE( stats.latency_percentile( 0.5 ) <= stats.latency_percentile( 0.999 ) );
+
+    // Exercise
+    ext::log::reset_statistics();
+
+    // Verify
+    stats = ext::log::get_statistics();
+    CHECK_EQUAL( 0, stats.emitted[LOG_PRIORITY_INFO] );
+    CHECK_EQUAL( 0, stats.handler_calls );
+    CHECK_EQUAL( 0, stats.latency_samples );
+    CHECK_EQUAL( 0, stats.latency_percentile( 0.5 ) );
+    LONGS_EQUAL( 0, stats.categories.size() );
+
+    // Cleanup
+    ext::log::set_latency_sampling( 64 );
+    ext::log::set_priority_limit( LOG_PRIORITY_MAX );
+    ext::log::set_log_handler( NULL );
+    testLogHandler.reset();
+}
+
+/*
+ * Check that the summary of the statistics is logged on demand, bypassing the priority limits.
+ */
+TEST( log, Statistics_Dump )
+{
+    // Prepare
+    ext::log::set_priority_limit( LOG_PRIORITY_ERROR );
+    ext::log::set_latency_sampling( 0 );
+    ext::log::reset_statistics();
+
+    mock().expectOneCall( "::OutputDebugString" ).withParameter( "lpOutputString",
+            "[ERROR] {ExtendedLib.Test.log.exe} <TEST_FUNC> TEST_MSG\n" );
+    ext::log::log_message( LOG_PRIORITY_ERROR, NULL, "TEST_FUNC", "TEST_MSG" );
+
+    mock().expectOneCall( "::OutputDebugString" ).withParameter( "lpOutputString",
+            "[INFO] {ExtendedLib.Test.log.exe:ExtendedLib} <ext::log> Statistics: emitted ERROR=1, filtered none, "
+            "56 bytes written, 0 dropped, 0 suppressed\n" );
+    mock().expectOneCall( "::OutputDebugString" ).withParameter( "lpOutputString",
+            "[INFO] {ExtendedLib.Test.log.exe:ExtendedLib} <ext::log> Statistics: handler 0 calls, 0 us; "
+            "latency p50 0 ns, p99 0 ns, p999 0 ns (0 samples)\n" );
+    mock().expectOneCall( "::OutputDebugString" ).withParameter( "lpOutputString",
+            "[INFO] {ExtendedLib.Test.log.exe:ExtendedLib} <ext::log> Statistics: category '': 1 emitted, 0 filtered\n" );
+
+    // Exercise
+    ext::log::dump_statistics();
+
+    // Verify
+    mock().checkExpectations();
+
+    // Cleanup
+    ext::log::set_latency_sampling( 64 );
+    ext::log::set_priority_limit( LOG_PRIORITY_MAX );
+}
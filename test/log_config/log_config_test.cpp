@@ -0,0 +1,194 @@
+/**
+ * @file
+ * @brief      unit tests for the "log_config" class
+ * @project    ExtendedLib
+ * @authors    Jesus Gonzalez <jgonzalez@gdr-sistemas.com>
+ * @copyright  Copyright (c) Jesus Gonzalez. All rights reserved.
+ * @license    See LICENSE.txt
+ */
+
+/*===========================================================================
+ *                              INCLUDES
+ *===========================================================================*/
+
+#include "Extended/log_config.hpp"
+#include "Extended/runtime_error.hpp"
+#include "test_log_sink.hpp"
+
+#include <stdio.h>
+
+#include <CppUTest/TestHarness.h>
+#include <CppUTestExt/MockSupport.h>
+
+/*===========================================================================
+ *                      COMMON TEST DEFINES & MACROS
+ *===========================================================================*/
+
+static std::string parse_error( const char* text )
+{
+    try
+    {
+        ext::log_config::parse( text );
+    }
+    catch( ext::runtime_error &e )
+    {
+        return e.what();
+    }
+
+    return "<NO ERROR>";
+}
+
+/*===========================================================================
+ *                          TEST GROUP DEFINITION
+ *===========================================================================*/
+
+TEST_GROUP( log_config )
+{
+    TEST_TEARDOWN()
+    {
+        ext::log::clear_category_priority_limits();
+        ext::log::set_priority_limit( LOG_PRIORITY_MAX );
+        ext::log::set_timestamps_enabled( false );
+        ext::log::set_thread_tags_enabled( false );
+
+        remove( "log_config_test.conf" );
+    }
+};
+
+/*===========================================================================
+ *                    TEST CASES IMPLEMENTATION
+ *===========================================================================*/
+
+/*
+ * Check that all the settings are parsed.
+ */
+TEST( log_config, Parse )
+{
+    // Exercise
+    ext::log_config config = ext::log_config::parse( "# Comment\n"
+                                                     "priority = info\n"
+                                                     "\n"
+                                                     "[categories]\n"
+                                                     "  TEST_* = DEBUG  \n"
+                                                     "; Comment\n"
+                                                     "TEST_CAT=2\n"
+                                                     "[Sinks]\n"
+                                                     "file = TRACE" );
+
+    // Verify
+    CHECK_EQUAL( LOG_PRIORITY_INFO, config.get_priority_limit() );
+    CHECK_EQUAL( 2, config.get_category_limits().size() );
+    STRCMP_EQUAL( "TEST_*", config.get_category_limits()[0].first.c_str() );
+    CHECK_EQUAL( LOG_PRIORITY_DEBUG, config.get_category_limits()[0].second );
+    STRCMP_EQUAL( "TEST_CAT", config.get_category_limits()[1].first.c_str() );
+    CHECK_EQUAL( LOG_PRIORITY_WARN, config.get_category_limits()[1].second );
+    CHECK_EQUAL( 1, config.get_sink_limits().size() );
+    STRCMP_EQUAL( "file", config.get_sink_limits()[0].first.c_str() );
+    CHECK_EQUAL( LOG_PRIORITY_TRACE, config.get_sink_limits()[0].second );
+
+    // Exercise
+    config = ext::log_config::parse( "" );
+
+    // Verify
+    CHECK_EQUAL( -1, config.get_priority_limit() );
+    CHECK_EQUAL( 0, config.get_category_limits().size() );
+    CHECK_EQUAL( 0, config.get_sink_limits().size() );
+}
+
+/*
+ * Check that errors in the configuration are reported with their line number.
+ */
+TEST( log_config, Parse_Errors )
+{
+    // Exercise & Verify
+    STRCMP_EQUAL( "Invalid log configuration (line 2): unknown section '[other]'",
+                  parse_error( "priority = INFO\n[other]\n" ).c_str() );
+    STRCMP_EQUAL( "Invalid log configuration (line 1): expected 'name = value'", parse_error( "priority\n" ).c_str() );
+    STRCMP_EQUAL( "Invalid log configuration (line 1): expected 'name = value'", parse_error( "= INFO\n" ).c_str() );
+    STRCMP_EQUAL( "Invalid log configuration (line 1): unknown setting 'level'", parse_error( "level = INFO\n" ).c_str() );
+    STRCMP_EQUAL( "Invalid log configuration (line 2): invalid priority 'VERBOSE'",
+                  parse_error( "[categories]\nTEST_CAT = VERBOSE\n" ).c_str() );
+    STRCMP_EQUAL( "Invalid log configuration (line 1): invalid priority '8'", parse_error( "priority = 8\n" ).c_str() );
+    STRCMP_EQUAL( "Invalid log configuration (line 1): invalid value 'yes' (expected 'on' or 'off')",
+                  parse_error( "timestamps = yes\n" ).c_str() );
+}
+
+/*
+ * Check that the configuration is applied to the priority limits, the console format and the sinks.
+ */
+TEST( log_config, Apply )
+{
+    // Prepare
+    std::shared_ptr<TestLogSink> sink1 = std::make_shared<TestLogSink>();
+    std::shared_ptr<TestLogSink> sink2 = std::make_shared<TestLogSink>();
+    ext::log_config::sink_map sinks;
+    sinks["sink1"] = sink1;
+    sinks["sink2"] = sink2;
+    ext::log::set_timestamps_enabled( true );
+    ext::log::set_thread_tags_enabled( true );
+
+    ext::log_config config = ext::log_config::parse( "priority = WARN\n"
+                                                     "timestamps = off\n"
+                                                     "thread_tags = off\n"
+                                                     "[categories]\n"
+                                                     "TEST_* = DEBUG\n"
+                                                     "[sinks]\n"
+                                                     "sink1 = ERROR\n"
+                                                     "other = ERROR\n" );
+
+    // Exercise
+    config.apply( sinks );
+
+    // Verify
+    CHECK_EQUAL( LOG_PRIORITY_WARN, ext::log::get_priority_limit() );
+    CHECK_EQUAL( LOG_PRIORITY_DEBUG, ext::log::get_category_priority_limit( "TEST_CAT" ) );
+    CHECK_EQUAL( LOG_PRIORITY_WARN, ext::log::get_category_priority_limit( "OTHER_CAT" ) );
+    CHECK_FALSE( ext::log::are_timestamps_enabled() );
+    CHECK_FALSE( ext::log::are_thread_tags_enabled() );
+    CHECK_EQUAL( LOG_PRIORITY_ERROR, sink1->get_priority_limit() );
+    CHECK_EQUAL( LOG_PRIORITY_ALLOC, sink2->get_priority_limit() );
+
+    // Exercise
+    ext::log_config::parse( "[categories]\nTEST_CAT = INFO\n" ).apply( sinks );
+
+    // Verify
+    CHECK_EQUAL( LOG_PRIORITY_WARN, ext::log::get_priority_limit() );
+    CHECK_EQUAL( LOG_PRIORITY_INFO, ext::log::get_category_priority_limit( "TEST_CAT" ) );
+    CHECK_EQUAL( LOG_PRIORITY_WARN, ext::log::get_category_priority_limit( "TEST_CAT2" ) );
+    CHECK_FALSE( ext::log::are_timestamps_enabled() );
+    CHECK_EQUAL( LOG_PRIORITY_ERROR, sink1->get_priority_limit() );
+}
+
+/*
+ * Check that a configuration file is loaded, and that an error is thrown when it can't be read.
+ */
+TEST( log_config, Load )
+{
+    // Prepare
+    FILE* file = fopen( "log_config_test.conf", "wb" );
+    fputs( "priority = DEBUG\r\n[categories]\r\nTEST_CAT = OFF\r\n", file );
+    fclose( file );
+
+    // Exercise
+    ext::log_config config = ext::log_config::load( "log_config_test.conf" );
+
+    // Verify
+    CHECK_EQUAL( LOG_PRIORITY_DEBUG, config.get_priority_limit() );
+    CHECK_EQUAL( 1, config.get_category_limits().size() );
+    CHECK_EQUAL( 0, config.get_category_limits()[0].second );
+
+    // Exercise
+    bool thrown = false;
+    try
+    {
+        ext::log_config::load( "non_existent_dir/log_config_test.conf" );
+    }
+    catch( ext::runtime_error &e )
+    {
+        thrown = true;
+        STRCMP_EQUAL( "Error reading log configuration file 'non_existent_dir/log_config_test.conf'", e.what() );
+    }
+
+    // Verify
+    CHECK_TRUE( thrown );
+}
@@ -0,0 +1,169 @@
+/**
+ * @file
+ * @brief      unit tests for the "log_config_watcher" class
+ * @project    ExtendedLib
+ * @authors    Jesus Gonzalez <jgonzalez@gdr-sistemas.com>
+ * @copyright  Copyright (c) Jesus Gonzalez. All rights reserved.
+ * @license    See LICENSE.txt
+ */
+
+/*===========================================================================
+ *                              INCLUDES
+ *===========================================================================*/
+
+#include "Extended/log_config_watcher.hpp"
+#include "Extended/runtime_error.hpp"
+#include "test_log_sink.hpp"
+
+#include <stdio.h>
+#include <chrono>
+#include <functional>
+#include <thread>
+
+#include <CppUTest/TestHarness.h>
+#include <CppUTestExt/MockSupport.h>
+
+/*===========================================================================
+ *                      COMMON TEST DEFINES & MACROS
+ *===========================================================================*/
+
+static void write_file( const char* path, const char* contents )
+{
+    FILE* file = fopen( path, "wb" );
+    fputs( contents, file );
+    fclose( file );
+}
+
+/**
+ * Waits until a condition is met (the watcher applies the changes asynchronously).
+ */
+static bool wait_for( const std::function<bool()>& condition )
+{
+    for( int i = 0; i < 500; i++ )
+    {
+        if( condition() )
+        {
+            return true;
+        }
+        std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+    }
+
+    return false;
+}
+
+/*===========================================================================
+ *                          TEST GROUP DEFINITION
+ *===========================================================================*/
+
+TEST_GROUP( log_config_watcher )
+{
+    TEST_SETUP()
+    {
+        remove( "log_config_watcher_test.conf" );
+        remove( "log_config_watcher_test.conf.new" );
+    }
+
+    TEST_TEARDOWN()
+    {
+        ext::log::clear_category_priority_limits();
+        ext::log::set_priority_limit( LOG_PRIORITY_MAX );
+
+        remove( "log_config_watcher_test.conf" );
+        remove( "log_config_watcher_test.conf.new" );
+    }
+};
+
+/*
+ * Check that an existing configuration file is applied when the watcher is created.
+ */
+TEST( log_config_watcher, AppliedOnStart )
+{
+    // Prepare
+    write_file( "log_config_watcher_test.conf", "priority = WARN\n" );
+
+    // Exercise
+    ext::log_config_watcher watcher( "log_config_watcher_test.conf" );
+
+    // Verify
+    STRCMP_EQUAL( "log_config_watcher_test.conf", watcher.get_path().c_str() );
+    CHECK_EQUAL( 1, watcher.get_applied_count() );
+    STRCMP_EQUAL( "", watcher.get_last_error().c_str() );
+    CHECK_EQUAL( LOG_PRIORITY_WARN, ext::log::get_priority_limit() );
+}
+
+/*
+ * Check that the configuration is applied when the file is created, written or replaced.
+ */
+TEST( log_config_watcher, Changes )
+{
+    // Prepare
+    std::shared_ptr<TestLogSink> sink = std::make_shared<TestLogSink>();
+    ext::log_config::sink_map sinks;
+    sinks["test"] = sink;
+    ext::log_config_watcher watcher( "./log_config_watcher_test.conf", sinks );
+
+    // Exercise
+    write_file( "log_config_watcher_test.conf", "priority = INFO\n[categories]\nTEST_CAT = DEBUG\n[sinks]\ntest = ERROR\n" );
+
+    // Verify
+    CHECK_TRUE( wait_for( [&]() { return watcher.get_applied_count() == 1; } ) );
+    CHECK_EQUAL( LOG_PRIORITY_INFO, ext::log::get_priority_limit() );
+    CHECK_EQUAL( LOG_PRIORITY_DEBUG, ext::log::get_category_priority_limit( "TEST_CAT" ) );
+    CHECK_EQUAL( LOG_PRIORITY_ERROR, sink->get_priority_limit() );
+
+    // Exercise
+    write_file( "log_config_watcher_test.conf.new", "priority = INFO\n" );
+    CHECK_EQUAL( 0, rename( "log_config_watcher_test.conf.new", "log_config_watcher_test.conf" ) );
+
+    // Verify
+    CHECK_TRUE( wait_for( [&]() { return watcher.get_applied_count() == 2; } ) );
+    CHECK_EQUAL( LOG_PRIORITY_INFO, ext::log::get_category_priority_limit( "TEST_CAT" ) );
+}
+
+/*
+ * Check that an invalid configuration is not applied at all.
+ */
+TEST( log_config_watcher, InvalidConfiguration )
+{
+    // Prepare
+    write_file( "log_config_watcher_test.conf", "priority = WARN\n" );
+    ext::log_config_watcher watcher( "log_config_watcher_test.conf" );
+
+    // Exercise
+    write_file( "log_config_watcher_test.conf", "priority = DEBUG\n[categories]\nTEST_CAT = VERBOSE\n" );
+
+    // Verify
+    CHECK_TRUE( wait_for( [&]() { return !watcher.get_last_error().empty(); } ) );
+    STRCMP_EQUAL( "Invalid log configuration (line 3): invalid priority 'VERBOSE'", watcher.get_last_error().c_str() );
+    CHECK_EQUAL( 1, watcher.get_applied_count() );
+    CHECK_EQUAL( LOG_PRIORITY_WARN, ext::log::get_priority_limit() );
+
+    // Exercise
+    write_file( "log_config_watcher_test.conf", "priority = DEBUG\n" );
+
+    // Verify
+    CHECK_TRUE( wait_for( [&]() { return watcher.get_applied_count() == 2; } ) );
+    STRCMP_EQUAL( "", watcher.get_last_error().c_str() );
+    CHECK_EQUAL( LOG_PRIORITY_DEBUG, ext::log::get_priority_limit() );
+}
+
+/*
+ * Check that an error is thrown when the directory of the file can't be watched.
+ */
+TEST( log_config_watcher, Error )
+{
+    // Exercise
+    bool thrown = false;
+    try
+    {
+        ext::log_config_watcher watcher( "non_existent_dir/log_config_watcher_test.conf" );
+    }
+    catch( ext::runtime_error &e )
+    {
+        thrown = true;
+        STRCMP_EQUAL( "Error watching log configuration file 'non_existent_dir/log_config_watcher_test.conf'", e.what() );
+    }
+
+    // Verify
+    CHECK_TRUE( thrown );
+}
@@ -0,0 +1,239 @@
+/**
+ * @file
+ * @brief      unit tests for the "log_crash_handler" class
+ * @project    ExtendedLib
+ * @authors    Jesus Gonzalez <jgonzalez@gdr-sistemas.com>
+ * @copyright  Copyright (c) Jesus Gonzalez. All rights reserved.
+ * @license    See LICENSE.txt
+ */
+
+/*===========================================================================
+ *                              INCLUDES
+ *===========================================================================*/
+
+#include "Extended/log_crash_handler.hpp"
+#include "Extended/log_file_sink.hpp"
+#include "file_helpers.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <thread>
+
+#include <CppUTest/TestHarness.h>
+#include <CppUTestExt/MockSupport.h>
+
+/*===========================================================================
+ *                      COMMON TEST DEFINES & MACROS
+ *===========================================================================*/
+
+/**
+ * Runs a function that crashes in a child process with the crash handler installed.
+ *
+ * @param[in] crash Function executed by the child process
+ * @param[out] report Crash report written by the handler
+ * @return Number of the signal that terminated the child process (0 if it wasn't terminated by a signal)
+ */
+static int run_crashing_child( void (*crash)(), std::string& report )
+{
+    int fds[2];
+    if( pipe( fds ) != 0 )
+    {
+        return 0;
+    }
+
+    pid_t pid = fork();
+    if( pid == 0 )
+    {
+        close( fds[0] );
+
+        ext::log_crash_handler::options opts;
+        opts.fd = fds[1];
+        ext::log_crash_handler::install( opts );
+
+        crash();
+
+        _exit( 1 );
+    }
+
+    close( fds[1] );
+
+    char buffer[1024];
+    ssize_t size;
+    while( ( size = read( fds[0], buffer, sizeof( buffer ) ) ) > 0 )
+    {
+        report.append( buffer, size );
+    }
+    close( fds[0] );
+
+    int status = 0;
+    waitpid( pid, &status, 0 );
+
+    return WIFSIGNALED( status ) ? WTERMSIG( status ) : 0;
+}
+
+static void crash_null_pointer()
+{
+    volatile int* pointer = NULL;
+    *pointer = 1;
+}
+
+static int recurse( int depth )
+{
+    volatile char frame[1024];
+    frame[0] = (char) depth;
+    if( depth < 0 )
+    {
+        return 0;
+    }
+    return recurse( depth + 1 ) + frame[0];
+}
+
+static void crash_stack_overflow()
+{
+    recurse( 0 );
+}
+
+static void crash_with_buffered_messages()
+{
+    ext::file_log_sink::options opts;
+    opts.flush_interval_ms = 0;
+    ext::log::set_log_handler( std::make_shared<ext::file_log_sink>( "log_crash_handler_test.log", opts ) );
+
+    ext::log::log_message( LOG_PRIORITY_INFO, NULL, "TEST_FUNC", "TEST_MSG %d", 1 );
+
+    abort();
+}
+
+static void crash_with_queued_messages()
+{
+    ext::file_log_sink::options opts;
+    opts.flush_interval_ms = 0;
+    ext::log::set_log_handler( std::make_shared<ext::file_log_sink>( "log_crash_handler_test.log", opts ) );
+    ext::log::enable_async_mode( 1024, ext::log::OVERFLOW_BLOCK );
+
+    for( int i = 0; i < 100; i++ )
+    {
+        ext::log::log_message( LOG_PRIORITY_INFO, NULL, "TEST_FUNC", "TEST_MSG %d", i );
+    }
+
+    abort();
+}
+
+/*===========================================================================
+ *                          TEST GROUP DEFINITION
+ *===========================================================================*/
+
+TEST_GROUP( log_crash_handler )
+{
+    TEST_SETUP()
+    {
+        remove( "log_crash_handler_test.log" );
+    }
+
+    TEST_TEARDOWN()
+    {
+        remove( "log_crash_handler_test.log" );
+    }
+};
+
+/*===========================================================================
+ *                    TEST CASES IMPLEMENTATION
+ *===========================================================================*/
+
+/*
+ * Check that the handler is installed for the fatal signals to run on an alternate stack, and uninstalled.
+ */
+TEST( log_crash_handler, InstallUninstall )
+{
+    // Exercise
+    ext::log_crash_handler::install();
+
+    // Verify
+    CHECK_TRUE( ext::log_crash_handler::is_installed() );
+    struct sigaction action;
+    sigaction( SIGSEGV, NULL, &action );
+    CHECK_EQUAL( SA_SIGINFO | SA_ONSTACK, action.sa_flags & ( SA_SIGINFO | SA_ONSTACK ) );
+    stack_t ss;
+    sigaltstack( NULL, &ss );
+    CHECK_EQUAL( 0, ss.ss_flags & SS_DISABLE );
+
+    // Exercise
+    std::thread thread( []() { ext::log_crash_handler::prepare_thread(); } );
+    thread.join();
+    ext::log_crash_handler::uninstall();
+
+    // Verify
+    CHECK_FALSE( ext::log_crash_handler::is_installed() );
+    sigaction( SIGSEGV, NULL, &action );
+    POINTERS_EQUAL( (void*) SIG_DFL, (void*) action.sa_handler );
+}
+
+/*
+ * Check that a crash is reported and the process is terminated by the signal.
+ */
+TEST( log_crash_handler, Report )
+{
+    // Exercise
+    std::string report;
+    int sig = run_crashing_child( crash_null_pointer, report );
+
+    // Verify
+    CHECK_EQUAL( SIGSEGV, sig );
+    STRCMP_CONTAINS( "*** Fatal signal 11 (SIGSEGV), code 1, address 0x0, pid ", report.c_str() );
+    STRCMP_CONTAINS( "\nBacktrace:\n[0]: 0x", report.c_str() );
+    STRCMP_CONTAINS( "\nExecutable mappings:\n", report.c_str() );
+    STRCMP_CONTAINS( " r-xp ", report.c_str() );
+    STRCMP_CONTAINS( "\n*** End of crash report ***\n", report.c_str() );
+}
+
+/*
+ * Check that a stack overflow is reported (the handler runs on the alternate stack).
+ */
+TEST( log_crash_handler, StackOverflow )
+{
+    // Exercise
+    std::string report;
+    int sig = run_crashing_child( crash_stack_overflow, report );
+
+    // Verify
+    CHECK_EQUAL( SIGSEGV, sig );
+    STRCMP_CONTAINS( "*** Fatal signal 11 (SIGSEGV)", report.c_str() );
+    STRCMP_CONTAINS( "\n*** End of crash report ***\n", report.c_str() );
+}
+
+/*
+ * Check that the messages buffered by a file sink are written to the file.
+ */
+TEST( log_crash_handler, FlushFileSink )
+{
+    // Exercise
+    std::string report;
+    int sig = run_crashing_child( crash_with_buffered_messages, report );
+
+    // Verify
+    CHECK_EQUAL( SIGABRT, sig );
+    STRCMP_CONTAINS( "*** Fatal signal 6 (SIGABRT), pid ", report.c_str() );
+    STRCMP_EQUAL( expected_line( "[INFO]", "TEST_MSG 1" ).c_str(), read_file( "log_crash_handler_test.log" ).c_str() );
+}
+
+/*
+ * Check that the messages queued in asynchronous mode are processed before the buffers are written.
+ */
+TEST( log_crash_handler, FlushAsyncMode )
+{
+    // Exercise
+    std::string report;
+    int sig = run_crashing_child( crash_with_queued_messages, report );
+
+    // Verify
+    CHECK_EQUAL( SIGABRT, sig );
+    std::string expected;
+    for( int i = 0; i < 100; i++ )
+    {
+        expected += expected_line( "[INFO]", ( "TEST_MSG " + std::to_string( i ) ).c_str() );
+    }
+    STRCMP_EQUAL( expected.c_str(), read_file( "log_crash_handler_test.log" ).c_str() );
+}
@@ -0,0 +1,74 @@
+/**
+ * @file
+ * @brief      unit tests for the initial state of the logging module
+ * @project    ExtendedLib
+ * @authors    Jesus Gonzalez <jgonzalez@gdr-sistemas.com>
+ * @copyright  Copyright (c) Jesus Gonzalez. All rights reserved.
+ * @license    See LICENSE.txt
+ */
+
+/*===========================================================================
+ *                              INCLUDES
+ *===========================================================================*/
+
+#include "Extended/log.hpp"
+
+#include <string>
+#include <vector>
+
+#include <CppUTest/TestHarness.h>
+#include <CppUTestExt/MockSupport.h>
+
+/*===========================================================================
+ *                      COMMON TEST DEFINES & MACROS
+ *===========================================================================*/
+
+class TestLogHandler : public ext::log_handler
+{
+public:
+    virtual bool process( int prio, const char* category, const char* function, const char* msg )
+    {
+        m_msgs.push_back( ( category == NULL ) ? msg : "<CATEGORIZED>" );
+        return false;
+    }
+
+    std::vector<std::string> m_msgs;
+};
+
+/*===========================================================================
+ *                          TEST GROUP DEFINITION
+ *===========================================================================*/
+
+// The tests of this module must not change the priority limits, so that they check those of a fresh process
+TEST_GROUP( log_defaults )
+{
+};
+
+/*===========================================================================
+ *                    TEST CASES IMPLEMENTATION
+ *===========================================================================*/
+
+/*
+ * Check that messages without category are logged at the default priority limit before any limit is set.
+ */
+TEST( log_defaults, UncategorizedMessages )
+{
+    // Prepare
+    std::shared_ptr<TestLogHandler> testLogHandler = std::make_shared<TestLogHandler>();
+    ext::log::set_log_handler( testLogHandler );
+
+    // Exercise
+    LOG_DEBUG( "TEST_MSG %d", 1 );
+    ext::log::log_message( LOG_PRIORITY_DEBUG, NULL, "TEST_FUNC", "TEST_MSG %d", 2 );
+
+    // Verify
+    CHECK_EQUAL( LOG_PRIORITY_ALLOC, ext::log::get_priority_limit() );
+    CHECK_EQUAL( LOG_PRIORITY_ALLOC, ext::log::get_category_priority_limit( NULL ) );
+    CHECK_EQUAL( 2, testLogHandler->m_msgs.size() );
+    STRCMP_EQUAL( "TEST_MSG 1", testLogHandler->m_msgs[0].c_str() );
+    STRCMP_EQUAL( "TEST_MSG 2", testLogHandler->m_msgs[1].c_str() );
+
+    // Cleanup
+    ext::log::set_log_handler( NULL );
+    testLogHandler.reset();
+}
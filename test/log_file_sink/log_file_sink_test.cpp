@@ -0,0 +1,311 @@
+/**
+ * @file
+ * @brief      unit tests for the "file_log_sink" class
+ * @project    ExtendedLib
+ * @authors    Jesus Gonzalez <jgonzalez@gdr-sistemas.com>
+ * @copyright  Copyright (c) Jesus Gonzalez. All rights reserved.
+ * @license    See LICENSE.txt
+ */
+
+/*===========================================================================
+ *                              INCLUDES
+ *===========================================================================*/
+
+#include "Extended/log_file_sink.hpp"
+#include "Extended/runtime_error.hpp"
+#include "file_helpers.hpp"
+#include "pipeline_fixture.hpp"
+
+#include <stdio.h>
+#include <thread>
+#include <chrono>
+#ifndef WIN32
+    #include <unistd.h>
+    #include <sys/stat.h>
+#endif
+
+#include <CppUTest/TestHarness.h>
+#include <CppUTestExt/MockSupport.h>
+
+/*===========================================================================
+ *                      COMMON TEST DEFINES & MACROS
+ *===========================================================================*/
+
+/*===========================================================================
+ *                          TEST GROUP DEFINITION
+ *===========================================================================*/
+
+TEST_GROUP_BASE( log_file_sink, pipeline_fixture )
+{
+    TEST_SETUP()
+    {
+        remove( "log_file_sink_test.log" );
+        remove( "log_file_sink_test.log.1" );
+        remove( "log_file_sink_test.log.2" );
+
+        pipeline_fixture::setup();
+    }
+
+    TEST_TEARDOWN()
+    {
+        pipeline_fixture::teardown();
+
+        remove( "log_file_sink_test.log" );
+        remove( "log_file_sink_test.log.1" );
+        remove( "log_file_sink_test.log.2" );
+    }
+};
+
+/*===========================================================================
+ *                    TEST CASES IMPLEMENTATION
+ *===========================================================================*/
+
+/*
+ * Check that messages are kept in the buffer until flushed, and then written to the file.
+ */
+TEST( log_file_sink, BufferedWrite )
+{
+    // Prepare
+    ext::file_log_sink::options opts;
+    opts.flush_interval_ms = 0;
+    std::shared_ptr<ext::file_log_sink> sink = std::make_shared<ext::file_log_sink>( "log_file_sink_test.log", opts );
+    pipeline->add_sink( sink );
+
+    // Exercise
+    ext::log::log_message( LOG_PRIORITY_WARN, "TEST_CAT", "TEST_FUNC", "TEST_MSG %d", 1 );
+    ext::log::log_message( LOG_PRIORITY_INFO, NULL, "TEST_FUNC", "TEST_MSG %d", 2 );
+
+    // Verify
+    mock().checkExpectations();
+    STRCMP_EQUAL( "", read_file( "log_file_sink_test.log" ).c_str() );
+    STRCMP_EQUAL( "log_file_sink_test.log", sink->get_path().c_str() );
+
+    // Exercise
+    sink->flush();
+
+    // Verify
+    STRCMP_EQUAL( "[WARN] {ExtendedLib.Test.log_file_sink.exe:TEST_CAT} <TEST_FUNC> TEST_MSG 1\n"
+                  "[INFO] {ExtendedLib.Test.log_file_sink.exe} <TEST_FUNC> TEST_MSG 2\n",
+                  read_file( "log_file_sink_test.log" ).c_str() );
+
+    // Cleanup
+    pipeline->clear_sinks();
+}
+
+/*
+ * Check that messages with a priority at or below the flush priority are written immediately.
+ */
+TEST( log_file_sink, FlushPriority )
+{
+    // Prepare
+    ext::file_log_sink::options opts;
+    opts.flush_interval_ms = 0;
+    opts.flush_priority = LOG_PRIORITY_ERROR;
+    std::shared_ptr<ext::file_log_sink> sink = std::make_shared<ext::file_log_sink>( "log_file_sink_test.log", opts );
+    pipeline->add_sink( sink );
+
+    // Exercise
+    ext::log::log_message( LOG_PRIORITY_WARN, "TEST_CAT", "TEST_FUNC", "TEST_MSG1" );
+    ext::log::log_message( LOG_PRIORITY_ERROR, "TEST_CAT", "TEST_FUNC", "TEST_MSG2" );
+
+    // Verify
+    std::string contents;
+    for( int i = 0; ( i < 500 ) && contents.empty(); i++ )
+    {
+        std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+        contents = read_file( "log_file_sink_test.log" );
+    }
+    STRCMP_EQUAL( "[WARN] {ExtendedLib.Test.log_file_sink.exe:TEST_CAT} <TEST_FUNC> TEST_MSG1\n"
+                  "[ERROR] {ExtendedLib.Test.log_file_sink.exe:TEST_CAT} <TEST_FUNC> TEST_MSG2\n",
+                  contents.c_str() );
+
+    // Cleanup
+    pipeline->clear_sinks();
+}
+
+/*
+ * Check that the file is rotated when it exceeds the maximum size.
+ */
+TEST( log_file_sink, RotationBySize )
+{
+    // Prepare
+    ext::file_log_sink::options opts;
+    opts.flush_interval_ms = 0;
+    opts.max_file_size = 100;
+    opts.max_backup_files = 1;
+    std::shared_ptr<ext::file_log_sink> sink = std::make_shared<ext::file_log_sink>( "log_file_sink_test.log", opts );
+    pipeline->add_sink( sink );
+
+    // Exercise
+    for( int i = 1; i <= 3; i++ )
+    {
+        ext::log::log_message( LOG_PRIORITY_INFO, NULL, "TEST_FUNC", "TEST_MSG %d ..............................", i );
+        sink->flush();
+    }
+
+    // Verify
+    STRCMP_EQUAL( "[INFO] {ExtendedLib.Test.log_file_sink.exe} <TEST_FUNC> TEST_MSG 3 ..............................\n",
+                  read_file( "log_file_sink_test.log" ).c_str() );
+    STRCMP_EQUAL( "[INFO] {ExtendedLib.Test.log_file_sink.exe} <TEST_FUNC> TEST_MSG 2 ..............................\n",
+                  read_file( "log_file_sink_test.log.1" ).c_str() );
+    STRCMP_EQUAL( "", read_file( "log_file_sink_test.log.2" ).c_str() );
+
+    // Cleanup
+    pipeline->clear_sinks();
+}
+
+#ifndef WIN32
+/*
+ * Check that messages are discarded while the file can't be reopened after a rotation, and that reopening it
+ * is retried (files can't be removed while they are open on Windows).
+ */
+TEST( log_file_sink, RotationError )
+{
+    // Prepare
+    ext::file_log_sink::options opts;
+    opts.flush_interval_ms = 0;
+    opts.max_file_size = 100;
+    opts.max_backup_files = 0;
+    std::shared_ptr<ext::file_log_sink> sink = std::make_shared<ext::file_log_sink>( "log_file_sink_test.log", opts );
+    pipeline->add_sink( sink );
+    ext::log::log_message( LOG_PRIORITY_INFO, NULL, "TEST_FUNC", "TEST_MSG 1 ..............................." );
+    sink->flush();
+    remove( "log_file_sink_test.log" );
+    mkdir( "log_file_sink_test.log", 0755 );
+
+    // Exercise
+    ext::log::log_message( LOG_PRIORITY_INFO, NULL, "TEST_FUNC", "TEST_MSG 2 ..............................." );
+    sink->flush();
+
+    // Verify
+    CHECK_EQUAL( expected_line( "[INFO]", "TEST_MSG 2 ..............................." ).size(),
+                 sink->get_dropped_bytes() );
+
+    // Exercise
+    rmdir( "log_file_sink_test.log" );
+    ext::log::log_message( LOG_PRIORITY_INFO, NULL, "TEST_FUNC", "TEST_MSG 3 ..............................." );
+    sink->flush();
+
+    // Verify
+    STRCMP_EQUAL( expected_line( "[INFO]", "TEST_MSG 3 ..............................." ).c_str(),
+                  read_file( "log_file_sink_test.log" ).c_str() );
+    CHECK_EQUAL( expected_line( "[INFO]", "TEST_MSG 2 ..............................." ).size(),
+                 sink->get_dropped_bytes() );
+
+    // Cleanup
+    pipeline->clear_sinks();
+}
+#endif
+
+/*
+ * Check that pending messages are written when the sink is destroyed, and that messages from the
+ * asynchronous writer thread are received.
+ */
+TEST( log_file_sink, AsyncModeAndDestruction )
+{
+    // Prepare
+    std::shared_ptr<ext::file_log_sink> sink = std::make_shared<ext::file_log_sink>( "log_file_sink_test.log" );
+    pipeline->add_sink( sink );
+    ext::log::enable_async_mode( 64, ext::log::OVERFLOW_BLOCK );
+
+    // Exercise
+    for( int i = 0; i < 100; i++ )
+    {
+        ext::log::log_message( LOG_PRIORITY_INFO, NULL, "TEST_FUNC", "TEST_MSG" );
+    }
+    ext::log::disable_async_mode();
+    pipeline->clear_sinks();
+    sink.reset();
+
+    // Verify
+    std::string expected;
+    for( int i = 0; i < 100; i++ )
+    {
+        expected += "[INFO] {ExtendedLib.Test.log_file_sink.exe} <TEST_FUNC> TEST_MSG\n";
+    }
+    STRCMP_EQUAL( expected.c_str(), read_file( "log_file_sink_test.log" ).c_str() );
+}
+
+/*
+ * Check that an error is thrown when the file can't be opened.
+ */
+TEST( log_file_sink, Error )
+{
+    // Prepare
+    ext::log::set_log_handler( NULL );
+
+    mock().expectOneCall( "::OutputDebugString" ).withParameter( "lpOutputString",
+            "[ERROR] {ExtendedLib.Test.log_file_sink.exe:ExtendedLib} <ext::file_log_sink::file_log_sink> Error opening log file 'non_existent_dir/log_file_sink_test.log'\n" );
+
+    // Exercise
+    try
+    {
+        ext::file_log_sink sink( "non_existent_dir/log_file_sink_test.log" );
+        FAIL( "Should have thrown an exception" );
+    }
+    catch( ext::runtime_error &e )
+    {
+        e.log();
+    }
+
+    // Verify
+    mock().checkExpectations();
+
+    // Cleanup
+}
+
+/*
+ * Check that messages are written as JSON objects, with the fields of structured messages as members.
+ */
+TEST( log_file_sink, JsonLines )
+{
+    // Prepare
+    ext::file_log_sink::options opts;
+    opts.flush_interval_ms = 0;
+    opts.format = ext::file_log_sink::FORMAT_JSON;
+    std::shared_ptr<ext::file_log_sink> sink = std::make_shared<ext::file_log_sink>( "log_file_sink_test.log", opts );
+    pipeline->add_sink( sink );
+
+    // Exercise
+    ext::log::log_message( LOG_PRIORITY_WARN, "TEST_CAT", "TEST_FUNC", "TEST_MSG \"%d\"", 1 );
+    LOG_WARN_KV( "TEST_MSG 2", "fd", 3, "ratio", 0.5, "peer", "a\tb", "ok", false );
+    sink->flush();
+
+    // Verify
+    STRCMP_EQUAL( "{\"level\":\"WARN\",\"program\":\"ExtendedLib.Test.log_file_sink.exe\",\"category\":\"TEST_CAT\","
+                  "\"function\":\"TEST_FUNC\",\"msg\":\"TEST_MSG \\\"1\\\"\"}\n"
+                  "{\"level\":\"WARN\",\"program\":\"ExtendedLib.Test.log_file_sink.exe\","
+                  "\"function\":\"TEST_log_file_sink_JsonLines_Test::testBody\",\"msg\":\"TEST_MSG 2\","
+                  "\"fd\":3,\"ratio\":0.5,\"peer\":\"a\\tb\",\"ok\":false}\n",
+                  read_file( "log_file_sink_test.log" ).c_str() );
+
+    // Cleanup
+    pipeline->clear_sinks();
+}
+
+/*
+ * Check that messages are written in logfmt format, with the fields of structured messages as additional keys.
+ */
+TEST( log_file_sink, LogfmtLines )
+{
+    // Prepare
+    ext::file_log_sink::options opts;
+    opts.flush_interval_ms = 0;
+    opts.format = ext::file_log_sink::FORMAT_LOGFMT;
+    std::shared_ptr<ext::file_log_sink> sink = std::make_shared<ext::file_log_sink>( "log_file_sink_test.log", opts );
+    pipeline->add_sink( sink );
+
+    // Exercise
+    ext::log::log_message( LOG_PRIORITY_WARN, "TEST_CAT", "TEST_FUNC", "TEST_MSG" );
+    LOG_WARN_KV( "TEST_MSG 2", "fd", 3, "peer", "a b" );
+    sink->flush();
+
+    // Verify
+    STRCMP_EQUAL( "level=WARN program=ExtendedLib.Test.log_file_sink.exe category=TEST_CAT function=TEST_FUNC msg=TEST_MSG\n"
+                  "level=WARN program=ExtendedLib.Test.log_file_sink.exe function=TEST_log_file_sink_LogfmtLines_Test::testBody "
+                  "msg=\"TEST_MSG 2\" fd=3 peer=\"a b\"\n",
+                  read_file( "log_file_sink_test.log" ).c_str() );
+
+    // Cleanup
+    pipeline->clear_sinks();
+}
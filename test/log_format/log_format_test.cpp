@@ -0,0 +1,183 @@
+/**
+ * @file
+ * @brief      unit tests for the deferred formatting of log messages
+ * @project    ExtendedLib
+ * @authors    Jesus Gonzalez <jgonzalez@gdr-sistemas.com>
+ * @copyright  Copyright (c) Jesus Gonzalez. All rights reserved.
+ * @license    See LICENSE.txt
+ */
+
+/*===========================================================================
+ *                              INCLUDES
+ *===========================================================================*/
+
+#include "log_format.hpp"
+
+#include <stdio.h>
+#include <stdarg.h>
+
+#include <CppUTest/TestHarness.h>
+#include <CppUTestExt/MockSupport.h>
+
+using namespace ext::log_internal;
+
+/*===========================================================================
+ *                      COMMON TEST DEFINES & MACROS
+ *===========================================================================*/
+
+static bool capture( std::string& captured, const char* format, ... )
+{
+    va_list args;
+    va_start( args, format );
+    bool ret = capture_format_args( format, args, captured );
+    va_end( args );
+    return ret;
+}
+
+static void check_deferred( const char* format, ... )
+{
+    char expected[4096];
+    std::string captured;
+    std::string rendered;
+    std::string planRendered;
+    std::string planCaptured;
+    format_plan plan( format );
+    va_list args;
+
+    va_start( args, format );
+    va_list argsCopy;
+    va_copy( argsCopy, args );
+    vsnprintf( expected, sizeof( expected ), format, argsCopy );
+    va_end( argsCopy );
+    bool ret = capture_format_args( format, args, captured );
+    plan.render( args, planRendered );
+    va_end( args );
+
+    CHECK_TRUE( ret );
+
+    render_format_args( format, captured.data(), captured.size(), rendered );
+    plan.render_captured( captured.data(), captured.size(), planCaptured );
+
+    STRCMP_EQUAL( expected, rendered.c_str() );
+    STRCMP_EQUAL( expected, planRendered.c_str() );
+    STRCMP_EQUAL( expected, planCaptured.c_str() );
+}
+
+static std::string render_plan( const format_plan& plan, ... )
+{
+    std::string rendered;
+    va_list args;
+    va_start( args, plan );
+    plan.render( args, rendered );
+    va_end( args );
+    return rendered;
+}
+
+/*===========================================================================
+ *                          TEST GROUP DEFINITION
+ *===========================================================================*/
+
+TEST_GROUP( log_format )
+{
+};
+
+/*===========================================================================
+ *                    TEST CASES IMPLEMENTATION
+ *===========================================================================*/
+
+/*
+ * Check that integer arguments are rendered as by printf
+ */
+TEST( log_format, Integers )
+{
+    check_deferred( "TEST %d %i %5d %-5d| %05d %+d", 1, -2, 3, 4, 5, 6 );
+    check_deferred( "TEST %hhd %hhu %hd %hu", 300, 300, 70000, 70000 );
+    check_deferred( "TEST %ld %lu %lld %llu %zu", -1L, 2UL, -3LL, 4ULL, (size_t) 5 );
+    check_deferred( "TEST %x %X %#x %o %#o", 255u, 255u, 255u, 8u, 8u );
+}
+
+/*
+ * Check that floating point arguments are rendered as by printf
+ */
+TEST( log_format, FloatingPoint )
+{
+    check_deferred( "TEST %f %.2f %e %g %G %10.3f", 3.14159, 2.5, 1e10, 0.0001, 1e-10, -2.25 );
+}
+
+/*
+ * Check that strings, characters and pointers are rendered as by printf
+ */
+TEST( log_format, StringsCharactersPointers )
+{
+    char notTerminated[3] = { 'a', 'b', 'c' };
+    std::string large( 3000, 'x' );
+
+    check_deferred( "TEST %s|%10s|%-10s|%.2s|%.*s", "str", "r", "l", "abcdef", 3, notTerminated );
+    check_deferred( "TEST %c%c%c 100%%", 'a', 'b', 'c' );
+    check_deferred( "TEST %p", (void*) 0x1234 );
+    check_deferred( "TEST [%s]", large.c_str() );
+}
+
+/*
+ * Check that width and precision given as arguments are rendered as by printf
+ */
+TEST( log_format, StarArguments )
+{
+    check_deferred( "TEST %*.*f|%-*d|%*d", 10, 2, 3.14159, 4, 7, 6, 42 );
+}
+
+/*
+ * Check that formats that can't be deferred are rejected
+ */
+TEST( log_format, Unsupported )
+{
+    std::string captured;
+
+    CHECK_FALSE( capture( captured, "TEST %n", (int*) NULL ) );
+    CHECK_FALSE( capture( captured, "TEST %1$d", 1 ) );
+}
+
+/*
+ * Check that conversions without captured data are rendered as a placeholder
+ */
+TEST( log_format, Truncated )
+{
+    std::string captured;
+    std::string rendered;
+
+    CHECK_TRUE( capture( captured, "%d", 1 ) );
+
+    // Exercise
+    render_format_args( "TEST %d %s", captured.data(), captured.size(), rendered );
+
+    // Verify
+    STRCMP_EQUAL( "TEST 1 <?>", rendered.c_str() );
+}
+
+/*
+ * Check that format plans render formats with extreme values and without conversions as by printf
+ */
+TEST( log_format, Plan_DirectConversions )
+{
+    check_deferred( "TEST" );
+    check_deferred( "" );
+    check_deferred( "%d%i%u%x%X", -2147483647 - 1, 0, 4294967295u, 0u, 0xABCDEFu );
+    check_deferred( "%lld %llu %llx %zu", -9223372036854775807LL - 1, 18446744073709551615ULL, 0x123456789ABCDEFULL, (size_t) 0 );
+    check_deferred( "%s|%s|%s", "", (const char*) NULL, "end" );
+}
+
+/*
+ * Check that format plans render formats that can't be deferred, using the variable arguments list
+ */
+TEST( log_format, Plan_Unsupported )
+{
+    // Prepare
+    format_plan plan( "TEST %2$s %1$d" );
+
+    // Exercise
+    std::string rendered = render_plan( plan, 7, "str" );
+
+    // Verify
+    STRCMP_EQUAL( "TEST str 7", rendered.c_str() );
+    STRCMP_EQUAL( "TEST %2$s %1$d", plan.format() );
+}
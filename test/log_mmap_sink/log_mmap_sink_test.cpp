@@ -0,0 +1,245 @@
+/**
+ * @file
+ * @brief      unit tests for the "mmap_log_sink" class
+ * @project    ExtendedLib
+ * @authors    Jesus Gonzalez <jgonzalez@gdr-sistemas.com>
+ * @copyright  Copyright (c) Jesus Gonzalez. All rights reserved.
+ * @license    See LICENSE.txt
+ */
+
+/*===========================================================================
+ *                              INCLUDES
+ *===========================================================================*/
+
+#include "Extended/log_mmap_sink.hpp"
+#include "Extended/runtime_error.hpp"
+#include "file_helpers.hpp"
+#include "pipeline_fixture.hpp"
+
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <CppUTest/TestHarness.h>
+#include <CppUTestExt/MockSupport.h>
+
+/*===========================================================================
+ *                      COMMON TEST DEFINES & MACROS
+ *===========================================================================*/
+
+/*===========================================================================
+ *                          TEST GROUP DEFINITION
+ *===========================================================================*/
+
+TEST_GROUP_BASE( log_mmap_sink, pipeline_fixture )
+{
+    TEST_SETUP()
+    {
+        remove( "log_mmap_sink_test.log" );
+        remove( "log_mmap_sink_test.log.1" );
+        remove( "log_mmap_sink_test.log.2" );
+
+        pipeline_fixture::setup();
+    }
+
+    TEST_TEARDOWN()
+    {
+        pipeline_fixture::teardown();
+
+        remove( "log_mmap_sink_test.log" );
+        remove( "log_mmap_sink_test.log.1" );
+        remove( "log_mmap_sink_test.log.2" );
+    }
+};
+
+/*===========================================================================
+ *                    TEST CASES IMPLEMENTATION
+ *===========================================================================*/
+
+/*
+ * Check that messages are written to the mapped file, which is truncated to the used size when closed.
+ */
+TEST( log_mmap_sink, Write )
+{
+    // Prepare
+    std::shared_ptr<ext::mmap_log_sink> sink = std::make_shared<ext::mmap_log_sink>( "log_mmap_sink_test.log" );
+    pipeline->add_sink( sink );
+
+    // Exercise
+    ext::log::log_message( LOG_PRIORITY_WARN, NULL, "TEST_FUNC", "TEST_MSG %d", 1 );
+    ext::log::log_message( LOG_PRIORITY_INFO, NULL, "TEST_FUNC", "TEST_MSG %d", 2 );
+
+    // Verify
+    STRCMP_EQUAL( "log_mmap_sink_test.log", sink->get_path().c_str() );
+    CHECK_EQUAL( 0, sink->get_dropped_count() );
+
+    // Exercise
+    pipeline->clear_sinks();
+    sink.reset();
+
+    // Verify
+    std::string expected = expected_line( "[WARN]", "TEST_MSG 1" ) + expected_line( "[INFO]", "TEST_MSG 2" );
+    STRCMP_EQUAL( expected.c_str(), read_file( "log_mmap_sink_test.log" ).c_str() );
+}
+
+/*
+ * Check that a new segment is created when the current one is full.
+ */
+TEST( log_mmap_sink, Roll )
+{
+    // Prepare
+    std::string line = expected_line( "[INFO]", "TEST_MSG" );
+    ext::mmap_log_sink::options opts;
+    opts.segment_size = line.size() * 2;
+    opts.max_backup_files = 1;
+    std::shared_ptr<ext::mmap_log_sink> sink = std::make_shared<ext::mmap_log_sink>( "log_mmap_sink_test.log", opts );
+    pipeline->add_sink( sink );
+
+    // Exercise
+    for( int i = 0; i < 3; i++ )
+    {
+        ext::log::log_message( LOG_PRIORITY_INFO, NULL, "TEST_FUNC", "TEST_MSG" );
+    }
+    pipeline->clear_sinks();
+    sink.reset();
+
+    // Verify
+    STRCMP_EQUAL( ( line + line ).c_str(), read_file( "log_mmap_sink_test.log.1" ).c_str() );
+    STRCMP_EQUAL( line.c_str(), read_file( "log_mmap_sink_test.log" ).c_str() );
+}
+
+/*
+ * Check that messages are discarded while a new segment can't be created, and that the creation is retried.
+ */
+TEST( log_mmap_sink, RollError )
+{
+    // Prepare
+    std::string line = expected_line( "[INFO]", "TEST_MSG" );
+    ext::mmap_log_sink::options opts;
+    opts.segment_size = line.size();
+    mkdir( "log_mmap_sink_test_dir", 0755 );
+    std::shared_ptr<ext::mmap_log_sink> sink =
+        std::make_shared<ext::mmap_log_sink>( "log_mmap_sink_test_dir/log_mmap_sink_test.log", opts );
+    pipeline->add_sink( sink );
+    ext::log::log_message( LOG_PRIORITY_INFO, NULL, "TEST_FUNC", "TEST_MSG" );
+    rename( "log_mmap_sink_test_dir", "log_mmap_sink_test_dir.old" );
+
+    // Exercise
+    ext::log::log_message( LOG_PRIORITY_INFO, NULL, "TEST_FUNC", "TEST_MSG" );
+    ext::log::log_message( LOG_PRIORITY_INFO, NULL, "TEST_FUNC", "TEST_MSG" );
+
+    // Verify
+    CHECK_EQUAL( 2, sink->get_dropped_count() );
+
+    // Exercise
+    mkdir( "log_mmap_sink_test_dir", 0755 );
+    ext::log::log_message( LOG_PRIORITY_INFO, NULL, "TEST_FUNC", "TEST_MSG" );
+    pipeline->clear_sinks();
+
+    // Verify
+    CHECK_EQUAL( 2, sink->get_dropped_count() );
+
+    // Exercise
+    sink.reset();
+
+    // Verify
+    STRCMP_EQUAL( line.c_str(), read_file( "log_mmap_sink_test_dir.old/log_mmap_sink_test.log" ).c_str() );
+    STRCMP_EQUAL( line.c_str(), read_file( "log_mmap_sink_test_dir/log_mmap_sink_test.log" ).c_str() );
+
+    // Cleanup
+    remove( "log_mmap_sink_test_dir.old/log_mmap_sink_test.log" );
+    remove( "log_mmap_sink_test_dir/log_mmap_sink_test.log" );
+    rmdir( "log_mmap_sink_test_dir.old" );
+    rmdir( "log_mmap_sink_test_dir" );
+}
+
+/*
+ * Check that messages larger than a segment are discarded.
+ */
+TEST( log_mmap_sink, MessageTooLarge )
+{
+    // Prepare
+    ext::mmap_log_sink::options opts;
+    opts.segment_size = 16;
+    std::shared_ptr<ext::mmap_log_sink> sink = std::make_shared<ext::mmap_log_sink>( "log_mmap_sink_test.log", opts );
+    pipeline->add_sink( sink );
+
+    // Exercise
+    ext::log::log_message( LOG_PRIORITY_INFO, NULL, "TEST_FUNC", "TEST_MSG" );
+
+    // Verify
+    CHECK_EQUAL( 1, sink->get_dropped_count() );
+
+    // Cleanup
+    pipeline->clear_sinks();
+}
+
+/*
+ * Check that the padding left by a process that didn't terminate properly is removed, and that an existing
+ * file is kept as a backup.
+ */
+TEST( log_mmap_sink, Recovery )
+{
+    // Prepare
+    FILE* file = fopen( "log_mmap_sink_test.log", "wb" );
+    fwrite( "TEST_LINE\n\0\0\0\0\0\0", 1, 16, file );
+    fclose( file );
+
+    // Exercise
+    std::shared_ptr<ext::mmap_log_sink> sink = std::make_shared<ext::mmap_log_sink>( "log_mmap_sink_test.log" );
+    sink.reset();
+
+    // Verify
+    STRCMP_EQUAL( "TEST_LINE\n", read_file( "log_mmap_sink_test.log.1" ).c_str() );
+    STRCMP_EQUAL( "", read_file( "log_mmap_sink_test.log" ).c_str() );
+    CHECK_TRUE( ext::mmap_log_sink::recover_file( "log_mmap_sink_test.log.2" ) );
+}
+
+/*
+ * Check that batches of messages from the asynchronous writer thread are written.
+ */
+TEST( log_mmap_sink, AsyncMode )
+{
+    // Prepare
+    std::shared_ptr<ext::mmap_log_sink> sink = std::make_shared<ext::mmap_log_sink>( "log_mmap_sink_test.log" );
+    pipeline->add_sink( sink );
+    ext::log::enable_async_mode( 64, ext::log::OVERFLOW_BLOCK );
+
+    // Exercise
+    for( int i = 0; i < 100; i++ )
+    {
+        ext::log::log_message( LOG_PRIORITY_INFO, NULL, "TEST_FUNC", "TEST_MSG" );
+    }
+    ext::log::disable_async_mode();
+    pipeline->clear_sinks();
+    sink.reset();
+
+    // Verify
+    std::string expected;
+    for( int i = 0; i < 100; i++ )
+    {
+        expected += expected_line( "[INFO]", "TEST_MSG" );
+    }
+    STRCMP_EQUAL( expected.c_str(), read_file( "log_mmap_sink_test.log" ).c_str() );
+}
+
+/*
+ * Check that an error is thrown when the file can't be created.
+ */
+TEST( log_mmap_sink, Error )
+{
+    // Exercise
+    bool thrown = false;
+    try
+    {
+        ext::mmap_log_sink sink( "non_existent_dir/log_mmap_sink_test.log" );
+    }
+    catch( ext::runtime_error &e )
+    {
+        thrown = true;
+        STRCMP_EQUAL( "Error creating log file 'non_existent_dir/log_mmap_sink_test.log'", e.what() );
+    }
+
+    // Verify
+    CHECK_TRUE( thrown );
+}
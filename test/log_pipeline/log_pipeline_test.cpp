@@ -0,0 +1,250 @@
+/**
+ * @file
+ * @brief      unit tests for the "log_pipeline" class
+ * @project    ExtendedLib
+ * @authors    Jesus Gonzalez <jgonzalez@gdr-sistemas.com>
+ * @copyright  Copyright (c) Jesus Gonzalez. All rights reserved.
+ * @license    See LICENSE.txt
+ */
+
+/*===========================================================================
+ *                              INCLUDES
+ *===========================================================================*/
+
+#include "Extended/log_pipeline.hpp"
+
+#include <CppUTest/TestHarness.h>
+#include <CppUTestExt/MockSupport.h>
+
+/*===========================================================================
+ *                      COMMON TEST DEFINES & MACROS
+ *===========================================================================*/
+
+class TestLogSink : public ext::log_sink
+{
+public:
+    TestLogSink( int logPriorityLimit ) : ext::log_sink( logPriorityLimit ) {}
+
+    virtual ~TestLogSink() {}
+
+    virtual bool process( int prio, const char* category, const char* function, const char* msg )
+    {
+        return mock().actualCall( "TestLogSink::process" ).onObject( this ).withParameter( "prio", prio )
+                     .withParameter( "category", category ).withParameter( "function", function )
+                     .withParameter( "msg", msg ).returnBoolValue();
+    }
+};
+
+class TextLogSink : public ext::log_sink
+{
+public:
+    TextLogSink( bool toConsole ) : m_toConsole( toConsole ), m_text( NULL ) {}
+
+    virtual ~TextLogSink() {}
+
+    virtual bool process_record( const ext::log_record& record )
+    {
+        m_text = record.text().c_str();
+        m_textCopy = record.text();
+        return m_toConsole;
+    }
+
+    bool m_toConsole;
+    const char* m_text;
+    std::string m_textCopy;
+};
+
+class BatchLogSink : public ext::log_sink
+{
+public:
+    BatchLogSink() : m_batches( 0 ), m_records( 0 ) {}
+
+    virtual ~BatchLogSink() {}
+
+    virtual bool process_record( const ext::log_record& )
+    {
+        FAIL( "Unexpected call to process_record" );
+        return false;
+    }
+
+    virtual void process_batch( const ext::log_record* const* records, size_t count, bool* toConsole )
+    {
+        m_batches++;
+        for( size_t i = 0; i < count; i++ )
+        {
+            STRCMP_EQUAL( "TEST_FUNC", records[i]->function() );
+            toConsole[i] = false;
+        }
+        m_records += count;
+    }
+
+    unsigned int m_batches;
+    size_t m_records;
+};
+
+/*===========================================================================
+ *                          TEST GROUP DEFINITION
+ *===========================================================================*/
+
+TEST_GROUP( log_pipeline )
+{
+};
+
+/*===========================================================================
+ *                    TEST CASES IMPLEMENTATION
+ *===========================================================================*/
+
+/*
+ * Check that messages are only passed to the sinks whose priority limit accepts them.
+ */
+TEST( log_pipeline, PerSinkPriorityLimit )
+{
+    // Prepare
+    std::shared_ptr<ext::log_pipeline> pipeline = std::make_shared<ext::log_pipeline>();
+    std::shared_ptr<TestLogSink> errorSink = std::make_shared<TestLogSink>( LOG_PRIORITY_ERROR );
+    std::shared_ptr<TestLogSink> infoSink = std::make_shared<TestLogSink>( LOG_PRIORITY_INFO );
+    pipeline->add_sink( errorSink );
+    pipeline->add_sink( infoSink );
+    ext::log::set_log_handler( pipeline );
+
+    mock().expectOneCall( "TestLogSink::process" ).onObject( errorSink.get() ).withParameter( "prio", LOG_PRIORITY_ERROR )
+                         .withParameter( "category", "TEST_CAT" ).withParameter( "function", "TEST_FUNC" )
+                         .withParameter( "msg", "TEST_MSG1" ).andReturnValue( false );
+    mock().expectOneCall( "TestLogSink::process" ).onObject( infoSink.get() ).withParameter( "prio", LOG_PRIORITY_ERROR )
+                         .withParameter( "category", "TEST_CAT" ).withParameter( "function", "TEST_FUNC" )
+                         .withParameter( "msg", "TEST_MSG1" ).andReturnValue( false );
+    mock().expectOneCall( "TestLogSink::process" ).onObject( infoSink.get() ).withParameter( "prio", LOG_PRIORITY_WARN )
+                         .withParameter( "category", "TEST_CAT" ).withParameter( "function", "TEST_FUNC" )
+                         .withParameter( "msg", "TEST_MSG2" ).andReturnValue( false );
+
+    // Exercise
+    ext::log::log_message( LOG_PRIORITY_ERROR, "TEST_CAT", "TEST_FUNC", "TEST_MSG%d", 1 );
+    ext::log::log_message( LOG_PRIORITY_WARN, "TEST_CAT", "TEST_FUNC", "TEST_MSG%d", 2 );
+    ext::log::log_message( LOG_PRIORITY_DEBUG, "TEST_CAT", "TEST_FUNC", "TEST_MSG%d", 3 );
+
+    // Verify
+    mock().checkExpectations();
+
+    // Exercise
+    infoSink->set_priority_limit( LOG_PRIORITY_ERROR );
+    ext::log::log_message( LOG_PRIORITY_WARN, "TEST_CAT", "TEST_FUNC", "TEST_MSG%d", 4 );
+
+    // Verify
+    CHECK_EQUAL( LOG_PRIORITY_ERROR, infoSink->get_priority_limit() );
+    mock().checkExpectations();
+
+    // Cleanup
+    ext::log::set_log_handler( NULL );
+}
+
+/*
+ * Check that the text of a message is formatted only once and shared by the sinks and the console output.
+ */
+TEST( log_pipeline, SharedText )
+{
+    // Prepare
+    std::shared_ptr<ext::log_pipeline> pipeline = std::make_shared<ext::log_pipeline>();
+    std::shared_ptr<TextLogSink> sink1 = std::make_shared<TextLogSink>( false );
+    std::shared_ptr<TextLogSink> sink2 = std::make_shared<TextLogSink>( true );
+    pipeline->add_sink( sink1 );
+    pipeline->add_sink( sink2 );
+    ext::log::set_log_handler( pipeline );
+
+    mock().expectOneCall( "::OutputDebugString" ).withParameter( "lpOutputString", "[ERROR] {ExtendedLib.Test.log_pipeline.exe:TEST_CAT} <TEST_FUNC> TEST_MSG\n" );
+
+    // Exercise
+    ext::log::log_message( LOG_PRIORITY_ERROR, "TEST_CAT", "TEST_FUNC", "TEST_MSG" );
+
+    // Verify
+    mock().checkExpectations();
+    POINTERS_EQUAL( sink1->m_text, sink2->m_text );
+    STRCMP_EQUAL( "[ERROR] {ExtendedLib.Test.log_pipeline.exe:TEST_CAT} <TEST_FUNC> TEST_MSG\n", sink1->m_textCopy.c_str() );
+
+    // Cleanup
+    ext::log::set_log_handler( NULL );
+}
+
+/*
+ * Check that messages are not logged to console when the pipeline has no sinks.
+ */
+TEST( log_pipeline, NoSinks )
+{
+    // Prepare
+    std::shared_ptr<ext::log_pipeline> pipeline = std::make_shared<ext::log_pipeline>();
+    ext::log::set_log_handler( pipeline );
+
+    // Exercise
+    ext::log::log_message( LOG_PRIORITY_ERROR, "TEST_CAT", "TEST_FUNC", "TEST_MSG" );
+
+    // Verify
+    mock().checkExpectations();
+    CHECK_EQUAL( 0, pipeline->get_sink_count() );
+
+    // Cleanup
+    ext::log::set_log_handler( NULL );
+}
+
+/*
+ * Check that sinks can be removed.
+ */
+TEST( log_pipeline, RemoveSink )
+{
+    // Prepare
+    std::shared_ptr<ext::log_pipeline> pipeline = std::make_shared<ext::log_pipeline>();
+    std::shared_ptr<TestLogSink> sink1 = std::make_shared<TestLogSink>( LOG_PRIORITY_ALLOC );
+    std::shared_ptr<TestLogSink> sink2 = std::make_shared<TestLogSink>( LOG_PRIORITY_ALLOC );
+    pipeline->add_sink( sink1 );
+    pipeline->add_sink( sink2 );
+    ext::log::set_log_handler( pipeline );
+
+    mock().expectOneCall( "TestLogSink::process" ).onObject( sink2.get() ).withParameter( "prio", LOG_PRIORITY_ERROR )
+                         .withParameter( "category", "TEST_CAT" ).withParameter( "function", "TEST_FUNC" )
+                         .withParameter( "msg", "TEST_MSG" ).andReturnValue( false );
+
+    // Exercise
+    CHECK_TRUE( pipeline->remove_sink( sink1 ) );
+    CHECK_FALSE( pipeline->remove_sink( sink1 ) );
+    ext::log::log_message( LOG_PRIORITY_ERROR, "TEST_CAT", "TEST_FUNC", "TEST_MSG" );
+
+    // Verify
+    mock().checkExpectations();
+    CHECK_EQUAL( 1, pipeline->get_sink_count() );
+
+    // Exercise
+    pipeline->clear_sinks();
+
+    // Verify
+    CHECK_EQUAL( 0, pipeline->get_sink_count() );
+
+    // Cleanup
+    ext::log::set_log_handler( NULL );
+}
+
+/*
+ * Check that in asynchronous mode the sinks receive the messages in batches.
+ */
+TEST( log_pipeline, AsyncModeBatches )
+{
+    // Prepare
+    std::shared_ptr<ext::log_pipeline> pipeline = std::make_shared<ext::log_pipeline>();
+    std::shared_ptr<BatchLogSink> sink = std::make_shared<BatchLogSink>();
+    pipeline->add_sink( sink );
+    ext::log::set_log_handler( pipeline );
+    ext::log::enable_async_mode( 256, ext::log::OVERFLOW_BLOCK );
+
+    // Exercise
+    for( int i = 0; i < 100; i++ )
+    {
+        ext::log::log_message( LOG_PRIORITY_ERROR, "TEST_CAT", "TEST_FUNC", "TEST_MSG %d", i );
+    }
+    ext::log::flush();
+
+    // Verify
+    CHECK_EQUAL( 100, sink->m_records );
+    CHECK( sink->m_batches >= 1 );
+    CHECK( sink->m_batches <= 100 );
+
+    // Cleanup
+    ext::log::disable_async_mode();
+    ext::log::set_log_handler( NULL );
+}
@@ -0,0 +1,374 @@
+/**
+ * @file
+ * @brief      unit tests for the "shm_log_sink" and "shm_log_reader" classes
+ * @project    ExtendedLib
+ * @authors    Jesus Gonzalez <jgonzalez@gdr-sistemas.com>
+ * @copyright  Copyright (c) Jesus Gonzalez. All rights reserved.
+ * @license    See LICENSE.txt
+ */
+
+/*===========================================================================
+ *                              INCLUDES
+ *===========================================================================*/
+
+#include "Extended/log_shm_sink.hpp"
+#include "Extended/runtime_error.hpp"
+#include "file_helpers.hpp"
+#include "pipeline_fixture.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <atomic>
+
+#include <CppUTest/TestHarness.h>
+#include <CppUTestExt/MockSupport.h>
+
+/*===========================================================================
+ *                      COMMON TEST DEFINES & MACROS
+ *===========================================================================*/
+
+#define SHM_NAME "/extlog_shm_sink_test"
+
+static std::string read_line( ext::shm_log_reader& reader, uint64_t* sequence = NULL )
+{
+    ext::shm_log_reader::line_view view;
+
+    if( !reader.peek( view ) )
+    {
+        return "<NONE>";
+    }
+
+    std::string line( view.text, view.length );
+    if( sequence != NULL )
+    {
+        *sequence = view.sequence;
+    }
+
+    return reader.consume() ? line : "<OVERWRITTEN>";
+}
+
+/*===========================================================================
+ *                          TEST GROUP DEFINITION
+ *===========================================================================*/
+
+TEST_GROUP_BASE( log_shm_sink, pipeline_fixture )
+{
+    TEST_SETUP()
+    {
+        shm_unlink( SHM_NAME );
+
+        pipeline_fixture::setup();
+    }
+
+    TEST_TEARDOWN()
+    {
+        pipeline_fixture::teardown();
+
+        shm_unlink( SHM_NAME );
+    }
+};
+
+/*===========================================================================
+ *                    TEST CASES IMPLEMENTATION
+ *===========================================================================*/
+
+/*
+ * Check that the lines published by the sink are read in order.
+ */
+TEST( log_shm_sink, Read )
+{
+    // Prepare
+    std::shared_ptr<ext::shm_log_sink> sink = std::make_shared<ext::shm_log_sink>( SHM_NAME );
+    pipeline->add_sink( sink );
+
+    // Exercise
+    ext::log::log_message( LOG_PRIORITY_WARN, NULL, "TEST_FUNC", "TEST_MSG %d", 1 );
+    ext::log::log_message( LOG_PRIORITY_INFO, NULL, "TEST_FUNC", "TEST_MSG %d", 2 );
+
+    ext::shm_log_reader reader( SHM_NAME );
+    ext::shm_log_reader::line_view view;
+    bool available = reader.peek( view );
+
+    // Verify
+    STRCMP_EQUAL( SHM_NAME, sink->get_name().c_str() );
+    CHECK_TRUE( available );
+    STRCMP_EQUAL( expected_line( "[WARN]", "TEST_MSG 1" ).c_str(), std::string( view.text, view.length ).c_str() );
+    CHECK_EQUAL( LOG_PRIORITY_WARN, view.priority );
+    CHECK_FALSE( view.truncated );
+    CHECK_EQUAL( 0, view.sequence );
+    CHECK_TRUE( reader.consume() );
+
+    uint64_t sequence;
+    STRCMP_EQUAL( expected_line( "[INFO]", "TEST_MSG 2" ).c_str(), read_line( reader, &sequence ).c_str() );
+    CHECK_EQUAL( 1, sequence );
+    STRCMP_EQUAL( "<NONE>", read_line( reader ).c_str() );
+
+    // Exercise
+    ext::log::log_message( LOG_PRIORITY_ERROR, NULL, "TEST_FUNC", "TEST_MSG %d", 3 );
+
+    // Verify
+    STRCMP_EQUAL( expected_line( "[ERROR]", "TEST_MSG 3" ).c_str(), read_line( reader ).c_str() );
+    CHECK_EQUAL( 0, reader.get_lost_count() );
+    CHECK_EQUAL( 0, sink->get_dropped_count() );
+
+    // Cleanup
+    pipeline->clear_sinks();
+}
+
+/*
+ * Check that a reader can skip the lines published before it was opened.
+ */
+TEST( log_shm_sink, ReadNewLines )
+{
+    // Prepare
+    std::shared_ptr<ext::shm_log_sink> sink = std::make_shared<ext::shm_log_sink>( SHM_NAME );
+    pipeline->add_sink( sink );
+    ext::log::log_message( LOG_PRIORITY_INFO, NULL, "TEST_FUNC", "TEST_MSG %d", 1 );
+
+    // Exercise
+    ext::shm_log_reader reader( SHM_NAME, false );
+    ext::log::log_message( LOG_PRIORITY_INFO, NULL, "TEST_FUNC", "TEST_MSG %d", 2 );
+
+    // Verify
+    STRCMP_EQUAL( expected_line( "[INFO]", "TEST_MSG 2" ).c_str(), read_line( reader ).c_str() );
+    STRCMP_EQUAL( "<NONE>", read_line( reader ).c_str() );
+
+    // Cleanup
+    pipeline->clear_sinks();
+}
+
+/*
+ * Check that lines longer than a slot are truncated.
+ */
+TEST( log_shm_sink, Truncated )
+{
+    // Prepare
+    ext::shm_log_sink::options opts;
+    opts.slot_size = 32;
+    std::shared_ptr<ext::shm_log_sink> sink = std::make_shared<ext::shm_log_sink>( SHM_NAME, opts );
+    pipeline->add_sink( sink );
+    ext::shm_log_reader reader( SHM_NAME );
+
+    // Exercise
+    ext::log::log_message( LOG_PRIORITY_INFO, NULL, "TEST_FUNC", "TEST_MSG" );
+
+    // Verify
+    ext::shm_log_reader::line_view view;
+    CHECK_TRUE( reader.peek( view ) );
+    CHECK_TRUE( view.truncated );
+    STRCMP_EQUAL( expected_line( "[INFO]", "TEST_MSG" ).substr( 0, 16 ).c_str(), std::string( view.text, view.length ).c_str() );
+    CHECK_TRUE( reader.consume() );
+
+    // Cleanup
+    pipeline->clear_sinks();
+}
+
+/*
+ * Check that a reader that falls behind skips the lines overwritten and counts them as lost.
+ */
+TEST( log_shm_sink, Overrun )
+{
+    // Prepare
+    ext::shm_log_sink::options opts;
+    opts.slot_count = 3;
+    std::shared_ptr<ext::shm_log_sink> sink = std::make_shared<ext::shm_log_sink>( SHM_NAME, opts );
+    pipeline->add_sink( sink );
+    ext::shm_log_reader reader( SHM_NAME );
+
+    // Exercise
+    for( int i = 0; i < 10; i++ )
+    {
+        ext::log::log_message( LOG_PRIORITY_INFO, NULL, "TEST_FUNC", "TEST_MSG %d", i );
+    }
+
+    // Verify (the number of slots is rounded up to 4)
+    uint64_t sequence;
+    STRCMP_EQUAL( expected_line( "[INFO]", "TEST_MSG 6" ).c_str(), read_line( reader, &sequence ).c_str() );
+    CHECK_EQUAL( 6, sequence );
+    CHECK_EQUAL( 6, reader.get_lost_count() );
+
+    // Exercise
+    ext::shm_log_reader::line_view view;
+    CHECK_TRUE( reader.peek( view ) );
+    for( int i = 10; i < 14; i++ )
+    {
+        ext::log::log_message( LOG_PRIORITY_INFO, NULL, "TEST_FUNC", "TEST_MSG %d", i );
+    }
+
+    // Verify
+    CHECK_FALSE( reader.consume() );
+    CHECK_EQUAL( 7, reader.get_lost_count() );
+    STRCMP_EQUAL( expected_line( "[INFO]", "TEST_MSG 10" ).c_str(), read_line( reader ).c_str() );
+    CHECK_EQUAL( 9, reader.get_lost_count() );
+    CHECK_EQUAL( 0, sink->get_dropped_count() );
+
+    // Cleanup
+    pipeline->clear_sinks();
+}
+
+/*
+ * Check that when a slot can't be claimed because the writer of the previous lap is still copying its line,
+ * the message is dropped (and skipped by the reader), and the slot is claimed again by the writers of the
+ * following laps.
+ */
+TEST( log_shm_sink, BusySlot )
+{
+    // Prepare
+    ext::shm_log_sink::options opts;
+    opts.slot_count = 4;
+    opts.slot_size = 256;
+    std::shared_ptr<ext::shm_log_sink> sink = std::make_shared<ext::shm_log_sink>( SHM_NAME, opts );
+    pipeline->add_sink( sink );
+    ext::shm_log_reader reader( SHM_NAME );
+
+    // The sequence number of the first slot follows the ring header (128 bytes)
+    int fd = shm_open( SHM_NAME, O_RDWR, 0 );
+    CHECK_TRUE( fd >= 0 );
+    void* base = mmap( NULL, 4096, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+    close( fd );
+    CHECK_TRUE( base != MAP_FAILED );
+    std::atomic<uint64_t>* firstSequence = (std::atomic<uint64_t>*) ( (char*) base + 128 );
+
+    for( int i = 0; i < 4; i++ )
+    {
+        ext::log::log_message( LOG_PRIORITY_INFO, NULL, "TEST_FUNC", "TEST_MSG %d", i );
+        STRCMP_EQUAL( expected_line( "[INFO]", StringFromFormat( "TEST_MSG %d", i ).asCharString() ).c_str(),
+                      read_line( reader ).c_str() );
+    }
+
+    // Exercise (the writer of the line 0 is simulated to be still copying it)
+    firstSequence->store( 2 );
+    ext::log::log_message( LOG_PRIORITY_INFO, NULL, "TEST_FUNC", "TEST_MSG %d", 4 );
+    firstSequence->store( 3 );
+
+    // Verify (the reader doesn't wait for the line abandoned)
+    CHECK_EQUAL( 1, sink->get_dropped_count() );
+    STRCMP_EQUAL( "<NONE>", read_line( reader ).c_str() );
+    CHECK_EQUAL( 1, reader.get_lost_count() );
+
+    // Exercise
+    ext::log::log_message( LOG_PRIORITY_INFO, NULL, "TEST_FUNC", "TEST_MSG %d", 5 );
+
+    // Verify
+    STRCMP_EQUAL( expected_line( "[INFO]", "TEST_MSG 5" ).c_str(), read_line( reader ).c_str() );
+
+    // Exercise
+    for( int i = 6; i < 13; i++ )
+    {
+        ext::log::log_message( LOG_PRIORITY_INFO, NULL, "TEST_FUNC", "TEST_MSG %d", i );
+    }
+
+    // Verify
+    for( int i = 9; i < 13; i++ )
+    {
+        STRCMP_EQUAL( expected_line( "[INFO]", StringFromFormat( "TEST_MSG %d", i ).asCharString() ).c_str(),
+                      read_line( reader ).c_str() );
+    }
+    STRCMP_EQUAL( "<NONE>", read_line( reader ).c_str() );
+    CHECK_EQUAL( 4, reader.get_lost_count() );
+    CHECK_EQUAL( 1, sink->get_dropped_count() );
+
+    // Cleanup
+    munmap( base, 4096 );
+    pipeline->clear_sinks();
+}
+
+/*
+ * Check that batches of messages from the asynchronous writer thread are published.
+ */
+TEST( log_shm_sink, AsyncMode )
+{
+    // Prepare
+    std::shared_ptr<ext::shm_log_sink> sink = std::make_shared<ext::shm_log_sink>( SHM_NAME );
+    pipeline->add_sink( sink );
+    ext::shm_log_reader reader( SHM_NAME );
+    ext::log::enable_async_mode( 64, ext::log::OVERFLOW_BLOCK );
+
+    // Exercise
+    for( int i = 0; i < 100; i++ )
+    {
+        ext::log::log_message( LOG_PRIORITY_INFO, NULL, "TEST_FUNC", "TEST_MSG" );
+    }
+    ext::log::disable_async_mode();
+
+    // Verify
+    for( int i = 0; i < 100; i++ )
+    {
+        STRCMP_EQUAL( expected_line( "[INFO]", "TEST_MSG" ).c_str(), read_line( reader ).c_str() );
+    }
+    STRCMP_EQUAL( "<NONE>", read_line( reader ).c_str() );
+
+    // Cleanup
+    pipeline->clear_sinks();
+}
+
+/*
+ * Check that the shared memory object is removed when the sink is destroyed, unless configured otherwise.
+ */
+TEST( log_shm_sink, RemoveOnClose )
+{
+    // Prepare
+    ext::shm_log_sink::options opts;
+    opts.remove_on_close = false;
+
+    // Exercise
+    {
+        ext::shm_log_sink sink( SHM_NAME, opts );
+    }
+
+    // Verify
+    ext::shm_log_reader reader( SHM_NAME );
+    STRCMP_EQUAL( "<NONE>", read_line( reader ).c_str() );
+
+    // Exercise
+    {
+        ext::shm_log_sink sink( SHM_NAME );
+    }
+
+    // Verify
+    int fd = shm_open( SHM_NAME, O_RDONLY, 0 );
+    CHECK_EQUAL( -1, fd );
+}
+
+/*
+ * Check that an error is thrown when the shared memory object doesn't exist or isn't a log ring.
+ */
+TEST( log_shm_sink, Error )
+{
+    // Exercise
+    bool thrown = false;
+    try
+    {
+        ext::shm_log_reader reader( SHM_NAME );
+    }
+    catch( ext::runtime_error &e )
+    {
+        thrown = true;
+        STRCMP_EQUAL( "Error opening shared memory '" SHM_NAME "'", e.what() );
+    }
+
+    // Verify
+    CHECK_TRUE( thrown );
+
+    // Prepare
+    int fd = shm_open( SHM_NAME, O_RDWR | O_CREAT, 0644 );
+    CHECK_TRUE( fd >= 0 );
+    CHECK_EQUAL( 0, ftruncate( fd, 4096 ) );
+    close( fd );
+
+    // Exercise
+    thrown = false;
+    try
+    {
+        ext::shm_log_reader reader( SHM_NAME );
+    }
+    catch( ext::runtime_error &e )
+    {
+        thrown = true;
+        STRCMP_EQUAL( "Shared memory '" SHM_NAME "' is not a log ring", e.what() );
+    }
+
+    // Verify
+    CHECK_TRUE( thrown );
+}
@@ -0,0 +1,140 @@
+/**
+ * @file
+ * @brief      unit tests for the symbolizer of backtrace addresses
+ * @project    ExtendedLib
+ * @authors    Jesus Gonzalez <jgonzalez@gdr-sistemas.com>
+ * @copyright  Copyright (c) Jesus Gonzalez. All rights reserved.
+ * @license    See LICENSE.txt
+ */
+
+/*===========================================================================
+ *                              INCLUDES
+ *===========================================================================*/
+
+#include "log_symbolizer.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <CppUTest/TestHarness.h>
+
+/*===========================================================================
+ *                      COMMON TEST DEFINES & MACROS
+ *===========================================================================*/
+
+static std::string get_executable_path()
+{
+    char path[4096];
+    ssize_t len = readlink( "/proc/self/exe", path, sizeof( path ) - 1 );
+    return std::string( path, ( len > 0 ) ? len : 0 );
+}
+
+// Not exported, therefore it can only be resolved through the .symtab section
+__attribute__((noinline)) static int symbolizer_test_function( int value )
+{
+    return value * 3 + 1;
+}
+
+namespace symbolizer_test
+{
+__attribute__((noinline)) void member_function( const char* text )
+{
+    printf( "%s", text );
+}
+}
+
+static const void* get_address( const void* function, uintptr_t offset )
+{
+    return (const char*) function + offset;
+}
+
+/*===========================================================================
+ *                          TEST GROUP DEFINITION
+ *===========================================================================*/
+
+TEST_GROUP( log_symbolizer )
+{
+};
+
+/*===========================================================================
+ *                    TEST CASES IMPLEMENTATION
+ *===========================================================================*/
+
+/*
+ * Check that the addresses of static functions are resolved, and their names demangled.
+ */
+TEST( log_symbolizer, StaticFunction )
+{
+    // Prepare
+    const void* address = get_address( (const void*) &symbolizer_test_function, 4 );
+    ext::log_internal::symbol_info info;
+
+    // Exercise
+    bool found = ext::log_internal::symbolize( address, info );
+
+    // Verify
+    CHECK_TRUE( found );
+    STRCMP_EQUAL( get_executable_path().c_str(), info.module.c_str() );
+    STRCMP_EQUAL( "symbolizer_test_function(int)", info.function.c_str() );
+    CHECK_EQUAL( 4, info.function_offset );
+}
+
+/*
+ * Check that the frames of backtraces are formatted with the module, the function and the offset.
+ */
+TEST( log_symbolizer, FormatFrame )
+{
+    // Prepare
+    const void* address = get_address( (const void*) &symbolizer_test::member_function, 0x10 );
+    char expected[128];
+    snprintf( expected, sizeof( expected ), "(symbolizer_test::member_function(char const*)+0x10) [%p]", address );
+
+    // Exercise
+    std::string frame = ext::log_internal::format_backtrace_frame( address );
+
+    // Verify
+    STRCMP_EQUAL( ( get_executable_path() + expected ).c_str(), frame.c_str() );
+}
+
+/*
+ * Check that addresses that don't belong to any module are not resolved.
+ */
+TEST( log_symbolizer, UnknownAddress )
+{
+    // Prepare
+    ext::log_internal::symbol_info info;
+
+    // Exercise & Verify
+    CHECK_FALSE( ext::log_internal::symbolize( (const void*) 0x10, info ) );
+    STRCMP_EQUAL( "[0x10]", ext::log_internal::format_backtrace_frame( (const void*) 0x10 ).c_str() );
+}
+
+/*
+ * Check that preloaded symbols are resolved without demangling.
+ */
+TEST( log_symbolizer, Raw )
+{
+    // Prepare
+    const void* address = get_address( (const void*) &symbolizer_test::member_function, 2 );
+    const char* module = NULL;
+    const char* function = NULL;
+    uintptr_t offset = 0;
+
+    ext::log_internal::preload_symbols();
+
+    // Exercise
+    bool found = ext::log_internal::symbolize_raw( address, module, function, offset );
+
+    // Verify
+    CHECK_TRUE( found );
+    STRCMP_EQUAL( get_executable_path().c_str(), module );
+    STRCMP_EQUAL( "_ZN15symbolizer_test15member_functionEPKc", function );
+    CHECK_EQUAL( 2, offset );
+
+    // Exercise
+    found = ext::log_internal::symbolize_raw( (const void*) 0x10, module, function, offset );
+
+    // Verify
+    CHECK_FALSE( found );
+}
@@ -0,0 +1,366 @@
+/**
+ * @file
+ * @brief      unit tests for the "syslog_log_sink" class
+ * @project    ExtendedLib
+ * @authors    Jesus Gonzalez <jgonzalez@gdr-sistemas.com>
+ * @copyright  Copyright (c) Jesus Gonzalez. All rights reserved.
+ * @license    See LICENSE.txt
+ */
+
+/*===========================================================================
+ *                              INCLUDES
+ *===========================================================================*/
+
+#define LOG_CATEGORY "TEST_CAT"
+
+#include "Extended/log_syslog_sink.hpp"
+#include "Extended/runtime_error.hpp"
+#include "pipeline_fixture.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include <CppUTest/TestHarness.h>
+#include <CppUTestExt/MockSupport.h>
+
+/*===========================================================================
+ *                      COMMON TEST DEFINES & MACROS
+ *===========================================================================*/
+
+#define TEST_SOCKET_PATH "log_syslog_sink_test.sock"
+
+/**
+ * Local socket that stands in for the syslog / journald daemon.
+ */
+class daemon_stand_in
+{
+public:
+    daemon_stand_in()
+    {
+        unlink( TEST_SOCKET_PATH );
+
+        struct sockaddr_un addr;
+        memset( &addr, 0, sizeof( addr ) );
+        addr.sun_family = AF_UNIX;
+        strcpy( addr.sun_path, TEST_SOCKET_PATH );
+
+        m_fd = socket( AF_UNIX, SOCK_DGRAM, 0 );
+        bind( m_fd, (struct sockaddr*) &addr, sizeof( addr ) );
+
+        struct timeval timeout = { 1, 0 };
+        setsockopt( m_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof( timeout ) );
+    }
+
+    ~daemon_stand_in()
+    {
+        close( m_fd );
+        unlink( TEST_SOCKET_PATH );
+    }
+
+    /**
+     * Receives a datagram (empty if none is received within 1 second).
+     */
+    std::string receive()
+    {
+        char buffer[4096];
+        ssize_t size = recv( m_fd, buffer, sizeof( buffer ), 0 );
+        return std::string( buffer, ( size > 0 ) ? size : 0 );
+    }
+
+    /**
+     * Indicates if there is a datagram waiting to be received.
+     */
+    bool has_pending()
+    {
+        char c;
+        return recv( m_fd, &c, 1, MSG_PEEK | MSG_DONTWAIT ) >= 0;
+    }
+
+private:
+    int m_fd;
+};
+
+static std::string get_hostname()
+{
+    char name[256] = "";
+    gethostname( name, sizeof( name ) - 1 );
+    return name;
+}
+
+static std::string rfc5424_header( int pri )
+{
+    return "<" + std::to_string( pri ) + ">1 TIMESTAMP " + get_hostname() + " TEST_APP " + std::to_string( (long) getpid() ) + " ";
+}
+
+/**
+ * Replaces the TIMESTAMP of a RFC 5424 message by a placeholder, provided that it has the expected format
+ * (e.g. 2024-01-31T12:34:56.123456Z).
+ */
+static std::string mask_timestamp( const std::string& msg )
+{
+    size_t start = msg.find( ">1 " );
+    if( start == std::string::npos )
+    {
+        return msg;
+    }
+
+    start += 3;
+    size_t end = msg.find( ' ', start );
+    if( ( end != std::string::npos ) && ( end - start == 27 ) && ( msg[start + 10] == 'T' ) && ( msg[end - 1] == 'Z' ) )
+    {
+        return msg.substr( 0, start ) + "TIMESTAMP" + msg.substr( end );
+    }
+
+    return msg;
+}
+
+static ext::syslog_log_sink::options test_options( ext::syslog_log_sink::protocol format )
+{
+    ext::syslog_log_sink::options opts;
+    opts.socket_path = TEST_SOCKET_PATH;
+    opts.format = format;
+    opts.facility = 16;
+    opts.app_name = "TEST_APP";
+    opts.reconnect_interval_ms = 0;
+    return opts;
+}
+
+/*===========================================================================
+ *                          TEST GROUP DEFINITION
+ *===========================================================================*/
+
+TEST_GROUP_BASE( log_syslog_sink, pipeline_fixture )
+{
+};
+
+/*===========================================================================
+ *                    TEST CASES IMPLEMENTATION
+ *===========================================================================*/
+
+/*
+ * Check that messages are sent as RFC 5424 syslog messages, with their timestamp even if timestamps are
+ * disabled for the console.
+ */
+TEST( log_syslog_sink, Rfc5424 )
+{
+    // Prepare
+    bool timestampsEnabled = ext::log::are_timestamps_enabled();
+    ext::log::set_timestamps_enabled( false );
+    daemon_stand_in daemon;
+    std::shared_ptr<ext::syslog_log_sink> sink =
+            std::make_shared<ext::syslog_log_sink>( test_options( ext::syslog_log_sink::PROTOCOL_RFC5424 ) );
+    pipeline->add_sink( sink );
+
+    // Exercise
+    ext::log::log_message( LOG_PRIORITY_WARN, "TEST_CAT", "TEST_FUNC", "TEST_MSG %d", 42 );
+    ext::log::log_message( LOG_PRIORITY_INFO, NULL, "ns::TEST_FUNC", "TEST_MSG \"]" );
+
+    // Verify
+    STRCMP_EQUAL( ( rfc5424_header( 16 * 8 + 4 ) + "TEST_CAT [ext@32473 function=\"TEST_FUNC\"] TEST_MSG 42" ).c_str(),
+                  mask_timestamp( daemon.receive() ).c_str() );
+    STRCMP_EQUAL( ( rfc5424_header( 16 * 8 + 6 ) + "- [ext@32473 function=\"ns::TEST_FUNC\"] TEST_MSG \"]" ).c_str(),
+                  mask_timestamp( daemon.receive() ).c_str() );
+    STRCMP_EQUAL( TEST_SOCKET_PATH, sink->get_socket_path().c_str() );
+    CHECK_TRUE( sink->is_connected() );
+    CHECK_EQUAL( 0, sink->get_dropped_count() );
+
+    // Cleanup
+    ext::log::set_timestamps_enabled( timestampsEnabled );
+}
+
+/*
+ * Check that the fields of structured messages are sent as escaped structured data parameters.
+ */
+TEST( log_syslog_sink, Rfc5424_StructuredData )
+{
+    // Prepare
+    daemon_stand_in daemon;
+    pipeline->add_sink( std::make_shared<ext::syslog_log_sink>( test_options( ext::syslog_log_sink::PROTOCOL_RFC5424 ) ) );
+
+    // Exercise
+    LOG_ERROR_KV( "TEST_MSG", "fd", 3, "peer", "a\"b]c\\d", "ok", true );
+
+    // Verify
+    STRCMP_EQUAL( ( rfc5424_header( 16 * 8 + 3 ) + "TEST_CAT [ext@32473 function=\"TEST_log_syslog_sink_Rfc5424_StructuredData_Test::testBody\""
+                    " fd=\"3\" peer=\"a\\\"b\\]c\\\\d\" ok=\"true\"] TEST_MSG" ).c_str(),
+                  mask_timestamp( daemon.receive() ).c_str() );
+}
+
+/*
+ * Check that messages are sent in the native protocol of journald, with multi-line values in binary form.
+ */
+TEST( log_syslog_sink, Journald )
+{
+    // Prepare
+    daemon_stand_in daemon;
+    pipeline->add_sink( std::make_shared<ext::syslog_log_sink>( test_options( ext::syslog_log_sink::PROTOCOL_JOURNALD ) ) );
+
+    // Exercise
+    LOG_INFO_KV( "LINE1\nLINE2", "peer.host", "x", "2nd", 7u );
+
+    // Verify
+    std::string expected = std::string( "MESSAGE\n" ) + std::string( "\x0B\0\0\0\0\0\0\0", 8 ) + "LINE1\nLINE2\n"
+                           "PRIORITY=6\n"
+                           "SYSLOG_FACILITY=16\n"
+                           "SYSLOG_IDENTIFIER=TEST_APP\n"
+                           "CATEGORY=TEST_CAT\n"
+                           "CODE_FUNC=TEST_log_syslog_sink_Journald_Test::testBody\n"
+                           "PEER_HOST=x\n"
+                           "F_2ND=7\n";
+    std::string received = daemon.receive();
+    CHECK_EQUAL( expected.size(), received.size() );
+    CHECK_TRUE( expected == received );
+}
+
+/*
+ * Check that log priorities are mapped to syslog severities.
+ */
+TEST( log_syslog_sink, Severities )
+{
+    // Exercise & Verify
+    CHECK_EQUAL( 3, ext::syslog_log_sink::get_severity( LOG_PRIORITY_ERROR ) );
+    CHECK_EQUAL( 4, ext::syslog_log_sink::get_severity( LOG_PRIORITY_WARN ) );
+    CHECK_EQUAL( 6, ext::syslog_log_sink::get_severity( LOG_PRIORITY_INFO ) );
+    CHECK_EQUAL( 7, ext::syslog_log_sink::get_severity( LOG_PRIORITY_DEBUG ) );
+    CHECK_EQUAL( 7, ext::syslog_log_sink::get_severity( LOG_PRIORITY_ALLOC ) );
+}
+
+/*
+ * Check that batches of messages from the writer thread are sent as individual datagrams.
+ */
+TEST( log_syslog_sink, Batch_AsyncMode )
+{
+    // Prepare
+    daemon_stand_in daemon;
+    pipeline->add_sink( std::make_shared<ext::syslog_log_sink>( test_options( ext::syslog_log_sink::PROTOCOL_RFC5424 ) ) );
+    ext::log::enable_async_mode( 256, ext::log::OVERFLOW_BLOCK );
+
+    // Exercise (the queue of datagrams of the stand-in may be as short as 10 datagrams)
+    for( int i = 0; i < 8; i++ )
+    {
+        ext::log::log_message( LOG_PRIORITY_INFO, NULL, "TEST_FUNC", "TEST_MSG %d", i );
+    }
+    ext::log::disable_async_mode();
+
+    // Verify
+    for( int i = 0; i < 8; i++ )
+    {
+        std::string expected = rfc5424_header( 16 * 8 + 6 ) + "- [ext@32473 function=\"TEST_FUNC\"] TEST_MSG " + std::to_string( i );
+        STRCMP_EQUAL( expected.c_str(), mask_timestamp( daemon.receive() ).c_str() );
+    }
+    CHECK_FALSE( daemon.has_pending() );
+}
+
+/*
+ * Check that messages are discarded instead of waiting when the daemon doesn't receive them.
+ */
+TEST( log_syslog_sink, DaemonNotReceiving )
+{
+    // Prepare
+    daemon_stand_in daemon;
+    std::shared_ptr<ext::syslog_log_sink> sink =
+            std::make_shared<ext::syslog_log_sink>( test_options( ext::syslog_log_sink::PROTOCOL_RFC5424 ) );
+    pipeline->add_sink( sink );
+
+    // Exercise
+    for( int i = 0; i < 5000; i++ )
+    {
+        ext::log::log_message( LOG_PRIORITY_INFO, NULL, "TEST_FUNC", "TEST_MSG" );
+    }
+
+    // Verify
+    CHECK_TRUE( sink->is_connected() );
+    CHECK_TRUE( sink->get_dropped_count() > 0 );
+    CHECK_TRUE( daemon.has_pending() );
+}
+
+/*
+ * Check that messages are discarded while the daemon is not running, and that the socket is reconnected
+ * when the daemon is restarted.
+ */
+TEST( log_syslog_sink, Reconnect )
+{
+    // Prepare
+    unlink( TEST_SOCKET_PATH );
+    std::shared_ptr<ext::syslog_log_sink> sink =
+            std::make_shared<ext::syslog_log_sink>( test_options( ext::syslog_log_sink::PROTOCOL_RFC5424 ) );
+    pipeline->add_sink( sink );
+
+    // Exercise
+    ext::log::log_message( LOG_PRIORITY_INFO, NULL, "TEST_FUNC", "TEST_MSG 1" );
+
+    // Verify
+    CHECK_FALSE( sink->is_connected() );
+    CHECK_EQUAL( 1, sink->get_dropped_count() );
+
+    // Exercise
+    std::unique_ptr<daemon_stand_in> daemon( new daemon_stand_in() );
+    ext::log::log_message( LOG_PRIORITY_INFO, NULL, "TEST_FUNC", "TEST_MSG 2" );
+
+    // Verify
+    CHECK_TRUE( sink->is_connected() );
+    STRCMP_EQUAL( ( rfc5424_header( 16 * 8 + 6 ) + "- [ext@32473 function=\"TEST_FUNC\"] TEST_MSG 2" ).c_str(),
+                  mask_timestamp( daemon->receive() ).c_str() );
+
+    // Exercise (restart the daemon)
+    daemon.reset();
+    daemon.reset( new daemon_stand_in() );
+    ext::log::log_message( LOG_PRIORITY_INFO, NULL, "TEST_FUNC", "TEST_MSG 3" );
+
+    // Verify
+    CHECK_TRUE( sink->is_connected() );
+    CHECK_EQUAL( 1, sink->get_dropped_count() );
+    STRCMP_EQUAL( ( rfc5424_header( 16 * 8 + 6 ) + "- [ext@32473 function=\"TEST_FUNC\"] TEST_MSG 3" ).c_str(),
+                  mask_timestamp( daemon->receive() ).c_str() );
+}
+
+/*
+ * Check that reconnection is not retried until the reconnection interval has elapsed.
+ */
+TEST( log_syslog_sink, ReconnectInterval )
+{
+    // Prepare
+    unlink( TEST_SOCKET_PATH );
+    ext::syslog_log_sink::options opts = test_options( ext::syslog_log_sink::PROTOCOL_RFC5424 );
+    opts.reconnect_interval_ms = 60000;
+    std::shared_ptr<ext::syslog_log_sink> sink = std::make_shared<ext::syslog_log_sink>( opts );
+    pipeline->add_sink( sink );
+
+    // Exercise
+    daemon_stand_in daemon;
+    ext::log::log_message( LOG_PRIORITY_INFO, NULL, "TEST_FUNC", "TEST_MSG" );
+
+    // Verify
+    CHECK_FALSE( sink->is_connected() );
+    CHECK_EQUAL( 1, sink->get_dropped_count() );
+    CHECK_FALSE( daemon.has_pending() );
+}
+
+/*
+ * Check that an error is thrown if the path of the socket is too long.
+ */
+TEST( log_syslog_sink, Error )
+{
+    // Prepare
+    ext::syslog_log_sink::options opts;
+    opts.socket_path = std::string( 200, 'x' );
+
+    // Exercise
+    bool thrown = false;
+    try
+    {
+        ext::syslog_log_sink sink( opts );
+    }
+    catch( ext::runtime_error &e )
+    {
+        thrown = true;
+        STRCMP_EQUAL( ( "Socket path '" + opts.socket_path + "' is too long" ).c_str(), e.what() );
+    }
+
+    // Verify
+    CHECK_TRUE( thrown );
+}
@@ -0,0 +1,293 @@
+/**
+ * @file
+ * @brief      unit tests for the trace spans
+ * @project    ExtendedLib
+ * @authors    Jesus Gonzalez <jgonzalez@gdr-sistemas.com>
+ * @copyright  Copyright (c) Jesus Gonzalez. All rights reserved.
+ * @license    See LICENSE.txt
+ */
+
+/*===========================================================================
+ *                              INCLUDES
+ *===========================================================================*/
+
+#define LOG_CATEGORY "TEST_CAT"
+
+#include "Extended/log.hpp"
+#include "Extended/runtime_error.hpp"
+#include "log_internal.hpp"
+#include "file_helpers.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <thread>
+
+#include <CppUTest/TestHarness.h>
+#include <CppUTestExt/MockSupport.h>
+
+/*===========================================================================
+ *                      COMMON TEST DEFINES & MACROS
+ *===========================================================================*/
+
+static unsigned int count_occurrences( const std::string& str, const std::string& pattern )
+{
+    unsigned int count = 0;
+    for( size_t pos = str.find( pattern ); pos != std::string::npos; pos = str.find( pattern, pos + 1 ) )
+    {
+        count++;
+    }
+    return count;
+}
+
+/**
+ * Returns the duration in microseconds of the first span with the given name in an exported trace.
+ */
+static double get_duration( const std::string& trace, const char* name )
+{
+    size_t pos = trace.find( std::string( "{\"name\":\"" ) + name + "\"" );
+    if( pos == std::string::npos )
+    {
+        return -1;
+    }
+
+    pos = trace.find( "\"dur\":", pos );
+    return atof( trace.c_str() + pos + 6 );
+}
+
+static void traced_function( bool exitEarly )
+{
+    TRACE_FUNCTION_ENTRY
+
+    {
+        TRACE_SPAN( "inner" );
+        std::this_thread::sleep_for( std::chrono::milliseconds( 2 ) );
+    }
+
+    if( exitEarly )
+    {
+        TRACE_FUNCTION_EXIT
+        std::this_thread::sleep_for( std::chrono::milliseconds( 50 ) );
+    }
+}
+
+static void untraced_function()
+{
+    TRACE_FUNCTION_EXIT
+}
+
+static void traced_loop( int count )
+{
+    for( int i = 0; i < count; i++ )
+    {
+        TRACE_SPAN( "loop" );
+    }
+}
+
+/*===========================================================================
+ *                          TEST GROUP DEFINITION
+ *===========================================================================*/
+
+TEST_GROUP( log_trace )
+{
+    TEST_TEARDOWN()
+    {
+        ext::log::disable_tracing();
+
+        remove( "log_trace_test.json" );
+    }
+};
+
+/*===========================================================================
+ *                    TEST CASES IMPLEMENTATION
+ *===========================================================================*/
+
+/*
+ * Check that spans are not recorded while tracing is disabled.
+ */
+TEST( log_trace, Disabled )
+{
+    // Prepare
+    ext::log::enable_tracing();
+    ext::log::disable_tracing();
+
+    // Exercise
+    traced_function( false );
+
+    // Verify
+    CHECK_FALSE( ext::log::is_tracing_enabled() );
+    STRCMP_EQUAL( "{\"traceEvents\":[\n],\"displayTimeUnit\":\"ns\"}\n", ext::log::export_trace().c_str() );
+}
+
+/*
+ * Check that nested spans are recorded and exported as complete events.
+ */
+TEST( log_trace, Spans )
+{
+    // Prepare
+    ext::log::enable_tracing();
+
+    // Exercise
+    traced_function( false );
+    std::string trace = ext::log::export_trace();
+
+    // Verify
+    CHECK_TRUE( ext::log::is_tracing_enabled() );
+    CHECK_EQUAL( 2, count_occurrences( trace, "\"ph\":\"X\"" ) );
+    CHECK_EQUAL( 1, count_occurrences( trace, "{\"name\":\"inner\",\"cat\":\"TEST_CAT\",\"ph\":\"X\"" ) );
+    CHECK_EQUAL( 1, count_occurrences( trace, "{\"name\":\"traced_function\",\"cat\":\"TEST_CAT\",\"ph\":\"X\"" ) );
+    CHECK_EQUAL( 2, count_occurrences( trace, "\"args\":{\"function\":\"traced_function\",\"file\":" ) );
+    CHECK_TRUE( get_duration( trace, "inner" ) >= 2000 );
+    CHECK_TRUE( get_duration( trace, "traced_function" ) >= get_duration( trace, "inner" ) );
+
+    // Inner spans end first
+    CHECK_TRUE( trace.find( "\"name\":\"inner\"" ) < trace.find( "\"name\":\"traced_function\"" ) );
+
+    // Exercise
+    ext::log::enable_tracing();
+
+    // Verify
+    CHECK_EQUAL( 0, count_occurrences( ext::log::export_trace(), "\"ph\":\"X\"" ) );
+}
+
+/*
+ * Check that TRACE_FUNCTION_EXIT ends the span of the function.
+ */
+TEST( log_trace, FunctionExit )
+{
+    // Prepare
+    ext::log::enable_tracing();
+
+    // Exercise
+    traced_function( true );
+    std::string trace = ext::log::export_trace();
+
+    // Verify
+    CHECK_EQUAL( 2, count_occurrences( trace, "\"ph\":\"X\"" ) );
+    CHECK_TRUE( get_duration( trace, "traced_function" ) < 50000 );
+}
+
+/*
+ * Check that TRACE_FUNCTION_EXIT does nothing in a function without TRACE_FUNCTION_ENTRY.
+ */
+TEST( log_trace, FunctionExitWithoutEntry )
+{
+    // Prepare
+    ext::log::enable_tracing();
+
+    // Exercise
+    untraced_function();
+
+    // Verify
+    CHECK_EQUAL( 0, count_occurrences( ext::log::export_trace(), "\"ph\":\"X\"" ) );
+}
+
+/*
+ * Check that the spans recorded before disabling tracing are kept.
+ */
+TEST( log_trace, DisabledAfterRecording )
+{
+    // Prepare
+    ext::log::enable_tracing();
+    traced_loop( 1 );
+
+    // Exercise
+    ext::log::disable_tracing();
+    traced_loop( 1 );
+
+    // Verify
+    CHECK_EQUAL( 1, count_occurrences( ext::log::export_trace(), "\"name\":\"loop\"" ) );
+}
+
+/*
+ * Check that spans that don't fit into the buffer of their thread are discarded and counted.
+ */
+TEST( log_trace, BufferFull )
+{
+    // Prepare
+    ext::log::enable_tracing( 3 );
+
+    // Exercise
+    traced_loop( 5 );
+
+    // Verify
+    CHECK_EQUAL( 3, count_occurrences( ext::log::export_trace(), "\"name\":\"loop\"" ) );
+    CHECK_EQUAL( 2, ext::log::get_trace_dropped_count() );
+
+    // Exercise
+    ext::log::enable_tracing( 10 );
+    traced_loop( 5 );
+
+    // Verify
+    CHECK_EQUAL( 5, count_occurrences( ext::log::export_trace(), "\"name\":\"loop\"" ) );
+    CHECK_EQUAL( 0, ext::log::get_trace_dropped_count() );
+}
+
+/*
+ * Check that the spans of each thread are exported with its identifier and name, including threads that
+ * have exited.
+ */
+TEST( log_trace, Threads )
+{
+    // Prepare
+    ext::log::enable_tracing();
+
+    // Exercise
+    traced_loop( 1 );
+    std::thread worker( []()
+    {
+        ext::log_internal::set_thread_name( "TEST_THREAD" );
+        traced_loop( 2 );
+    } );
+    worker.join();
+    std::string trace = ext::log::export_trace();
+
+    // Verify
+    CHECK_EQUAL( 3, count_occurrences( trace, "\"name\":\"loop\"" ) );
+    CHECK_EQUAL( 1, count_occurrences( trace, "\"args\":{\"name\":\"TEST_THREAD\"}" ) );
+
+    // The metadata event naming the worker thread and its two spans have the same thread identifier
+    size_t nameEnd = trace.find( ",\"args\":{\"name\":\"TEST_THREAD\"}" );
+    size_t tidBegin = trace.rfind( "\"tid\":", nameEnd );
+    std::string workerTid = trace.substr( tidBegin, nameEnd - tidBegin ) + ",";
+    CHECK_EQUAL( 3, count_occurrences( trace, workerTid ) );
+
+    // Exercise (the buffer of the thread that exited is reused)
+    ext::log::enable_tracing();
+    std::thread worker2( []() { traced_loop( 1 ); } );
+    worker2.join();
+
+    // Verify
+    CHECK_EQUAL( 1, count_occurrences( ext::log::export_trace(), "\"name\":\"loop\"" ) );
+}
+
+/*
+ * Check that the trace is exported to a file, and that an error is thrown when it can't be created.
+ */
+TEST( log_trace, ExportFile )
+{
+    // Prepare
+    ext::log::enable_tracing();
+    traced_loop( 1 );
+
+    // Exercise
+    ext::log::export_trace( "log_trace_test.json" );
+
+    // Verify
+    STRCMP_EQUAL( ext::log::export_trace().c_str(), read_file( "log_trace_test.json" ).c_str() );
+
+    // Exercise
+    bool thrown = false;
+    try
+    {
+        ext::log::export_trace( "non_existent_dir/log_trace_test.json" );
+    }
+    catch( ext::runtime_error &e )
+    {
+        thrown = true;
+        STRCMP_EQUAL( "Error creating trace file 'non_existent_dir/log_trace_test.json'", e.what() );
+    }
+
+    // Verify
+    CHECK_TRUE( thrown );
+}
@@ -0,0 +1,45 @@
+/**
+ * @file
+ * @brief      Tool to convert binary log files to text
+ * @authors    Jesus Gonzalez <jgonzalez@gdr-sistemas.com>
+ * @copyright  Copyright (c) 2003-2016 Jesus Gonzalez
+ * @license    See LICENSE.txt
+ */
+
+#include <stdio.h>
+#include <string>
+
+#include "log_binary.hpp"
+#include "log_internal.hpp"
+
+using namespace ext::log_internal;
+
+int main( int argc, char* argv[] )
+{
+    if( argc != 2 )
+    {
+        fprintf( stderr, "Usage: extlog_decode <binary log file>\n" );
+        return 2;
+    }
+
+    binary_log_reader reader;
+
+    if( !reader.open( argv[1] ) )
+    {
+        fprintf( stderr, "Error: '%s' is not a valid binary log file\n", argv[1] );
+        return 1;
+    }
+
+    binary_log_entry entry;
+
+    while( reader.read_next( entry ) )
+    {
+        std::string line = compose_log_line( entry.prio, reader.get_program_name().c_str(),
+                                             entry.has_category ? entry.category.c_str() : NULL,
+                                             entry.function.c_str(), entry.msg.c_str(), entry.timestamp, entry.thread_id,
+                                             entry.thread_name.c_str() );
+        fputs( line.c_str(), stdout );
+    }
+
+    return 0;
+}
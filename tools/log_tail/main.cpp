@@ -0,0 +1,77 @@
+/**
+ * @file
+ * @brief      Tool to follow the log messages published into a shared memory ring
+ * @authors    Jesus Gonzalez <jgonzalez@gdr-sistemas.com>
+ * @copyright  Copyright (c) 2003-2016 Jesus Gonzalez
+ * @license    See LICENSE.txt
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "Extended/log_shm_sink.hpp"
+#include "Extended/runtime_error.hpp"
+
+#define POLL_INTERVAL_US 10000
+
+int main( int argc, char* argv[] )
+{
+    bool fromOldest = true;
+    const char* name = NULL;
+
+    if( ( argc == 3 ) && ( strcmp( argv[1], "-n" ) == 0 ) )
+    {
+        fromOldest = false;
+        name = argv[2];
+    }
+    else if( argc == 2 )
+    {
+        name = argv[1];
+    }
+    else
+    {
+        fprintf( stderr, "Usage: extlog_tail [-n] <shared memory name>\n" );
+        fprintf( stderr, "  -n  Only show the lines published from now on\n" );
+        return 2;
+    }
+
+    try
+    {
+        ext::shm_log_reader reader( name, fromOldest );
+        ext::shm_log_reader::line_view view;
+        unsigned long long lostCount = 0;
+
+        for(;;)
+        {
+            if( !reader.peek( view ) )
+            {
+                fflush( stdout );
+                usleep( POLL_INTERVAL_US );
+                continue;
+            }
+
+            // The line is written directly from the shared memory, but it's only valid if it wasn't overwritten
+            // meanwhile, which is reported along with the lines skipped
+            fwrite( view.text, 1, view.length, stdout );
+            if( view.truncated )
+            {
+                fputs( " [...]\n", stdout );
+            }
+
+            reader.consume();
+
+            if( reader.get_lost_count() != lostCount )
+            {
+                fflush( stdout );
+                fprintf( stderr, "*** %llu lines lost\n", reader.get_lost_count() - lostCount );
+                lostCount = reader.get_lost_count();
+            }
+        }
+    }
+    catch( ext::runtime_error& e )
+    {
+        fprintf( stderr, "Error: %s\n", e.what() );
+        return 1;
+    }
+}